@@ -0,0 +1,829 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "BatchDvhMetricsCLP.h"
+
+// DoseVolumeHistogram includes
+#include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
+#include "vtkMRMLDoseVolumeHistogramNode.h"
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SlicerRt includes
+#include "SlicerRtCommon.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+
+// SegmentationCore includes
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// SubjectHierarchy includes
+#include "vtkSlicerSubjectHierarchyModuleLogic.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLSubjectHierarchyConstants.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLTableNode.h>
+#include <vtkMRMLVolumeArchetypeStorageNode.h>
+
+// VTK includes
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+#include <vtkTimerLog.h>
+#include <vtkVariant.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/Directory.hxx>
+#include <vtksys/Glob.hxx>
+#include <vtksys/Process.h>
+#include <vtksys/SystemInformation.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+// STD includes
+#include <algorithm>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Exit code of a worker that could not allocate memory within its budget
+  const int WORKER_EXIT_MEMORY_BUDGET_EXCEEDED = 2;
+
+  /// Elements longer than this are not read when identifying DICOM files (pixel data, contour data)
+  const Uint32 DICOM_HEADER_MAXIMUM_ELEMENT_LENGTH = 256;
+
+  //----------------------------------------------------------------------------
+  struct PatientEntry
+  {
+    PatientEntry() : TotalFileSize(0), Succeeded(false) { }
+
+    /// Folder containing the DICOM files of the patient
+    std::string Folder;
+    /// Name of the folder, used in the reports and the output file names
+    std::string Name;
+    /// Size of all files in the folder. Large patients are started first so that they do not end up last
+    unsigned long TotalFileSize;
+    /// Metrics file written by the worker
+    std::string WorkerOutputFile;
+
+    bool Succeeded;
+    std::string ErrorMessage;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Orders patient indices by decreasing total file size
+  struct LargerPatientFirst
+  {
+    LargerPatientFirst(const std::vector<PatientEntry>& patients) : Patients(patients) { }
+    bool operator()(size_t first, size_t second) const
+    {
+      return this->Patients[first].TotalFileSize > this->Patients[second].TotalFileSize;
+    }
+    const std::vector<PatientEntry>& Patients;
+  };
+
+  //----------------------------------------------------------------------------
+  struct RunningWorker
+  {
+    vtksysProcess* Process;
+    size_t PatientIndex;
+    double StartTime;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Quote a CSV field if it contains a separator, quote or line break
+  std::string CsvField(const std::string& value)
+  {
+    if (value.find_first_of(",\"\r\n") == std::string::npos)
+    {
+      return value;
+    }
+    std::string quotedValue("\"");
+    for (std::string::const_iterator characterIt=value.begin(); characterIt!=value.end(); ++characterIt)
+    {
+      if (*characterIt == '"')
+      {
+        quotedValue += '"';
+      }
+      quotedValue += *characterIt;
+    }
+    quotedValue += '"';
+    return quotedValue;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Limit the memory the current process can allocate. Allocations beyond the limit fail
+  /// \return True if the limit could be set
+  bool SetProcessMemoryLimit(int memoryLimitMb)
+  {
+    if (memoryLimitMb <= 0)
+    {
+      return true;
+    }
+#ifdef _WIN32
+    HANDLE job = CreateJobObject(NULL, NULL);
+    if (!job)
+    {
+      return false;
+    }
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limitInformation;
+    ZeroMemory(&limitInformation, sizeof(limitInformation));
+    limitInformation.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+    limitInformation.ProcessMemoryLimit = static_cast<SIZE_T>(memoryLimitMb) * 1024 * 1024;
+    return SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limitInformation, sizeof(limitInformation))
+      && AssignProcessToJobObject(job, GetCurrentProcess());
+#else
+    struct rlimit limit;
+    limit.rlim_cur = static_cast<rlim_t>(memoryLimitMb) * 1024 * 1024;
+    limit.rlim_max = limit.rlim_cur;
+#ifdef __linux__
+    // The data limit covers the heap and anonymous mappings, but not the shared libraries
+    return setrlimit(RLIMIT_DATA, &limit) == 0;
+#else
+    return setrlimit(RLIMIT_AS, &limit) == 0;
+#endif
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  void GetFilesInFolder(const std::string& folder, std::vector<std::string>& files)
+  {
+    vtksys::Glob glob;
+    glob.RecurseOn();
+    glob.FindFiles(folder + "/*");
+    files = glob.GetFiles();
+    std::sort(files.begin(), files.end());
+  }
+
+  //----------------------------------------------------------------------------
+  /// Each subfolder of the input folder is a patient. If there are no subfolders, then the input folder is the patient
+  void FindPatients(const std::string& inputFolder, std::vector<PatientEntry>& patients)
+  {
+    vtksys::Directory directory;
+    directory.Load(inputFolder.c_str());
+    std::vector<std::string> subfolderNames;
+    for (unsigned long fileIndex=0; fileIndex<directory.GetNumberOfFiles(); ++fileIndex)
+    {
+      std::string fileName(directory.GetFile(fileIndex));
+      if (fileName == "." || fileName == "..")
+      {
+        continue;
+      }
+      if (vtksys::SystemTools::FileIsDirectory(inputFolder + "/" + fileName))
+      {
+        subfolderNames.push_back(fileName);
+      }
+    }
+    std::sort(subfolderNames.begin(), subfolderNames.end());
+
+    if (subfolderNames.empty())
+    {
+      PatientEntry patient;
+      patient.Folder = inputFolder;
+      patient.Name = vtksys::SystemTools::GetFilenameName(vtksys::SystemTools::CollapseFullPath(inputFolder));
+      patients.push_back(patient);
+    }
+    for (std::vector<std::string>::iterator nameIt=subfolderNames.begin(); nameIt!=subfolderNames.end(); ++nameIt)
+    {
+      PatientEntry patient;
+      patient.Folder = inputFolder + "/" + (*nameIt);
+      patient.Name = (*nameIt);
+      patients.push_back(patient);
+    }
+
+    for (std::vector<PatientEntry>::iterator patientIt=patients.begin(); patientIt!=patients.end(); ++patientIt)
+    {
+      std::vector<std::string> files;
+      GetFilesInFolder(patientIt->Folder, files);
+      for (std::vector<std::string>::iterator fileIt=files.begin(); fileIt!=files.end(); ++fileIt)
+      {
+        patientIt->TotalFileSize += vtksys::SystemTools::FileLength(*fileIt);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Find the structure set and dose files of a patient. Only the short elements of the files are read
+  void FindDicomRtFiles(const std::string& patientFolder, std::vector<std::string>& structureSetFiles, std::vector<std::string>& doseFiles)
+  {
+    std::vector<std::string> files;
+    GetFilesInFolder(patientFolder, files);
+    for (std::vector<std::string>::iterator fileIt=files.begin(); fileIt!=files.end(); ++fileIt)
+    {
+      DcmFileFormat fileFormat;
+      if (fileFormat.loadFile(fileIt->c_str(), EXS_Unknown, EGL_noChange, DICOM_HEADER_MAXIMUM_ELEMENT_LENGTH).bad())
+      {
+        continue; // Not a DICOM file
+      }
+      OFString sopClass("");
+      if (fileFormat.getDataset()->findAndGetOFString(DCM_SOPClassUID, sopClass).bad())
+      {
+        continue;
+      }
+      if (sopClass == UID_RTStructureSetStorage)
+      {
+        structureSetFiles.push_back(*fileIt);
+      }
+      else if (sopClass == UID_RTDoseStorage)
+      {
+        doseFiles.push_back(*fileIt);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get name of a loaded series: series description if available, file name otherwise
+  std::string GetSeriesName(vtkSlicerDicomRtReader* rtReader, const std::string& fileName)
+  {
+    if (!SlicerRtCommon::IsStringNullOrEmpty(rtReader->GetSeriesDescription()))
+    {
+      return std::string(rtReader->GetSeriesDescription());
+    }
+    return vtksys::SystemTools::GetFilenameWithoutLastExtension(fileName);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Load the contour structures of an RTSTRUCT file into a new segmentation node.
+  /// Point structures are skipped as they have no DVH.
+  /// \return Segmentation node added to the scene, NULL on failure
+  vtkMRMLSegmentationNode* LoadStructureSet(vtkMRMLScene* scene, const std::string& fileName)
+  {
+    vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+    rtReader->SetFileName(fileName.c_str());
+    rtReader->Update();
+    if (!rtReader->GetLoadRTStructureSetSuccessful())
+    {
+      std::cerr << "Failed to read structure set " << fileName << std::endl;
+      return NULL;
+    }
+
+    vtkSmartPointer<vtkMRMLSegmentationNode> segmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+    segmentationNode->SetName(scene->GenerateUniqueName(GetSeriesName(rtReader, fileName)).c_str());
+    scene->AddNode(segmentationNode);
+    segmentationNode->GetSegmentation()->SetMasterRepresentationName(
+      vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName() );
+
+    for (int roiIndex=0; roiIndex<rtReader->GetNumberOfRois(); ++roiIndex)
+    {
+      vtkPolyData* roiPolyData = rtReader->GetRoiPolyData(roiIndex);
+      if (!roiPolyData || roiPolyData->GetNumberOfPoints() < 2)
+      {
+        continue;
+      }
+      const char* roiName = rtReader->GetRoiName(roiIndex);
+      double* roiColor = rtReader->GetRoiDisplayColor(roiIndex);
+
+      vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+      segment->SetName(roiName ? roiName : "Unnamed");
+      segment->SetColor(roiColor[0], roiColor[1], roiColor[2]);
+      segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(), roiPolyData);
+      segmentationNode->GetSegmentation()->AddSegment(segment);
+    }
+
+    return segmentationNode;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Load an RTDOSE file into a new dose volume node, the same way as DICOM RT import does.
+  /// The dose unit is stored in the subject hierarchy study so that the metrics are named as dose.
+  /// \return Dose volume node added to the scene, NULL on failure
+  vtkMRMLScalarVolumeNode* LoadDose(vtkMRMLScene* scene, const std::string& fileName, std::string& patientId)
+  {
+    vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+    rtReader->SetFileName(fileName.c_str());
+    rtReader->Update();
+    if (!rtReader->GetLoadRTDoseSuccessful())
+    {
+      std::cerr << "Failed to read dose " << fileName << std::endl;
+      return NULL;
+    }
+    if (patientId.empty() && rtReader->GetPatientId())
+    {
+      patientId = rtReader->GetPatientId();
+    }
+
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    volumeStorageNode->SetFileName(fileName.c_str());
+    volumeStorageNode->ResetFileNameList();
+    volumeStorageNode->SetSingleFile(1);
+    if (!volumeStorageNode->ReadData(volumeNode))
+    {
+      std::cerr << "Failed to read dose volume " << fileName << std::endl;
+      return NULL;
+    }
+
+    volumeNode->SetName(scene->GenerateUniqueName(GetSeriesName(rtReader, fileName)).c_str());
+    double* initialSpacing = volumeNode->GetSpacing();
+    double* correctSpacing = rtReader->GetPixelSpacing();
+    volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
+    volumeNode->SetAttribute(SlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+    scene->AddNode(volumeNode);
+
+    // Apply dose grid scaling
+    double doseGridScaling = vtkVariant(rtReader->GetDoseGridScaling()).ToDouble();
+    vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
+    imageCast->SetInputData(volumeNode->GetImageData());
+    imageCast->SetOutputScalarTypeToFloat();
+    imageCast->Update();
+    vtkSmartPointer<vtkImageData> floatVolumeData = vtkSmartPointer<vtkImageData>::New();
+    floatVolumeData->ShallowCopy(imageCast->GetOutput());
+    float* floatPtr = static_cast<float*>(floatVolumeData->GetScalarPointer());
+    for (vtkIdType i=0; i<floatVolumeData->GetNumberOfPoints(); ++i, ++floatPtr)
+    {
+      (*floatPtr) = static_cast<float>((*floatPtr) * doseGridScaling);
+    }
+    volumeNode->SetAndObserveImageData(floatVolumeData);
+
+    // Set up the subject hierarchy the DVH metric names are taken from
+    vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(scene);
+    if ( !shNode || SlicerRtCommon::IsStringNullOrEmpty(rtReader->GetPatientId())
+      || SlicerRtCommon::IsStringNullOrEmpty(rtReader->GetStudyInstanceUid())
+      || SlicerRtCommon::IsStringNullOrEmpty(rtReader->GetSeriesInstanceUid()) )
+    {
+      std::cerr << "Missing patient, study or series identifier in " << fileName << ", dose unit is ignored" << std::endl;
+      return volumeNode;
+    }
+    vtkIdType seriesItemID = shNode->CreateItem(shNode->GetSceneItemID(), volumeNode);
+    shNode->SetItemUID(seriesItemID, vtkMRMLSubjectHierarchyConstants::GetDICOMUIDName(), rtReader->GetSeriesInstanceUid());
+    vtkSlicerSubjectHierarchyModuleLogic::InsertDicomSeriesInHierarchy(
+      shNode, rtReader->GetPatientId(), rtReader->GetStudyInstanceUid(), rtReader->GetSeriesInstanceUid() );
+    vtkIdType studyItemID = shNode->GetItemParent(seriesItemID);
+    if (studyItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID && rtReader->GetDoseUnits())
+    {
+      shNode->SetItemAttribute(studyItemID, SlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, rtReader->GetDoseUnits());
+      shNode->SetItemAttribute(studyItemID, SlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_VALUE_ATTRIBUTE_NAME, rtReader->GetDoseGridScaling());
+    }
+
+    return volumeNode;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute DVHs and metrics for every dose and structure set pair of one patient, and write the metrics to a CSV file.
+  /// Pairs that fail are reported and skipped, the metrics of the others are still written.
+  /// \return Exit code of the worker
+  int ProcessPatient(const std::string& patientFolder, const std::string& outputFileName, const std::string& dvhFolder,
+    const std::string& vDoseValues, const std::string& dVolumeValuesCc, const std::string& dVolumeValuesPercent)
+  {
+    std::vector<std::string> structureSetFiles;
+    std::vector<std::string> doseFiles;
+    FindDicomRtFiles(patientFolder, structureSetFiles, doseFiles);
+    if (structureSetFiles.empty() || doseFiles.empty())
+    {
+      std::cerr << "No RTSTRUCT and RTDOSE pair found in " << patientFolder << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    vtkSmartPointer<vtkMRMLScene> scene = vtkSmartPointer<vtkMRMLScene>::New();
+    vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic> dvhLogic = vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic>::New();
+    dvhLogic->SetMRMLScene(scene);
+
+    bool allSucceeded = true;
+    std::string patientId;
+    std::vector<vtkMRMLScalarVolumeNode*> doseVolumeNodes;
+    for (std::vector<std::string>::iterator fileIt=doseFiles.begin(); fileIt!=doseFiles.end(); ++fileIt)
+    {
+      vtkMRMLScalarVolumeNode* doseVolumeNode = LoadDose(scene, *fileIt, patientId);
+      if (doseVolumeNode)
+      {
+        doseVolumeNodes.push_back(doseVolumeNode);
+      }
+      else
+      {
+        allSucceeded = false;
+      }
+    }
+    std::vector<vtkMRMLSegmentationNode*> segmentationNodes;
+    for (std::vector<std::string>::iterator fileIt=structureSetFiles.begin(); fileIt!=structureSetFiles.end(); ++fileIt)
+    {
+      vtkMRMLSegmentationNode* segmentationNode = LoadStructureSet(scene, *fileIt);
+      if (segmentationNode && segmentationNode->GetSegmentation()->GetNumberOfSegments() > 0)
+      {
+        segmentationNodes.push_back(segmentationNode);
+      }
+      else if (!segmentationNode)
+      {
+        allSucceeded = false;
+      }
+    }
+
+    std::ofstream outStream(outputFileName.c_str());
+    if (!outStream.is_open())
+    {
+      std::cerr << "Failed to open metrics file " << outputFileName << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::string patientName = vtksys::SystemTools::GetFilenameName(vtksys::SystemTools::CollapseFullPath(patientFolder));
+
+    int pairIndex = 0;
+    for (std::vector<vtkMRMLScalarVolumeNode*>::iterator doseIt=doseVolumeNodes.begin(); doseIt!=doseVolumeNodes.end(); ++doseIt)
+    {
+      for (std::vector<vtkMRMLSegmentationNode*>::iterator segmentationIt=segmentationNodes.begin(); segmentationIt!=segmentationNodes.end(); ++segmentationIt)
+      {
+        vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode> parameterNode = vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode>::New();
+        scene->AddNode(parameterNode);
+        parameterNode->SetAndObserveDoseVolumeNode(*doseIt);
+        parameterNode->SetAndObserveSegmentationNode(*segmentationIt);
+        parameterNode->SetVDoseValues(vDoseValues.c_str());
+        parameterNode->SetShowVMetricsCc(!vDoseValues.empty());
+        parameterNode->SetShowVMetricsPercent(!vDoseValues.empty());
+        parameterNode->SetDVolumeValuesCc(dVolumeValuesCc.c_str());
+        parameterNode->SetDVolumeValuesPercent(dVolumeValuesPercent.c_str());
+        parameterNode->SetShowDMetrics(!dVolumeValuesCc.empty() || !dVolumeValuesPercent.empty());
+
+        std::string errorMessage = dvhLogic->ComputeDvh(parameterNode);
+        if (errorMessage.empty() && (!dvhLogic->ComputeVMetrics(parameterNode) || !dvhLogic->ComputeDMetrics(parameterNode)))
+        {
+          errorMessage = "Failed to compute DVH metrics";
+        }
+        if (!errorMessage.empty())
+        {
+          std::cerr << "Dose " << (*doseIt)->GetName() << ", structure set " << (*segmentationIt)->GetName() << ": " << errorMessage << std::endl;
+          allSucceeded = false;
+          continue;
+        }
+
+        // The first column is the visibility of the DVH in the chart, it is not written
+        vtkTable* metricsTable = parameterNode->GetMetricsTableNode()->GetTable();
+        if (pairIndex == 0)
+        {
+          outStream << "Patient folder,Patient ID,Structure set";
+          for (int column=vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure; column<metricsTable->GetNumberOfColumns(); ++column)
+          {
+            outStream << "," << CsvField(metricsTable->GetColumnName(column) ? metricsTable->GetColumnName(column) : "");
+          }
+          outStream << std::endl;
+        }
+        for (vtkIdType row=0; row<metricsTable->GetNumberOfRows(); ++row)
+        {
+          outStream << CsvField(patientName) << "," << CsvField(patientId) << "," << CsvField((*segmentationIt)->GetName());
+          for (int column=vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure; column<metricsTable->GetNumberOfColumns(); ++column)
+          {
+            outStream << "," << CsvField(metricsTable->GetValue(row, column).ToString());
+          }
+          outStream << std::endl;
+        }
+
+        if (!dvhFolder.empty())
+        {
+          std::ostringstream archiveFileNameStream;
+          archiveFileNameStream << dvhFolder << "/" << patientName;
+          if (pairIndex > 0)
+          {
+            archiveFileNameStream << "_" << pairIndex + 1;
+          }
+          archiveFileNameStream << ".dvharchive";
+          if (!dvhLogic->ExportDvhToArchive(parameterNode, archiveFileNameStream.str().c_str()))
+          {
+            std::cerr << "Failed to write DVH archive " << archiveFileNameStream.str() << std::endl;
+            allSucceeded = false;
+          }
+        }
+        ++pairIndex;
+      }
+    }
+
+    if (pairIndex == 0)
+    {
+      std::cerr << "No DVH could be computed for " << patientFolder << std::endl;
+      return EXIT_FAILURE;
+    }
+    return (allSucceeded ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Start a worker process for a patient
+  /// \return Process handle, NULL if it could not be started
+  vtksysProcess* StartWorker(const std::vector<std::string>& arguments)
+  {
+    std::vector<const char*> command;
+    for (std::vector<std::string>::const_iterator argumentIt=arguments.begin(); argumentIt!=arguments.end(); ++argumentIt)
+    {
+      command.push_back(argumentIt->c_str());
+    }
+    command.push_back(NULL);
+
+    vtksysProcess* process = vtksysProcess_New();
+    vtksysProcess_SetCommand(process, &command[0]);
+    // Workers print their messages directly to the console
+    vtksysProcess_SetPipeShared(process, vtksysProcess_Pipe_STDOUT, 1);
+    vtksysProcess_SetPipeShared(process, vtksysProcess_Pipe_STDERR, 1);
+    vtksysProcess_Execute(process);
+    if (vtksysProcess_GetState(process) != vtksysProcess_State_Executing)
+    {
+      std::cerr << "Failed to start worker: " << vtksysProcess_GetErrorString(process) << std::endl;
+      vtksysProcess_Delete(process);
+      return NULL;
+    }
+    return process;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get error message of a finished worker process, empty if it succeeded
+  std::string GetWorkerErrorMessage(vtksysProcess* process)
+  {
+    switch (vtksysProcess_GetState(process))
+    {
+    case vtksysProcess_State_Exited:
+      if (vtksysProcess_GetExitValue(process) == EXIT_SUCCESS)
+      {
+        return "";
+      }
+      if (vtksysProcess_GetExitValue(process) == WORKER_EXIT_MEMORY_BUDGET_EXCEEDED)
+      {
+        return "Memory budget exceeded";
+      }
+      return "Processing failed";
+    case vtksysProcess_State_Exception:
+      return std::string("Worker terminated: ") + vtksysProcess_GetExceptionString(process);
+    case vtksysProcess_State_Error:
+      return std::string("Worker error: ") + vtksysProcess_GetErrorString(process);
+    default:
+      return "Worker terminated unexpectedly";
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Concatenate the metrics files of the patients in patient order. The metrics of patients whose metric names
+  /// differ from those of the first merged patient are not merged and the patient is marked as failed
+  bool MergeWorkerOutputs(std::vector<PatientEntry>& patients, const std::string& outputMetricsFile)
+  {
+    std::ofstream outStream(outputMetricsFile.c_str());
+    if (!outStream.is_open())
+    {
+      std::cerr << "Failed to open output metrics file " << outputMetricsFile << std::endl;
+      return false;
+    }
+    std::string header;
+    for (std::vector<PatientEntry>::iterator patientIt=patients.begin(); patientIt!=patients.end(); ++patientIt)
+    {
+      std::ifstream inStream(patientIt->WorkerOutputFile.c_str());
+      std::string line;
+      if (!inStream.is_open() || !std::getline(inStream, line))
+      {
+        continue;
+      }
+      if (header.empty())
+      {
+        header = line;
+        outStream << header << std::endl;
+      }
+      else if (line != header)
+      {
+        // Happens if the dose unit is different or missing. The values would end up in the wrong columns
+        patientIt->Succeeded = false;
+        patientIt->ErrorMessage = "Metric names differ from the first patient's, metrics not merged: " + line;
+        continue;
+      }
+      while (std::getline(inStream, line))
+      {
+        outStream << line << std::endl;
+      }
+    }
+    return outStream.good();
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  PARSE_ARGS;
+
+  //
+  // Worker: process one patient
+  //
+  if (!workerPatientFolder.empty())
+  {
+    if (!SetProcessMemoryLimit(memoryBudgetMb))
+    {
+      std::cerr << "Failed to set memory budget of " << memoryBudgetMb << " MB" << std::endl;
+    }
+    if (workerThreads > 0)
+    {
+      vtkSMPTools::Initialize(workerThreads);
+    }
+    itk::itkFactoryRegistration();
+    vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+      vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+    vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+      vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New() );
+
+    try
+    {
+      return ProcessPatient(workerPatientFolder, workerOutputFile, dvhFolder, vDoseValues, dVolumeValuesCc, dVolumeValuesPercent);
+    }
+    catch (std::bad_alloc&)
+    {
+      std::cerr << "Memory budget of " << memoryBudgetMb << " MB exceeded while processing " << workerPatientFolder << std::endl;
+      return WORKER_EXIT_MEMORY_BUDGET_EXCEEDED;
+    }
+  }
+
+  //
+  // Batch: run one worker process per patient
+  //
+  if (inputFolder.empty() || !vtksys::SystemTools::FileIsDirectory(inputFolder))
+  {
+    std::cerr << "Invalid input folder: " << inputFolder << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (outputMetricsFile.empty())
+  {
+    std::cerr << "Output metrics file is not specified" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!dvhFolder.empty() && !vtksys::SystemTools::MakeDirectory(dvhFolder))
+  {
+    std::cerr << "Failed to create DVH archive folder " << dvhFolder << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<PatientEntry> patients;
+  FindPatients(inputFolder, patients);
+
+  std::string workerOutputFolder = outputMetricsFile + "_workers";
+  if (!vtksys::SystemTools::MakeDirectory(workerOutputFolder))
+  {
+    std::cerr << "Failed to create temporary folder " << workerOutputFolder << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (size_t patientIndex=0; patientIndex<patients.size(); ++patientIndex)
+  {
+    std::ostringstream workerOutputFileStream;
+    workerOutputFileStream << workerOutputFolder << "/Patient" << patientIndex << ".csv";
+    patients[patientIndex].WorkerOutputFile = workerOutputFileStream.str();
+  }
+
+  // Share the processors among the workers, as the DVH computation is multi-threaded too
+  vtksys::SystemInformation systemInformation;
+  systemInformation.RunCPUCheck();
+  int numberOfProcessors = static_cast<int>(systemInformation.GetNumberOfLogicalCPU());
+  if (numberOfProcessors < 1)
+  {
+    numberOfProcessors = 1;
+  }
+  if (numberOfWorkers <= 0)
+  {
+    numberOfWorkers = numberOfProcessors;
+  }
+  if (numberOfWorkers > static_cast<int>(patients.size()))
+  {
+    numberOfWorkers = static_cast<int>(patients.size());
+  }
+  int threadsPerWorker = (numberOfProcessors > numberOfWorkers ? numberOfProcessors / numberOfWorkers : 1);
+  std::cout << "Processing " << patients.size() << " patients with " << numberOfWorkers << " workers ("
+    << threadsPerWorker << " threads and " << memoryBudgetMb << " MB memory budget each)" << std::endl;
+
+  std::vector<std::string> commonArguments;
+  commonArguments.push_back("--workerthreads");
+  commonArguments.push_back(vtkVariant(threadsPerWorker).ToString());
+  commonArguments.push_back("--memorybudget");
+  commonArguments.push_back(vtkVariant(memoryBudgetMb).ToString());
+  if (!vDoseValues.empty())
+  {
+    commonArguments.push_back("--vdose");
+    commonArguments.push_back(vDoseValues);
+  }
+  if (!dVolumeValuesCc.empty())
+  {
+    commonArguments.push_back("--dvolumecc");
+    commonArguments.push_back(dVolumeValuesCc);
+  }
+  if (!dVolumeValuesPercent.empty())
+  {
+    commonArguments.push_back("--dvolumepercent");
+    commonArguments.push_back(dVolumeValuesPercent);
+  }
+  if (!dvhFolder.empty())
+  {
+    commonArguments.push_back("--dvhfolder");
+    commonArguments.push_back(dvhFolder);
+  }
+
+  std::vector<size_t> startOrder;
+  for (size_t patientIndex=0; patientIndex<patients.size(); ++patientIndex)
+  {
+    startOrder.push_back(patientIndex);
+  }
+  std::stable_sort(startOrder.begin(), startOrder.end(), LargerPatientFirst(patients));
+
+  double batchStartTime = vtkTimerLog::GetUniversalTime();
+  size_t numberOfStartedPatients = 0;
+  size_t numberOfFinishedPatients = 0;
+  std::vector<RunningWorker> runningWorkers;
+  while (numberOfStartedPatients < startOrder.size() || !runningWorkers.empty())
+  {
+    // Start workers for the next patients
+    while (static_cast<int>(runningWorkers.size()) < numberOfWorkers && numberOfStartedPatients < startOrder.size())
+    {
+      PatientEntry& patient = patients[startOrder[numberOfStartedPatients]];
+      std::vector<std::string> arguments;
+      arguments.push_back(argv[0]);
+      arguments.push_back("--workerpatient");
+      arguments.push_back(patient.Folder);
+      arguments.push_back("--workeroutput");
+      arguments.push_back(patient.WorkerOutputFile);
+      arguments.insert(arguments.end(), commonArguments.begin(), commonArguments.end());
+
+      RunningWorker worker;
+      worker.Process = StartWorker(arguments);
+      worker.PatientIndex = startOrder[numberOfStartedPatients];
+      worker.StartTime = vtkTimerLog::GetUniversalTime();
+      ++numberOfStartedPatients;
+      if (!worker.Process)
+      {
+        patient.ErrorMessage = "Failed to start worker";
+        ++numberOfFinishedPatients;
+        continue;
+      }
+      runningWorkers.push_back(worker);
+    }
+
+    // Collect finished workers
+    for (std::vector<RunningWorker>::iterator workerIt=runningWorkers.begin(); workerIt!=runningWorkers.end(); )
+    {
+      double timeout = 0.0;
+      if (!vtksysProcess_WaitForExit(workerIt->Process, &timeout))
+      {
+        ++workerIt;
+        continue;
+      }
+      PatientEntry& patient = patients[workerIt->PatientIndex];
+      patient.ErrorMessage = GetWorkerErrorMessage(workerIt->Process);
+      patient.Succeeded = patient.ErrorMessage.empty();
+      vtksysProcess_Delete(workerIt->Process);
+      ++numberOfFinishedPatients;
+
+      std::cout << "[" << numberOfFinishedPatients << "/" << patients.size() << "] " << patient.Name << ": "
+        << (patient.Succeeded ? "Done" : patient.ErrorMessage) << " ("
+        << vtkTimerLog::GetUniversalTime() - workerIt->StartTime << " s)" << std::endl;
+      workerIt = runningWorkers.erase(workerIt);
+    }
+
+    if (!runningWorkers.empty())
+    {
+      vtksys::SystemTools::Delay(100);
+    }
+  }
+
+  // Metrics of partially processed patients are kept too
+  bool mergeSuccessful = MergeWorkerOutputs(patients, outputMetricsFile);
+  vtksys::SystemTools::RemoveADirectory(workerOutputFolder);
+
+  int numberOfFailedPatients = 0;
+  for (std::vector<PatientEntry>::iterator patientIt=patients.begin(); patientIt!=patients.end(); ++patientIt)
+  {
+    if (!patientIt->Succeeded)
+    {
+      std::cerr << "Failed patient " << patientIt->Name << ": " << patientIt->ErrorMessage << std::endl;
+      ++numberOfFailedPatients;
+    }
+  }
+  std::cout << "Processed " << patients.size() - numberOfFailedPatients << " of " << patients.size() << " patients in "
+    << vtkTimerLog::GetUniversalTime() - batchStartTime << " s" << std::endl;
+
+  return ((mergeSuccessful && numberOfFailedPatients == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
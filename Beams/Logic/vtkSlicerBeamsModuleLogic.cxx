@@ -44,11 +44,17 @@ vtkStandardNewMacro(vtkSlicerBeamsModuleLogic);
 //----------------------------------------------------------------------------
 vtkSlicerBeamsModuleLogic::vtkSlicerBeamsModuleLogic()
 {
+  this->IECLogic = vtkSlicerIECTransformLogic::New();
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerBeamsModuleLogic::~vtkSlicerBeamsModuleLogic()
 {
+  if (this->IECLogic)
+  {
+    this->IECLogic->Delete();
+    this->IECLogic = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -78,6 +84,8 @@ void vtkSlicerBeamsModuleLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
   events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
   events->InsertNextValue(vtkMRMLScene::EndImportEvent);
   this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+
+  this->IECLogic->SetMRMLScene(newScene);
 }
 
 //---------------------------------------------------------------------------
@@ -149,10 +157,7 @@ void vtkSlicerBeamsModuleLogic::UpdateTransformForBeam(vtkMRMLRTBeamNode* beamNo
     return;
   }
 
-  //TODO: Use one IEC logic in a private scene for all beam transform updates?
-  vtkSmartPointer<vtkSlicerIECTransformLogic> iecLogic = vtkSmartPointer<vtkSlicerIECTransformLogic>::New();
-  iecLogic->SetMRMLScene(scene);
-  iecLogic->UpdateBeamTransform(beamNode);
+  this->IECLogic->UpdateBeamTransform(beamNode);
 }
 
 //----------------------------------------------------------------------------
@@ -207,6 +212,15 @@ void vtkSlicerBeamsModuleLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsign
         return;
       }
 
+      // If the beam is being modified together with the plan, then request the updates
+      // so that they are performed only once when the modification ends
+      if (beamNode->IsBeamModifying())
+      {
+        beamNode->InvokeBeamTransformModifiedEvent();
+        beamNode->InvokeBeamGeometryModifiedEvent();
+        return;
+      }
+
       // Make sure transform node exists
       beamNode->CreateDefaultTransformNode();
       // Calculate transform from beam parameters and isocenter from plan
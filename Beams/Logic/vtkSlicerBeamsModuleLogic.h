@@ -34,6 +34,8 @@
 #include "vtkSlicerBeamsModuleLogicExport.h"
 #include "vtkMRMLRTBeamNode.h"
 
+class vtkSlicerIECTransformLogic;
+
 /// \ingroup SlicerRt_QtModules_Beams
 class VTK_SLICER_BEAMS_LOGIC_EXPORT vtkSlicerBeamsModuleLogic :
   public vtkSlicerModuleLogic
@@ -46,6 +48,9 @@ public:
   /// Update parent transform of a given beam using its parameters and the IEC logic
   void UpdateTransformForBeam(vtkMRMLRTBeamNode* beamNode);
 
+  /// Get IEC logic used for the beam transform updates
+  vtkGetObjectMacro(IECLogic, vtkSlicerIECTransformLogic);
+
 protected:
   vtkSlicerBeamsModuleLogic();
   virtual ~vtkSlicerBeamsModuleLogic();
@@ -61,6 +66,10 @@ protected:
   /// Handles events registered in the observer manager
   virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData) VTK_OVERRIDE;
 
+protected:
+  /// IEC logic shared by all beam transform updates, so that its cached transforms are reused
+  vtkSlicerIECTransformLogic* IECLogic;
+
 private:
   vtkSlicerBeamsModuleLogic(const vtkSlicerBeamsModuleLogic&); // Not implemented
   void operator=(const vtkSlicerBeamsModuleLogic&);            // Not implemented
@@ -33,6 +33,11 @@
 #include <vtkObjectFactory.h>
 #include <vtkGeneralTransform.h>
 #include <vtkTransform.h>
+#include <vtkMatrix4x4.h>
+#include <vtkIntArray.h>
+
+// STD includes
+#include <algorithm>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIECTransformLogic);
@@ -63,6 +68,13 @@ vtkSlicerIECTransformLogic::vtkSlicerIECTransformLogic()
   this->IecTransforms.push_back(std::make_pair(PatientSupport, PatientSupportRotation)); // Scaling component of patient support transform
   this->IecTransforms.push_back(std::make_pair(TableTopEccentricRotation, PatientSupportRotation)); // NOTE: Currently not supported by REV
   this->IecTransforms.push_back(std::make_pair(TableTop, TableTopEccentricRotation));
+
+  this->ParentFrames.clear();
+  std::vector< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier> >::iterator transformIt;
+  for (transformIt=this->IecTransforms.begin(); transformIt!=this->IecTransforms.end(); ++transformIt)
+  {
+    this->ParentFrames[transformIt->first] = transformIt->second;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -70,6 +82,10 @@ vtkSlicerIECTransformLogic::~vtkSlicerIECTransformLogic()
 {
   this->CoordinateSystemsMap.clear();
   this->IecTransforms.clear();
+  this->ParentFrames.clear();
+  this->TransformNodes.clear();
+  this->TransformMTimes.clear();
+  this->MatrixCache.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -84,10 +100,13 @@ void vtkSlicerIECTransformLogic::PrintSelf(ostream& os, vtkIndent indent)
   for (transformIt=this->IecTransforms.begin(); transformIt!=this->IecTransforms.end(); ++transformIt)
   {
     std::string transformNodeName = this->GetTransformNodeNameBetween(transformIt->first, transformIt->second);
-    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(
-      this->GetMRMLScene()->GetFirstNodeByName(transformNodeName.c_str()) );
+    vtkMRMLLinearTransformNode* transformNode = this->GetTransformNodeBetween(transformIt->first, transformIt->second);
 
     os << indent.GetNextIndent() << transformNodeName << std::endl;
+    if (!transformNode)
+    {
+      continue;
+    }
     transformNode->GetMatrixTransformToParent(matrix);
     for (int i = 0; i < 4; i++)
     {
@@ -99,6 +118,83 @@ void vtkSlicerIECTransformLogic::PrintSelf(ostream& os, vtkIndent indent)
       os << std::endl;
     }
   }
+
+  os << indent << "Cached matrices: " << this->MatrixCache.size() << std::endl;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::SetMRMLSceneInternal(vtkMRMLScene* newScene)
+{
+  // Cached transform nodes and matrices belong to the previous scene
+  std::map<CoordinateSystemIdentifier, vtkWeakPointer<vtkMRMLLinearTransformNode> >::iterator nodeIt;
+  for (nodeIt=this->TransformNodes.begin(); nodeIt!=this->TransformNodes.end(); ++nodeIt)
+  {
+    if (nodeIt->second)
+    {
+      vtkUnObserveMRMLNodeMacro(nodeIt->second.GetPointer());
+    }
+  }
+  this->TransformNodes.clear();
+  this->TransformMTimes.clear();
+  this->MatrixCache.clear();
+
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
+  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
+{
+  if (!node)
+  {
+    return;
+  }
+
+  std::map<CoordinateSystemIdentifier, vtkWeakPointer<vtkMRMLLinearTransformNode> >::iterator nodeIt;
+  for (nodeIt=this->TransformNodes.begin(); nodeIt!=this->TransformNodes.end(); ++nodeIt)
+  {
+    if (nodeIt->second.GetPointer() == node)
+    {
+      vtkUnObserveMRMLNodeMacro(node);
+      this->InvalidateMatricesContainingFrame(nodeIt->first);
+      this->TransformMTimes.erase(nodeIt->first);
+      this->TransformNodes.erase(nodeIt);
+      return;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
+{
+  this->Superclass::ProcessMRMLNodesEvents(caller, event, callData);
+
+  if (event != vtkMRMLTransformableNode::TransformModifiedEvent)
+  {
+    return;
+  }
+
+  std::map<CoordinateSystemIdentifier, vtkWeakPointer<vtkMRMLLinearTransformNode> >::iterator nodeIt;
+  for (nodeIt=this->TransformNodes.begin(); nodeIt!=this->TransformNodes.end(); ++nodeIt)
+  {
+    vtkMRMLLinearTransformNode* transformNode = nodeIt->second;
+    if (!transformNode || transformNode != caller)
+    {
+      continue;
+    }
+
+    // The event is also invoked when a parent transform is modified. Matrices containing the parent
+    // are invalidated by the event of the parent node, so only changes of this transform are handled here
+    vtkAbstractTransform* transformToParent = transformNode->GetTransformToParent();
+    vtkMTimeType transformMTime = (transformToParent ? transformToParent->GetMTime() : 0);
+    if (transformMTime != this->TransformMTimes[nodeIt->first])
+    {
+      this->TransformMTimes[nodeIt->first] = transformMTime;
+      this->InvalidateMatricesContainingFrame(nodeIt->first);
+    }
+    return;
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -114,9 +210,9 @@ void vtkSlicerIECTransformLogic::BuildIECTransformHierarchy()
   std::vector< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier> >::iterator transformIt;
   for (transformIt=this->IecTransforms.begin(); transformIt!=this->IecTransforms.end(); ++transformIt)
   {
-    std::string transformNodeName = this->GetTransformNodeNameBetween(transformIt->first, transformIt->second);
-    if (!this->GetMRMLScene()->GetFirstNodeByName(transformNodeName.c_str()))
+    if (!this->GetTransformNodeBetween(transformIt->first, transformIt->second))
     {
+      std::string transformNodeName = this->GetTransformNodeNameBetween(transformIt->first, transformIt->second);
       vtkSmartPointer<vtkMRMLLinearTransformNode> transformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
       transformNode->SetName(transformNodeName.c_str());
       transformNode->SetHideFromEditors(1);
@@ -176,20 +272,12 @@ void vtkSlicerIECTransformLogic::UpdateBeamTransform(vtkMRMLRTBeamNode* beamNode
   // Update transforms in IEC logic from beam node parameters
   this->UpdateIECTransformsFromBeam(beamNode);
 
-  vtkSmartPointer<vtkGeneralTransform> beamGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  if (this->GetTransformBetween(Collimator, RAS, beamGeneralTransform))
+  vtkSmartPointer<vtkMatrix4x4> collimatorToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (this->GetMatrixBetween(Collimator, RAS, collimatorToRasMatrix))
   {
-    // Convert general transform to linear
-    // This call also makes hard copy of the transform so that it doesn't change when other beam transforms change
-    vtkSmartPointer<vtkTransform> beamLinearTransform = vtkSmartPointer<vtkTransform>::New();
-    if (!vtkMRMLTransformNode::IsGeneralTransformLinear(beamGeneralTransform, beamLinearTransform))
-    {
-      vtkErrorMacro("UpdateBeamTransform: Unable to set transform with non-linear components to beam " << beamNode->GetName());
-      return;
-    }
-
     // Set transform to beam node
-    beamTransformNode->SetAndObserveTransformToParent(beamLinearTransform);
+    // The matrix is copied so that it doesn't change when other beam transforms change
+    beamTransformNode->SetMatrixTransformToParent(collimatorToRasMatrix);
 
     // Update the name of the transform node too
     // (the user may have renamed the beam, but it's very expensive to update the transform name on every beam modified event)
@@ -276,8 +364,41 @@ vtkMRMLLinearTransformNode* vtkSlicerIECTransformLogic::GetTransformNodeBetween(
     return NULL;
   }
 
-  return vtkMRMLLinearTransformNode::SafeDownCast(
+  // Only the transforms of the IEC hierarchy have nodes
+  std::map<CoordinateSystemIdentifier, CoordinateSystemIdentifier>::iterator parentIt = this->ParentFrames.find(fromFrame);
+  if (parentIt == this->ParentFrames.end() || parentIt->second != toFrame)
+  {
+    return NULL;
+  }
+
+  vtkMRMLLinearTransformNode* cachedTransformNode = this->TransformNodes[fromFrame];
+  if (cachedTransformNode && cachedTransformNode->GetScene() == this->GetMRMLScene())
+  {
+    return cachedTransformNode;
+  }
+  if (cachedTransformNode)
+  {
+    vtkUnObserveMRMLNodeMacro(cachedTransformNode);
+  }
+
+  // Look up transform node by name and keep it for subsequent calls
+  vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(
     this->GetMRMLScene()->GetFirstNodeByName( this->GetTransformNodeNameBetween(fromFrame, toFrame).c_str() ) );
+  this->TransformNodes[fromFrame] = transformNode;
+  if (transformNode)
+  {
+    vtkAbstractTransform* transformToParent = transformNode->GetTransformToParent();
+    this->TransformMTimes[fromFrame] = (transformToParent ? transformToParent->GetMTime() : 0);
+
+    vtkSmartPointer<vtkIntArray> events = vtkSmartPointer<vtkIntArray>::New();
+    events->InsertNextValue(vtkMRMLTransformableNode::TransformModifiedEvent);
+    vtkObserveMRMLNodeEventsMacro(transformNode, events);
+  }
+
+  // Matrices may have been composed using a previous node
+  this->InvalidateMatricesContainingFrame(fromFrame);
+
+  return transformNode;
 }
 
 //-----------------------------------------------------------------------------
@@ -294,15 +415,126 @@ bool vtkSlicerIECTransformLogic::GetTransformBetween(CoordinateSystemIdentifier
     return false;
   }
 
-  //TODO: !!! IMPLEMENT DYNAMICALLY !!!
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!this->GetMatrixBetween(fromFrame, toFrame, matrix))
+  {
+    vtkErrorMacro("GetTransformBetween: Failed to get transform " << this->GetTransformNodeNameBetween(fromFrame, toFrame));
+    return false;
+  }
 
-  if (fromFrame == Collimator && toFrame == RAS)
+  outputTransform->Identity();
+  outputTransform->Concatenate(matrix);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerIECTransformLogic::GetMatrixBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, vtkMatrix4x4* outputMatrix)
+{
+  if (!outputMatrix)
   {
-    vtkMRMLTransformNode::GetTransformBetweenNodes(
-      this->GetTransformNodeBetween(Collimator, Gantry), NULL, outputTransform );
-    return true;
+    vtkErrorMacro("GetMatrixBetween: Invalid output matrix");
+    return false;
+  }
+  if (!this->GetMRMLScene())
+  {
+    vtkErrorMacro("GetMatrixBetween: Invalid MRML scene");
+    return false;
   }
 
-  vtkErrorMacro("GetTransformBetween: Failed to get transform " << this->GetTransformNodeNameBetween(fromFrame, toFrame));
-  return false;
+  CachedMatrix& cachedMatrix = this->MatrixCache[std::make_pair(fromFrame, toFrame)];
+  if (!cachedMatrix.Valid)
+  {
+    // Get the frames from both frames to the root, and remove the common part so that
+    // only the frames below the closest common ancestor remain
+    std::vector<CoordinateSystemIdentifier> fromFrames;
+    std::vector<CoordinateSystemIdentifier> toFrames;
+    if (!this->GetFramesToRoot(fromFrame, fromFrames) || !this->GetFramesToRoot(toFrame, toFrames))
+    {
+      vtkErrorMacro("GetMatrixBetween: Coordinate frame is not part of the IEC transform hierarchy");
+      return false;
+    }
+    while (!fromFrames.empty() && !toFrames.empty() && fromFrames.back() == toFrames.back())
+    {
+      fromFrames.pop_back();
+      toFrames.pop_back();
+    }
+
+    // From frame -> common ancestor -> to frame
+    vtkSmartPointer<vtkMatrix4x4> fromToAncestorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> toToAncestorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if ( !this->ComposeTransformsToParent(fromFrames, fromToAncestorMatrix)
+      || !this->ComposeTransformsToParent(toFrames, toToAncestorMatrix) )
+    {
+      vtkErrorMacro("GetMatrixBetween: Failed to compose transform " << this->GetTransformNodeNameBetween(fromFrame, toFrame));
+      return false;
+    }
+    toToAncestorMatrix->Invert();
+
+    if (!cachedMatrix.Matrix)
+    {
+      cachedMatrix.Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+    vtkMatrix4x4::Multiply4x4(toToAncestorMatrix, fromToAncestorMatrix, cachedMatrix.Matrix);
+    cachedMatrix.Frames = fromFrames;
+    cachedMatrix.Frames.insert(cachedMatrix.Frames.end(), toFrames.begin(), toFrames.end());
+    cachedMatrix.Valid = true;
+  }
+
+  outputMatrix->DeepCopy(cachedMatrix.Matrix);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerIECTransformLogic::GetFramesToRoot(CoordinateSystemIdentifier frame, std::vector<CoordinateSystemIdentifier>& frames)
+{
+  frames.clear();
+  frames.push_back(frame);
+  while (frame != RAS)
+  {
+    std::map<CoordinateSystemIdentifier, CoordinateSystemIdentifier>::iterator parentIt = this->ParentFrames.find(frame);
+    if (parentIt == this->ParentFrames.end())
+    {
+      return false;
+    }
+    frame = parentIt->second;
+    frames.push_back(frame);
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerIECTransformLogic::ComposeTransformsToParent(
+  const std::vector<CoordinateSystemIdentifier>& frames, vtkMatrix4x4* outputMatrix )
+{
+  outputMatrix->Identity();
+
+  vtkSmartPointer<vtkMatrix4x4> transformToParentMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  std::vector<CoordinateSystemIdentifier>::const_iterator frameIt;
+  for (frameIt=frames.begin(); frameIt!=frames.end(); ++frameIt)
+  {
+    CoordinateSystemIdentifier parentFrame = this->ParentFrames[*frameIt];
+    vtkMRMLLinearTransformNode* transformNode = this->GetTransformNodeBetween(*frameIt, parentFrame);
+    if (!transformNode || !transformNode->GetMatrixTransformToParent(transformToParentMatrix))
+    {
+      vtkErrorMacro("ComposeTransformsToParent: Failed to get linear transform " << this->GetTransformNodeNameBetween(*frameIt, parentFrame));
+      return false;
+    }
+    vtkMatrix4x4::Multiply4x4(transformToParentMatrix, outputMatrix, outputMatrix);
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::InvalidateMatricesContainingFrame(CoordinateSystemIdentifier frame)
+{
+  std::map< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier>, CachedMatrix >::iterator cacheIt;
+  for (cacheIt=this->MatrixCache.begin(); cacheIt!=this->MatrixCache.end(); ++cacheIt)
+  {
+    std::vector<CoordinateSystemIdentifier>& frames = cacheIt->second.Frames;
+    if (cacheIt->second.Valid && std::find(frames.begin(), frames.end(), frame) != frames.end())
+    {
+      cacheIt->second.Valid = false;
+    }
+  }
 }
@@ -27,11 +27,16 @@
 // Slicer includes
 #include "vtkMRMLAbstractLogic.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
 // STD includes
 #include <map>
 #include <vector>
 
 class vtkGeneralTransform;
+class vtkMatrix4x4;
 class vtkMRMLRTBeamNode;
 class vtkMRMLLinearTransformNode;
 
@@ -43,6 +48,11 @@ class vtkMRMLLinearTransformNode;
 /// With this logic class it is possible to get a transform from any defined coordinate
 /// system to another by simply inputting the coordinate systems. The logic can observe an
 /// RT beam node to get the geometrical parameters defining the state of the objects involved.
+///
+/// The transforms between coordinate frames are composed from the IEC transform nodes and cached
+/// for each frame pair that has been requested. A cached matrix is only recomputed when one of the
+/// transforms in its chain is modified, so that repeated queries during interactive motion are cheap.
+///
 /// Image describing these coordinate frames:
 /// http://perk.cs.queensu.ca/sites/perkd7.cs.queensu.ca/files/Project/IEC_Transformations.PNG
 ///
@@ -82,6 +92,12 @@ public:
   /// \return Success flag (false on any error)
   bool GetTransformBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, vtkGeneralTransform* outputTransform);
 
+  /// Get transform matrix from one coordinate frame to another.
+  /// The matrix is composed along the IEC transform hierarchy and returned from the cache if none
+  /// of the transforms between the two frames have changed since the last call
+  /// \return Success flag (false on any error)
+  bool GetMatrixBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, vtkMatrix4x4* outputMatrix);
+
   /// Update parent transform node of a given beam from the IEC transform hierarchy and the beam parameters
   void UpdateBeamTransform(vtkMRMLRTBeamNode* beamNode);
   /// Update IEC transforms according to beam node
@@ -93,6 +109,37 @@ protected:
   ///   Note: If IEC does not specify a transform between the given coordinate frames, then there will be no node with the returned name.
   std::string GetTransformNodeNameBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame);
 
+  /// Get the frames from a coordinate frame up to the root (RAS) of the IEC transform hierarchy, both included
+  /// \return Success flag (false if the frame is not part of the hierarchy)
+  bool GetFramesToRoot(CoordinateSystemIdentifier frame, std::vector<CoordinateSystemIdentifier>& frames);
+
+  /// Compose the transforms from each frame of a chain to its parent, starting with the first frame
+  /// \return Success flag (false if a transform node is missing or not linear)
+  bool ComposeTransformsToParent(const std::vector<CoordinateSystemIdentifier>& frames, vtkMatrix4x4* outputMatrix);
+
+  /// Mark cached matrices invalid that contain the transform from the given frame to its parent
+  void InvalidateMatricesContainingFrame(CoordinateSystemIdentifier frame);
+
+  /// Observe scene events to forget the cached transform nodes when they are removed
+  virtual void SetMRMLSceneInternal(vtkMRMLScene* newScene) VTK_OVERRIDE;
+  virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) VTK_OVERRIDE;
+
+  /// Invalidate the cached matrices affected by a modified IEC transform node
+  virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData) VTK_OVERRIDE;
+
+protected:
+  /// Cached composed matrix between two coordinate frames
+  struct CachedMatrix
+  {
+    CachedMatrix() : Valid(false) { };
+    /// Transform matrix from the first frame of the pair to the second
+    vtkSmartPointer<vtkMatrix4x4> Matrix;
+    /// Child frames of the IEC transforms the matrix is composed of
+    std::vector<CoordinateSystemIdentifier> Frames;
+    /// Flag indicating whether the matrix is up-to-date
+    bool Valid;
+  };
+
 protected:
   /// Map from \sa CoordinateSystemIdentifier to coordinate system name. Used for getting transforms
   std::map<CoordinateSystemIdentifier, std::string> CoordinateSystemsMap;
@@ -100,6 +147,20 @@ protected:
   /// List of IEC transforms
   std::vector< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier> > IecTransforms;
 
+  /// Parent of each coordinate frame in the IEC transform hierarchy (built from \sa IecTransforms)
+  std::map<CoordinateSystemIdentifier, CoordinateSystemIdentifier> ParentFrames;
+
+  /// Transform node of each IEC transform, indexed by its child frame.
+  /// Set when the node is first accessed so that nodes are not looked up by name every time
+  std::map<CoordinateSystemIdentifier, vtkWeakPointer<vtkMRMLLinearTransformNode> > TransformNodes;
+
+  /// Modified time of the transform to parent of each cached transform node when it was last processed.
+  /// Used to tell modifications of the transform itself from modifications of its parents
+  std::map<CoordinateSystemIdentifier, vtkMTimeType> TransformMTimes;
+
+  /// Composed matrices for each requested (from, to) frame pair
+  std::map< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier>, CachedMatrix > MatrixCache;
+
 protected:
   vtkSlicerIECTransformLogic();
   virtual ~vtkSlicerIECTransformLogic();
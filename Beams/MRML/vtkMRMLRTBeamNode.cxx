@@ -43,6 +43,10 @@
 
 // SlicerRt includes
 #include "PlmCommon.h"
+#include "vtkBeamControlPointSequence.h"
+
+// STD includes
+#include <vector>
 
 //------------------------------------------------------------------------------
 const char* vtkMRMLRTBeamNode::NEW_BEAM_NODE_NAME_PREFIX = "NewBeam_";
@@ -53,6 +57,10 @@ static const char* MLCPOSITION_REFERENCE_ROLE = "MLCPositionRef";
 static const char* DRR_REFERENCE_ROLE = "DRRRef";
 static const char* CONTOUR_BEV_REFERENCE_ROLE = "contourBEVRef";
 
+//------------------------------------------------------------------------------
+/// Width of the leaves described by the MLC position double array node (mm)
+static const double MLC_ARRAY_LEAF_WIDTH = 10.0;
+
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLRTBeamNode);
 
@@ -73,12 +81,26 @@ vtkMRMLRTBeamNode::vtkMRMLRTBeamNode()
   this->CouchAngle = 0.0;
 
   this->SAD = 2000.0;
+
+  this->ControlPoints = NULL;
+  this->ControlPointIndex = 0;
+
+  this->BeamModifyCount = 0;
+  this->BeamModifyWasModifying = 0;
+  this->BeamGeometryModifiedPending = false;
+  this->BeamTransformModifiedPending = false;
 }
 
 //----------------------------------------------------------------------------
 vtkMRMLRTBeamNode::~vtkMRMLRTBeamNode()
 {
   this->SetBeamDescription(NULL);
+
+  if (this->ControlPoints)
+  {
+    this->ControlPoints->UnRegister(this);
+    this->ControlPoints = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -189,7 +211,11 @@ void vtkMRMLRTBeamNode::Copy(vtkMRMLNode *anode)
   }
 
   // Copy beam parameters
-  this->DisableModifiedEventOn();
+  this->StartBeamModify();
+
+  // Control points first, so that the copied parameters override the ones of the current control point
+  this->ControlPointIndex = node->GetControlPointIndex();
+  this->SetControlPoints(node->GetControlPoints());
 
   this->SetBeamNumber(node->GetBeamNumber());
   this->SetBeamDescription(node->GetBeamDescription());
@@ -203,9 +229,8 @@ void vtkMRMLRTBeamNode::Copy(vtkMRMLNode *anode)
   this->SetGantryAngle(node->GetGantryAngle());
   this->SetCollimatorAngle(node->GetCollimatorAngle());
   this->SetCouchAngle(node->GetCouchAngle());
-  
-  this->DisableModifiedEventOff();
-  this->InvokePendingModifiedEvent();
+
+  this->EndBeamModify();
 }
 
 //----------------------------------------------------------------------------
@@ -240,6 +265,9 @@ void vtkMRMLRTBeamNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << " GantryAngle:   " << this->GantryAngle << "\n";
   os << indent << " CollimatorAngle:   " << this->CollimatorAngle << "\n";
   os << indent << " CouchAngle:   " << this->CouchAngle << "\n";
+
+  os << indent << " NumberOfControlPoints:   " << (this->ControlPoints ? this->ControlPoints->GetNumberOfControlPoints() : 0) << "\n";
+  os << indent << " ControlPointIndex:   " << this->ControlPointIndex << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -306,7 +334,7 @@ void vtkMRMLRTBeamNode::SetAndObserveMLCPositionDoubleArrayNode(vtkMRMLDoubleArr
 
   this->SetNodeReferenceID(MLCPOSITION_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  this->InvokeBeamGeometryModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -392,7 +420,7 @@ void vtkMRMLRTBeamNode::SetX1Jaw(double x1Jaw)
 {
   this->X1Jaw = x1Jaw;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  this->InvokeBeamGeometryModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -400,7 +428,7 @@ void vtkMRMLRTBeamNode::SetX2Jaw(double x2Jaw)
 {
   this->X2Jaw = x2Jaw;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  this->InvokeBeamGeometryModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -408,7 +436,7 @@ void vtkMRMLRTBeamNode::SetY1Jaw(double y1Jaw)
 {
   this->Y1Jaw = y1Jaw;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  this->InvokeBeamGeometryModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -416,7 +444,7 @@ void vtkMRMLRTBeamNode::SetY2Jaw(double y2Jaw)
 {
   this->Y2Jaw = y2Jaw;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  this->InvokeBeamGeometryModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -424,7 +452,7 @@ void vtkMRMLRTBeamNode::SetGantryAngle(double angle)
 {
   this->GantryAngle = angle;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+  this->InvokeBeamTransformModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -432,7 +460,7 @@ void vtkMRMLRTBeamNode::SetCollimatorAngle(double angle)
 {
   this->CollimatorAngle = angle;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+  this->InvokeBeamTransformModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -440,7 +468,7 @@ void vtkMRMLRTBeamNode::SetCouchAngle(double angle)
 {
   this->CouchAngle = angle;
   this->Modified();
-  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+  this->InvokeBeamTransformModifiedEvent();
 }
 
 //----------------------------------------------------------------------------
@@ -448,9 +476,127 @@ void vtkMRMLRTBeamNode::SetSAD(double sad)
 {
   this->SAD = sad;
   this->Modified();
+  this->InvokeBeamGeometryModifiedEvent();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::SetControlPoints(vtkBeamControlPointSequence* controlPoints)
+{
+  if (controlPoints == this->ControlPoints)
+  {
+    return;
+  }
+  if (this->ControlPoints)
+  {
+    this->ControlPoints->UnRegister(this);
+  }
+  this->ControlPoints = controlPoints;
+  if (this->ControlPoints)
+  {
+    this->ControlPoints->Register(this);
+  }
+
+  if (this->ControlPoints && this->ControlPoints->GetNumberOfControlPoints() > 0)
+  {
+    this->SetControlPointIndex(this->ControlPointIndex < this->ControlPoints->GetNumberOfControlPoints() ? this->ControlPointIndex : 0);
+  }
+  else
+  {
+    this->Modified();
+    this->InvokeBeamGeometryModifiedEvent();
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::SetControlPointIndex(int index)
+{
+  if (!this->ControlPoints || index < 0 || index >= this->ControlPoints->GetNumberOfControlPoints())
+  {
+    vtkErrorMacro("SetControlPointIndex: Invalid control point index " << index << " in beam " << (this->Name ? this->Name : ""));
+    return;
+  }
+
+  this->StartBeamModify();
+
+  this->ControlPointIndex = index;
+
+  double jawPositions[4] = {0.0, 0.0, 0.0, 0.0};
+  this->ControlPoints->GetJawPositions(index, jawPositions);
+  this->SetX1Jaw(jawPositions[0]);
+  this->SetX2Jaw(jawPositions[1]);
+  this->SetY1Jaw(jawPositions[2]);
+  this->SetY2Jaw(jawPositions[3]);
+
+  this->SetGantryAngle(this->ControlPoints->GetGantryAngle(index));
+  this->SetCollimatorAngle(this->ControlPoints->GetCollimatorAngle(index));
+  this->SetCouchAngle(this->ControlPoints->GetCouchAngle(index));
+
+  // Leaf positions are different even if the jaws are not
+  this->InvokeBeamGeometryModifiedEvent();
+
+  this->EndBeamModify();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::StartBeamModify()
+{
+  if (this->BeamModifyCount++ == 0)
+  {
+    this->BeamModifyWasModifying = this->StartModify();
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::EndBeamModify()
+{
+  if (this->BeamModifyCount <= 0)
+  {
+    vtkErrorMacro("EndBeamModify: No matching StartBeamModify call for beam " << (this->Name ? this->Name : ""));
+    return;
+  }
+  if (--this->BeamModifyCount > 0)
+  {
+    return;
+  }
+
+  // Invoke the pending modified event first so that the observers see the final parameters
+  this->EndModify(this->BeamModifyWasModifying);
+
+  // Same order as when a beam is added to a plan: the transform node is created before the model is updated
+  if (this->BeamTransformModifiedPending)
+  {
+    this->BeamTransformModifiedPending = false;
+    this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+  }
+  if (this->BeamGeometryModifiedPending)
+  {
+    this->BeamGeometryModifiedPending = false;
+    this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::InvokeBeamGeometryModifiedEvent()
+{
+  if (this->BeamModifyCount > 0)
+  {
+    this->BeamGeometryModifiedPending = true;
+    return;
+  }
   this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
 }
 
+//---------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::InvokeBeamTransformModifiedEvent()
+{
+  if (this->BeamModifyCount > 0)
+  {
+    this->BeamTransformModifiedPending = true;
+    return;
+  }
+  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+}
+
 //---------------------------------------------------------------------------
 void vtkMRMLRTBeamNode::UpdateGeometry()
 {
@@ -470,139 +616,48 @@ void vtkMRMLRTBeamNode::CreateBeamPolyData(vtkPolyData* beamModelPolyData)
     return;
   }
 
-  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
-  vtkSmartPointer<vtkCellArray> cellArray = vtkSmartPointer<vtkCellArray>::New();
+  double jawPositions[4] = {this->X1Jaw, this->X2Jaw, this->Y1Jaw, this->Y2Jaw};
 
-  vtkMRMLDoubleArrayNode* mlcArrayNode = this->GetMLCPositionDoubleArrayNode();
-  if (mlcArrayNode)
+  // Use MLC of the current control point if available
+  if ( this->ControlPoints && this->ControlPoints->GetNumberOfLeafPairs() > 0
+    && this->ControlPointIndex >= 0 && this->ControlPointIndex < this->ControlPoints->GetNumberOfControlPoints() )
   {
-    // First we extract the shape of the MLC
-    int x1count = this->X1Jaw/10.0;
-    int x2count = this->X2Jaw/10.0;
-    int numLeavesVisible = x2count - x1count; // Calculate the number of leaves visible
-    int numPointsEachSide = numLeavesVisible *2;
-
-    double y2LeafPosition[40];
-    double y1LeafPosition[40];
-
-    // Calculate Y2 first
-    for (int i = x2count; i >= x1count; i--)
-    {
-      double leafPosition = mlcArrayNode->GetArray()->GetComponent(-(i-20), 1);
-      if (leafPosition < this->Y2Jaw)
-      {
-        y2LeafPosition[-(i-20)] = leafPosition;
-      }
-      else
-      {
-        y2LeafPosition[-(i-20)] = this->Y2Jaw;
-      }
-    }
-    // Calculate Y1 next
-    for (int i = x2count; i >= x1count; i--)
-    {
-      double leafPosition = mlcArrayNode->GetArray()->GetComponent(-(i-20), 0);
-      if (leafPosition < this->Y1Jaw)
-      {
-        y1LeafPosition[-(i-20)] = leafPosition;
-      }
-      else
-      {
-        y1LeafPosition[-(i-20)] = this->Y1Jaw;
-      }
-    }
-
-    // Create beam model
-    points->InsertPoint(0,0,0,this->SAD);
-
-    int count = 1;
-    for (int i = x2count; i > x1count; i--)
-    {
-      points->InsertPoint(count,-y2LeafPosition[-(i-20)]*2, i*10*2, -this->SAD );
-      count ++;
-      points->InsertPoint(count,-y2LeafPosition[-(i-20)]*2, (i-1)*10*2, -this->SAD );
-      count ++;
-    }
-
-    for (int i = x1count; i < x2count; i++)
-    {
-      points->InsertPoint(count,y1LeafPosition[-(i-20)]*2, i*10*2, -this->SAD );
-      count ++;
-      points->InsertPoint(count,y1LeafPosition[-(i-20)]*2, (i+1)*10*2, -this->SAD );
-      count ++;
-    }
+    vtkBeamControlPointSequence::CreateAperturePolyData(this->SAD, jawPositions,
+      this->ControlPoints->GetNumberOfLeafPairs(), this->ControlPoints->GetLeafPairBoundaries(),
+      this->ControlPoints->GetLeafPositions(this->ControlPointIndex), this->ControlPoints->GetMLCDirection(),
+      beamModelPolyData );
+    return;
+  }
 
-    for (int i = 1; i <numPointsEachSide; i++)
+  vtkMRMLDoubleArrayNode* mlcArrayNode = this->GetMLCPositionDoubleArrayNode();
+  if (mlcArrayNode && mlcArrayNode->GetArray() && mlcArrayNode->GetArray()->GetNumberOfComponents() >= 2)
+  {
+    // Each tuple of the MLC position array contains the Y1 and Y2 side leaf positions of a leaf pair.
+    // Leaf pairs are MLC_ARRAY_LEAF_WIDTH wide, centered on the beam axis, the first one at the X2 side
+    vtkDoubleArray* mlcArray = mlcArrayNode->GetArray();
+    int numberOfLeafPairs = mlcArray->GetNumberOfTuples();
+    std::vector<double> leafPairBoundaries(numberOfLeafPairs + 1, 0.0);
+    std::vector<double> leafPositions(2 * numberOfLeafPairs, 0.0);
+    for (int boundaryIndex=0; boundaryIndex<=numberOfLeafPairs; ++boundaryIndex)
     {
-      cellArray->InsertNextCell(3);
-      cellArray->InsertCellPoint(0);
-      cellArray->InsertCellPoint(i);
-      cellArray->InsertCellPoint(i+1);
+      leafPairBoundaries[boundaryIndex] = (boundaryIndex - numberOfLeafPairs/2.0) * MLC_ARRAY_LEAF_WIDTH;
     }
-    // Add connection between Y2 and Y1
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(numPointsEachSide);
-    cellArray->InsertCellPoint(numPointsEachSide+1);
-    for (int i = numPointsEachSide+1; i <2*numPointsEachSide; i++)
+    for (int leafPair=0; leafPair<numberOfLeafPairs; ++leafPair)
     {
-      cellArray->InsertNextCell(3);
-      cellArray->InsertCellPoint(0);
-      cellArray->InsertCellPoint(i);
-      cellArray->InsertCellPoint(i+1);
+      int tupleIndex = numberOfLeafPairs - 1 - leafPair;
+      leafPositions[leafPair] = mlcArray->GetComponent(tupleIndex, 0);
+      leafPositions[numberOfLeafPairs + leafPair] = mlcArray->GetComponent(tupleIndex, 1);
     }
 
-    // Add connection between Y2 and Y1
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(2*numPointsEachSide);
-    cellArray->InsertCellPoint(1);
-
-    // Add the cap to the bottom
-    cellArray->InsertNextCell(2*numPointsEachSide);
-    for (int i = 1; i <= 2*numPointsEachSide; i++)
-    {
-      cellArray->InsertCellPoint(i);
-    }
-  }
-  else
-  {
-    points->InsertPoint(0,0,0,this->SAD);
-    points->InsertPoint(1, -2*this->Y2Jaw, -2*this->X2Jaw, -this->SAD );
-    points->InsertPoint(2, -2*this->Y2Jaw, -2*this->X1Jaw, -this->SAD );
-    points->InsertPoint(3, -2*this->Y1Jaw, -2*this->X1Jaw, -this->SAD );
-    points->InsertPoint(4, -2*this->Y1Jaw, -2*this->X2Jaw, -this->SAD );
-
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(1);
-    cellArray->InsertCellPoint(2);
-
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(2);
-    cellArray->InsertCellPoint(3);
-
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(3);
-    cellArray->InsertCellPoint(4);
-
-    cellArray->InsertNextCell(3);
-    cellArray->InsertCellPoint(0);
-    cellArray->InsertCellPoint(4);
-    cellArray->InsertCellPoint(1);
-
-    // Add the cap to the bottom
-    cellArray->InsertNextCell(4);
-    cellArray->InsertCellPoint(1);
-    cellArray->InsertCellPoint(2);
-    cellArray->InsertCellPoint(3);
-    cellArray->InsertCellPoint(4);
+    vtkBeamControlPointSequence::CreateAperturePolyData(this->SAD, jawPositions,
+      numberOfLeafPairs, (numberOfLeafPairs > 0 ? &leafPairBoundaries[0] : NULL), (numberOfLeafPairs > 0 ? &leafPositions[0] : NULL),
+      vtkBeamControlPointSequence::MLCY, beamModelPolyData );
+    return;
   }
 
-  beamModelPolyData->SetPoints(points);
-  beamModelPolyData->SetPolys(cellArray);
+  // Opening of the jaws only
+  vtkBeamControlPointSequence::CreateAperturePolyData(this->SAD, jawPositions,
+    0, NULL, NULL, vtkBeamControlPointSequence::MLCX, beamModelPolyData);
 }
 
 //---------------------------------------------------------------------------
@@ -28,6 +28,7 @@
 // MRML includes
 #include <vtkMRMLModelNode.h>
 
+class vtkBeamControlPointSequence;
 class vtkPolyData;
 class vtkMRMLScene;
 class vtkMRMLDoubleArrayNode;
@@ -94,6 +95,22 @@ public:
   /// clones the beam if exists
   void RequestCloning();
 
+  /// Start changing multiple beam parameters. The \sa BeamGeometryModified and \sa BeamTransformModified
+  /// events are collected until the matching \sa EndBeamModify call, which invokes each of them at most once,
+  /// so that the beam model and transform are updated only once. Calls can be nested.
+  void StartBeamModify();
+  /// Finish changing multiple beam parameters and invoke the collected update events
+  void EndBeamModify();
+  /// Return true if beam parameter changes are being collected by \sa StartBeamModify
+  bool IsBeamModifying() { return this->BeamModifyCount > 0; };
+
+  /// Request update of the beam model. Invokes \sa BeamGeometryModified, or defers it to
+  /// \sa EndBeamModify if the beam is being modified
+  void InvokeBeamGeometryModifiedEvent();
+  /// Request update of the beam transform. Invokes \sa BeamTransformModified, or defers it to
+  /// \sa EndBeamModify if the beam is being modified
+  void InvokeBeamTransformModifiedEvent();
+
 public:
   /// Get parent plan node
   vtkMRMLRTPlanNode* GetParentPlanNode();
@@ -179,6 +196,19 @@ public:
   /// Set beam weight
   vtkSetMacro(BeamWeight, double);
 
+  /// Get control points of the beam (NULL if the beam has no control points, such as a beam created in planning)
+  vtkGetObjectMacro(ControlPoints, vtkBeamControlPointSequence);
+  /// Set control points of the beam (e.g. a VMAT arc). The control points are not copied,
+  /// so beams cloned from each other share them. Applies the current control point (\sa SetControlPointIndex)
+  void SetControlPoints(vtkBeamControlPointSequence* controlPoints);
+
+  /// Get index of the control point that the beam parameters and model are taken from
+  vtkGetMacro(ControlPointIndex, int);
+  /// Set the control point that the beam parameters and model are taken from. Sets angles and jaw
+  /// positions from the control point, and the beam model is created from its MLC leaf positions.
+  /// Triggers \sa BeamTransformModified and \sa BeamGeometryModified events once
+  void SetControlPointIndex(int index);
+
 protected:
   /// Create beam model from beam parameters, supporting MLC leaves
   void CreateBeamPolyData(vtkPolyData* beamModelPolyData);
@@ -215,6 +245,23 @@ protected:
   double CollimatorAngle;
   /// Couch angle
   double CouchAngle;
+
+  /// Control points of the beam. Only the control point sequence is stored in the beam,
+  /// the aperture of a control point is created when needed
+  vtkBeamControlPointSequence* ControlPoints;
+  /// Index of the current control point in \sa ControlPoints
+  int ControlPointIndex;
+
+// Batched modification
+protected:
+  /// Nesting level of \sa StartBeamModify calls
+  int BeamModifyCount;
+  /// Modified event state of the node before the outermost \sa StartBeamModify call
+  int BeamModifyWasModifying;
+  /// Flag indicating that a geometry update was requested while the beam was being modified
+  bool BeamGeometryModifiedPending;
+  /// Flag indicating that a transform update was requested while the beam was being modified
+  bool BeamTransformModifiedPending;
 };
 
 #endif // __vtkMRMLRTBeamNode_h
@@ -75,6 +75,10 @@ vtkMRMLRTPlanNode::vtkMRMLRTPlanNode()
   this->DoseGrid[0] = 0;
   this->DoseGrid[1] = 0;
   this->DoseGrid[2] = 0;
+
+  this->BeamsModifyCount = 0;
+  this->ModifiedBeams = vtkCollection::New();
+  this->IsocenterModifiedPending = false;
 }
 
 //----------------------------------------------------------------------------
@@ -82,6 +86,12 @@ vtkMRMLRTPlanNode::~vtkMRMLRTPlanNode()
 {
   this->SetTargetSegmentID(NULL);
   this->SetDoseEngineName(NULL);
+
+  if (this->ModifiedBeams)
+  {
+    this->ModifiedBeams->Delete();
+    this->ModifiedBeams = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -248,6 +258,12 @@ void vtkMRMLRTPlanNode::ProcessMRMLEvents(vtkObject *caller, unsigned long event
   if ( eventID == vtkMRMLMarkupsNode::PointModifiedEvent
     && caller == this->GetPoisMarkupsFiducialNode() )
   {
+    if (this->BeamsModifyCount > 0)
+    {
+      this->IsocenterModifiedPending = true;
+      return;
+    }
+
     // Update the model
     this->InvokeCustomModifiedEvent(vtkMRMLRTPlanNode::IsocenterModifiedEvent);
   }
@@ -602,6 +618,13 @@ void vtkMRMLRTPlanNode::AddBeam(vtkMRMLRTBeamNode* beamNode)
   // Set the beam number
   beamNode->SetBeamNumber(this->NextBeamNumber++);
 
+  // Include beam in the ongoing modification so that it is only updated when it ends
+  if (this->BeamsModifyCount > 0 && !this->ModifiedBeams->IsItemPresent(beamNode))
+  {
+    beamNode->StartBeamModify();
+    this->ModifiedBeams->AddItem(beamNode);
+  }
+
   // Add beam node in the right subject hierarchy branch
   shNode->CreateItem(planShItemID, beamNode);
 
@@ -619,6 +642,13 @@ void vtkMRMLRTPlanNode::RemoveBeam(vtkMRMLRTBeamNode* beamNode)
     return;
   }
 
+  // Finish modification of the beam while it is still in the scene
+  if (this->ModifiedBeams->IsItemPresent(beamNode))
+  {
+    this->ModifiedBeams->RemoveItem(beamNode);
+    beamNode->EndBeamModify();
+  }
+
   // Fire beam added event (do it first so that operations can be performed with beam while exists)
   this->InvokeEvent(vtkMRMLRTPlanNode::BeamRemoved, (void*)beamNode->GetID());
 
@@ -645,6 +675,60 @@ void vtkMRMLRTPlanNode::RemoveAllBeams()
   this->InvokePendingModifiedEvent();
 }
 
+//---------------------------------------------------------------------------
+void vtkMRMLRTPlanNode::StartBeamsModify()
+{
+  if (this->BeamsModifyCount++ > 0)
+  {
+    return;
+  }
+
+  std::vector<vtkMRMLRTBeamNode*> beams;
+  this->GetBeams(beams);
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+  {
+    vtkMRMLRTBeamNode* beamNode = (*beamIt);
+    beamNode->StartBeamModify();
+    this->ModifiedBeams->AddItem(beamNode);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLRTPlanNode::EndBeamsModify()
+{
+  if (this->BeamsModifyCount <= 0)
+  {
+    vtkErrorMacro("EndBeamsModify: No matching StartBeamsModify call for plan " << (this->Name ? this->Name : ""));
+    return;
+  }
+  if (--this->BeamsModifyCount > 0)
+  {
+    return;
+  }
+
+  // Invoke isocenter event while the beams are still being modified, so that the
+  // transform updates it requests are merged with the ones from the beam parameter changes
+  if (this->IsocenterModifiedPending)
+  {
+    this->IsocenterModifiedPending = false;
+    this->InvokeCustomModifiedEvent(vtkMRMLRTPlanNode::IsocenterModifiedEvent);
+  }
+
+  // Detach the beams from the collection first, as observers may add or remove beams
+  vtkSmartPointer<vtkCollection> modifiedBeams = vtkSmartPointer<vtkCollection>::New();
+  for (int i=0; i<this->ModifiedBeams->GetNumberOfItems(); ++i)
+  {
+    modifiedBeams->AddItem(this->ModifiedBeams->GetItemAsObject(i));
+  }
+  this->ModifiedBeams->RemoveAllItems();
+
+  for (int i=0; i<modifiedBeams->GetNumberOfItems(); ++i)
+  {
+    vtkMRMLRTBeamNode* beamNode = vtkMRMLRTBeamNode::SafeDownCast(modifiedBeams->GetItemAsObject(i));
+    beamNode->EndBeamModify();
+  }
+}
+
 //---------------------------------------------------------------------------
 vtkIdType vtkMRMLRTPlanNode::GetPlanSubjectHierarchyItemID()
 {
@@ -100,6 +100,13 @@ public:
   /// Remove all beam nodes from plan
   void RemoveAllBeams();
 
+  /// Start changing parameters of multiple beams or the isocenter. Calls \sa vtkMRMLRTBeamNode::StartBeamModify
+  /// on all beams of the plan (including the ones added before \sa EndBeamsModify), and defers
+  /// \sa IsocenterModifiedEvent, so that each beam is updated only once at the end. Calls can be nested.
+  void StartBeamsModify();
+  /// Finish changing beam parameters. Invokes the deferred isocenter event, then ends the modification of the beams
+  void EndBeamsModify();
+
   /// Generate new beam name from new beam name prefix and next beam number
   std::string GenerateNewBeamName();
 
@@ -213,6 +220,13 @@ protected:
   ///TODO: Allow user to specify dose volume resolution different from reference volume
   /// (currently output dose volume has the same spacing as the reference anatomy)
   double DoseGrid[3];
+
+  /// Nesting level of \sa StartBeamsModify calls
+  int BeamsModifyCount;
+  /// Beams on which \sa vtkMRMLRTBeamNode::StartBeamModify was called by \sa StartBeamsModify
+  vtkCollection* ModifiedBeams;
+  /// Flag indicating that the isocenter changed while the beams were being modified
+  bool IsocenterModifiedPending;
 };
 
 #endif // __vtkMRMLRTPlanNode_h
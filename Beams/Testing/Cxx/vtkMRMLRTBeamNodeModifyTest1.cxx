@@ -0,0 +1,280 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Beams includes
+#include "vtkMRMLRTBeamNode.h"
+#include "vtkMRMLRTPlanNode.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <map>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Records the events invoked by the observed nodes
+  struct EventRecorder
+  {
+    /// Number of invocations per observed object and event
+    std::map<vtkObject*, std::map<unsigned long, int> > Counts;
+    /// Events in the order of invocation
+    std::vector<unsigned long> Order;
+
+    int GetCount(vtkObject* caller, unsigned long event)
+    {
+      return this->Counts[caller][event];
+    }
+    void Reset()
+    {
+      this->Counts.clear();
+      this->Order.clear();
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  void RecordEvent(vtkObject* caller, unsigned long event, void* clientData, void* vtkNotUsed(callData))
+  {
+    EventRecorder* recorder = reinterpret_cast<EventRecorder*>(clientData);
+    recorder->Counts[caller][event]++;
+    recorder->Order.push_back(event);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Request transform update of all beams of the plan on isocenter change, as External Beam Planning does
+  void UpdateBeamTransformsOnIsocenterModified(vtkObject* caller, unsigned long vtkNotUsed(event), void* vtkNotUsed(clientData), void* vtkNotUsed(callData))
+  {
+    vtkMRMLRTPlanNode* planNode = vtkMRMLRTPlanNode::SafeDownCast(caller);
+    std::vector<vtkMRMLRTBeamNode*> beams;
+    planNode->GetBeams(beams);
+    for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+    {
+      (*beamIt)->InvokeBeamTransformModifiedEvent();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ObserveBeam(vtkMRMLRTBeamNode* beamNode, vtkCallbackCommand* callback)
+  {
+    beamNode->AddObserver(vtkCommand::ModifiedEvent, callback);
+    beamNode->AddObserver(vtkMRMLRTBeamNode::BeamGeometryModified, callback);
+    beamNode->AddObserver(vtkMRMLRTBeamNode::BeamTransformModified, callback);
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckBeamEventCounts(EventRecorder& recorder, vtkMRMLRTBeamNode* beamNode,
+    int expectedGeometryCount, int expectedTransformCount, int line)
+  {
+    int geometryCount = recorder.GetCount(beamNode, vtkMRMLRTBeamNode::BeamGeometryModified);
+    int transformCount = recorder.GetCount(beamNode, vtkMRMLRTBeamNode::BeamTransformModified);
+    if (geometryCount != expectedGeometryCount || transformCount != expectedTransformCount)
+    {
+      std::cerr << line << ": Beam " << beamNode->GetName() << " invoked " << geometryCount << " BeamGeometryModified and "
+        << transformCount << " BeamTransformModified events instead of " << expectedGeometryCount << " and " << expectedTransformCount << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLRTBeamNodeModifyTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  if (!vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene))
+  {
+    std::cerr << __LINE__ << ": Failed to access subject hierarchy node" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  EventRecorder recorder;
+  vtkNew<vtkCallbackCommand> recordCallback;
+  recordCallback->SetClientData(&recorder);
+  recordCallback->SetCallback(RecordEvent);
+
+  //
+  // Beam modify scope
+
+  vtkSmartPointer<vtkMRMLRTBeamNode> beamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  beamNode->SetName("Beam");
+  mrmlScene->AddNode(beamNode);
+  ObserveBeam(beamNode, recordCallback.GetPointer());
+
+  // Without a scope every setter invokes its update event
+  beamNode->SetX1Jaw(-50.0);
+  beamNode->SetGantryAngle(10.0);
+  if (!CheckBeamEventCounts(recorder, beamNode, 1, 1, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+  recorder.Reset();
+
+  // Change all geometry and transform parameters, with a nested scope
+  beamNode->StartBeamModify();
+  beamNode->SetX1Jaw(-60.0);
+  beamNode->SetX2Jaw(60.0);
+  beamNode->SetY1Jaw(-70.0);
+  beamNode->SetY2Jaw(70.0);
+  beamNode->SetSAD(1000.0);
+  beamNode->StartBeamModify();
+  beamNode->SetGantryAngle(90.0);
+  beamNode->SetCollimatorAngle(15.0);
+  beamNode->SetCouchAngle(5.0);
+  beamNode->EndBeamModify();
+  if (!beamNode->IsBeamModifying() || !recorder.Order.empty())
+  {
+    std::cerr << __LINE__ << ": Events were invoked before the outermost EndBeamModify call" << std::endl;
+    return EXIT_FAILURE;
+  }
+  beamNode->EndBeamModify();
+
+  if (beamNode->IsBeamModifying())
+  {
+    std::cerr << __LINE__ << ": Beam is still being modified after the outermost EndBeamModify call" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckBeamEventCounts(recorder, beamNode, 1, 1, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+  if (recorder.GetCount(beamNode, vtkCommand::ModifiedEvent) != 1)
+  {
+    std::cerr << __LINE__ << ": Beam invoked " << recorder.GetCount(beamNode, vtkCommand::ModifiedEvent)
+      << " modified events instead of 1" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Observers see the final parameters first, then the transform is updated before the model
+  if (recorder.Order.size() != 3)
+  {
+    std::cerr << __LINE__ << ": Beam invoked " << recorder.Order.size() << " events instead of 3" << std::endl;
+    return EXIT_FAILURE;
+  }
+  unsigned long expectedOrder[3] = { vtkCommand::ModifiedEvent, vtkMRMLRTBeamNode::BeamTransformModified, vtkMRMLRTBeamNode::BeamGeometryModified };
+  for (int eventIndex=0; eventIndex<3; ++eventIndex)
+  {
+    if (recorder.Order[eventIndex] != expectedOrder[eventIndex])
+    {
+      std::cerr << __LINE__ << ": Event " << eventIndex << " is " << recorder.Order[eventIndex] << " instead of " << expectedOrder[eventIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  recorder.Reset();
+
+  // Scope without geometry changes only updates the transform
+  beamNode->StartBeamModify();
+  beamNode->SetGantryAngle(180.0);
+  beamNode->SetCouchAngle(0.0);
+  beamNode->EndBeamModify();
+  if (!CheckBeamEventCounts(recorder, beamNode, 0, 1, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+  recorder.Reset();
+
+  //
+  // Plan modify scope
+
+  vtkSmartPointer<vtkMRMLRTPlanNode> planNode = vtkSmartPointer<vtkMRMLRTPlanNode>::New();
+  planNode->SetName("Plan");
+  mrmlScene->AddNode(planNode);
+  // Create POIs markups node before observing, so that only the isocenter change is recorded
+  if (!planNode->GetPoisMarkupsFiducialNode())
+  {
+    std::cerr << __LINE__ << ": Failed to create POIs markups node for plan" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkMRMLRTBeamNode> firstBeamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  firstBeamNode->SetName("FirstBeam");
+  mrmlScene->AddNode(firstBeamNode);
+  planNode->AddBeam(firstBeamNode);
+  vtkSmartPointer<vtkMRMLRTBeamNode> secondBeamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  secondBeamNode->SetName("SecondBeam");
+  mrmlScene->AddNode(secondBeamNode);
+  planNode->AddBeam(secondBeamNode);
+  vtkSmartPointer<vtkMRMLRTBeamNode> addedBeamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  addedBeamNode->SetName("AddedBeam");
+  mrmlScene->AddNode(addedBeamNode);
+
+  ObserveBeam(firstBeamNode, recordCallback.GetPointer());
+  ObserveBeam(secondBeamNode, recordCallback.GetPointer());
+  ObserveBeam(addedBeamNode, recordCallback.GetPointer());
+  vtkNew<vtkCallbackCommand> isocenterCallback;
+  isocenterCallback->SetCallback(UpdateBeamTransformsOnIsocenterModified);
+  planNode->AddObserver(vtkMRMLRTPlanNode::IsocenterModifiedEvent, isocenterCallback.GetPointer());
+  planNode->AddObserver(vtkMRMLRTPlanNode::IsocenterModifiedEvent, recordCallback.GetPointer());
+
+  // Move the isocenter, change parameters of the existing beams, and add a beam within the scope
+  planNode->StartBeamsModify();
+  double isocenter[3] = { 10.0, 20.0, 30.0 };
+  planNode->SetIsocenterPosition(isocenter);
+  firstBeamNode->SetGantryAngle(45.0);
+  firstBeamNode->SetCollimatorAngle(30.0);
+  secondBeamNode->SetX1Jaw(-30.0);
+  secondBeamNode->SetY2Jaw(40.0);
+  isocenter[0] = 15.0;
+  planNode->SetIsocenterPosition(isocenter);
+  planNode->AddBeam(addedBeamNode);
+  addedBeamNode->SetX2Jaw(80.0);
+  addedBeamNode->SetGantryAngle(270.0);
+  if ( recorder.GetCount(planNode, vtkMRMLRTPlanNode::IsocenterModifiedEvent) != 0
+    || !CheckBeamEventCounts(recorder, firstBeamNode, 0, 0, __LINE__)
+    || !CheckBeamEventCounts(recorder, secondBeamNode, 0, 0, __LINE__)
+    || !CheckBeamEventCounts(recorder, addedBeamNode, 0, 0, __LINE__) )
+  {
+    std::cerr << __LINE__ << ": Update events were invoked before the EndBeamsModify call" << std::endl;
+    return EXIT_FAILURE;
+  }
+  planNode->EndBeamsModify();
+
+  if (recorder.GetCount(planNode, vtkMRMLRTPlanNode::IsocenterModifiedEvent) != 1)
+  {
+    std::cerr << __LINE__ << ": Plan invoked " << recorder.GetCount(planNode, vtkMRMLRTPlanNode::IsocenterModifiedEvent)
+      << " isocenter modified events instead of 1" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Every beam follows the isocenter, so each transform is updated once
+  if ( !CheckBeamEventCounts(recorder, firstBeamNode, 0, 1, __LINE__)
+    || !CheckBeamEventCounts(recorder, secondBeamNode, 1, 1, __LINE__)
+    || !CheckBeamEventCounts(recorder, addedBeamNode, 1, 1, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+  if (firstBeamNode->IsBeamModifying() || secondBeamNode->IsBeamModifying() || addedBeamNode->IsBeamModifying())
+  {
+    std::cerr << __LINE__ << ": Beams are still being modified after the EndBeamsModify call" << std::endl;
+    return EXIT_FAILURE;
+  }
+  recorder.Reset();
+
+  // Events are invoked immediately again after the scope
+  secondBeamNode->SetX2Jaw(35.0);
+  if (!CheckBeamEventCounts(recorder, secondBeamNode, 1, 0, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Beam modify scope test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
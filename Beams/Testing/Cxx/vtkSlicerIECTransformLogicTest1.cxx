@@ -258,6 +258,69 @@ int vtkSlicerIECTransformLogicTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)
     return EXIT_FAILURE;
     }
 
+  //
+  // Test composed matrices between coordinate frames
+
+  vtkSmartPointer<vtkMatrix4x4> beamTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> collimatorToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> rasToCollimatorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  beamTransformNode->GetMatrixTransformToParent(beamTransformMatrix);
+  if ( !iecLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::RAS, collimatorToRasMatrix)
+    || !IsEqual(collimatorToRasMatrix, beamTransformMatrix) )
+    {
+    std::cerr << __LINE__ << ": Collimator to RAS matrix does not match beam transform" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  vtkSmartPointer<vtkMatrix4x4> identityMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> roundTripMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  iecLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::RAS, vtkSlicerIECTransformLogic::Collimator, rasToCollimatorMatrix);
+  vtkMatrix4x4::Multiply4x4(rasToCollimatorMatrix, collimatorToRasMatrix, roundTripMatrix);
+  if (!IsEqual(roundTripMatrix, identityMatrix))
+    {
+    std::cerr << __LINE__ << ": RAS to collimator matrix is not the inverse of collimator to RAS" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Gantry rotation invalidates the cached collimator to RAS matrix
+  vtkSmartPointer<vtkMatrix4x4> collimatorToRasMatrixBeforeRotation = vtkSmartPointer<vtkMatrix4x4>::New();
+  collimatorToRasMatrixBeforeRotation->DeepCopy(collimatorToRasMatrix);
+  beamNode->SetGantryAngle(180.0);
+  iecLogic->UpdateBeamTransform(beamNode);
+  iecLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::RAS, collimatorToRasMatrix);
+  if (IsEqual(collimatorToRasMatrix, collimatorToRasMatrixBeforeRotation))
+    {
+    std::cerr << __LINE__ << ": Collimator to RAS matrix did not change after gantry rotation" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Compare to the matrix composed by MRML along the transform hierarchy, independently from the cache
+  vtkSmartPointer<vtkMatrix4x4> collimatorToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMRMLTransformNode::GetMatrixTransformBetweenNodes(
+    iecLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry),
+    NULL, collimatorToWorldMatrix );
+  if (!IsEqual(collimatorToRasMatrix, collimatorToWorldMatrix))
+    {
+    std::cerr << __LINE__ << ": Collimator to RAS matrix does not match transform hierarchy after gantry rotation" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  vtkSmartPointer<vtkMatrix4x4> expectedCollimatorToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  double expectedCollimatorToRas_Gantry180_Collimator90_MatrixElements[16] =
+    {  0, -1, 0, 1000,   0, 0, -1, 200,   1, 0, 0, 0,   0, 0, 0, 1  };
+  expectedCollimatorToRasMatrix->DeepCopy(expectedCollimatorToRas_Gantry180_Collimator90_MatrixElements);
+  if (!IsEqual(collimatorToRasMatrix, expectedCollimatorToRasMatrix))
+    {
+    std::cerr << __LINE__ << ": Collimator to RAS matrix does not match baseline for gantry 180 and collimator 90 degree angles" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if ( !IsTransformMatrixEqualTo(mrmlScene,
+      beamTransformNode, expectedCollimatorToRas_Gantry180_Collimator90_MatrixElements ) )
+    {
+    std::cerr << __LINE__ << ": Beam transform does not match baseline for gantry 180 and collimator 90 degree angles" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   //TODO: Test code to print all non-identity transforms (useful to add more test cases)
   //std::cout << "ZZZ after collimator angle 90:" << std::endl;
   //PrintLinearTransformNodeMatrices(mrmlScene, false, true);
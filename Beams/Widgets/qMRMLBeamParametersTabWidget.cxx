@@ -658,9 +658,11 @@ void qMRMLBeamParametersTabWidget::xJawsPositionValuesChanged(double minVal, dou
     return;
   }
 
-  // Do not disable modifier events as geometry need to be updated
+  // Update geometry once for both jaws
+  d->BeamNode->StartBeamModify();
   d->BeamNode->SetX1Jaw(minVal);
   d->BeamNode->SetX2Jaw(maxVal);
+  d->BeamNode->EndBeamModify();
 }
 
 //-----------------------------------------------------------------------------
@@ -674,9 +676,11 @@ void qMRMLBeamParametersTabWidget::yJawsPositionValuesChanged(double minVal, dou
     return;
   }
 
-  // Do not disable modifier events as geometry need to be updated
+  // Update geometry once for both jaws
+  d->BeamNode->StartBeamModify();
   d->BeamNode->SetY1Jaw(minVal);
   d->BeamNode->SetY2Jaw(maxVal);
+  d->BeamNode->EndBeamModify();
 }
 
 //-----------------------------------------------------------------------------
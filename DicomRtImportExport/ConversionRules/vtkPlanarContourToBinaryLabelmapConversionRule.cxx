@@ -0,0 +1,436 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+#include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkIdList.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Maximum deviation of contour points from the plane of the contour (in slices)
+  /// for the contour to be considered parallel to the slices of the reference geometry
+  const double PLANE_TOLERANCE = 0.05;
+
+  typedef vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane ContourPlane;
+
+  bool CompareContourPlanes(const ContourPlane& a, const ContourPlane& b)
+  {
+    return a.K < b.K;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Transform the contours to the IJK coordinate system of the reference geometry and sort them into planes.
+  /// \return False if a contour is not parallel to the slices of the reference geometry
+  bool TransformContoursToPlanes(vtkPolyData* planarContourPolyData, vtkMatrix4x4* worldToImageMatrix,
+    std::vector<ContourPlane>& contourPlanes, double contourBounds[6])
+  {
+    contourPlanes.clear();
+    for (int axis=0; axis<3; ++axis)
+    {
+      contourBounds[2*axis] = VTK_DOUBLE_MAX;
+      contourBounds[2*axis+1] = VTK_DOUBLE_MIN;
+    }
+
+    vtkSmartPointer<vtkIdList> cellPointIds = vtkSmartPointer<vtkIdList>::New();
+    std::vector<double> contourPoints_IJK;
+    for (vtkIdType cellId=0; cellId<planarContourPolyData->GetNumberOfCells(); ++cellId)
+    {
+      planarContourPolyData->GetCellPoints(cellId, cellPointIds);
+      vtkIdType numberOfPoints = cellPointIds->GetNumberOfIds();
+      if (numberOfPoints < 3)
+      {
+        continue;
+      }
+
+      contourPoints_IJK.resize(3*numberOfPoints);
+      double sumK = 0.0;
+      for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+      {
+        double point_World[4] = {0.0, 0.0, 0.0, 1.0};
+        planarContourPolyData->GetPoint(cellPointIds->GetId(pointIndex), point_World);
+        double point_IJK[4] = {0.0, 0.0, 0.0, 1.0};
+        worldToImageMatrix->MultiplyPoint(point_World, point_IJK);
+        for (int axis=0; axis<3; ++axis)
+        {
+          contourPoints_IJK[3*pointIndex+axis] = point_IJK[axis];
+          contourBounds[2*axis] = std::min(contourBounds[2*axis], point_IJK[axis]);
+          contourBounds[2*axis+1] = std::max(contourBounds[2*axis+1], point_IJK[axis]);
+        }
+        sumK += point_IJK[2];
+      }
+      double contourK = sumK / numberOfPoints;
+      for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+      {
+        if (fabs(contourPoints_IJK[3*pointIndex+2] - contourK) > PLANE_TOLERANCE)
+        {
+          return false;
+        }
+      }
+
+      // Find plane of the contour, add new plane if not found
+      ContourPlane* contourPlane = NULL;
+      for (std::vector<ContourPlane>::iterator planeIt = contourPlanes.begin(); planeIt != contourPlanes.end(); ++planeIt)
+      {
+        if (fabs(planeIt->K - contourK) <= PLANE_TOLERANCE)
+        {
+          contourPlane = &(*planeIt);
+          break;
+        }
+      }
+      if (!contourPlane)
+      {
+        contourPlanes.push_back(ContourPlane());
+        contourPlane = &contourPlanes.back();
+        contourPlane->K = contourK;
+      }
+
+      // Add edges. The contour is closed whether or not the last point repeats the first one
+      contourPlane->ContourStarts.push_back(contourPlane->Edges.size());
+      for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+      {
+        vtkIdType nextPointIndex = (pointIndex+1) % numberOfPoints;
+        contourPlane->Edges.push_back(contourPoints_IJK[3*pointIndex]);
+        contourPlane->Edges.push_back(contourPoints_IJK[3*pointIndex+1]);
+        contourPlane->Edges.push_back(contourPoints_IJK[3*nextPointIndex]);
+        contourPlane->Edges.push_back(contourPoints_IJK[3*nextPointIndex+1]);
+      }
+    }
+
+    std::sort(contourPlanes.begin(), contourPlanes.end(), CompareContourPlanes);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Most frequent distance of neighboring contour planes (in slices). Default spacing is returned
+  /// if there is only one plane
+  double ComputeContourPlaneSpacing(const std::vector<ContourPlane>& contourPlanes, double defaultSpacing)
+  {
+    std::map<int, int> spacingFrequencies;
+    for (unsigned int planeIndex=1; planeIndex<contourPlanes.size(); ++planeIndex)
+    {
+      double spacing = contourPlanes[planeIndex].K - contourPlanes[planeIndex-1].K;
+      spacingFrequencies[vtkMath::Round(spacing / PLANE_TOLERANCE)]++;
+    }
+    int majoritySpacing = -1;
+    int majorityCount = 0;
+    for (std::map<int, int>::iterator spacingIt = spacingFrequencies.begin(); spacingIt != spacingFrequencies.end(); ++spacingIt)
+    {
+      if (spacingIt->second > majorityCount)
+      {
+        majoritySpacing = spacingIt->first;
+        majorityCount = spacingIt->second;
+      }
+    }
+    return (majorityCount > 0 ? majoritySpacing * PLANE_TOLERANCE : defaultSpacing);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Fill slices of the labelmap from their assigned contour plane by scanline filling with the even-odd rule.
+  /// Voxels are set if their center is inside.
+  class FillSlicesFunctor
+  {
+  public:
+    FillSlicesFunctor(const std::vector<ContourPlane>& contourPlanes, const std::vector<int>& slicePlaneIndices, vtkOrientedImageData* binaryLabelmap)
+      : ContourPlanes(contourPlanes)
+      , SlicePlaneIndices(slicePlaneIndices)
+      , BinaryLabelmap(binaryLabelmap)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      int extent[6] = {0,-1,0,-1,0,-1};
+      this->BinaryLabelmap->GetExtent(extent);
+      vtkIdType rowSize = extent[1]-extent[0]+1;
+      vtkIdType sliceSize = rowSize * (extent[3]-extent[2]+1);
+      unsigned char* scalars = static_cast<unsigned char*>(this->BinaryLabelmap->GetScalarPointer());
+
+      std::vector<double> crossings;
+      for (vtkIdType slice=beginSlice; slice<endSlice; ++slice)
+      {
+        int planeIndex = this->SlicePlaneIndices[slice];
+        if (planeIndex < 0)
+        {
+          continue;
+        }
+        const std::vector<double>& edges = this->ContourPlanes[planeIndex].Edges;
+        unsigned char* slicePtr = scalars + slice*sliceSize;
+
+        for (int j=extent[2]; j<=extent[3]; ++j)
+        {
+          // Crossings of the row with the edges. Edges are half-open in J so that vertices on the row are counted once
+          crossings.clear();
+          for (size_t edgeIndex=0; edgeIndex+3<edges.size(); edgeIndex+=4)
+          {
+            double i0 = edges[edgeIndex];
+            double j0 = edges[edgeIndex+1];
+            double i1 = edges[edgeIndex+2];
+            double j1 = edges[edgeIndex+3];
+            if ((j0 <= j) != (j1 <= j))
+            {
+              crossings.push_back(i0 + (j-j0) * (i1-i0) / (j1-j0));
+            }
+          }
+          if (crossings.size() < 2)
+          {
+            continue;
+          }
+          std::sort(crossings.begin(), crossings.end());
+
+          unsigned char* rowPtr = slicePtr + (j-extent[2])*rowSize;
+          for (size_t crossingIndex=0; crossingIndex+1<crossings.size(); crossingIndex+=2)
+          {
+            int firstI = std::max(extent[0], (int)ceil(crossings[crossingIndex]));
+            int lastI = std::min(extent[1], (int)ceil(crossings[crossingIndex+1])-1);
+            for (int i=firstI; i<=lastI; ++i)
+            {
+              rowPtr[i-extent[0]] = 1;
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& ContourPlanes;
+    const std::vector<int>& SlicePlaneIndices;
+    vtkOrientedImageData* BinaryLabelmap;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToBinaryLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+  this->ConversionParameters[vtkSegmentationConverter::GetReferenceImageGeometryParameterName()] = std::make_pair("",
+    "Image geometry description string determining the geometry of the labelmap that is created in course of conversion.");
+  this->ConversionParameters[vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
+    "Default thickness for contours if slice spacing cannot be calculated.");
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::~vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToBinaryLabelmapConversionRule::GetConversionCost(vtkDataObject* vtkNotUsed(sourceRepresentation)/*=NULL*/, vtkDataObject* vtkNotUsed(targetRepresentation)/*=NULL*/)
+{
+  // Rough input-independent guess (ms), less than the ribbon model path
+  return 100;
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkPlanarContourToBinaryLabelmapConversionRule::ConstructRepresentationObjectByRepresentation(std::string representationName)
+{
+  if (!representationName.compare(this->GetSourceRepresentationName()))
+  {
+    return (vtkDataObject*)vtkPolyData::New();
+  }
+  else if (!representationName.compare(this->GetTargetRepresentationName()))
+  {
+    return (vtkDataObject*)vtkOrientedImageData::New();
+  }
+  else
+  {
+    return NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkPlanarContourToBinaryLabelmapConversionRule::ConstructRepresentationObjectByClass(std::string className)
+{
+  if (!className.compare("vtkPolyData"))
+  {
+    return (vtkDataObject*)vtkPolyData::New();
+  }
+  else if (!className.compare("vtkOrientedImageData"))
+  {
+    return (vtkDataObject*)vtkOrientedImageData::New();
+  }
+  else
+  {
+    return NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  std::vector<ContourPlane> contourPlanes;
+  double contourBounds_IJK[6] = {0.0, -1.0, 0.0, -1.0, 0.0, -1.0};
+  double planeSpacing = 1.0;
+  if (!this->ComputeContourPlanes(planarContourPolyData, imageToWorldMatrix, contourPlanes, contourBounds_IJK, planeSpacing))
+  {
+    vtkDebugMacro("Convert: No reference geometry or contours are not parallel to its slices, using ribbon model");
+    return this->ConvertUsingRibbonModel(planarContourPolyData, binaryLabelmap);
+  }
+
+  // Each slice is filled from the nearest contour plane if it is within half of the plane spacing
+  double halfPlaneSpacing = 0.5 * planeSpacing + PLANE_TOLERANCE;
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  if (!contourPlanes.empty())
+  {
+    extent[0] = (int)ceil(contourBounds_IJK[0]);
+    extent[1] = (int)floor(contourBounds_IJK[1]);
+    extent[2] = (int)ceil(contourBounds_IJK[2]);
+    extent[3] = (int)floor(contourBounds_IJK[3]);
+    extent[4] = (int)ceil(contourPlanes.front().K - halfPlaneSpacing);
+    extent[5] = (int)floor(contourPlanes.back().K + halfPlaneSpacing);
+  }
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    extent[0] = extent[2] = extent[4] = 0;
+    extent[1] = extent[3] = extent[5] = -1;
+  }
+
+  binaryLabelmap->SetExtent(extent);
+  binaryLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  binaryLabelmap->SetImageToWorldMatrix(imageToWorldMatrix);
+  if (extent[0] > extent[1])
+  {
+    return true;
+  }
+  unsigned char* scalars = static_cast<unsigned char*>(binaryLabelmap->GetScalarPointer());
+  memset(scalars, 0, binaryLabelmap->GetNumberOfPoints() * sizeof(unsigned char));
+
+  // Assign contour planes to slices
+  std::vector<int> slicePlaneIndices(extent[5]-extent[4]+1, -1);
+  ContourPlane slicePlane;
+  for (int k=extent[4]; k<=extent[5]; ++k)
+  {
+    slicePlane.K = k;
+    std::vector<ContourPlane>::iterator nextPlaneIt = std::lower_bound(
+      contourPlanes.begin(), contourPlanes.end(), slicePlane, CompareContourPlanes );
+    int nearestPlaneIndex = -1;
+    double nearestDistance = halfPlaneSpacing;
+    if (nextPlaneIt != contourPlanes.end() && nextPlaneIt->K - k <= nearestDistance)
+    {
+      nearestPlaneIndex = nextPlaneIt - contourPlanes.begin();
+      nearestDistance = nextPlaneIt->K - k;
+    }
+    if (nextPlaneIt != contourPlanes.begin() && k - (nextPlaneIt-1)->K < nearestDistance)
+    {
+      nearestPlaneIndex = (nextPlaneIt-1) - contourPlanes.begin();
+    }
+    slicePlaneIndices[k-extent[4]] = nearestPlaneIndex;
+  }
+
+  FillSlicesFunctor functor(contourPlanes, slicePlaneIndices, binaryLabelmap);
+  vtkSMPTools::For(0, (vtkIdType)slicePlaneIndices.size(), functor);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::ComputeContourPlanes(vtkPolyData* planarContourPolyData, vtkMatrix4x4* imageToWorldMatrix,
+  std::vector<ContourPlane>& contourPlanes, double contourBounds[6], double& planeSpacing)
+{
+  if (!planarContourPolyData || !imageToWorldMatrix)
+  {
+    return false;
+  }
+
+  std::string geometryString = this->ConversionParameters[vtkSegmentationConverter::GetReferenceImageGeometryParameterName()].first;
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  if (geometryString.empty() || !vtkSegmentationConverter::DeserializeImageGeometry(geometryString, imageToWorldMatrix, referenceExtent))
+  {
+    return false;
+  }
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(imageToWorldMatrix, worldToImageMatrix);
+
+  if (!TransformContoursToPlanes(planarContourPolyData, worldToImageMatrix, contourPlanes, contourBounds))
+  {
+    return false;
+  }
+
+  // The default slice thickness is used if there is only one contour plane
+  double sliceSpacing = sqrt( imageToWorldMatrix->GetElement(0,2)*imageToWorldMatrix->GetElement(0,2)
+    + imageToWorldMatrix->GetElement(1,2)*imageToWorldMatrix->GetElement(1,2)
+    + imageToWorldMatrix->GetElement(2,2)*imageToWorldMatrix->GetElement(2,2) );
+  double defaultSliceThickness = atof(this->ConversionParameters[
+    vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName()].first.c_str() );
+  double defaultPlaneSpacing = (defaultSliceThickness > 0.0 && sliceSpacing > 0.0 ? defaultSliceThickness / sliceSpacing : 1.0);
+  planeSpacing = ComputeContourPlaneSpacing(contourPlanes, defaultPlaneSpacing);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::ConvertUsingRibbonModel(vtkPolyData* planarContourPolyData, vtkOrientedImageData* binaryLabelmap)
+{
+  vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule> ribbonModelRule =
+    vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New();
+  vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule> rasterizerRule =
+    vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule>::New();
+  for (ConversionParameterListType::iterator parameterIt = this->ConversionParameters.begin();
+    parameterIt != this->ConversionParameters.end(); ++parameterIt)
+  {
+    rasterizerRule->SetConversionParameter(parameterIt->first, parameterIt->second.first);
+  }
+
+  vtkSmartPointer<vtkPolyData> ribbonModel = vtkSmartPointer<vtkPolyData>::New();
+  if (!ribbonModelRule->Convert(planarContourPolyData, ribbonModel))
+  {
+    vtkErrorMacro("ConvertUsingRibbonModel: Failed to create ribbon model");
+    return false;
+  }
+  return rasterizerRule->Convert(ribbonModel, binaryLabelmap);
+}
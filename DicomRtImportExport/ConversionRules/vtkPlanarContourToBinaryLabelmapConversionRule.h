@@ -0,0 +1,113 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToBinaryLabelmapConversionRule_h
+#define __vtkPlanarContourToBinaryLabelmapConversionRule_h
+
+// SegmentationCore includes
+#include "vtkSegmentationConverterRule.h"
+#include "vtkSegmentationConverter.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+class vtkMatrix4x4;
+class vtkOrientedImageData;
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to binary
+///   labelmap representation (vtkOrientedImageData type) without building a mesh.
+///   Each image slice of the reference geometry is filled from the nearest contour plane
+///   (within half of the contour plane spacing) by scanline polygon filling using the
+///   even-odd rule, so that inner contours of a plane make holes. Slices are filled in parallel.
+///   If the contours are not parallel to the slices of the reference geometry, then the
+///   conversion falls back to rasterizing a ribbon model.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToBinaryLabelmapConversionRule
+  : public vtkSegmentationConverterRule
+{
+public:
+  static vtkPlanarContourToBinaryLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToBinaryLabelmapConversionRule, vtkSegmentationConverterRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Contours of one plane in the IJK coordinate system of the reference geometry
+  struct ContourPlane
+  {
+    /// Slice coordinate (K) of the plane
+    double K;
+    /// Edges of all the contours in the plane, as (I0,J0,I1,J1) quadruples
+    std::vector<double> Edges;
+    /// Index of the first value in \sa Edges for each contour
+    std::vector<size_t> ContourStarts;
+  };
+
+  /// Constructs representation object from representation name for the supported representation classes
+  /// (typically source and target representation VTK classes, subclasses of vtkDataObject)
+  /// Note: Need to take ownership of the created object! For example using vtkSmartPointer<vtkDataObject>::Take
+  virtual vtkDataObject* ConstructRepresentationObjectByRepresentation(std::string representationName) VTK_OVERRIDE;
+
+  /// Constructs representation object from class name for the supported representation classes
+  /// (typically source and target representation VTK classes, subclasses of vtkDataObject)
+  /// Note: Need to take ownership of the created object! For example using vtkSmartPointer<vtkDataObject>::Take
+  virtual vtkDataObject* ConstructRepresentationObjectByClass(std::string className) VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Get the cost of the conversion. Lower than that of the conversion through ribbon model
+  /// or closed surface, so that this rule is preferred
+  virtual unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=NULL, vtkDataObject* targetRepresentation=NULL) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to binary labelmap"; };
+
+  /// Human-readable name of the source representation
+  virtual const char* GetSourceRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(); };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
+
+protected:
+  /// Transform the contours to the IJK coordinate system of the reference geometry and group them by plane
+  /// \param planarContourPolyData Input poly data containing the planar contours
+  /// \param imageToWorldMatrix Output geometry of the reference image
+  /// \param contourPlanes Output contour planes sorted by slice coordinate
+  /// \param contourBounds Output IJK bounds of the contours
+  /// \param planeSpacing Output distance of neighboring contour planes (in slices)
+  /// \return False if there is no reference geometry or the contours are not parallel to its slices
+  bool ComputeContourPlanes(vtkPolyData* planarContourPolyData, vtkMatrix4x4* imageToWorldMatrix,
+    std::vector<ContourPlane>& contourPlanes, double contourBounds[6], double& planeSpacing);
+
+  /// Convert by rasterizing a ribbon model, used if the contours are oblique to the reference slices
+  bool ConvertUsingRibbonModel(vtkPolyData* planarContourPolyData, vtkOrientedImageData* binaryLabelmap);
+
+protected:
+  vtkPlanarContourToBinaryLabelmapConversionRule();
+  ~vtkPlanarContourToBinaryLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToBinaryLabelmapConversionRule(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToBinaryLabelmapConversionRule_h
@@ -0,0 +1,405 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
+#include "vtkPolyDataToFractionalLabelmapFilter.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkDoubleArray.h>
+#include <vtkFieldData.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  typedef vtkPlanarContourToBinaryLabelmapConversionRule::ContourPlane ContourPlane;
+
+  //----------------------------------------------------------------------------
+  /// Accumulate the signed area covered by the polygon edge (x0,y0)-(x1,y1) into a buffer of
+  /// pixel differences. Pixel (x,y) spans [x,x+1]x[y,y+1]. After summing each row from the left,
+  /// the buffer contains the exact area of each pixel covered by the closed polygons whose edges
+  /// were accumulated (negative for counter-clockwise polygons).
+  /// Coordinates must be within [0,width]x[0,height], and rows have width+2 elements.
+  void AccumulateEdgeArea(double x0, double y0, double x1, double y1, double weight,
+    double* accumulation, int rowSize, int height)
+  {
+    if (y0 == y1)
+    {
+      return;
+    }
+    double direction = weight;
+    if (y0 > y1)
+    {
+      std::swap(x0, x1);
+      std::swap(y0, y1);
+      direction = -weight;
+    }
+    double dxdy = (x1-x0) / (y1-y0);
+    double x = x0;
+    int firstRow = std::max(0, (int)floor(y0));
+    int lastRow = std::min(height, (int)ceil(y1));
+    if (y0 < firstRow)
+    {
+      x += (firstRow-y0) * dxdy;
+    }
+    for (int row=firstRow; row<lastRow; ++row)
+    {
+      double* rowPtr = accumulation + row*rowSize;
+      double dy = std::min(row+1.0, y1) - std::max((double)row, y0);
+      double xNext = x + dxdy*dy;
+      double d = dy * direction;
+      double xLeft = std::min(x, xNext);
+      double xRight = std::max(x, xNext);
+      double xLeftFloor = floor(xLeft);
+      int xLeftIndex = (int)xLeftFloor;
+      double xRightCeil = ceil(xRight);
+      int xRightIndex = (int)xRightCeil;
+      if (xRightIndex <= xLeftIndex+1)
+      {
+        // Edge within one pixel column in this row
+        double xMidFraction = 0.5*(x+xNext) - xLeftFloor;
+        rowPtr[xLeftIndex] += d - d*xMidFraction;
+        rowPtr[xLeftIndex+1] += d*xMidFraction;
+      }
+      else
+      {
+        double s = 1.0 / (xRight-xLeft);
+        double xLeftFraction = xLeft - xLeftFloor;
+        double a0 = 0.5 * s * (1.0-xLeftFraction) * (1.0-xLeftFraction);
+        double xRightFraction = xRight - xRightCeil + 1.0;
+        double am = 0.5 * s * xRightFraction * xRightFraction;
+        rowPtr[xLeftIndex] += d*a0;
+        if (xRightIndex == xLeftIndex+2)
+        {
+          rowPtr[xLeftIndex+1] += d * (1.0-a0-am);
+        }
+        else
+        {
+          double a1 = s * (1.5-xLeftFraction);
+          rowPtr[xLeftIndex+1] += d * (a1-a0);
+          for (int column=xLeftIndex+2; column<xRightIndex-1; ++column)
+          {
+            rowPtr[column] += d*s;
+          }
+          double a2 = a1 + (xRightIndex-xLeftIndex-3) * s;
+          rowPtr[xRightIndex-1] += d * (1.0-a2-am);
+        }
+        rowPtr[xRightIndex] += d*am;
+      }
+      x = xNext;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Is point inside the contour (even-odd rule)
+  bool IsPointInContour(double x, double y, const std::vector<double>& edges, size_t firstEdge, size_t endEdge)
+  {
+    bool inside = false;
+    for (size_t edgeIndex=firstEdge; edgeIndex<endEdge; edgeIndex+=4)
+    {
+      double x0 = edges[edgeIndex];
+      double y0 = edges[edgeIndex+1];
+      double x1 = edges[edgeIndex+2];
+      double y1 = edges[edgeIndex+3];
+      if ((y0 > y) != (y1 > y) && x < x0 + (y-y0) * (x1-x0) / (y1-y0))
+      {
+        inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute the fraction of the area of each voxel covered by the contours of each plane
+  class ComputePlaneCoverageFunctor
+  {
+  public:
+    ComputePlaneCoverageFunctor(const std::vector<ContourPlane>& contourPlanes, const int extent[6], std::vector<std::vector<float> >& coverages)
+      : ContourPlanes(contourPlanes)
+      , Coverages(coverages)
+    {
+      std::copy(extent, extent+6, this->Extent);
+    }
+
+    void operator()(vtkIdType beginPlane, vtkIdType endPlane)
+    {
+      int width = this->Extent[1]-this->Extent[0]+1;
+      int height = this->Extent[3]-this->Extent[2]+1;
+      int rowSize = width+2;
+      // Voxel (i,j) spans pixel (i-extent[0], j-extent[2])
+      double originI = this->Extent[0]-0.5;
+      double originJ = this->Extent[2]-0.5;
+
+      std::vector<double> accumulation(rowSize*height);
+      for (vtkIdType planeIndex=beginPlane; planeIndex<endPlane; ++planeIndex)
+      {
+        const ContourPlane& contourPlane = this->ContourPlanes[planeIndex];
+        const std::vector<double>& edges = contourPlane.Edges;
+        std::fill(accumulation.begin(), accumulation.end(), 0.0);
+
+        for (size_t contourIndex=0; contourIndex<contourPlane.ContourStarts.size(); ++contourIndex)
+        {
+          size_t firstEdge = contourPlane.ContourStarts[contourIndex];
+          size_t endEdge = (contourIndex+1 < contourPlane.ContourStarts.size() ? contourPlane.ContourStarts[contourIndex+1] : edges.size());
+          if (firstEdge == endEdge)
+          {
+            continue;
+          }
+
+          // Contours inside an odd number of other contours are holes. Contributions are signed
+          // by orientation and hole status so that coverage is positive inside the structure
+          int numberOfEnclosingContours = 0;
+          for (size_t otherContourIndex=0; otherContourIndex<contourPlane.ContourStarts.size(); ++otherContourIndex)
+          {
+            size_t otherFirstEdge = contourPlane.ContourStarts[otherContourIndex];
+            size_t otherEndEdge = (otherContourIndex+1 < contourPlane.ContourStarts.size() ? contourPlane.ContourStarts[otherContourIndex+1] : edges.size());
+            if ( otherContourIndex != contourIndex
+              && IsPointInContour(edges[firstEdge], edges[firstEdge+1], edges, otherFirstEdge, otherEndEdge) )
+            {
+              ++numberOfEnclosingContours;
+            }
+          }
+          double signedArea = 0.0;
+          for (size_t edgeIndex=firstEdge; edgeIndex<endEdge; edgeIndex+=4)
+          {
+            signedArea += edges[edgeIndex]*edges[edgeIndex+3] - edges[edgeIndex+2]*edges[edgeIndex+1];
+          }
+          double weight = (signedArea > 0.0 ? -1.0 : 1.0) * (numberOfEnclosingContours % 2 ? -1.0 : 1.0);
+
+          for (size_t edgeIndex=firstEdge; edgeIndex<endEdge; edgeIndex+=4)
+          {
+            AccumulateEdgeArea(
+              std::min(std::max(edges[edgeIndex]-originI, 0.0), (double)width),
+              std::min(std::max(edges[edgeIndex+1]-originJ, 0.0), (double)height),
+              std::min(std::max(edges[edgeIndex+2]-originI, 0.0), (double)width),
+              std::min(std::max(edges[edgeIndex+3]-originJ, 0.0), (double)height),
+              weight, &accumulation[0], rowSize, height );
+          }
+        }
+
+        std::vector<float>& coverage = this->Coverages[planeIndex];
+        coverage.resize(width*height);
+        for (int row=0; row<height; ++row)
+        {
+          double area = 0.0;
+          for (int column=0; column<width; ++column)
+          {
+            area += accumulation[row*rowSize+column];
+            coverage[row*width+column] = (float)std::min(std::max(area, 0.0), 1.0);
+          }
+        }
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& ContourPlanes;
+    std::vector<std::vector<float> >& Coverages;
+    int Extent[6];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Fill slices of the fractional labelmap from the plane coverages weighted by the overlap
+  /// of the slice with the slab of each plane
+  class FillFractionalSlicesFunctor
+  {
+  public:
+    FillFractionalSlicesFunctor(const std::vector<ContourPlane>& contourPlanes, const std::vector<std::vector<float> >& coverages,
+      double halfPlaneSpacing, vtkOrientedImageData* fractionalLabelmap)
+      : ContourPlanes(contourPlanes)
+      , Coverages(coverages)
+      , HalfPlaneSpacing(halfPlaneSpacing)
+      , FractionalLabelmap(fractionalLabelmap)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      int extent[6] = {0,-1,0,-1,0,-1};
+      this->FractionalLabelmap->GetExtent(extent);
+      vtkIdType sliceSize = (vtkIdType)(extent[1]-extent[0]+1) * (extent[3]-extent[2]+1);
+      FRACTIONAL_DATA_TYPE* scalars = static_cast<FRACTIONAL_DATA_TYPE*>(this->FractionalLabelmap->GetScalarPointer());
+
+      std::vector<float> fractions(sliceSize);
+      for (vtkIdType slice=beginSlice; slice<endSlice; ++slice)
+      {
+        double k = extent[4] + slice;
+        std::fill(fractions.begin(), fractions.end(), 0.0f);
+        for (size_t planeIndex=0; planeIndex<this->ContourPlanes.size(); ++planeIndex)
+        {
+          double planeK = this->ContourPlanes[planeIndex].K;
+          float overlap = (float)( std::min(k+0.5, planeK+this->HalfPlaneSpacing)
+            - std::max(k-0.5, planeK-this->HalfPlaneSpacing) );
+          if (overlap <= 0.0f)
+          {
+            continue;
+          }
+          const std::vector<float>& coverage = this->Coverages[planeIndex];
+          for (vtkIdType index=0; index<sliceSize; ++index)
+          {
+            fractions[index] += overlap * coverage[index];
+          }
+        }
+
+        FRACTIONAL_DATA_TYPE* slicePtr = scalars + slice*sliceSize;
+        for (vtkIdType index=0; index<sliceSize; ++index)
+        {
+          float fraction = std::min(fractions[index], 1.0f);
+          slicePtr[index] = (FRACTIONAL_DATA_TYPE)(FRACTIONAL_MIN + floor(fraction*(FRACTIONAL_MAX-FRACTIONAL_MIN) + 0.5));
+        }
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& ContourPlanes;
+    const std::vector<std::vector<float> >& Coverages;
+    double HalfPlaneSpacing;
+    vtkOrientedImageData* FractionalLabelmap;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToFractionalLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::~vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToFractionalLabelmapConversionRule::GetConversionCost(vtkDataObject* vtkNotUsed(sourceRepresentation)/*=NULL*/, vtkDataObject* vtkNotUsed(targetRepresentation)/*=NULL*/)
+{
+  // Rough input-independent guess (ms), less than the closed surface path
+  return 150;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToFractionalLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* fractionalLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!fractionalLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  std::vector<ContourPlane> contourPlanes;
+  double contourBounds_IJK[6] = {0.0, -1.0, 0.0, -1.0, 0.0, -1.0};
+  double planeSpacing = 1.0;
+  if (!this->ComputeContourPlanes(planarContourPolyData, imageToWorldMatrix, contourPlanes, contourBounds_IJK, planeSpacing))
+  {
+    vtkDebugMacro("Convert: No reference geometry or contours are not parallel to its slices, using closed surface");
+    return this->ConvertUsingClosedSurface(planarContourPolyData, fractionalLabelmap);
+  }
+  double halfPlaneSpacing = 0.5 * planeSpacing;
+
+  // Extent of the voxels partially covered by the contour slabs
+  int extent[6] = {0,-1,0,-1,0,-1};
+  if (!contourPlanes.empty())
+  {
+    extent[0] = (int)floor(contourBounds_IJK[0] + 0.5);
+    extent[1] = (int)floor(contourBounds_IJK[1] + 0.5);
+    extent[2] = (int)floor(contourBounds_IJK[2] + 0.5);
+    extent[3] = (int)floor(contourBounds_IJK[3] + 0.5);
+    extent[4] = (int)floor(contourPlanes.front().K - halfPlaneSpacing + 0.5);
+    extent[5] = (int)floor(contourPlanes.back().K + halfPlaneSpacing + 0.5);
+  }
+
+  fractionalLabelmap->SetExtent(extent);
+  fractionalLabelmap->AllocateScalars(VTK_FRACTIONAL_DATA_TYPE, 1);
+  fractionalLabelmap->SetImageToWorldMatrix(imageToWorldMatrix);
+
+  // Specify the scalar range of values in the labelmap
+  vtkSmartPointer<vtkDoubleArray> scalarRange = vtkSmartPointer<vtkDoubleArray>::New();
+  scalarRange->SetName(vtkSegmentationConverter::GetScalarRangeFieldName());
+  scalarRange->InsertNextValue(FRACTIONAL_MIN);
+  scalarRange->InsertNextValue(FRACTIONAL_MAX);
+  fractionalLabelmap->GetFieldData()->AddArray(scalarRange);
+
+  // Specify the surface threshold value for visualization
+  vtkSmartPointer<vtkDoubleArray> thresholdValue = vtkSmartPointer<vtkDoubleArray>::New();
+  thresholdValue->SetName(vtkSegmentationConverter::GetThresholdValueFieldName());
+  thresholdValue->InsertNextValue((FRACTIONAL_MIN+FRACTIONAL_MAX)/2.0);
+  fractionalLabelmap->GetFieldData()->AddArray(thresholdValue);
+
+  if (contourPlanes.empty())
+  {
+    return true;
+  }
+
+  // In-plane coverage of each contour plane, then the slices are composed from the planes
+  std::vector<std::vector<float> > coverages(contourPlanes.size());
+  ComputePlaneCoverageFunctor coverageFunctor(contourPlanes, extent, coverages);
+  vtkSMPTools::For(0, (vtkIdType)contourPlanes.size(), coverageFunctor);
+
+  FillFractionalSlicesFunctor fillFunctor(contourPlanes, coverages, halfPlaneSpacing, fractionalLabelmap);
+  vtkSMPTools::For(0, extent[5]-extent[4]+1, fillFunctor);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToFractionalLabelmapConversionRule::ConvertUsingClosedSurface(vtkPolyData* planarContourPolyData, vtkOrientedImageData* fractionalLabelmap)
+{
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule =
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSmartPointer<vtkClosedSurfaceToFractionalLabelmapConversionRule> fractionalLabelmapRule =
+    vtkSmartPointer<vtkClosedSurfaceToFractionalLabelmapConversionRule>::New();
+  for (ConversionParameterListType::iterator parameterIt = this->ConversionParameters.begin();
+    parameterIt != this->ConversionParameters.end(); ++parameterIt)
+  {
+    closedSurfaceRule->SetConversionParameter(parameterIt->first, parameterIt->second.first);
+    fractionalLabelmapRule->SetConversionParameter(parameterIt->first, parameterIt->second.first);
+  }
+
+  vtkSmartPointer<vtkPolyData> closedSurface = vtkSmartPointer<vtkPolyData>::New();
+  if (!closedSurfaceRule->Convert(planarContourPolyData, closedSurface))
+  {
+    vtkErrorMacro("ConvertUsingClosedSurface: Failed to create closed surface");
+    return false;
+  }
+  return fractionalLabelmapRule->Convert(closedSurface, fractionalLabelmap);
+}
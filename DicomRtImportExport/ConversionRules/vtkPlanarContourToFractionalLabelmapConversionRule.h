@@ -0,0 +1,72 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToFractionalLabelmapConversionRule_h
+#define __vtkPlanarContourToFractionalLabelmapConversionRule_h
+
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) to fractional
+///   labelmap representation (vtkOrientedImageData type) without oversampling.
+///   The in-plane area of each voxel covered by the contours of a plane is computed
+///   exactly (holes by the even-odd rule). Each contour plane represents a slab of
+///   the contour plane spacing, so the value of a voxel is the covered area weighted by
+///   the overlap of the voxel with the slabs of the neighboring planes.
+///   The value range is the same as the other fractional labelmap conversions, so the
+///   result can be used with \sa vtkFractionalImageAccumulate.
+///   If the contours are not parallel to the slices of the reference geometry, then
+///   the conversion falls back to closed surface conversion.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToFractionalLabelmapConversionRule
+  : public vtkPlanarContourToBinaryLabelmapConversionRule
+{
+public:
+  static vtkPlanarContourToFractionalLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToFractionalLabelmapConversionRule, vtkPlanarContourToBinaryLabelmapConversionRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Get the cost of the conversion. Lower than that of the conversion through closed surface
+  virtual unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=NULL, vtkDataObject* targetRepresentation=NULL) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to fractional labelmap"; };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationFractionalLabelmapRepresentationName(); };
+
+protected:
+  /// Convert through closed surface, used if the contours are oblique to the reference slices
+  bool ConvertUsingClosedSurface(vtkPolyData* planarContourPolyData, vtkOrientedImageData* fractionalLabelmap);
+
+protected:
+  vtkPlanarContourToFractionalLabelmapConversionRule();
+  ~vtkPlanarContourToFractionalLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToFractionalLabelmapConversionRule(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToFractionalLabelmapConversionRule_h
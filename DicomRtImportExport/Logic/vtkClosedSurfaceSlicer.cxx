@@ -0,0 +1,402 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkClosedSurfaceSlicer.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkTriangleFilter.h>
+#include <vtkNew.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <map>
+#include <algorithm>
+#include <math.h>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Contour loops of one slice, filled by the slicing threads
+  struct SliceContours
+  {
+    /// Point coordinates (3 values per point)
+    std::vector<double> Points;
+    /// Point indices of the loops, loop i is between LoopOffsets[i] and LoopOffsets[i+1]
+    std::vector<vtkIdType> LoopPointIds;
+    std::vector<vtkIdType> LoopOffsets;
+    /// Flag per loop whether the chain is closed
+    std::vector<bool> LoopClosed;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Cut the triangles of each slice and chain the segments into loops.
+  /// An edge crosses slice s if exactly one of its end points has slice coordinate <= s. This
+  /// half-open rule gives exactly zero or two crossings for each triangle, also if a vertex is
+  /// on the plane, and the crossing point of an edge is shared by the two triangles of the edge
+  class CutSlicesFunctor
+  {
+  public:
+    CutSlicesFunctor(const std::vector<double>& points, const std::vector<double>& pointSliceCoordinates,
+      const std::vector<vtkIdType>& triangles, const std::vector<vtkIdType>& sliceOffsets,
+      const std::vector<vtkIdType>& sliceTriangles, int firstSlice, std::vector<SliceContours>& sliceContours)
+      : Points(points)
+      , PointSliceCoordinates(pointSliceCoordinates)
+      , Triangles(triangles)
+      , SliceOffsets(sliceOffsets)
+      , SliceTriangles(sliceTriangles)
+      , FirstSlice(firstSlice)
+      , Contours(sliceContours)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      for (vtkIdType sliceIndex=beginSlice; sliceIndex<endSlice; ++sliceIndex)
+      {
+        if (this->SliceOffsets[sliceIndex] < this->SliceOffsets[sliceIndex+1])
+        {
+          this->CutSlice(sliceIndex);
+        }
+      }
+    }
+
+  protected:
+    void CutSlice(vtkIdType sliceIndex)
+    {
+      double slicePosition = this->FirstSlice + sliceIndex;
+      SliceContours& contours = this->Contours[sliceIndex];
+
+      // Crossing points keyed by mesh edge, and the (at most two) neighbors of each crossing point
+      std::map<std::pair<vtkIdType, vtkIdType>, vtkIdType> edgeCrossings;
+      std::vector<vtkIdType> neighbors;
+
+      for (vtkIdType bucketIndex=this->SliceOffsets[sliceIndex]; bucketIndex<this->SliceOffsets[sliceIndex+1]; ++bucketIndex)
+      {
+        const vtkIdType* triangle = &(this->Triangles[3*this->SliceTriangles[bucketIndex]]);
+        vtkIdType segment[2] = {-1, -1};
+        int numberOfCrossings = 0;
+        for (int edge=0; edge<3 && numberOfCrossings<2; ++edge)
+        {
+          vtkIdType a = triangle[edge];
+          vtkIdType b = triangle[(edge+1)%3];
+          double ka = this->PointSliceCoordinates[a];
+          double kb = this->PointSliceCoordinates[b];
+          if ((ka <= slicePosition) == (kb <= slicePosition))
+          {
+            continue;
+          }
+
+          std::pair<vtkIdType, vtkIdType> edgeKey(std::min(a,b), std::max(a,b));
+          std::map<std::pair<vtkIdType, vtkIdType>, vtkIdType>::iterator crossingIt = edgeCrossings.find(edgeKey);
+          if (crossingIt == edgeCrossings.end())
+          {
+            vtkIdType crossingId = static_cast<vtkIdType>(contours.Points.size() / 3);
+            double t = (slicePosition - ka) / (kb - ka);
+            for (int axis=0; axis<3; ++axis)
+            {
+              double pa = this->Points[3*a+axis];
+              contours.Points.push_back(pa + t * (this->Points[3*b+axis] - pa));
+            }
+            neighbors.push_back(-1);
+            neighbors.push_back(-1);
+            crossingIt = edgeCrossings.insert(std::make_pair(edgeKey, crossingId)).first;
+          }
+          segment[numberOfCrossings++] = crossingIt->second;
+        }
+        if (numberOfCrossings != 2 || segment[0] == segment[1])
+        {
+          continue;
+        }
+        this->AddNeighbor(neighbors, segment[0], segment[1]);
+        this->AddNeighbor(neighbors, segment[1], segment[0]);
+      }
+
+      // Chain segments into loops. Open chains (surface with holes) are started from their ends
+      vtkIdType numberOfCrossingPoints = static_cast<vtkIdType>(contours.Points.size() / 3);
+      std::vector<bool> visited(numberOfCrossingPoints, false);
+      contours.LoopOffsets.push_back(0);
+      for (int pass=0; pass<2; ++pass)
+      {
+        for (vtkIdType startId=0; startId<numberOfCrossingPoints; ++startId)
+        {
+          bool isChainEnd = (neighbors[2*startId] < 0 || neighbors[2*startId+1] < 0);
+          if (visited[startId] || (pass == 0 && !isChainEnd))
+          {
+            continue;
+          }
+          vtkIdType previousId = -1;
+          vtkIdType currentId = startId;
+          bool closed = false;
+          while (true)
+          {
+            visited[currentId] = true;
+            contours.LoopPointIds.push_back(currentId);
+            vtkIdType nextId = (neighbors[2*currentId] != previousId ? neighbors[2*currentId] : neighbors[2*currentId+1]);
+            if (nextId < 0)
+            {
+              break;
+            }
+            if (visited[nextId])
+            {
+              closed = (nextId == startId);
+              break;
+            }
+            previousId = currentId;
+            currentId = nextId;
+          }
+          contours.LoopOffsets.push_back(static_cast<vtkIdType>(contours.LoopPointIds.size()));
+          contours.LoopClosed.push_back(closed);
+        }
+      }
+    }
+
+    void AddNeighbor(std::vector<vtkIdType>& neighbors, vtkIdType pointId, vtkIdType neighborId)
+    {
+      // Non-manifold crossings (more than two neighbors) are ignored
+      if (neighbors[2*pointId] < 0)
+      {
+        neighbors[2*pointId] = neighborId;
+      }
+      else if (neighbors[2*pointId+1] < 0)
+      {
+        neighbors[2*pointId+1] = neighborId;
+      }
+    }
+
+  private:
+    const std::vector<double>& Points;
+    const std::vector<double>& PointSliceCoordinates;
+    const std::vector<vtkIdType>& Triangles;
+    const std::vector<vtkIdType>& SliceOffsets;
+    const std::vector<vtkIdType>& SliceTriangles;
+    int FirstSlice;
+    std::vector<SliceContours>& Contours;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkClosedSurfaceSlicer);
+vtkCxxSetObjectMacro(vtkClosedSurfaceSlicer, InputSurface, vtkPolyData);
+vtkCxxSetObjectMacro(vtkClosedSurfaceSlicer, ImageToWorldMatrix, vtkMatrix4x4);
+
+//----------------------------------------------------------------------------
+vtkClosedSurfaceSlicer::vtkClosedSurfaceSlicer()
+{
+  this->InputSurface = NULL;
+  this->ImageToWorldMatrix = NULL;
+  this->SliceRange[0] = 0;
+  this->SliceRange[1] = -1;
+}
+
+//----------------------------------------------------------------------------
+vtkClosedSurfaceSlicer::~vtkClosedSurfaceSlicer()
+{
+  this->SetInputSurface(NULL);
+  this->SetImageToWorldMatrix(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkClosedSurfaceSlicer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "SliceRange: " << this->SliceRange[0] << ", " << this->SliceRange[1] << "\n";
+  os << indent << "NumberOfContourSlices: " << this->ContourSlices.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkClosedSurfaceSlicer::GetNumberOfContourSlices()
+{
+  return static_cast<int>(this->ContourSlices.size());
+}
+
+//----------------------------------------------------------------------------
+int vtkClosedSurfaceSlicer::GetContourSliceIndex(int contourSlice)
+{
+  if (contourSlice < 0 || contourSlice >= static_cast<int>(this->ContourSliceIndices.size()))
+  {
+    vtkErrorMacro("GetContourSliceIndex: Invalid contour slice " << contourSlice);
+    return -1;
+  }
+  return this->ContourSliceIndices[contourSlice];
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkClosedSurfaceSlicer::GetContourSlice(int contourSlice)
+{
+  if (contourSlice < 0 || contourSlice >= static_cast<int>(this->ContourSlices.size()))
+  {
+    vtkErrorMacro("GetContourSlice: Invalid contour slice " << contourSlice);
+    return NULL;
+  }
+  return this->ContourSlices[contourSlice];
+}
+
+//----------------------------------------------------------------------------
+void vtkClosedSurfaceSlicer::Update()
+{
+  this->ContourSliceIndices.clear();
+  this->ContourSlices.clear();
+
+  if (!this->InputSurface || !this->ImageToWorldMatrix)
+  {
+    vtkErrorMacro("Update: Input surface and image to world matrix have to be set!");
+    return;
+  }
+  if (this->SliceRange[0] > this->SliceRange[1])
+  {
+    return;
+  }
+
+  // Make sure there are only triangles
+  vtkNew<vtkTriangleFilter> triangleFilter;
+  triangleFilter->SetInputData(this->InputSurface);
+  triangleFilter->PassLinesOff();
+  triangleFilter->PassVertsOff();
+  triangleFilter->Update();
+  vtkPolyData* surface = triangleFilter->GetOutput();
+  if (!surface->GetPoints() || surface->GetNumberOfPolys() == 0)
+  {
+    return;
+  }
+
+  // Copy points and compute their continuous slice coordinate
+  vtkNew<vtkMatrix4x4> worldToImageMatrix;
+  vtkMatrix4x4::Invert(this->ImageToWorldMatrix, worldToImageMatrix.GetPointer());
+  vtkIdType numberOfPoints = surface->GetNumberOfPoints();
+  std::vector<double> points(3*numberOfPoints);
+  std::vector<double> pointSliceCoordinates(numberOfPoints);
+  for (vtkIdType pointId=0; pointId<numberOfPoints; ++pointId)
+  {
+    double* point = &(points[3*pointId]);
+    surface->GetPoint(pointId, point);
+    pointSliceCoordinates[pointId] = worldToImageMatrix->GetElement(2,0) * point[0] + worldToImageMatrix->GetElement(2,1) * point[1]
+      + worldToImageMatrix->GetElement(2,2) * point[2] + worldToImageMatrix->GetElement(2,3);
+  }
+
+  // Collect triangles and the range of slices each of them intersects (slices s with kMin <= s < kMax)
+  int numberOfSlices = this->SliceRange[1] - this->SliceRange[0] + 1;
+  std::vector<vtkIdType> triangles;
+  triangles.reserve(3*surface->GetNumberOfPolys());
+  std::vector<int> triangleSliceRanges;
+  triangleSliceRanges.reserve(2*surface->GetNumberOfPolys());
+  std::vector<vtkIdType> sliceOffsets(numberOfSlices+1, 0);
+  vtkCellArray* polys = surface->GetPolys();
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); )
+  {
+    if (numberOfCellPoints != 3)
+    {
+      continue;
+    }
+    double kMin = std::min(pointSliceCoordinates[cellPointIds[0]], std::min(pointSliceCoordinates[cellPointIds[1]], pointSliceCoordinates[cellPointIds[2]]));
+    double kMax = std::max(pointSliceCoordinates[cellPointIds[0]], std::max(pointSliceCoordinates[cellPointIds[1]], pointSliceCoordinates[cellPointIds[2]]));
+    int firstSlice = std::max(static_cast<int>(ceil(kMin)), this->SliceRange[0]) - this->SliceRange[0];
+    int lastSlice = std::min(static_cast<int>(ceil(kMax)) - 1, this->SliceRange[1]) - this->SliceRange[0];
+    if (firstSlice > lastSlice)
+    {
+      continue;
+    }
+    triangles.insert(triangles.end(), cellPointIds, cellPointIds+3);
+    triangleSliceRanges.push_back(firstSlice);
+    triangleSliceRanges.push_back(lastSlice);
+    for (int slice=firstSlice; slice<=lastSlice; ++slice)
+    {
+      ++sliceOffsets[slice+1];
+    }
+  }
+
+  // Sort triangles into slabs (compressed row storage: triangles of slice s are between offsets s and s+1)
+  for (int slice=0; slice<numberOfSlices; ++slice)
+  {
+    sliceOffsets[slice+1] += sliceOffsets[slice];
+  }
+  std::vector<vtkIdType> sliceTriangles(sliceOffsets[numberOfSlices]);
+  std::vector<vtkIdType> sliceFillPositions(sliceOffsets.begin(), sliceOffsets.end()-1);
+  vtkIdType numberOfTriangles = static_cast<vtkIdType>(triangleSliceRanges.size() / 2);
+  for (vtkIdType triangleIndex=0; triangleIndex<numberOfTriangles; ++triangleIndex)
+  {
+    for (int slice=triangleSliceRanges[2*triangleIndex]; slice<=triangleSliceRanges[2*triangleIndex+1]; ++slice)
+    {
+      sliceTriangles[sliceFillPositions[slice]++] = triangleIndex;
+    }
+  }
+
+  // Cut slices in parallel
+  std::vector<SliceContours> sliceContours(numberOfSlices);
+  CutSlicesFunctor functor(points, pointSliceCoordinates, triangles, sliceOffsets, sliceTriangles, this->SliceRange[0], sliceContours);
+  vtkSMPTools::For(0, numberOfSlices, functor);
+
+  // Create output contours
+  int numberOfOpenChains = 0;
+  int firstOpenChainSlice = -1;
+  for (int slice=0; slice<numberOfSlices; ++slice)
+  {
+    SliceContours& contours = sliceContours[slice];
+    if (contours.LoopClosed.empty())
+    {
+      continue;
+    }
+
+    vtkSmartPointer<vtkPoints> contourPoints = vtkSmartPointer<vtkPoints>::New();
+    contourPoints->SetNumberOfPoints(static_cast<vtkIdType>(contours.Points.size() / 3));
+    for (vtkIdType pointId=0; pointId<contourPoints->GetNumberOfPoints(); ++pointId)
+    {
+      contourPoints->SetPoint(pointId, &(contours.Points[3*pointId]));
+    }
+    vtkSmartPointer<vtkCellArray> contourPolys = vtkSmartPointer<vtkCellArray>::New();
+    for (size_t loopIndex=0; loopIndex<contours.LoopClosed.size(); ++loopIndex)
+    {
+      vtkIdType loopStart = contours.LoopOffsets[loopIndex];
+      vtkIdType loopSize = contours.LoopOffsets[loopIndex+1] - loopStart;
+      if (!contours.LoopClosed[loopIndex])
+      {
+        // Open chains would be written as closed contours, connecting their ends across the structure
+        if (numberOfOpenChains++ == 0)
+        {
+          firstOpenChainSlice = this->SliceRange[0] + slice;
+        }
+        continue;
+      }
+      if (loopSize >= 3)
+      {
+        contourPolys->InsertNextCell(loopSize, &(contours.LoopPointIds[loopStart]));
+      }
+    }
+    if (contourPolys->GetNumberOfCells() == 0)
+    {
+      continue;
+    }
+
+    vtkSmartPointer<vtkPolyData> contourSlice = vtkSmartPointer<vtkPolyData>::New();
+    contourSlice->SetPoints(contourPoints);
+    contourSlice->SetPolys(contourPolys);
+    this->ContourSliceIndices.push_back(this->SliceRange[0] + slice);
+    this->ContourSlices.push_back(contourSlice);
+  }
+
+  if (numberOfOpenChains > 0)
+  {
+    vtkWarningMacro("Update: Surface is not closed, " << numberOfOpenChains << " open contours dropped (first at slice "
+      << firstOpenChainSlice << ")");
+  }
+}
@@ -0,0 +1,91 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkClosedSurfaceSlicer - Cut closed surface with the slice planes of an image
+// .SECTION Description
+// Creates closed planar contours from a closed surface mesh at each slice of an image, for
+// example to export it as RT structure set contours. The triangles are sorted into slabs
+// between neighboring slices beforehand, so each slice only visits the triangles that
+// intersect it. Crossing points are identified by mesh edge, so the segments of each slice
+// are chained into ordered polygon loops.
+
+#ifndef __vtkClosedSurfaceSlicer_h
+#define __vtkClosedSurfaceSlicer_h
+
+#include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+class vtkMatrix4x4;
+
+/// \ingroup SlicerRt_QtModules_DicomRtImportExport
+class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkClosedSurfaceSlicer : public vtkObject
+{
+public:
+  static vtkClosedSurfaceSlicer *New();
+  vtkTypeMacro(vtkClosedSurfaceSlicer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Cut the input surface at each slice in the slice range
+  virtual void Update();
+
+  /// Set closed surface to cut (world coordinates). Needs to consist of triangles sharing points
+  void SetInputSurface(vtkPolyData* inputSurface);
+  vtkGetObjectMacro(InputSurface, vtkPolyData);
+
+  /// Set image to world matrix defining the slice planes. Slice k is the plane K=k in image coordinates
+  void SetImageToWorldMatrix(vtkMatrix4x4* imageToWorldMatrix);
+  vtkGetObjectMacro(ImageToWorldMatrix, vtkMatrix4x4);
+
+  /// First and last slice index to cut (inclusive)
+  vtkGetVector2Macro(SliceRange, int);
+  vtkSetVector2Macro(SliceRange, int);
+
+  /// Get number of slices that contain contours after \sa Update
+  int GetNumberOfContourSlices();
+  /// Get slice index of a slice that contains contours
+  int GetContourSliceIndex(int contourSlice);
+  /// Get contours of a slice. Each polygon cell is a closed loop in world coordinates (the first
+  /// point is not repeated). Chains that cannot be closed (the surface has holes) are dropped with a
+  /// warning, as RT structure set contours are always interpreted as closed
+  vtkPolyData* GetContourSlice(int contourSlice);
+
+protected:
+  vtkPolyData* InputSurface;
+  vtkMatrix4x4* ImageToWorldMatrix;
+  int SliceRange[2];
+
+  /// Slice indices of the slices that contain contours
+  std::vector<int> ContourSliceIndices;
+  /// Contours of the slices that contain contours
+  std::vector<vtkSmartPointer<vtkPolyData> > ContourSlices;
+
+protected:
+  vtkClosedSurfaceSlicer();
+  virtual ~vtkClosedSurfaceSlicer();
+
+private:
+  vtkClosedSurfaceSlicer(const vtkClosedSurfaceSlicer&); // Not implemented
+  void operator=(const vtkClosedSurfaceSlicer&);         // Not implemented
+};
+
+#endif
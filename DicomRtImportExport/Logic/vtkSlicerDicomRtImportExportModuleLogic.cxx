@@ -27,9 +27,12 @@
 #include "vtkSlicerDicomRtImportExportModuleLogic.h"
 #include "vtkSlicerDicomRtReader.h"
 #include "vtkSlicerDicomRtWriter.h"
+#include "vtkClosedSurfaceSlicer.h"
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
 #include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
 #include "vtkFractionalLabelmapToClosedSurfaceConversionRule.h"
 
@@ -48,6 +51,7 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 #include "PlmCommon.h"
+#include "vtkSlicerRtTracer.h"
 #include "vtkMRMLIsodoseNode.h"
 #include "vtkMRMLPlanarImageNode.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
@@ -90,6 +94,7 @@
 #include <vtkMRMLLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLSelectionNode.h>
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
+#include <vtkMRMLTransformNode.h>
 
 // Markups includes
 #include <vtkMRMLMarkupsFiducialNode.h>
@@ -105,9 +110,15 @@
 #include <vtkObjectFactory.h>
 #include <vtkGeneralTransform.h>
 #include <vtkTransformPolyDataFilter.h>
-#include <vtkCutter.h>
+#include <vtkTransform.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSMPTools.h>
+#include <vtkCellArray.h>
+#include <vtkExtractVOI.h>
+#include <vtkImageConstantPad.h>
+#include <vtkMarchingSquares.h>
+#include <vtkPoints.h>
 #include <vtkStripper.h>
-#include <vtkPlane.h>
 
 // ITK includes
 #include <itkImage.h>
@@ -119,6 +130,289 @@
 #include "vtkSlicerDICOMLoadable.h"
 #include "vtkSlicerDICOMExportable.h"
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Create transform to apply to a segment in an export thread. Linear transforms are created
+  /// for each segment from the matrix, non-linear transforms are shared (only used serially)
+  vtkSmartPointer<vtkAbstractTransform> CreateSegmentToWorldTransform(vtkMatrix4x4* nodeToWorldMatrix, vtkAbstractTransform* nodeToWorldTransform)
+  {
+    if (nodeToWorldMatrix)
+    {
+      vtkSmartPointer<vtkTransform> linearTransform = vtkSmartPointer<vtkTransform>::New();
+      linearTransform->SetMatrix(nodeToWorldMatrix);
+      return linearTransform;
+    }
+    return nodeToWorldTransform;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Planar contours of one segment to be added to the RTSTRUCT writer
+  struct SegmentSliceContours
+  {
+    std::vector<int> SliceNumbers;
+    std::vector<std::string> SliceUIDs;
+    std::vector<vtkSmartPointer<vtkPolyData> > SliceContours;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Extract the planar contours of a binary labelmap at each of its slices. The contours are closed
+  /// polygons in world coordinates (the first point is not repeated), as created by the closed surface slicer
+  /// \param labelmap Unsigned char labelmap in the anatomical image geometry
+  /// \param firstImageSlice Index of the first slice of the anatomical image, which has slice number 0
+  void ExtractLabelmapSliceContours(vtkOrientedImageData* labelmap, int firstImageSlice,
+    const std::vector<std::string>& imageSliceUIDs, SegmentSliceContours& contours)
+  {
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    labelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+
+    // The image filters ignore the image directions, so the contours are extracted
+    // in image coordinates and transformed to world coordinates afterwards
+    vtkSmartPointer<vtkImageData> imageLabelmap = vtkSmartPointer<vtkImageData>::New();
+    imageLabelmap->ShallowCopy(labelmap);
+    imageLabelmap->SetOrigin(0.0, 0.0, 0.0);
+    imageLabelmap->SetSpacing(1.0, 1.0, 1.0);
+
+    int extent[6] = {0,-1,0,-1,0,-1};
+    imageLabelmap->GetExtent(extent);
+    if (!imageLabelmap->GetScalarPointer())
+    {
+      // Empty segment
+      return;
+    }
+    vtkIdType numberOfSliceVoxels = static_cast<vtkIdType>(extent[1]-extent[0]+1) * (extent[3]-extent[2]+1);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      // Skip empty slices
+      const unsigned char* sliceVoxels = static_cast<const unsigned char*>(imageLabelmap->GetScalarPointer(extent[0], extent[2], k));
+      bool sliceEmpty = true;
+      for (vtkIdType voxelIndex=0; voxelIndex<numberOfSliceVoxels && sliceEmpty; ++voxelIndex)
+      {
+        sliceEmpty = (sliceVoxels[voxelIndex] == 0);
+      }
+      if (sliceEmpty)
+      {
+        continue;
+      }
+
+      // Pad the slice with background so that contours touching the image border are closed
+      vtkSmartPointer<vtkExtractVOI> extractSlice = vtkSmartPointer<vtkExtractVOI>::New();
+      extractSlice->SetInputData(imageLabelmap);
+      extractSlice->SetVOI(extent[0], extent[1], extent[2], extent[3], k, k);
+      vtkSmartPointer<vtkImageConstantPad> padSlice = vtkSmartPointer<vtkImageConstantPad>::New();
+      padSlice->SetInputConnection(extractSlice->GetOutputPort());
+      padSlice->SetOutputWholeExtent(extent[0]-1, extent[1]+1, extent[2]-1, extent[3]+1, k, k);
+      padSlice->SetConstant(0.0);
+      vtkSmartPointer<vtkMarchingSquares> marchingSquares = vtkSmartPointer<vtkMarchingSquares>::New();
+      marchingSquares->SetInputConnection(padSlice->GetOutputPort());
+      marchingSquares->SetValue(0, 0.5);
+      vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
+      stripper->SetInputConnection(marchingSquares->GetOutputPort());
+      stripper->SetMaximumLength(100000);
+      stripper->Update();
+
+      vtkPolyData* sliceLines = stripper->GetOutput();
+      vtkSmartPointer<vtkPoints> contourPoints = vtkSmartPointer<vtkPoints>::New();
+      vtkSmartPointer<vtkCellArray> contourPolygons = vtkSmartPointer<vtkCellArray>::New();
+      vtkCellArray* lines = sliceLines->GetLines();
+      vtkIdType numberOfLinePoints = 0;
+      vtkIdType* linePointIds = NULL;
+      for (lines->InitTraversal(); lines->GetNextCell(numberOfLinePoints, linePointIds); )
+      {
+        // Closed loops end with their first point
+        if (numberOfLinePoints > 1 && linePointIds[0] == linePointIds[numberOfLinePoints-1])
+        {
+          --numberOfLinePoints;
+        }
+        if (numberOfLinePoints < 3)
+        {
+          continue;
+        }
+        contourPolygons->InsertNextCell(numberOfLinePoints);
+        for (vtkIdType linePointIndex=0; linePointIndex<numberOfLinePoints; ++linePointIndex)
+        {
+          double* imagePoint = sliceLines->GetPoint(linePointIds[linePointIndex]);
+          double imagePoint4[4] = { imagePoint[0], imagePoint[1], imagePoint[2], 1.0 };
+          double worldPoint4[4] = { 0.0, 0.0, 0.0, 1.0 };
+          imageToWorldMatrix->MultiplyPoint(imagePoint4, worldPoint4);
+          contourPolygons->InsertCellPoint(contourPoints->InsertNextPoint(worldPoint4));
+        }
+      }
+      if (contourPolygons->GetNumberOfCells() == 0)
+      {
+        continue;
+      }
+
+      vtkSmartPointer<vtkPolyData> sliceContour = vtkSmartPointer<vtkPolyData>::New();
+      sliceContour->SetPoints(contourPoints);
+      sliceContour->SetPolys(contourPolygons);
+
+      int sliceNumber = k - firstImageSlice;
+      contours.SliceNumbers.push_back(sliceNumber);
+      contours.SliceUIDs.push_back(imageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? imageSliceUIDs[sliceNumber] : "");
+      contours.SliceContours.push_back(sliceContour);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Prepare binary labelmap segments for RTSTRUCT export: copy, apply parent transform, resample
+  /// to the anatomical image geometry, and extract the planar contours at the anatomical image slices.
+  /// The contours are stored per segment so that they can be added to the writer in order
+  class PrepareLabelmapSegmentsFunctor
+  {
+  public:
+    PrepareLabelmapSegmentsFunctor(const std::vector<std::string>& segmentIDs, const std::vector<vtkOrientedImageData*>& binaryLabelmaps,
+      vtkMatrix4x4* nodeToWorldMatrix, vtkAbstractTransform* nodeToWorldTransform, vtkOrientedImageData* referenceImage,
+      const std::vector<std::string>& imageSliceUIDs, std::vector<SegmentSliceContours>& segmentContours, std::vector<std::string>& errors)
+      : SegmentIDs(segmentIDs)
+      , BinaryLabelmaps(binaryLabelmaps)
+      , NodeToWorldMatrix(nodeToWorldMatrix)
+      , NodeToWorldTransform(nodeToWorldTransform)
+      , ReferenceImage(referenceImage)
+      , ImageSliceUIDs(imageSliceUIDs)
+      , SegmentContours(segmentContours)
+      , Errors(errors)
+    {
+    }
+
+    void operator()(vtkIdType beginSegment, vtkIdType endSegment)
+    {
+      for (vtkIdType segmentIndex=beginSegment; segmentIndex<endSegment; ++segmentIndex)
+      {
+        SLICERRT_TRACE_SCOPE("DicomRtImportExport", "Prepare labelmap segment");
+
+        // Temporarily copy labelmap image data as it will be probably resampled
+        vtkSmartPointer<vtkOrientedImageData> binaryLabelmapCopy = vtkSmartPointer<vtkOrientedImageData>::New();
+        binaryLabelmapCopy->DeepCopy(this->BinaryLabelmaps[segmentIndex]);
+
+        // Apply parent transformation nodes if necessary
+        vtkSmartPointer<vtkAbstractTransform> segmentToWorldTransform =
+          CreateSegmentToWorldTransform(this->NodeToWorldMatrix, this->NodeToWorldTransform);
+        if (segmentToWorldTransform.GetPointer())
+        {
+          vtkOrientedImageDataResample::TransformOrientedImage(binaryLabelmapCopy, segmentToWorldTransform);
+        }
+        // Make sure the labelmap dimensions match the reference dimensions
+        if ( !vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceImage, binaryLabelmapCopy)
+          || !vtkOrientedImageDataResample::DoExtentsMatch(this->ReferenceImage, binaryLabelmapCopy) )
+        {
+          if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(binaryLabelmapCopy, this->ReferenceImage, binaryLabelmapCopy))
+          {
+            this->Errors[segmentIndex] = "Failed to resample segment " + this->SegmentIDs[segmentIndex] + " to match anatomical image geometry";
+            continue;
+          }
+        }
+
+        // Contour extraction scans the voxels directly
+        if (binaryLabelmapCopy->GetScalarType() != VTK_UNSIGNED_CHAR)
+        {
+          vtkSmartPointer<vtkImageCast> castFilter = vtkSmartPointer<vtkImageCast>::New();
+          castFilter->SetInputData(binaryLabelmapCopy);
+          castFilter->SetOutputScalarTypeToUnsignedChar();
+          castFilter->ClampOverflowOn();
+          castFilter->Update();
+          vtkSmartPointer<vtkMatrix4x4> labelmapToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+          binaryLabelmapCopy->GetImageToWorldMatrix(labelmapToWorldMatrix);
+          vtkSmartPointer<vtkOrientedImageData> castLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+          castLabelmap->ShallowCopy(castFilter->GetOutput());
+          castLabelmap->SetGeometryFromImageToWorldMatrix(labelmapToWorldMatrix);
+          binaryLabelmapCopy = castLabelmap;
+        }
+
+        // Extract planar contours at the anatomical image slices
+        ExtractLabelmapSliceContours(binaryLabelmapCopy, this->ReferenceImage->GetExtent()[4],
+          this->ImageSliceUIDs, this->SegmentContours[segmentIndex]);
+      }
+    }
+
+  private:
+    const std::vector<std::string>& SegmentIDs;
+    const std::vector<vtkOrientedImageData*>& BinaryLabelmaps;
+    vtkMatrix4x4* NodeToWorldMatrix;
+    vtkAbstractTransform* NodeToWorldTransform;
+    vtkOrientedImageData* ReferenceImage;
+    const std::vector<std::string>& ImageSliceUIDs;
+    std::vector<SegmentSliceContours>& SegmentContours;
+    std::vector<std::string>& Errors;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Cut closed surface segments at the anatomical image slices for RTSTRUCT export.
+  /// Each segment uses its own slicer, so segments can be processed in parallel
+  class PrepareClosedSurfaceSegmentsFunctor
+  {
+  public:
+    PrepareClosedSurfaceSegmentsFunctor(const std::vector<vtkPolyData*>& closedSurfaces,
+      vtkMatrix4x4* nodeToWorldMatrix, vtkAbstractTransform* nodeToWorldTransform,
+      vtkMatrix4x4* imageToWorldMatrix, int imageExtent[6], const std::vector<std::string>& imageSliceUIDs,
+      std::vector<SegmentSliceContours>& segmentContours)
+      : ClosedSurfaces(closedSurfaces)
+      , NodeToWorldMatrix(nodeToWorldMatrix)
+      , NodeToWorldTransform(nodeToWorldTransform)
+      , ImageToWorldMatrix(imageToWorldMatrix)
+      , ImageSliceUIDs(imageSliceUIDs)
+      , SegmentContours(segmentContours)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->ImageExtent[i] = imageExtent[i];
+      }
+    }
+
+    void operator()(vtkIdType beginSegment, vtkIdType endSegment)
+    {
+      for (vtkIdType segmentIndex=beginSegment; segmentIndex<endSegment; ++segmentIndex)
+      {
+        SLICERRT_TRACE_SCOPE("DicomRtImportExport", "Prepare closed surface segment");
+
+        // Transform segment to world (RAS)
+        vtkSmartPointer<vtkPolyData> worldSurface = vtkSmartPointer<vtkPolyData>::New();
+        vtkSmartPointer<vtkAbstractTransform> segmentToWorldTransform =
+          CreateSegmentToWorldTransform(this->NodeToWorldMatrix, this->NodeToWorldTransform);
+        if (segmentToWorldTransform.GetPointer())
+        {
+          vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+          transformPolyData->SetTransform(segmentToWorldTransform);
+          transformPolyData->SetInputData(this->ClosedSurfaces[segmentIndex]);
+          transformPolyData->Update();
+          worldSurface->ShallowCopy(transformPolyData->GetOutput());
+        }
+        else
+        {
+          worldSurface->ShallowCopy(this->ClosedSurfaces[segmentIndex]);
+        }
+
+        // Cut closed surface at each anatomical image slice
+        vtkSmartPointer<vtkClosedSurfaceSlicer> slicer = vtkSmartPointer<vtkClosedSurfaceSlicer>::New();
+        slicer->SetInputSurface(worldSurface);
+        slicer->SetImageToWorldMatrix(this->ImageToWorldMatrix);
+        slicer->SetSliceRange(this->ImageExtent[4], this->ImageExtent[5]);
+        slicer->Update();
+
+        SegmentSliceContours& contours = this->SegmentContours[segmentIndex];
+        for (int contourSlice=0; contourSlice<slicer->GetNumberOfContourSlices(); ++contourSlice)
+        {
+          // Get instance UID of corresponding slice
+          int sliceNumber = slicer->GetContourSliceIndex(contourSlice) - this->ImageExtent[4];
+          contours.SliceNumbers.push_back(sliceNumber);
+          std::string sliceInstanceUID = (this->ImageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? this->ImageSliceUIDs[sliceNumber] : "");
+          contours.SliceUIDs.push_back(sliceInstanceUID);
+          contours.SliceContours.push_back(slicer->GetContourSlice(contourSlice));
+        }
+      }
+    }
+
+  private:
+    const std::vector<vtkPolyData*>& ClosedSurfaces;
+    vtkMatrix4x4* NodeToWorldMatrix;
+    vtkAbstractTransform* NodeToWorldTransform;
+    vtkMatrix4x4* ImageToWorldMatrix;
+    int ImageExtent[6];
+    const std::vector<std::string>& ImageSliceUIDs;
+    std::vector<SegmentSliceContours>& SegmentContours;
+  };
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDicomRtImportExportModuleLogic);
 vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, IsodoseLogic, vtkSlicerIsodoseModuleLogic);
@@ -437,6 +731,7 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtImageDataset
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtDose(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
+  SLICERRT_TRACE_SCOPE("DicomRtImportExport", "LoadRtDose");
   vtkMRMLScene* scene = this->External->GetMRMLScene();
   if (!scene)
   {
@@ -613,6 +908,7 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtDose(vtkSlicerD
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtPlan(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
+  SLICERRT_TRACE_SCOPE("DicomRtImportExport", "LoadRtPlan");
   vtkMRMLScene* scene = this->External->GetMRMLScene();
   if (!scene)
   {
@@ -689,6 +985,9 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtPlan(vtkSlicerD
 
     beamNode->SetSAD(rtReader->GetBeamSourceAxisDistance(dicomBeamNumber));
 
+    // Keep all control points (e.g. VMAT arc) with the beam, which shows the first one
+    beamNode->SetControlPoints(rtReader->GetBeamControlPoints(dicomBeamNumber));
+
     // Set isocenter to parent plan
     double* isocenter = rtReader->GetBeamIsocenterPositionRas(dicomBeamNumber);
     planNode->SetIsocenterSpecification(vtkMRMLRTPlanNode::ArbitraryPoint);
@@ -805,6 +1104,7 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtPlan(vtkSlicerD
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
+  SLICERRT_TRACE_SCOPE("DicomRtImportExport", "LoadRtStructureSet");
   vtkMRMLScene* scene = this->External->GetMRMLScene();
   if (!scene)
   {
@@ -1008,6 +1308,7 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtImage(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
+  SLICERRT_TRACE_SCOPE("DicomRtImportExport", "LoadRtImage");
   vtkMRMLScene* scene = this->External->GetMRMLScene();
   if (!scene)
   {
@@ -1623,6 +1924,10 @@ void vtkSlicerDicomRtImportExportModuleLogic::RegisterNodes()
     vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New() );
   vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
     vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToFractionalLabelmapConversionRule>::New() );
 
 }
 
@@ -1721,12 +2026,16 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable
   }
 
   const char* firstFileName = loadable->GetFiles()->GetValue(0);
+  SLICERRT_TRACE_SCOPE_DETAIL("DicomRtImportExport", "LoadDicomRT", loadable->GetName());
 
   std::cout << "Loading series '" << loadable->GetName() << "' from file '" << firstFileName << "'" << std::endl;
 
   vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
   rtReader->SetFileName(firstFileName);
-  rtReader->Update();
+  {
+    SLICERRT_TRACE_SCOPE("DicomRtImportExport", "Read DICOM");
+    rtReader->Update();
+  }
 
   // One series can contain composite information, e.g, an RTPLAN series can contain structure sets and plans as well
   // TODO: vtkSlicerDicomRtReader class does not support this yet
@@ -1761,6 +2070,8 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable
 //----------------------------------------------------------------------------
 std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkCollection* exportables)
 {
+  SLICERRT_TRACE_SCOPE("DicomRtImportExport", "ExportDicomRTStudy");
+
   std::string error("");
   vtkMRMLScene* mrmlScene = this->GetMRMLScene();
   if (!mrmlScene)
@@ -2002,7 +2313,33 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
   // Convert input segmentation to the format Plastimatch can use
   if (segmentationNode)
   {
-    // If master representation is labelmap type, then export binary labelmap
+    // Segments are prepared for the writer in parallel. Linear parent transforms are passed to the
+    // threads as a matrix, non-linear transforms cannot be safely shared so then segments are prepared serially
+    vtkSmartPointer<vtkMatrix4x4> nodeToWorldMatrix;
+    vtkSmartPointer<vtkGeneralTransform> nodeToWorldTransform;
+    vtkMRMLTransformNode* parentTransformNode = segmentationNode->GetParentTransformNode();
+    if (parentTransformNode)
+    {
+      if (parentTransformNode->IsTransformToWorldLinear())
+      {
+        nodeToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+        parentTransformNode->GetMatrixTransformToWorld(nodeToWorldMatrix);
+      }
+      else
+      {
+        nodeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+        parentTransformNode->GetTransformToWorld(nodeToWorldTransform);
+      }
+    }
+    bool prepareSegmentsInParallel = (nodeToWorldTransform.GetPointer() == NULL);
+
+    // Get segments to export
+    std::vector< std::string > segmentIDs;
+    segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    vtkIdType numberOfSegments = static_cast<vtkIdType>(segmentIDs.size());
+    std::vector<SegmentSliceContours> segmentContours(numberOfSegments);
+
+    // If master representation is labelmap type, then export planar contours extracted from the binary labelmaps
     vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
     if (segmentation->IsMasterRepresentationImageData())
     {
@@ -2015,15 +2352,12 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
         return error;
       }
 
-      // Export each segment in segmentation
-      std::vector< std::string > segmentIDs;
-      segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+      // Get binary labelmap representation of each segment
+      std::vector<vtkOrientedImageData*> binaryLabelmaps;
       for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
       {
         std::string segmentID = *segmentIdIt;
         vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt);
-
-        // Get binary labelmap representation
         vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(
           segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
         if (!binaryLabelmap)
@@ -2032,47 +2366,31 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
           vtkErrorMacro("ExportDicomRTStudy: " + error);
           return error;
         }
-        // Temporarily copy labelmap image data as it will be probably resampled
-        vtkSmartPointer<vtkOrientedImageData> binaryLabelmapCopy = vtkSmartPointer<vtkOrientedImageData>::New();
-        binaryLabelmapCopy->DeepCopy(binaryLabelmap);
-
-        // Apply parent transformation nodes if necessary
-        if (segmentationNode->GetParentTransformNode())
-        {
-          if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, binaryLabelmapCopy))
-          {
-            std::string errorMessage("Failed to apply parent transformation to exported segment");
-            vtkErrorMacro("ExportDicomRTStudy: " << errorMessage);
-            return errorMessage;
-          }
-        }
-        // Make sure the labelmap dimensions match the reference dimensions
-        if ( !vtkOrientedImageDataResample::DoGeometriesMatch(imageOrientedImageData, binaryLabelmapCopy)
-          || !vtkOrientedImageDataResample::DoExtentsMatch(imageOrientedImageData, binaryLabelmapCopy) )
-        {
-          if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(binaryLabelmapCopy, imageOrientedImageData, binaryLabelmapCopy))
-          {
-            error = "Failed to resample segment " + segmentID + " to match anatomical image geometry";
-            vtkErrorMacro("ExportDicomRTStudy: " + error);
-            return error;
-          }
-        }
+        binaryLabelmaps.push_back(binaryLabelmap);
+      }
 
-        // Convert mask to Plm image
-        Plm_image::Pointer plmStructure = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(binaryLabelmapCopy);
-        if (!plmStructure)
+      // Transform, resample and extract the planar contours of the segments in parallel. Each segment
+      // is one work item, so a thread only holds the reference-sized labelmap of its current segment
+      std::vector<std::string> segmentErrors(numberOfSegments);
+      PrepareLabelmapSegmentsFunctor prepareSegments(segmentIDs, binaryLabelmaps,
+        nodeToWorldMatrix, nodeToWorldTransform, imageOrientedImageData, imageSliceUIDs, segmentContours, segmentErrors);
+      if (prepareSegmentsInParallel)
+      {
+        vtkSMPTools::For(0, numberOfSegments, 1, prepareSegments);
+      }
+      else
+      {
+        prepareSegments(0, numberOfSegments);
+      }
+      for (vtkIdType segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+      {
+        if (!segmentErrors[segmentIndex].empty())
         {
-          error = "Failed to convert segment labelmap " + segmentID + " to Plastimatch image";
+          error = segmentErrors[segmentIndex];
           vtkErrorMacro("ExportDicomRTStudy: " + error);
           return error;
         }
-
-        // Get segment properties
-        std::string segmentName = segment->GetName();
-        double* segmentColor = segment->GetColor();
-
-        rtWriter->AddStructure(plmStructure->itk_uchar(), segmentName.c_str(), segmentColor);
-      } // For each segment
+      }
     }
     // If master representation is poly data type, then export from closed surface
     else if (segmentation->IsMasterRepresentationPolyData())
@@ -2086,33 +2404,12 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
         return error;
       }
 
-      // Get transform  from segmentation to world (RAS)
-      vtkSmartPointer<vtkGeneralTransform> nodeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-      nodeToWorldTransform->Identity();
-      if (segmentationNode->GetParentTransformNode())
-      {
-        segmentationNode->GetParentTransformNode()->GetTransformToWorld(nodeToWorldTransform);
-      }
-      // Initialize poly data transformer
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetTransform(nodeToWorldTransform);
-
-      // Initialize cutting plane with normal of the Z axis of the anatomical image
-      vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-      imageOrientedImageData->GetImageToWorldMatrix(imageToWorldMatrix);
-      double normal[3] = { imageToWorldMatrix->GetElement(0,2), imageToWorldMatrix->GetElement(1,2), imageToWorldMatrix->GetElement(2,2) };
-      vtkSmartPointer<vtkPlane> slicePlane = vtkSmartPointer<vtkPlane>::New();
-      slicePlane->SetNormal(normal);
-
-      // Export each segment in segmentation
-      std::vector< std::string > segmentIDs;
-      segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+      // Get closed surface representation of each segment
+      std::vector<vtkPolyData*> closedSurfaces;
       for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
       {
         std::string segmentID = *segmentIdIt;
         vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt);
-
-        // Get closed surface representation
         vtkPolyData* closedSurfacePolyData = vtkPolyData::SafeDownCast(
           segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()) );
         if (!closedSurfacePolyData)
@@ -2121,71 +2418,24 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
           vtkErrorMacro("ExportDicomRTStudy: " + error);
           return error;
         }
+        closedSurfaces.push_back(closedSurfacePolyData);
+      }
 
-        // Initialize cutter pipeline for segment
-        transformPolyData->SetInputData(closedSurfacePolyData);
-        vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
-        cutter->SetInputConnection(transformPolyData->GetOutputPort());
-        cutter->SetGenerateCutScalars(0);
-        vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
-        stripper->SetInputConnection(cutter->GetOutputPort());
-
-        // Get segment bounding box
-        double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
-        transformPolyData->Update();
-        transformPolyData->GetOutput()->GetBounds(bounds);
-
-        // Containers to be passed to the writer
-        std::vector<int> sliceNumbers;
-        std::vector<std::string> sliceUIDs;
-        std::vector<vtkPolyData*> sliceContours;
-
-        // Create planar contours from closed surface based on each of the anatomical image slices
-        int imageExtent[6] = {0,-1,0,-1,0,-1};
-        imageOrientedImageData->GetExtent(imageExtent);
-        for (int slice=imageExtent[4]; slice<imageExtent[5]; ++slice)
-        {
-          // Calculate slice origin
-          double origin[3] = { imageToWorldMatrix->GetElement(0,3) + slice*normal[0],
-                               imageToWorldMatrix->GetElement(1,3) + slice*normal[1],
-                               imageToWorldMatrix->GetElement(2,3) + slice*normal[2] };
-          slicePlane->SetOrigin(origin);
-          if (origin[2] < bounds[4] || origin[2] > bounds[5])
-          {
-            // No contours outside surface bounds
-            continue;
-          }
-
-          // Cut closed surface at slice
-          cutter->SetCutFunction(slicePlane);
-
-          // Get instance UID of corresponding slice
-          int sliceNumber = slice-imageExtent[0];
-          sliceNumbers.push_back(sliceNumber);
-          std::string sliceInstanceUID = (imageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? imageSliceUIDs[sliceNumber] : "");
-          sliceUIDs.push_back(sliceInstanceUID);
-
-          // Save slice contour
-          stripper->Update();
-          vtkPolyData* sliceContour = vtkPolyData::New();
-          sliceContour->SetPoints(stripper->GetOutput()->GetPoints());
-          sliceContour->SetPolys(stripper->GetOutput()->GetLines());
-          sliceContours.push_back(sliceContour);
-        } // For each anatomical image slice
-
-        // Get segment properties
-        std::string segmentName = segment->GetName();
-        double* segmentColor = segment->GetColor();
-
-        // Add contours to writer
-        rtWriter->AddStructure(segmentName.c_str(), segmentColor, sliceNumbers, sliceUIDs, sliceContours);
-
-        // Clean up slice contours
-        for (std::vector<vtkPolyData*>::iterator contourIt=sliceContours.begin(); contourIt!=sliceContours.end(); ++contourIt)
-        {
-          (*contourIt)->Delete();
-        }
-      } // For each segment
+      // Create planar contours from closed surfaces based on each of the anatomical image slices
+      vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      imageOrientedImageData->GetImageToWorldMatrix(imageToWorldMatrix);
+      int imageExtent[6] = {0,-1,0,-1,0,-1};
+      imageOrientedImageData->GetExtent(imageExtent);
+      PrepareClosedSurfaceSegmentsFunctor prepareSegments(closedSurfaces,
+        nodeToWorldMatrix, nodeToWorldTransform, imageToWorldMatrix, imageExtent, imageSliceUIDs, segmentContours);
+      if (prepareSegmentsInParallel)
+      {
+        vtkSMPTools::For(0, numberOfSegments, 1, prepareSegments);
+      }
+      else
+      {
+        prepareSegments(0, numberOfSegments);
+      }
     }
     else
     {
@@ -2193,11 +2443,32 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
       vtkErrorMacro("ExportDicomRTStudy: " + error);
       return error;
     }
+
+    // Add contours to writer in order
+    for (vtkIdType segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+    {
+      // Get segment properties
+      vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(segmentIDs[segmentIndex]);
+      std::string segmentName = segment->GetName();
+      double* segmentColor = segment->GetColor();
+
+      // Writer takes raw pointers, the contours are owned by the segment contours container
+      SegmentSliceContours& contours = segmentContours[segmentIndex];
+      std::vector<vtkPolyData*> sliceContours;
+      for (std::vector<vtkSmartPointer<vtkPolyData> >::iterator contourIt=contours.SliceContours.begin(); contourIt!=contours.SliceContours.end(); ++contourIt)
+      {
+        sliceContours.push_back(*contourIt);
+      }
+      rtWriter->AddStructure(segmentName.c_str(), segmentColor, contours.SliceNumbers, contours.SliceUIDs, sliceContours);
+    } // For each segment
   }
 
   // Write files to disk
   rtWriter->SetFileName(outputPath);
-  rtWriter->Write();
+  {
+    SLICERRT_TRACE_SCOPE("DicomRtImportExport", "Write DICOM");
+    rtWriter->Write();
+  }
 
   // Success (error is empty string)
   return error;
@@ -26,6 +26,7 @@
 
 // SlicerRt includes
 #include "SlicerRtCommon.h"
+#include "vtkBeamControlPointSequence.h"
 
 // VTK includes
 #include <vtkCellArray.h>
@@ -36,6 +37,8 @@
 #include <vtkSmartPointer.h>
 
 // STD includes
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <map>
 
@@ -122,6 +125,7 @@ public:
       LeafJawPositions[0][1]=0.0;
       LeafJawPositions[1][0]=0.0;
       LeafJawPositions[1][1]=0.0;
+      ControlPoints=vtkSmartPointer<vtkBeamControlPointSequence>::New();
     }
     unsigned int Number;
     std::string Name;
@@ -129,18 +133,16 @@ public:
     std::string Description;
     double IsocenterPositionRas[3];
 
-    // TODO: 
-    // In case of VMAT the following parameters can change by each control point
-    //   (this is not supported yet!)
-    // In case of IMRT, these are fixed (for Slicer visualization, in reality there is
-    //   a second control point that defines the CumulativeMetersetWeight to know when
-    //   to end irradiation.
+    // Parameters of the first control point. In case of VMAT these change by each
+    // control point, the parameters of all control points are in ControlPoints
     double SourceAxisDistance;
     double GantryAngle;
     double PatientSupportAngle;
     double BeamLimitingDeviceAngle;
     /// Jaw positions: X and Y positions with isocenter as origin (e.g. {{-50,50}{-50,50}} )
     double LeafJawPositions[2][2];
+    /// All control points of the beam, including MLC leaf positions
+    vtkSmartPointer<vtkBeamControlPointSequence> ControlPoints;
   };
 
   /// List of loaded contour ROIs from structure set
@@ -518,89 +520,194 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTPlan(DcmDataset* dataset)
       currentBeamSequenceObject.getSourceAxisDistance(sourceAxisDistance);
       beamEntry.SourceAxisDistance = sourceAxisDistance;
 
+      vtkTypeFloat64 finalCumulativeMetersetWeight = 1.0;
+      if (currentBeamSequenceObject.getFinalCumulativeMetersetWeight(finalCumulativeMetersetWeight).good())
+      {
+        beamEntry.ControlPoints->SetFinalCumulativeMetersetWeight(finalCumulativeMetersetWeight);
+      }
+
+      // Get MLC definition of the beam. The number of leaves and their widths depend on the machine
+      bool hasXJaws = false;
+      bool hasYJaws = false;
+      DRTBeamLimitingDeviceSequenceInRTBeamsModule &rtBeamLimitingDeviceSequenceObject = currentBeamSequenceObject.getBeamLimitingDeviceSequence();
+      if (rtBeamLimitingDeviceSequenceObject.gotoFirstItem().good())
+      {
+        do
+        {
+          DRTBeamLimitingDeviceSequenceInRTBeamsModule::Item &beamLimitingDeviceItem = rtBeamLimitingDeviceSequenceObject.getCurrentItem();
+          if (!beamLimitingDeviceItem.isValid())
+          {
+            continue;
+          }
+          OFString rtBeamLimitingDeviceType("");
+          beamLimitingDeviceItem.getRTBeamLimitingDeviceType(rtBeamLimitingDeviceType);
+          if ( !rtBeamLimitingDeviceType.compare("ASYMX") || !rtBeamLimitingDeviceType.compare("X") )
+          {
+            hasXJaws = true;
+          }
+          else if ( !rtBeamLimitingDeviceType.compare("ASYMY") || !rtBeamLimitingDeviceType.compare("Y") )
+          {
+            hasYJaws = true;
+          }
+          else if ( !rtBeamLimitingDeviceType.compare("MLCX") || !rtBeamLimitingDeviceType.compare("MLCY") )
+          {
+            Sint32 numberOfLeafPairs = 0;
+            beamLimitingDeviceItem.getNumberOfLeafJawPairs(numberOfLeafPairs);
+            OFVector<vtkTypeFloat64> leafPositionBoundaries;
+            beamLimitingDeviceItem.getLeafPositionBoundaries(leafPositionBoundaries);
+            if (numberOfLeafPairs <= 0 || leafPositionBoundaries.size() != static_cast<size_t>(numberOfLeafPairs + 1))
+            {
+              vtkWarningWithObjectMacro(this->External, "LoadRTPlan: Invalid leaf position boundaries in multi-leaf collimator of beam " << beamEntry.Name);
+              continue;
+            }
+            std::vector<double> boundaries(leafPositionBoundaries.begin(), leafPositionBoundaries.end());
+            beamEntry.ControlPoints->SetMLC(numberOfLeafPairs, &boundaries[0],
+              !rtBeamLimitingDeviceType.compare("MLCX") ? vtkBeamControlPointSequence::MLCX : vtkBeamControlPointSequence::MLCY );
+          }
+        }
+        while (rtBeamLimitingDeviceSequenceObject.gotoNextItem().good());
+      }
+
+      // Parameters of the current control point. DICOM control points only contain the parameters
+      // that change, so the values are carried over from the previous control point
+      int numberOfLeafPairs = beamEntry.ControlPoints->GetNumberOfLeafPairs();
+      double jawPositions[4] = {0.0, 0.0, 0.0, 0.0};
+      if (numberOfLeafPairs > 0)
+      {
+        // Limit the field by the MLC extent along the axes without jaws
+        const double* boundaries = beamEntry.ControlPoints->GetLeafPairBoundaries();
+        double mlcHalfExtent = fabs(boundaries[0]) > fabs(boundaries[numberOfLeafPairs]) ? fabs(boundaries[0]) : fabs(boundaries[numberOfLeafPairs]);
+        if (!hasXJaws)
+        {
+          jawPositions[0] = -mlcHalfExtent;
+          jawPositions[1] = mlcHalfExtent;
+        }
+        if (!hasYJaws)
+        {
+          jawPositions[2] = -mlcHalfExtent;
+          jawPositions[3] = mlcHalfExtent;
+        }
+      }
+      std::vector<double> leafPositions(2*numberOfLeafPairs, 0.0);
+      vtkTypeFloat64 gantryAngle = 0.0;
+      vtkTypeFloat64 patientSupportAngle = 0.0;
+      vtkTypeFloat64 beamLimitingDeviceAngle = 0.0;
+      vtkTypeFloat64 cumulativeMetersetWeight = 0.0;
+
       DRTControlPointSequence &rtControlPointSequenceObject = currentBeamSequenceObject.getControlPointSequence();
       if (rtControlPointSequenceObject.gotoFirstItem().good())
       {
-        // do // TODO: comment out for now since only first control point is loaded (as isocenter)
+        do
         {
           DRTControlPointSequence::Item &controlPointItem = rtControlPointSequenceObject.getCurrentItem();
-          if (controlPointItem.isValid())
+          if (!controlPointItem.isValid())
           {
-            OFVector<vtkTypeFloat64> isocenterPositionDataLps;
-            controlPointItem.getIsocenterPosition(isocenterPositionDataLps);
+            continue;
+          }
+          bool firstControlPoint = (beamEntry.ControlPoints->GetNumberOfControlPoints() == 0);
 
+          // Only the first control point is used as isocenter (it is the same for all control points)
+          OFVector<vtkTypeFloat64> isocenterPositionDataLps;
+          if (firstControlPoint && controlPointItem.getIsocenterPosition(isocenterPositionDataLps).good() && isocenterPositionDataLps.size() >= 3)
+          {
             // Convert from DICOM LPS -> Slicer RAS
             beamEntry.IsocenterPositionRas[0] = -isocenterPositionDataLps[0];
             beamEntry.IsocenterPositionRas[1] = -isocenterPositionDataLps[1];
             beamEntry.IsocenterPositionRas[2] = isocenterPositionDataLps[2];
+          }
 
-            vtkTypeFloat64 gantryAngle = 0.0;
-            controlPointItem.getGantryAngle(gantryAngle);
-            beamEntry.GantryAngle = gantryAngle;
+          vtkTypeFloat64 value = 0.0;
+          if (controlPointItem.getGantryAngle(value).good())
+          {
+            gantryAngle = value;
+          }
+          if (controlPointItem.getPatientSupportAngle(value).good())
+          {
+            patientSupportAngle = value;
+          }
+          if (controlPointItem.getBeamLimitingDeviceAngle(value).good())
+          {
+            beamLimitingDeviceAngle = value;
+          }
+          if (controlPointItem.getCumulativeMetersetWeight(value).good())
+          {
+            cumulativeMetersetWeight = value;
+          }
 
-            vtkTypeFloat64 patientSupportAngle = 0.0;
-            controlPointItem.getPatientSupportAngle(patientSupportAngle);
-            beamEntry.PatientSupportAngle = patientSupportAngle;
+          DRTBeamLimitingDevicePositionSequence &currentCollimatorPositionSequenceObject =
+            controlPointItem.getBeamLimitingDevicePositionSequence();
+          if (currentCollimatorPositionSequenceObject.gotoFirstItem().good())
+          {
+            do 
+            {
+              DRTBeamLimitingDevicePositionSequence::Item &collimatorPositionItem =
+                currentCollimatorPositionSequenceObject.getCurrentItem();
+              if (!collimatorPositionItem.isValid())
+              {
+                continue;
+              }
+              OFString rtBeamLimitingDeviceType("");
+              collimatorPositionItem.getRTBeamLimitingDeviceType(rtBeamLimitingDeviceType);
 
-            vtkTypeFloat64 beamLimitingDeviceAngle = 0.0;
-            controlPointItem.getBeamLimitingDeviceAngle(beamLimitingDeviceAngle);
-            beamEntry.BeamLimitingDeviceAngle = beamLimitingDeviceAngle;
+              OFVector<vtkTypeFloat64> leafJawPositions;
+              if (collimatorPositionItem.getLeafJawPositions(leafJawPositions).bad())
+              {
+                vtkDebugWithObjectMacro(this->External, "LoadRTPlan: No jaw position found in collimator entry");
+                continue;
+              }
 
-            DRTBeamLimitingDevicePositionSequence &currentCollimatorPositionSequenceObject =
-              controlPointItem.getBeamLimitingDevicePositionSequence();
-            if (currentCollimatorPositionSequenceObject.gotoFirstItem().good())
-            {
-              do 
+              if ( !rtBeamLimitingDeviceType.compare("ASYMX") || !rtBeamLimitingDeviceType.compare("X") )
+              {
+                if (leafJawPositions.size() >= 2)
+                {
+                  jawPositions[0] = leafJawPositions[0];
+                  jawPositions[1] = leafJawPositions[1];
+                }
+              }
+              else if ( !rtBeamLimitingDeviceType.compare("ASYMY") || !rtBeamLimitingDeviceType.compare("Y") )
               {
-                DRTBeamLimitingDevicePositionSequence::Item &collimatorPositionItem =
-                  currentCollimatorPositionSequenceObject.getCurrentItem();
-                if (collimatorPositionItem.isValid())
+                if (leafJawPositions.size() >= 2)
                 {
-                  OFString rtBeamLimitingDeviceType("");
-                  collimatorPositionItem.getRTBeamLimitingDeviceType(rtBeamLimitingDeviceType);
-
-                  OFVector<vtkTypeFloat64> leafJawPositions;
-                  OFCondition getJawPositionsCondition = collimatorPositionItem.getLeafJawPositions(leafJawPositions);
-
-                  if ( !rtBeamLimitingDeviceType.compare("ASYMX") || !rtBeamLimitingDeviceType.compare("X") )
-                  {
-                    if (getJawPositionsCondition.good())
-                    {
-                      beamEntry.LeafJawPositions[0][0] = leafJawPositions[0];
-                      beamEntry.LeafJawPositions[0][1] = leafJawPositions[1];
-                    }
-                    else
-                    {
-                      vtkDebugWithObjectMacro(this->External, "LoadRTPlan: No jaw position found in collimator entry");
-                    }
-                  }
-                  else if ( !rtBeamLimitingDeviceType.compare("ASYMY") || !rtBeamLimitingDeviceType.compare("Y") )
-                  {
-                    if (getJawPositionsCondition.good())
-                    {
-                      beamEntry.LeafJawPositions[1][0] = leafJawPositions[0];
-                      beamEntry.LeafJawPositions[1][1] = leafJawPositions[1];
-                    }
-                    else
-                    {
-                      vtkDebugWithObjectMacro(this->External, "LoadRTPlan: No jaw position found in collimator entry");
-                    }
-                  }
-                  else if ( !rtBeamLimitingDeviceType.compare("MLCX") || !rtBeamLimitingDeviceType.compare("MLCY") )
-                  {
-                    vtkWarningWithObjectMacro(this->External, "LoadRTPlan: Multi-leaf collimator entry found. This collimator type is not yet supported!");
-                  }
-                  else
-                  {
-                    vtkErrorWithObjectMacro(this->External, "LoadRTPlan: Unsupported collimator type: " << rtBeamLimitingDeviceType);
-                  }
+                  jawPositions[2] = leafJawPositions[0];
+                  jawPositions[3] = leafJawPositions[1];
                 }
               }
-              while (currentCollimatorPositionSequenceObject.gotoNextItem().good());
+              else if ( !rtBeamLimitingDeviceType.compare("MLCX") || !rtBeamLimitingDeviceType.compare("MLCY") )
+              {
+                if (leafJawPositions.size() == leafPositions.size())
+                {
+                  std::copy(leafJawPositions.begin(), leafJawPositions.end(), leafPositions.begin());
+                }
+                else
+                {
+                  vtkWarningWithObjectMacro(this->External, "LoadRTPlan: Number of leaf positions (" << leafJawPositions.size()
+                    << ") does not match the multi-leaf collimator definition (" << leafPositions.size() << ") in beam " << beamEntry.Name);
+                }
+              }
+              else
+              {
+                vtkErrorWithObjectMacro(this->External, "LoadRTPlan: Unsupported collimator type: " << rtBeamLimitingDeviceType);
+              }
             }
-          } // endif controlPointItem.isValid()
+            while (currentCollimatorPositionSequenceObject.gotoNextItem().good());
+          }
+
+          beamEntry.ControlPoints->AddControlPoint(gantryAngle, beamLimitingDeviceAngle, patientSupportAngle,
+            cumulativeMetersetWeight, jawPositions, (numberOfLeafPairs > 0 ? &leafPositions[0] : NULL) );
+
+          // Beam parameters are those of the first control point
+          if (firstControlPoint)
+          {
+            beamEntry.GantryAngle = gantryAngle;
+            beamEntry.PatientSupportAngle = patientSupportAngle;
+            beamEntry.BeamLimitingDeviceAngle = beamLimitingDeviceAngle;
+            beamEntry.LeafJawPositions[0][0] = jawPositions[0];
+            beamEntry.LeafJawPositions[0][1] = jawPositions[1];
+            beamEntry.LeafJawPositions[1][0] = jawPositions[2];
+            beamEntry.LeafJawPositions[1][1] = jawPositions[3];
+          }
         }
-        // while (rtControlPointSequenceObject.gotoNextItem().good());
+        while (rtControlPointSequenceObject.gotoNextItem().good());
       }
 
       this->BeamSequenceVector.push_back(beamEntry);
@@ -1468,3 +1575,15 @@ void vtkSlicerDicomRtReader::GetBeamLeafJawPositions(unsigned int beamNumber, do
   jawPositions[1][0]=beam->LeafJawPositions[1][0];
   jawPositions[1][1]=beam->LeafJawPositions[1][1];
 }
+
+//----------------------------------------------------------------------------
+vtkBeamControlPointSequence* vtkSlicerDicomRtReader::GetBeamControlPoints(unsigned int beamNumber)
+{
+  vtkInternal::BeamEntry* beam=this->Internal->FindBeamByNumber(beamNumber);
+  if (beam==NULL)
+  {
+    vtkErrorMacro("GetBeamControlPoints: Unable to find beam of number" << beamNumber);
+    return NULL;
+  }
+  return beam->ControlPoints;
+}
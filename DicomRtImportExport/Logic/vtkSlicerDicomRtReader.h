@@ -35,6 +35,7 @@
 // VTK includes
 #include <vtkObject.h>
 
+class vtkBeamControlPointSequence;
 class vtkPolyData;
 
 // Due to some reason the Python wrapping of this class fails, therefore
@@ -105,6 +106,9 @@ public:
   /// \param jawPositions Array in which the jaw positions are copied
   void GetBeamLeafJawPositions(unsigned int beamNumber, double jawPositions[2][2]);
 
+  /// Get all control points of a given beam, including the MLC leaf positions
+  vtkBeamControlPointSequence* GetBeamControlPoints(unsigned int beamNumber);
+
   /// Set input file name
   vtkSetStringMacro(FileName);
 
@@ -0,0 +1,139 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSphereSource.h>
+#include <vtkMath.h>
+#include <vtkTestingOutputWindow.h>
+
+// DicomRTImportExport includes
+#include "vtkClosedSurfaceSlicer.h"
+
+namespace
+{
+  const double RADIUS = 10.0;
+  const double CENTER[3] = {1.0, -2.0, 0.3};
+  const double SLICE_SPACING = 2.5;
+  const double SLICE_ORIGIN = -20.0;
+}
+
+//----------------------------------------------------------------------------
+int vtkClosedSurfaceSlicerTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkSphereSource> sphereSource;
+  sphereSource->SetRadius(RADIUS);
+  sphereSource->SetCenter(CENTER[0], CENTER[1], CENTER[2]);
+  sphereSource->SetThetaResolution(64);
+  sphereSource->SetPhiResolution(32);
+  sphereSource->Update();
+
+  // Axial slices with thick spacing
+  vtkNew<vtkMatrix4x4> imageToWorldMatrix;
+  imageToWorldMatrix->SetElement(2,2, SLICE_SPACING);
+  imageToWorldMatrix->SetElement(0,3, SLICE_ORIGIN);
+  imageToWorldMatrix->SetElement(1,3, SLICE_ORIGIN);
+  imageToWorldMatrix->SetElement(2,3, SLICE_ORIGIN);
+
+  vtkNew<vtkClosedSurfaceSlicer> slicer;
+  slicer->SetInputSurface(sphereSource->GetOutput());
+  slicer->SetImageToWorldMatrix(imageToWorldMatrix.GetPointer());
+  slicer->SetSliceRange(0, 16);
+  slicer->Update();
+
+  // Slices strictly between the poles of the sphere
+  int expectedFirstSlice = static_cast<int>(ceil((CENTER[2] - RADIUS - SLICE_ORIGIN) / SLICE_SPACING));
+  int expectedLastSlice = static_cast<int>(floor((CENTER[2] + RADIUS - SLICE_ORIGIN) / SLICE_SPACING));
+  int expectedNumberOfSlices = expectedLastSlice - expectedFirstSlice + 1;
+  if (slicer->GetNumberOfContourSlices() != expectedNumberOfSlices)
+  {
+    std::cerr << __LINE__ << ": Number of contour slices: " << slicer->GetNumberOfContourSlices()
+      << " does not match expected value: " << expectedNumberOfSlices << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (int contourSlice=0; contourSlice<slicer->GetNumberOfContourSlices(); ++contourSlice)
+  {
+    int sliceIndex = slicer->GetContourSliceIndex(contourSlice);
+    if (sliceIndex != expectedFirstSlice + contourSlice)
+    {
+      std::cerr << __LINE__ << ": Contour slice index: " << sliceIndex << " does not match expected value: "
+        << expectedFirstSlice + contourSlice << "!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // One closed loop per slice
+    vtkPolyData* contour = slicer->GetContourSlice(contourSlice);
+    if (contour->GetNumberOfPolys() != 1 || contour->GetNumberOfLines() != 0)
+    {
+      std::cerr << __LINE__ << ": Slice " << sliceIndex << " has " << contour->GetNumberOfPolys() << " closed and "
+        << contour->GetNumberOfLines() << " open contours instead of one closed contour!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Contour points are on the slice plane and on the surface (between the inscribed and the exact sphere)
+    double sliceZ = SLICE_ORIGIN + sliceIndex * SLICE_SPACING;
+    vtkIdType numberOfLoopPoints = 0;
+    vtkIdType* loopPointIds = NULL;
+    vtkCellArray* polys = contour->GetPolys();
+    polys->InitTraversal();
+    polys->GetNextCell(numberOfLoopPoints, loopPointIds);
+    if (numberOfLoopPoints != contour->GetNumberOfPoints())
+    {
+      std::cerr << __LINE__ << ": Slice " << sliceIndex << " contour contains " << numberOfLoopPoints << " of "
+        << contour->GetNumberOfPoints() << " points!" << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (vtkIdType pointIndex=0; pointIndex<numberOfLoopPoints; ++pointIndex)
+    {
+      double point[3] = {0.0,0.0,0.0};
+      contour->GetPoint(loopPointIds[pointIndex], point);
+      double distance = sqrt(vtkMath::Distance2BetweenPoints(point, CENTER));
+      if (fabs(point[2] - sliceZ) > 1e-6 || distance > RADIUS + 1e-6 || distance < 0.99 * RADIUS)
+      {
+        std::cerr << __LINE__ << ": Slice " << sliceIndex << " contour point (" << point[0] << ", " << point[1] << ", " << point[2]
+          << ") is not on the sphere surface at the slice plane!" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // Open surface: a sphere with a wedge cut out gives open arcs, which would be written as closed
+  // contours connecting the ends of the arcs. They are dropped with a warning
+  sphereSource->SetEndTheta(270.0);
+  sphereSource->Update();
+  slicer->SetInputSurface(sphereSource->GetOutput());
+  TESTING_OUTPUT_ASSERT_WARNINGS_BEGIN();
+  slicer->Update();
+  TESTING_OUTPUT_ASSERT_WARNINGS_END();
+  if (slicer->GetNumberOfContourSlices() != 0)
+  {
+    std::cerr << __LINE__ << ": Open surface resulted in " << slicer->GetNumberOfContourSlices()
+      << " contour slices instead of none!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Closed surface slicer test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+
+// SegmentationCore includes
+#include <vtkSegmentationConverter.h>
+#include <vtkOrientedImageData.h>
+#include <vtkPolyDataToFractionalLabelmapFilter.h>
+
+// DicomRTImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
+
+namespace
+{
+  const int NUMBER_OF_CONTOUR_POINTS = 64;
+  const int NUMBER_OF_PLANES = 10;
+  const double RADIUS = 10.0;
+  const double CENTER[2] = {0.3, 0.2};
+}
+
+void CreateCylinderContourPolyData(vtkPolyData* polyData);
+
+//----------------------------------------------------------------------------
+int vtkPlanarContourToLabelmapConversionTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkPolyData> contourPolyData;
+  CreateCylinderContourPolyData(contourPolyData.GetPointer());
+
+  // Reference geometry with unit spacing, contour planes are on the slices
+  vtkNew<vtkOrientedImageData> referenceImage;
+  referenceImage->SetExtent(-20, 20, -20, 20, -5, 15);
+  std::string geometryString = vtkSegmentationConverter::SerializeImageGeometry(referenceImage.GetPointer());
+
+  // Binary labelmap: voxel centers inside the contour polygon in each contour plane
+  vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> binaryRule;
+  binaryRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), geometryString);
+  vtkNew<vtkOrientedImageData> binaryLabelmap;
+  if (!binaryRule->Convert(contourPolyData.GetPointer(), binaryLabelmap.GetPointer()))
+  {
+    std::cerr << __LINE__ << ": Failed to convert planar contours to binary labelmap!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int expectedInsideVoxelsPerSlice = 0;
+  double vertexAngle = 2.0 * vtkMath::Pi() / NUMBER_OF_CONTOUR_POINTS;
+  double apothem = RADIUS * cos(0.5 * vertexAngle);
+  for (int j=-20; j<=20; ++j)
+  {
+    for (int i=-20; i<=20; ++i)
+    {
+      // Inside of a regular polygon: within the apothem along the normal of every edge
+      double x = i - CENTER[0];
+      double y = j - CENTER[1];
+      bool inside = true;
+      for (int edge=0; edge<NUMBER_OF_CONTOUR_POINTS && inside; ++edge)
+      {
+        double normalAngle = (edge + 0.5) * vertexAngle;
+        inside = (x*cos(normalAngle) + y*sin(normalAngle) < apothem);
+      }
+      expectedInsideVoxelsPerSlice += (inside ? 1 : 0);
+    }
+  }
+
+  int binaryExtent[6] = {0,-1,0,-1,0,-1};
+  binaryLabelmap->GetExtent(binaryExtent);
+  int voxelCount = 0;
+  for (int k=binaryExtent[4]; k<=binaryExtent[5]; ++k)
+  {
+    for (int j=binaryExtent[2]; j<=binaryExtent[3]; ++j)
+    {
+      for (int i=binaryExtent[0]; i<=binaryExtent[1]; ++i)
+      {
+        voxelCount += (*static_cast<unsigned char*>(binaryLabelmap->GetScalarPointer(i,j,k)) > 0 ? 1 : 0);
+      }
+    }
+  }
+  int expectedVoxelCount = expectedInsideVoxelsPerSlice * NUMBER_OF_PLANES;
+  if (voxelCount != expectedVoxelCount)
+  {
+    std::cerr << __LINE__ << ": Binary voxel count: " << voxelCount << " does not match expected value: " << expectedVoxelCount << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Fractional labelmap: total fractional volume equals the volume of the extruded polygon
+  vtkNew<vtkPlanarContourToFractionalLabelmapConversionRule> fractionalRule;
+  fractionalRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), geometryString);
+  vtkNew<vtkOrientedImageData> fractionalLabelmap;
+  if (!fractionalRule->Convert(contourPolyData.GetPointer(), fractionalLabelmap.GetPointer()))
+  {
+    std::cerr << __LINE__ << ": Failed to convert planar contours to fractional labelmap!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (fractionalLabelmap->GetScalarType() != VTK_FRACTIONAL_DATA_TYPE)
+  {
+    std::cerr << __LINE__ << ": Fractional labelmap scalar type " << fractionalLabelmap->GetScalarType() << " is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int fractionalExtent[6] = {0,-1,0,-1,0,-1};
+  fractionalLabelmap->GetExtent(fractionalExtent);
+  double fractionalVolume = 0.0;
+  double minimumValue = FRACTIONAL_MAX;
+  double maximumValue = FRACTIONAL_MIN;
+  for (int k=fractionalExtent[4]; k<=fractionalExtent[5]; ++k)
+  {
+    for (int j=fractionalExtent[2]; j<=fractionalExtent[3]; ++j)
+    {
+      for (int i=fractionalExtent[0]; i<=fractionalExtent[1]; ++i)
+      {
+        double value = *static_cast<FRACTIONAL_DATA_TYPE*>(fractionalLabelmap->GetScalarPointer(i,j,k));
+        fractionalVolume += (value - FRACTIONAL_MIN) / (FRACTIONAL_MAX - FRACTIONAL_MIN);
+        minimumValue = std::min(minimumValue, value);
+        maximumValue = std::max(maximumValue, value);
+      }
+    }
+  }
+  if (minimumValue != FRACTIONAL_MIN || maximumValue != FRACTIONAL_MAX)
+  {
+    std::cerr << __LINE__ << ": Fractional range: " << minimumValue << ".." << maximumValue << " does not match expected range: "
+      << FRACTIONAL_MIN << ".." << FRACTIONAL_MAX << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double expectedFractionalVolume = 0.5 * NUMBER_OF_CONTOUR_POINTS * RADIUS * RADIUS * sin(vertexAngle) * NUMBER_OF_PLANES;
+  if (fabs(fractionalVolume - expectedFractionalVolume) > 0.002 * expectedFractionalVolume)
+  {
+    std::cerr << __LINE__ << ": Fractional volume: " << std::fixed << fractionalVolume << " does not match expected value: "
+      << expectedFractionalVolume << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Planar contour to labelmap conversion test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void CreateCylinderContourPolyData(vtkPolyData* polyData)
+{
+  if (!polyData)
+  {
+    return;
+  }
+
+  // Closed polylines as read from RT structure sets, the last point repeating the first
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  for (int plane=0; plane<NUMBER_OF_PLANES; ++plane)
+  {
+    lines->InsertNextCell(NUMBER_OF_CONTOUR_POINTS+1);
+    vtkIdType firstPointId = points->GetNumberOfPoints();
+    for (int pointIndex=0; pointIndex<NUMBER_OF_CONTOUR_POINTS; ++pointIndex)
+    {
+      double angle = 2.0 * vtkMath::Pi() * pointIndex / NUMBER_OF_CONTOUR_POINTS;
+      lines->InsertCellPoint(points->InsertNextPoint(CENTER[0] + RADIUS*cos(angle), CENTER[1] + RADIUS*sin(angle), plane));
+    }
+    lines->InsertCellPoint(firstPointId);
+  }
+  polyData->SetPoints(points.GetPointer());
+  polyData->SetLines(lines.GetPointer());
+}
@@ -0,0 +1,293 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtImportExportModuleLogic.h"
+
+// SlicerRt includes
+#include "SlicerRtCommon.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+#include <vtkSegment.h>
+#include <vtkSegmentation.h>
+#include <vtkSegmentationConverter.h>
+
+// Subject hierarchy includes
+#include "vtkMRMLSubjectHierarchyConstants.h"
+#include "vtkMRMLSubjectHierarchyNode.h"
+#include "vtkSlicerSubjectHierarchyModuleLogic.h"
+
+// DICOMLib includes
+#include "vtkSlicerDICOMExportable.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmrt/drtstrct.h>
+
+// STD includes
+#include <cmath>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDicomRtImportExportModuleLogicTest1(int argc, char * argv[])
+{
+  // Get temporary directory
+  const char *temporaryDirectoryPath = NULL;
+  if (argc > 2)
+  {
+    if (STRCASECMP(argv[1], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[2];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    }
+    else
+    {
+      std::cerr << "Invalid argument!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string outputDirectoryPath = std::string(temporaryDirectoryPath) + "/DicomRtExportMultiSegment";
+  vtksys::SystemTools::RemoveADirectory(outputDirectoryPath.c_str());
+  if (!vtksys::SystemTools::MakeDirectory(outputDirectoryPath.c_str()))
+  {
+    std::cerr << __LINE__ << ": Failed to create output directory " << outputDirectoryPath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Constrain the number of threads so that each thread extracts the contours of several segments
+  const int numberOfSegments = 7;
+  vtkMultiThreader::SetGlobalMaximumNumberOfThreads(2);
+
+  // Create scene and logic
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene);
+  if (!shNode)
+  {
+    std::cerr << __LINE__ << ": Failed to access subject hierarchy node" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkSlicerDicomRtImportExportModuleLogic> dicomRtLogic = vtkSmartPointer<vtkSlicerDicomRtImportExportModuleLogic>::New();
+  dicomRtLogic->SetMRMLScene(mrmlScene);
+
+  // Create anatomical volume
+  vtkNew<vtkImageData> anatomicalImage;
+  anatomicalImage->SetDimensions(32, 32, 3 * numberOfSegments + 2);
+  anatomicalImage->AllocateScalars(VTK_SHORT, 1);
+  short* anatomicalScalars = static_cast<short*>(anatomicalImage->GetScalarPointer());
+  for (vtkIdType index=0; index<anatomicalImage->GetNumberOfPoints(); ++index)
+  {
+    anatomicalScalars[index] = static_cast<short>(index % 100);
+  }
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> anatomicalVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  anatomicalVolumeNode->SetName("Anatomy");
+  anatomicalVolumeNode->SetSpacing(1.5, 1.5, 2.0);
+  anatomicalVolumeNode->SetOrigin(-24.0, -24.0, -20.0);
+  anatomicalVolumeNode->SetAndObserveImageData(anatomicalImage.GetPointer());
+  mrmlScene->AddNode(anatomicalVolumeNode);
+
+  // Create segmentation with one box segment per slab of slices
+  vtkSmartPointer<vtkOrientedImageData> referenceImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!SlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(anatomicalVolumeNode, referenceImage))
+  {
+    std::cerr << __LINE__ << ": Failed to convert anatomical volume to oriented image data" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkMatrix4x4> referenceToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceImage->GetImageToWorldMatrix(referenceToWorldMatrix);
+
+  vtkSmartPointer<vtkMRMLSegmentationNode> segmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  segmentationNode->SetName("Structures");
+  mrmlScene->AddNode(segmentationNode);
+  segmentationNode->GetSegmentation()->SetMasterRepresentationName(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() );
+
+  std::vector<std::string> segmentNames;
+  for (int segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    labelmap->SetExtent(referenceImage->GetExtent());
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    labelmap->SetGeometryFromImageToWorldMatrix(referenceToWorldMatrix);
+    unsigned char* labelmapScalars = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    int dims[3] = {0, 0, 0};
+    labelmap->GetDimensions(dims);
+    for (int k=0; k<dims[2]; ++k)
+    {
+      for (int j=0; j<dims[1]; ++j)
+      {
+        for (int i=0; i<dims[0]; ++i)
+        {
+          bool inside = ( i >= 4 + segmentIndex && i < 20 + segmentIndex
+            && j >= 6 && j < 24
+            && k >= 3 * segmentIndex + 1 && k < 3 * segmentIndex + 3 );
+          labelmapScalars[(k * dims[1] + j) * dims[0] + i] = (inside ? 1 : 0);
+        }
+      }
+    }
+
+    std::stringstream segmentNameStream;
+    segmentNameStream << "Box_" << segmentIndex;
+    segmentNames.push_back(segmentNameStream.str());
+
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(segmentNameStream.str().c_str());
+    segment->AddRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmap );
+    segmentationNode->GetSegmentation()->AddSegment(segment);
+  }
+
+  // Put the volume and the segmentation in the same study
+  const char* patientId = "RTEXPORTTEST";
+  const char* studyInstanceUid = "1.2.826.0.1.3680043.2.1125.1.1";
+  const char* anatomicalSeriesUid = "1.2.826.0.1.3680043.2.1125.1.2";
+  const char* structureSetSeriesUid = "1.2.826.0.1.3680043.2.1125.1.3";
+  vtkIdType anatomicalItemID = shNode->CreateItem(shNode->GetSceneItemID(), anatomicalVolumeNode);
+  shNode->SetItemUID(anatomicalItemID, vtkMRMLSubjectHierarchyConstants::GetDICOMUIDName(), anatomicalSeriesUid);
+  vtkSlicerSubjectHierarchyModuleLogic::InsertDicomSeriesInHierarchy(shNode, patientId, studyInstanceUid, anatomicalSeriesUid);
+  vtkIdType segmentationItemID = shNode->CreateItem(shNode->GetSceneItemID(), segmentationNode);
+  shNode->SetItemUID(segmentationItemID, vtkMRMLSubjectHierarchyConstants::GetDICOMUIDName(), structureSetSeriesUid);
+  vtkSlicerSubjectHierarchyModuleLogic::InsertDicomSeriesInHierarchy(shNode, patientId, studyInstanceUid, structureSetSeriesUid);
+
+  // Export
+  vtkNew<vtkCollection> exportables;
+  vtkIdType itemIDs[2] = { anatomicalItemID, segmentationItemID };
+  for (int exportableIndex=0; exportableIndex<2; ++exportableIndex)
+  {
+    vtkNew<vtkSlicerDICOMExportable> exportable;
+    exportable->SetSubjectHierarchyItemID(itemIDs[exportableIndex]);
+    exportable->SetDirectory(outputDirectoryPath.c_str());
+    exportable->SetTag(vtkMRMLSubjectHierarchyConstants::GetDICOMPatientNameTagName().c_str(), "RtExport^Test");
+    exportable->SetTag(vtkMRMLSubjectHierarchyConstants::GetDICOMPatientIDTagName().c_str(), patientId);
+    exportable->SetTag("Modality", "CT");
+    exportables->AddItem(exportable.GetPointer());
+  }
+
+  std::string error = dicomRtLogic->ExportDicomRTStudy(exportables.GetPointer());
+  vtkMultiThreader::SetGlobalMaximumNumberOfThreads(0);
+  if (!error.empty())
+  {
+    std::cerr << __LINE__ << ": Export failed: " << error << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Read back the structure set and check that every segment was written in order
+  std::string rtssFilePath = outputDirectoryPath + "/rtss.dcm";
+  DcmFileFormat fileFormat;
+  if (fileFormat.loadFile(rtssFilePath.c_str()).bad())
+  {
+    std::cerr << __LINE__ << ": Failed to load exported structure set " << rtssFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+  DRTStructureSetIOD rtStructureSetObject;
+  if (rtStructureSetObject.read(*fileFormat.getDataset()).bad())
+  {
+    std::cerr << __LINE__ << ": Failed to read structure set object from " << rtssFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  DRTStructureSetROISequence& roiSequence = rtStructureSetObject.getStructureSetROISequence();
+  if ((int)roiSequence.getNumberOfItems() != numberOfSegments)
+  {
+    std::cerr << __LINE__ << ": Number of exported ROIs is " << roiSequence.getNumberOfItems()
+      << " instead of " << numberOfSegments << std::endl;
+    return EXIT_FAILURE;
+  }
+  int roiIndex = 0;
+  for (OFCondition status = roiSequence.gotoFirstItem(); status.good(); status = roiSequence.gotoNextItem(), ++roiIndex)
+  {
+    OFString roiName("");
+    roiSequence.getCurrentItem().getROIName(roiName);
+    if (segmentNames[roiIndex].compare(roiName.c_str()))
+    {
+      std::cerr << __LINE__ << ": Exported ROI " << roiIndex << " is named '" << roiName.c_str()
+        << "' instead of '" << segmentNames[roiIndex] << "'" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  DRTROIContourSequence& roiContourSequence = rtStructureSetObject.getROIContourSequence();
+  if ((int)roiContourSequence.getNumberOfItems() != numberOfSegments)
+  {
+    std::cerr << __LINE__ << ": Number of exported ROI contours is " << roiContourSequence.getNumberOfItems()
+      << " instead of " << numberOfSegments << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Each box covers two slices, and has one closed contour on each of them
+  roiIndex = 0;
+  for (OFCondition status = roiContourSequence.gotoFirstItem(); status.good(); status = roiContourSequence.gotoNextItem(), ++roiIndex)
+  {
+    DRTContourSequence& contourSequence = roiContourSequence.getCurrentItem().getContourSequence();
+    if (contourSequence.getNumberOfItems() != 2)
+    {
+      std::cerr << __LINE__ << ": Exported ROI " << roiIndex << " contains " << contourSequence.getNumberOfItems()
+        << " contours instead of 2" << std::endl;
+      return EXIT_FAILURE;
+    }
+    int contourIndex = 0;
+    for (OFCondition contourStatus = contourSequence.gotoFirstItem(); contourStatus.good(); contourStatus = contourSequence.gotoNextItem(), ++contourIndex)
+    {
+      OFVector<Float64> contourData;
+      contourSequence.getCurrentItem().getContourData(contourData);
+      if (contourData.size() < 9 || contourData.size() % 3 != 0)
+      {
+        std::cerr << __LINE__ << ": Contour " << contourIndex << " of ROI " << roiIndex << " has "
+          << contourData.size() << " coordinates" << std::endl;
+        return EXIT_FAILURE;
+      }
+      double expectedSliceZ = -20.0 + 2.0 * (3 * roiIndex + 1 + contourIndex);
+      for (size_t coordinateIndex=2; coordinateIndex<contourData.size(); coordinateIndex+=3)
+      {
+        if (fabs(contourData[coordinateIndex] - expectedSliceZ) > 1e-3)
+        {
+          std::cerr << __LINE__ << ": Contour " << contourIndex << " of ROI " << roiIndex << " is at z=" << contourData[coordinateIndex]
+            << " instead of " << expectedSliceZ << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  std::cout << "DICOM-RT multi-segment export test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
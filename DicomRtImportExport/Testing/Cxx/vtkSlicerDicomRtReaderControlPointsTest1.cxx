@@ -0,0 +1,267 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+
+// SlicerRtCommon includes
+#include "vtkBeamControlPointSequence.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const int BEAM_NUMBER = 1;
+  const int NUMBER_OF_LEAF_PAIRS = 4;
+  const double TOLERANCE = 1e-6;
+
+  //----------------------------------------------------------------------------
+  void AddBeamLimitingDevice(DcmItem* beamItem, const char* type, const char* numberOfPairs, const char* boundaries)
+  {
+    DcmItem* deviceItem = NULL;
+    beamItem->findOrCreateSequenceItem(DCM_BeamLimitingDeviceSequence, deviceItem, -2);
+    deviceItem->putAndInsertString(DCM_RTBeamLimitingDeviceType, type);
+    deviceItem->putAndInsertString(DCM_NumberOfLeafJawPairs, numberOfPairs);
+    if (boundaries)
+    {
+      deviceItem->putAndInsertString(DCM_LeafPositionBoundaries, boundaries);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void AddBeamLimitingDevicePosition(DcmItem* controlPointItem, const char* type, const char* positions)
+  {
+    DcmItem* positionItem = NULL;
+    controlPointItem->findOrCreateSequenceItem(DCM_BeamLimitingDevicePositionSequence, positionItem, -2);
+    positionItem->putAndInsertString(DCM_RTBeamLimitingDeviceType, type);
+    positionItem->putAndInsertString(DCM_LeafJawPositions, positions);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Write an RT plan with one arc beam of three control points. Only the first control point
+  /// contains all parameters, the others only contain the ones that change.
+  bool WritePlan(const std::string& fileName)
+  {
+    DcmFileFormat fileFormat;
+    DcmDataset* dataset = fileFormat.getDataset();
+    dataset->putAndInsertString(DCM_SOPClassUID, UID_RTPlanStorage);
+    dataset->putAndInsertString(DCM_SOPInstanceUID, "1.2.826.0.1.3680043.2.1125.2.4");
+    dataset->putAndInsertString(DCM_StudyInstanceUID, "1.2.826.0.1.3680043.2.1125.2.1");
+    dataset->putAndInsertString(DCM_SeriesInstanceUID, "1.2.826.0.1.3680043.2.1125.2.2");
+    dataset->putAndInsertString(DCM_FrameOfReferenceUID, "1.2.826.0.1.3680043.2.1125.2.3");
+    dataset->putAndInsertString(DCM_Modality, "RTPLAN");
+    dataset->putAndInsertString(DCM_PatientName, "ControlPoints^Test");
+    dataset->putAndInsertString(DCM_PatientID, "RTPLANTEST");
+    dataset->putAndInsertString(DCM_RTPlanLabel, "Arc");
+    dataset->putAndInsertString(DCM_RTPlanGeometry, "PATIENT");
+
+    DcmItem* beamItem = NULL;
+    dataset->findOrCreateSequenceItem(DCM_BeamSequence, beamItem, -2);
+    beamItem->putAndInsertString(DCM_BeamNumber, "1");
+    beamItem->putAndInsertString(DCM_BeamName, "Arc1");
+    beamItem->putAndInsertString(DCM_BeamType, "DYNAMIC");
+    beamItem->putAndInsertString(DCM_RadiationType, "PHOTON");
+    beamItem->putAndInsertString(DCM_TreatmentDeliveryType, "TREATMENT");
+    beamItem->putAndInsertString(DCM_SourceAxisDistance, "1000");
+    beamItem->putAndInsertString(DCM_FinalCumulativeMetersetWeight, "1");
+    beamItem->putAndInsertString(DCM_NumberOfControlPoints, "3");
+    AddBeamLimitingDevice(beamItem, "ASYMX", "1", NULL);
+    AddBeamLimitingDevice(beamItem, "ASYMY", "1", NULL);
+    AddBeamLimitingDevice(beamItem, "MLCX", "4", "-20\\-10\\0\\10\\20");
+
+    DcmItem* controlPointItem = NULL;
+    beamItem->findOrCreateSequenceItem(DCM_ControlPointSequence, controlPointItem, -2);
+    controlPointItem->putAndInsertString(DCM_ControlPointIndex, "0");
+    controlPointItem->putAndInsertString(DCM_GantryAngle, "180");
+    controlPointItem->putAndInsertString(DCM_BeamLimitingDeviceAngle, "10");
+    controlPointItem->putAndInsertString(DCM_PatientSupportAngle, "5");
+    controlPointItem->putAndInsertString(DCM_CumulativeMetersetWeight, "0");
+    controlPointItem->putAndInsertString(DCM_IsocenterPosition, "1\\2\\3");
+    AddBeamLimitingDevicePosition(controlPointItem, "ASYMX", "-50\\50");
+    AddBeamLimitingDevicePosition(controlPointItem, "ASYMY", "-40\\40");
+    AddBeamLimitingDevicePosition(controlPointItem, "MLCX", "-5\\-6\\-7\\-8\\5\\6\\7\\8");
+
+    // Gantry rotates and the leaves move
+    beamItem->findOrCreateSequenceItem(DCM_ControlPointSequence, controlPointItem, -2);
+    controlPointItem->putAndInsertString(DCM_ControlPointIndex, "1");
+    controlPointItem->putAndInsertString(DCM_GantryAngle, "190");
+    controlPointItem->putAndInsertString(DCM_CumulativeMetersetWeight, "0.5");
+    AddBeamLimitingDevicePosition(controlPointItem, "MLCX", "-1\\-2\\-3\\-4\\1\\2\\3\\4");
+
+    // Gantry rotates and the Y jaws close
+    beamItem->findOrCreateSequenceItem(DCM_ControlPointSequence, controlPointItem, -2);
+    controlPointItem->putAndInsertString(DCM_ControlPointIndex, "2");
+    controlPointItem->putAndInsertString(DCM_GantryAngle, "200");
+    controlPointItem->putAndInsertString(DCM_CumulativeMetersetWeight, "1");
+    AddBeamLimitingDevicePosition(controlPointItem, "ASYMY", "-30\\30");
+
+    return fileFormat.saveFile(fileName.c_str(), EXS_LittleEndianExplicit).good();
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckValue(const char* name, int controlPointIndex, double value, double expectedValue, int line)
+  {
+    if (fabs(value - expectedValue) > TOLERANCE)
+    {
+      std::cerr << line << ": " << name << " of control point " << controlPointIndex << " is " << value
+        << " instead of " << expectedValue << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckControlPoint(vtkBeamControlPointSequence* controlPoints, int index,
+    double gantryAngle, double collimatorAngle, double couchAngle, double metersetWeight,
+    const double jawPositions[4], const double leafPositions[2*NUMBER_OF_LEAF_PAIRS], int line)
+  {
+    if ( !CheckValue("Gantry angle", index, controlPoints->GetGantryAngle(index), gantryAngle, line)
+      || !CheckValue("Collimator angle", index, controlPoints->GetCollimatorAngle(index), collimatorAngle, line)
+      || !CheckValue("Couch angle", index, controlPoints->GetCouchAngle(index), couchAngle, line)
+      || !CheckValue("Cumulative meterset weight", index, controlPoints->GetCumulativeMetersetWeight(index), metersetWeight, line) )
+    {
+      return false;
+    }
+    double readJawPositions[4] = {0.0, 0.0, 0.0, 0.0};
+    controlPoints->GetJawPositions(index, readJawPositions);
+    for (int i=0; i<4; ++i)
+    {
+      if (!CheckValue("Jaw position", index, readJawPositions[i], jawPositions[i], line))
+      {
+        return false;
+      }
+    }
+    const double* readLeafPositions = controlPoints->GetLeafPositions(index);
+    if (!readLeafPositions)
+    {
+      std::cerr << line << ": No leaf positions in control point " << index << std::endl;
+      return false;
+    }
+    for (int i=0; i<2*NUMBER_OF_LEAF_PAIRS; ++i)
+    {
+      if (!CheckValue("Leaf position", index, readLeafPositions[i], leafPositions[i], line))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDicomRtReaderControlPointsTest1(int argc, char * argv[])
+{
+  // Get temporary directory
+  const char *temporaryDirectoryPath = NULL;
+  if (argc > 2)
+  {
+    if (STRCASECMP(argv[1], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[2];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    }
+    else
+    {
+      std::cerr << "Invalid argument!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string planFilePath = std::string(temporaryDirectoryPath) + "/TestRtPlan_ControlPoints.dcm";
+  if (!WritePlan(planFilePath))
+  {
+    std::cerr << __LINE__ << ": Failed to write RT plan " << planFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+  rtReader->SetFileName(planFilePath.c_str());
+  rtReader->Update();
+  if (!rtReader->GetLoadRTPlanSuccessful() || rtReader->GetNumberOfBeams() != 1)
+  {
+    std::cerr << __LINE__ << ": Failed to load the beam of RT plan " << planFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Beam parameters are those of the first control point
+  double* isocenterRas = rtReader->GetBeamIsocenterPositionRas(BEAM_NUMBER);
+  if ( !CheckValue("Isocenter R", 0, isocenterRas[0], -1.0, __LINE__)
+    || !CheckValue("Isocenter A", 0, isocenterRas[1], -2.0, __LINE__)
+    || !CheckValue("Isocenter S", 0, isocenterRas[2], 3.0, __LINE__)
+    || !CheckValue("Beam gantry angle", 0, rtReader->GetBeamGantryAngle(BEAM_NUMBER), 180.0, __LINE__)
+    || !CheckValue("Beam source axis distance", 0, rtReader->GetBeamSourceAxisDistance(BEAM_NUMBER), 1000.0, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  vtkBeamControlPointSequence* controlPoints = rtReader->GetBeamControlPoints(BEAM_NUMBER);
+  if (!controlPoints || controlPoints->GetNumberOfControlPoints() != 3)
+  {
+    std::cerr << __LINE__ << ": Beam does not have 3 control points" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // MLC definition
+  const double expectedBoundaries[NUMBER_OF_LEAF_PAIRS+1] = { -20.0, -10.0, 0.0, 10.0, 20.0 };
+  if ( controlPoints->GetNumberOfLeafPairs() != NUMBER_OF_LEAF_PAIRS
+    || controlPoints->GetMLCDirection() != vtkBeamControlPointSequence::MLCX )
+  {
+    std::cerr << __LINE__ << ": MLC has " << controlPoints->GetNumberOfLeafPairs() << " leaf pairs instead of "
+      << NUMBER_OF_LEAF_PAIRS << " or its direction is not MLCX" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int i=0; i<=NUMBER_OF_LEAF_PAIRS; ++i)
+  {
+    if (!CheckValue("Leaf pair boundary", 0, controlPoints->GetLeafPairBoundaries()[i], expectedBoundaries[i], __LINE__))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  if (!CheckValue("Final cumulative meterset weight", 0, controlPoints->GetFinalCumulativeMetersetWeight(), 1.0, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Parameters missing from a control point are carried over from the previous one
+  const double firstJawPositions[4] = { -50.0, 50.0, -40.0, 40.0 };
+  const double lastJawPositions[4] = { -50.0, 50.0, -30.0, 30.0 };
+  const double firstLeafPositions[2*NUMBER_OF_LEAF_PAIRS] = { -5.0, -6.0, -7.0, -8.0, 5.0, 6.0, 7.0, 8.0 };
+  const double movedLeafPositions[2*NUMBER_OF_LEAF_PAIRS] = { -1.0, -2.0, -3.0, -4.0, 1.0, 2.0, 3.0, 4.0 };
+  if ( !CheckControlPoint(controlPoints, 0, 180.0, 10.0, 5.0, 0.0, firstJawPositions, firstLeafPositions, __LINE__)
+    || !CheckControlPoint(controlPoints, 1, 190.0, 10.0, 5.0, 0.5, firstJawPositions, movedLeafPositions, __LINE__)
+    || !CheckControlPoint(controlPoints, 2, 200.0, 10.0, 5.0, 1.0, lastJawPositions, movedLeafPositions, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "DICOM-RT plan control point reading test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -25,6 +25,7 @@
 #include <vtkMRMLScene.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSegmentationNode.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -38,6 +39,7 @@ static const char* REFERENCE_DOSE_VOLUME_REFERENCE_ROLE = "referenceDoseVolumeRe
 static const char* COMPARE_DOSE_VOLUME_REFERENCE_ROLE = "compareDoseVolumeRef";
 static const char* MASK_SEGMENTATION_REFERENCE_ROLE = "maskSegmentationRef";
 static const char* GAMMA_VOLUME_REFERENCE_ROLE = "outputGammaVolumeRef";
+static const char* STRUCTURE_METRICS_TABLE_REFERENCE_ROLE = "structureMetricsTableRef";
 
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLDoseComparisonNode);
@@ -58,6 +60,7 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
   this->ResultsValid = false;
   this->ReportString = NULL;
   this->LocalDoseDifference = false;
+  this->ComputeStructureMetrics = false;
 
   this->HideFromEditors = false;
 }
@@ -84,6 +87,7 @@ void vtkMRMLDoseComparisonNode::WriteXML(ostream& of, int nIndent)
   of << " UseLinearInterpolation=\"" << (this->UseLinearInterpolation ? "true" : "false") << "\"";
   of << " LocalDoseDifference=\"" << (this->LocalDoseDifference ? "true" : "false") << "\"";
   of << " DoseThresholdOnReferenceOnly=\"" << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\"";
+  of << " ComputeStructureMetrics=\"" << (this->ComputeStructureMetrics ? "true" : "false") << "\"";
   of << " PassFractionPercent=\"" << this->PassFractionPercent << "\"";
   of << " ResultsValid=\"" << (this->ResultsValid ? "true" : "false") << "\"";
   of << " ReportString=\"" << (this->ReportString ? this->ReportString : "") << "\"";
@@ -143,6 +147,10 @@ void vtkMRMLDoseComparisonNode::ReadXMLAttributes(const char** atts)
       {
       this->DoseThresholdOnReferenceOnly = (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "ComputeStructureMetrics")) 
+      {
+      this->ComputeStructureMetrics = (strcmp(attValue,"true") ? false : true);
+      }
     else if (!strcmp(attName, "PassFractionPercent")) 
       {
       this->PassFractionPercent = vtkVariant(attValue).ToDouble();
@@ -177,6 +185,7 @@ void vtkMRMLDoseComparisonNode::Copy(vtkMRMLNode *anode)
   this->UseLinearInterpolation = node->UseLinearInterpolation;
   this->LocalDoseDifference = node->LocalDoseDifference;
   this->DoseThresholdOnReferenceOnly = node->DoseThresholdOnReferenceOnly;
+  this->ComputeStructureMetrics = node->ComputeStructureMetrics;
   this->ResultsValid = node->ResultsValid;
   this->ReportString = node->ReportString;
 
@@ -199,6 +208,7 @@ void vtkMRMLDoseComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "UseLinearInterpolation:   " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
   os << indent << "LocalDoseDifference:   " << (this->LocalDoseDifference ? "true" : "false") << "\n";
   os << indent << "DoseThresholdOnReferenceOnly:   " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "ComputeStructureMetrics:   " << (this->ComputeStructureMetrics ? "true" : "false") << "\n";
   os << indent << "PassFractionPercent:   " << this->PassFractionPercent << "\n";
   os << indent << "ResultsValid:   " << (this->ResultsValid ? "true" : "false") << "\n";
   os << indent << "ReportString:   " << (this->ReportString ? this->ReportString : "") << "\n";
@@ -275,3 +285,21 @@ void vtkMRMLDoseComparisonNode::SetAndObserveGammaVolumeNode(vtkMRMLScalarVolume
 
   this->SetNodeReferenceID(GAMMA_VOLUME_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
+
+//----------------------------------------------------------------------------
+vtkMRMLTableNode* vtkMRMLDoseComparisonNode::GetStructureMetricsTableNode()
+{
+  return vtkMRMLTableNode::SafeDownCast( this->GetNodeReference(STRUCTURE_METRICS_TABLE_REFERENCE_ROLE) );
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetAndObserveStructureMetricsTableNode(vtkMRMLTableNode* node)
+{
+  if (node && this->Scene != node->GetScene())
+    {
+    vtkErrorMacro("Cannot set reference: the referenced and referencing node are not in the same scene");
+    return;
+    }
+
+  this->SetNodeReferenceID(STRUCTURE_METRICS_TABLE_REFERENCE_ROLE, (node ? node->GetID() : NULL));
+}
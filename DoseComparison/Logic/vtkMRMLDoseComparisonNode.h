@@ -33,6 +33,7 @@
 
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLSegmentationNode;
+class vtkMRMLTableNode;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkMRMLDoseComparisonNode : public vtkMRMLNode
@@ -78,6 +79,11 @@ public:
   /// Set and observe output gamma volume node
   void SetAndObserveGammaVolumeNode(vtkMRMLScalarVolumeNode* node);
 
+  /// Get output table node containing the gamma metrics of each segment of the mask segmentation
+  vtkMRMLTableNode* GetStructureMetricsTableNode();
+  /// Set and observe output structure metrics table node
+  void SetAndObserveStructureMetricsTableNode(vtkMRMLTableNode* node);
+
   /// Get mask segment ID
   vtkGetStringMacro(MaskSegmentID);
   /// Set mask segment ID
@@ -136,6 +142,13 @@ public:
   /// Set local dose difference flag
   vtkBooleanMacro(LocalDoseDifference, bool);
 
+  /// Get structure metrics flag
+  vtkGetMacro(ComputeStructureMetrics, bool);
+  /// Set structure metrics flag
+  vtkSetMacro(ComputeStructureMetrics, bool);
+  /// Set structure metrics flag
+  vtkBooleanMacro(ComputeStructureMetrics, bool);
+
   /// Get valid flag
   vtkGetMacro(ResultsValid, bool);
   /// Set valid flag
@@ -197,6 +210,11 @@ protected:
   /// Flag determining whether dose thresholding should be performed using only the reference image
   /// Default value is false, meaning that both images will be used
   bool DoseThresholdOnReferenceOnly;
+
+  /// Flag determining whether gamma metrics are computed for each segment of the mask segmentation.
+  /// If enabled, the gamma volume is computed once without the mask segment, and the pass fraction, mean
+  /// gamma and gamma histogram of every segment are written to the structure metrics table. False by default
+  bool ComputeStructureMetrics;
   
   /// Percentage of voxels that passed (output)
   double PassFractionPercent;
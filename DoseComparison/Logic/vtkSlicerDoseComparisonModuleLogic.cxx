@@ -25,6 +25,7 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 #include "PlmCommon.h"
+#include "vtkSlicerRtTracer.h"
 
 // Plastimatch includes
 #include "gamma_dose_comparison.h"
@@ -33,11 +34,13 @@
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
+#include <vtkMRMLTableNode.h>
 #include <vtkMRMLTransformNode.h>
 #include <vtkMRMLColorTableNode.h>
 #include <vtkMRMLSelectionNode.h>
@@ -55,9 +58,20 @@
 #include <vtkTimerLog.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
+#include <vtkImageCast.h>
 #include <vtkObjectFactory.h>
+#include <vtkTable.h>
+#include <vtkStringArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMath.h>
+#include <vtkSMPTools.h>
+#include <vtkSMPThreadLocal.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <sstream>
+
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
@@ -67,6 +81,7 @@ const char* vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_DEFAULT_GAMMA_COL
 const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_OUTPUT_BASE_NAME_PREFIX = "GammaVolume_";
 const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_REFERENCE_DOSE_VOLUME_REFERENCE_ROLE = "referenceDoseVolumeRef"; // Reference
 const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_COMPARE_DOSE_VOLUME_REFERENCE_ROLE = "compareDoseVolumeRef"; // Reference
+const std::string vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_STRUCTURE_METRICS_TABLE_NAME_POSTFIX = "_StructureMetrics";
 
 //---------------------------------------------------------------------------
 vtkSlicerDoseComparisonModuleLogic* LogicInstance = NULL;
@@ -78,6 +93,149 @@ void GammaProgressCallback(float progress)
   }
 }
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Segment labelmap resampled to the gamma volume geometry (the extent may differ)
+  struct SegmentVoxels
+  {
+    const unsigned char* Voxels;
+    int Extent[6];
+  };
+
+  /// Gamma statistics of the analyzed voxels of a segment
+  struct SegmentGammaTally
+  {
+    vtkIdType NumberOfAnalyzedVoxels;
+    vtkIdType NumberOfPassedVoxels;
+    double GammaSum;
+    std::vector<vtkIdType> Histogram;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Tally the gamma values of all segments in one pass over the slices of the gamma volume
+  class SegmentGammaTallyFunctor
+  {
+  public:
+    SegmentGammaTallyFunctor(const float* gammaVoxels, const unsigned char* passVoxels, const unsigned char* failVoxels,
+      const int gammaExtent[6], const std::vector<SegmentVoxels>& segments, double maximumGamma, int numberOfBins)
+      : GammaVoxels(gammaVoxels)
+      , PassVoxels(passVoxels)
+      , FailVoxels(failVoxels)
+      , Segments(segments)
+      , NumberOfBins(numberOfBins)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->GammaExtent[i] = gammaExtent[i];
+      }
+      this->BinWidth = (maximumGamma > 0.0 ? maximumGamma / numberOfBins : 1.0);
+
+      SegmentGammaTally emptyTally;
+      emptyTally.NumberOfAnalyzedVoxels = 0;
+      emptyTally.NumberOfPassedVoxels = 0;
+      emptyTally.GammaSum = 0.0;
+      emptyTally.Histogram.resize(numberOfBins, 0);
+      this->Result.resize(segments.size(), emptyTally);
+    }
+
+    void Initialize()
+    {
+      this->Partials.Local() = this->Result;
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      std::vector<SegmentGammaTally>& tallies = this->Partials.Local();
+      const int* extent = this->GammaExtent;
+      vtkIdType dimX = extent[1] - extent[0] + 1;
+      vtkIdType dimY = extent[3] - extent[2] + 1;
+
+      for (vtkIdType slice = beginSlice; slice < endSlice; ++slice)
+      {
+        int k = extent[4] + static_cast<int>(slice);
+        for (int j = extent[2]; j <= extent[3]; ++j)
+        {
+          vtkIdType rowStart = (slice * dimY + (j - extent[2])) * dimX;
+          for (size_t segmentIndex = 0; segmentIndex < this->Segments.size(); ++segmentIndex)
+          {
+            const SegmentVoxels& segment = this->Segments[segmentIndex];
+            const int* segmentExtent = segment.Extent;
+            if (k < segmentExtent[4] || k > segmentExtent[5] || j < segmentExtent[2] || j > segmentExtent[3])
+            {
+              continue;
+            }
+            vtkIdType segmentDimX = segmentExtent[1] - segmentExtent[0] + 1;
+            vtkIdType segmentDimY = segmentExtent[3] - segmentExtent[2] + 1;
+            const unsigned char* segmentRow = segment.Voxels
+              + ((k - segmentExtent[4]) * segmentDimY + (j - segmentExtent[2])) * segmentDimX;
+            int iMin = (extent[0] > segmentExtent[0] ? extent[0] : segmentExtent[0]);
+            int iMax = (extent[1] < segmentExtent[1] ? extent[1] : segmentExtent[1]);
+
+            SegmentGammaTally& tally = tallies[segmentIndex];
+            for (int i = iMin; i <= iMax; ++i)
+            {
+              if (!segmentRow[i - segmentExtent[0]])
+              {
+                continue;
+              }
+              vtkIdType voxelIndex = rowStart + (i - extent[0]);
+              bool passed = (this->PassVoxels[voxelIndex] != 0);
+              if (!passed && !this->FailVoxels[voxelIndex])
+              {
+                continue; // Not analyzed (e.g. below analysis threshold)
+              }
+
+              double gamma = this->GammaVoxels[voxelIndex];
+              ++tally.NumberOfAnalyzedVoxels;
+              if (passed)
+              {
+                ++tally.NumberOfPassedVoxels;
+              }
+              tally.GammaSum += gamma;
+              int bin = static_cast<int>(gamma / this->BinWidth);
+              bin = (bin < 0 ? 0 : (bin >= this->NumberOfBins ? this->NumberOfBins - 1 : bin));
+              ++tally.Histogram[bin];
+            }
+          }
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      vtkSMPThreadLocal< std::vector<SegmentGammaTally> >::iterator partialIt;
+      for (partialIt = this->Partials.begin(); partialIt != this->Partials.end(); ++partialIt)
+      {
+        for (size_t segmentIndex = 0; segmentIndex < this->Result.size(); ++segmentIndex)
+        {
+          SegmentGammaTally& tally = this->Result[segmentIndex];
+          const SegmentGammaTally& partial = (*partialIt)[segmentIndex];
+          tally.NumberOfAnalyzedVoxels += partial.NumberOfAnalyzedVoxels;
+          tally.NumberOfPassedVoxels += partial.NumberOfPassedVoxels;
+          tally.GammaSum += partial.GammaSum;
+          for (int bin = 0; bin < this->NumberOfBins; ++bin)
+          {
+            tally.Histogram[bin] += partial.Histogram[bin];
+          }
+        }
+      }
+    }
+
+    std::vector<SegmentGammaTally> Result;
+
+  private:
+    const float* GammaVoxels;
+    const unsigned char* PassVoxels;
+    const unsigned char* FailVoxels;
+    int GammaExtent[6];
+    const std::vector<SegmentVoxels>& Segments;
+    int NumberOfBins;
+    double BinWidth;
+    vtkSMPThreadLocal< std::vector<SegmentGammaTally> > Partials;
+  };
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseComparisonModuleLogic);
 
@@ -191,6 +349,8 @@ void vtkSlicerDoseComparisonModuleLogic::GammaProgressUpdated(float progress)
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("DoseComparison", "ComputeGammaDoseDifference");
+
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
 
@@ -198,14 +358,24 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
 
   double checkpointConvertStart = timer->GetUniversalTime();
   vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
+  Plm_image::Pointer referenceDose;
+  Plm_image::Pointer compareDose;
+  {
+    SLICERRT_TRACE_SCOPE("DoseComparison", "Convert doses to ITK");
+    referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
+    compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
+  }
 
   Plm_image::Pointer maskVolume;
   vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
   const char* maskSegmentID = parameterNode->GetMaskSegmentID();
-  if (maskSegmentationNode && maskSegmentID)
+  // The gamma volume is computed for all voxels if metrics are computed for each segment
+  bool computeStructureMetrics = (maskSegmentationNode && parameterNode->GetComputeStructureMetrics());
+  bool useMaskSegment = (maskSegmentationNode && maskSegmentID && !computeStructureMetrics);
+  if (useMaskSegment)
   {
+    SLICERRT_TRACE_SCOPE_DETAIL("DoseComparison", "Convert mask", maskSegmentID);
+
     // Extract a labelmap for the dose comparison to use it as a mask
     vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
     vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
@@ -255,7 +425,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   Gamma_dose_comparison gamma;
   gamma.set_reference_image(referenceDose->itk_float());
   gamma.set_compare_image(compareDose->itk_float());
-  if (maskSegmentationNode && maskSegmentID)
+  if (useMaskSegment)
   {
     gamma.set_mask_image(maskVolume->itk_uchar());
   }
@@ -272,7 +442,10 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
   gamma.set_progress_callback(&GammaProgressCallback);
 
-  gamma.run();
+  {
+    SLICERRT_TRACE_SCOPE("DoseComparison", "Gamma computation");
+    gamma.run();
+  }
 
   itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
   parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
@@ -280,6 +453,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
 
   // Convert output to VTK
   double checkpointVtkConvertStart = timer->GetUniversalTime();
+  SLICERRT_TRACE_SCOPE("DoseComparison", "MRML update");
 
   vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
   if (gammaVolumeNode == NULL)
@@ -346,6 +520,30 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   gammaVolumeNode->AddNodeReferenceID( vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_COMPARE_DOSE_VOLUME_REFERENCE_ROLE.c_str(),
     parameterNode->GetCompareDoseVolumeNode()->GetID() );
 
+  // Tally gamma for each segment using the same gamma volume
+  if (computeStructureMetrics)
+  {
+    SLICERRT_TRACE_SCOPE("DoseComparison", "Structure metrics");
+
+    itk::Image<unsigned char, 3>::Pointer passImageItk = gamma.get_pass_image_itk();
+    itk::Image<unsigned char, 3>::Pointer failImageItk = gamma.get_fail_image_itk();
+    if ( !passImageItk || !failImageItk
+      || passImageItk->GetLargestPossibleRegion() != gammaVolumeItk->GetLargestPossibleRegion()
+      || failImageItk->GetLargestPossibleRegion() != gammaVolumeItk->GetLargestPossibleRegion() )
+    {
+      std::string errorMessage("Failed to get gamma pass and fail images");
+      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      return errorMessage;
+    }
+
+    std::string errorMessage = this->ComputeStructureGammaMetrics(parameterNode,
+      passImageItk->GetBufferPointer(), failImageItk->GetBufferPointer() );
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
+  }
+
   // Select as active volume
   if (this->GetApplicationLogic()!=NULL)
   {
@@ -371,6 +569,170 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeStructureGammaMetrics(vtkMRMLDoseComparisonNode* parameterNode,
+  const unsigned char* passVoxels, const unsigned char* failVoxels)
+{
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetMaskSegmentationNode();
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  vtkImageData* gammaImageData = (gammaVolumeNode ? gammaVolumeNode->GetImageData() : NULL);
+  if (!segmentationNode || !gammaImageData || gammaImageData->GetScalarType() != VTK_FLOAT || !passVoxels || !failVoxels)
+  {
+    std::string errorMessage("Invalid inputs for structure gamma metrics");
+    vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Get binary labelmaps of all segments. Segments are copied so that the labelmaps can be resampled
+  // to the gamma volume geometry without changing the original segmentation
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+  std::vector<std::string> segmentIDs;
+  segmentation->GetSegmentIDs(segmentIDs);
+  vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+  segmentationCopy->SetMasterRepresentationName(segmentation->GetMasterRepresentationName());
+  segmentationCopy->CopyConversionParameters(segmentation);
+  for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+  {
+    segmentationCopy->CopySegmentFromSegmentation(segmentation, *segmentIdIt);
+  }
+  if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+  {
+    std::string errorMessage("Failed to create binary labelmap representation for segments");
+    vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> gammaGeometryImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(gammaVolumeNode) );
+  if (!gammaGeometryImageData.GetPointer())
+  {
+    std::string errorMessage("Failed to get gamma volume geometry");
+    vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+    return errorMessage;
+  }
+
+  std::vector<SegmentVoxels> segmentVoxels;
+  std::vector< vtkSmartPointer<vtkImageData> > segmentLabelmaps; // Keep the resampled labelmaps until the tally is done
+  for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+  {
+    vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(*segmentIdIt)->GetRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+    if (!segmentLabelmap)
+    {
+      std::string errorMessage("Failed to get binary labelmap of segment " + (*segmentIdIt));
+      vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Apply parent transformation nodes if necessary
+    if ( segmentationNode->GetParentTransformNode()
+      && !vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, segmentLabelmap) )
+    {
+      std::string errorMessage("Failed to apply parent transform on segment " + (*segmentIdIt));
+      vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+      return errorMessage;
+    }
+
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(segmentLabelmap, gammaGeometryImageData, segmentLabelmap))
+    {
+      std::string errorMessage("Failed to resample segment " + (*segmentIdIt) + " to gamma volume geometry");
+      vtkErrorMacro("ComputeStructureGammaMetrics: " << errorMessage);
+      return errorMessage;
+    }
+
+    vtkSmartPointer<vtkImageData> labelmap = segmentLabelmap;
+    if (segmentLabelmap->GetScalarType() != VTK_UNSIGNED_CHAR)
+    {
+      vtkSmartPointer<vtkImageCast> castFilter = vtkSmartPointer<vtkImageCast>::New();
+      castFilter->SetInputData(segmentLabelmap);
+      castFilter->SetOutputScalarTypeToUnsignedChar();
+      castFilter->ClampOverflowOn();
+      castFilter->Update();
+      labelmap = castFilter->GetOutput();
+    }
+    segmentLabelmaps.push_back(labelmap);
+
+    SegmentVoxels voxels;
+    labelmap->GetExtent(voxels.Extent);
+    voxels.Voxels = static_cast<const unsigned char*>(labelmap->GetScalarPointer());
+    if (!voxels.Voxels)
+    {
+      // Empty segment, nothing to tally
+      voxels.Extent[0] = voxels.Extent[2] = voxels.Extent[4] = 0;
+      voxels.Extent[1] = voxels.Extent[3] = voxels.Extent[5] = -1;
+    }
+    segmentVoxels.push_back(voxels);
+  }
+
+  // Tally all segments in one pass over the gamma volume
+  int* gammaExtent = gammaImageData->GetExtent();
+  int numberOfBins = vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_HISTOGRAM_NUMBER_OF_BINS;
+  double maximumGamma = parameterNode->GetMaximumGamma();
+  SegmentGammaTallyFunctor tallyFunctor(static_cast<const float*>(gammaImageData->GetScalarPointer()),
+    passVoxels, failVoxels, gammaExtent, segmentVoxels, maximumGamma, numberOfBins);
+  vtkSMPTools::For(0, gammaExtent[5] - gammaExtent[4] + 1, tallyFunctor);
+
+  // Assemble metrics table
+  vtkSmartPointer<vtkTable> metricsTable = vtkSmartPointer<vtkTable>::New();
+  vtkSmartPointer<vtkStringArray> segmentNameColumn = vtkSmartPointer<vtkStringArray>::New();
+  segmentNameColumn->SetName("Segment");
+  metricsTable->AddColumn(segmentNameColumn);
+  vtkSmartPointer<vtkIdTypeArray> analyzedVoxelsColumn = vtkSmartPointer<vtkIdTypeArray>::New();
+  analyzedVoxelsColumn->SetName("Analyzed voxels");
+  metricsTable->AddColumn(analyzedVoxelsColumn);
+  vtkSmartPointer<vtkDoubleArray> passFractionColumn = vtkSmartPointer<vtkDoubleArray>::New();
+  passFractionColumn->SetName("Pass fraction (%)");
+  metricsTable->AddColumn(passFractionColumn);
+  vtkSmartPointer<vtkDoubleArray> meanGammaColumn = vtkSmartPointer<vtkDoubleArray>::New();
+  meanGammaColumn->SetName("Mean gamma");
+  metricsTable->AddColumn(meanGammaColumn);
+  std::vector<vtkDoubleArray*> histogramColumns;
+  double binWidth = maximumGamma / numberOfBins;
+  for (int bin = 0; bin < numberOfBins; ++bin)
+  {
+    std::ostringstream columnNameStream;
+    columnNameStream << "Gamma " << bin * binWidth << "-" << (bin + 1) * binWidth << " (%)";
+    vtkSmartPointer<vtkDoubleArray> histogramColumn = vtkSmartPointer<vtkDoubleArray>::New();
+    histogramColumn->SetName(columnNameStream.str().c_str());
+    metricsTable->AddColumn(histogramColumn);
+    histogramColumns.push_back(histogramColumn);
+  }
+
+  metricsTable->SetNumberOfRows(static_cast<vtkIdType>(segmentIDs.size()));
+  for (size_t segmentIndex = 0; segmentIndex < segmentIDs.size(); ++segmentIndex)
+  {
+    const SegmentGammaTally& tally = tallyFunctor.Result[segmentIndex];
+    vtkIdType row = static_cast<vtkIdType>(segmentIndex);
+    segmentNameColumn->SetValue(row, segmentation->GetSegment(segmentIDs[segmentIndex])->GetName());
+    analyzedVoxelsColumn->SetValue(row, tally.NumberOfAnalyzedVoxels);
+    // Metrics are undefined for segments without analyzed voxels
+    double numberOfAnalyzedVoxels = static_cast<double>(tally.NumberOfAnalyzedVoxels);
+    bool valid = (tally.NumberOfAnalyzedVoxels > 0);
+    passFractionColumn->SetValue(row, valid ? tally.NumberOfPassedVoxels * 100.0 / numberOfAnalyzedVoxels : vtkMath::Nan());
+    meanGammaColumn->SetValue(row, valid ? tally.GammaSum / numberOfAnalyzedVoxels : vtkMath::Nan());
+    for (int bin = 0; bin < numberOfBins; ++bin)
+    {
+      histogramColumns[bin]->SetValue(row, valid ? tally.Histogram[bin] * 100.0 / numberOfAnalyzedVoxels : vtkMath::Nan());
+    }
+  }
+
+  // Create output table node if not specified
+  vtkMRMLTableNode* metricsTableNode = parameterNode->GetStructureMetricsTableNode();
+  if (!metricsTableNode)
+  {
+    vtkSmartPointer<vtkMRMLTableNode> newMetricsTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+    std::string metricsTableNodeName = std::string(gammaVolumeNode->GetName())
+      + vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_STRUCTURE_METRICS_TABLE_NAME_POSTFIX;
+    newMetricsTableNode->SetName(this->GetMRMLScene()->GenerateUniqueName(metricsTableNodeName).c_str());
+    this->GetMRMLScene()->AddNode(newMetricsTableNode);
+    parameterNode->SetAndObserveStructureMetricsTableNode(newMetricsTableNode);
+    metricsTableNode = newMetricsTableNode;
+  }
+  metricsTableNode->SetAndObserveTable(metricsTable);
+
+  return "";
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerDoseComparisonModuleLogic::CreateDefaultGammaColorTable()
 {
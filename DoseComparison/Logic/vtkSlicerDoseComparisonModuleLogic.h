@@ -45,6 +45,8 @@ public:
   static const std::string DOSECOMPARISON_OUTPUT_BASE_NAME_PREFIX;
   static const std::string DOSECOMPARISON_REFERENCE_DOSE_VOLUME_REFERENCE_ROLE;
   static const std::string DOSECOMPARISON_COMPARE_DOSE_VOLUME_REFERENCE_ROLE;
+  static const std::string DOSECOMPARISON_STRUCTURE_METRICS_TABLE_NAME_POSTFIX;
+  static const int DOSECOMPARISON_GAMMA_HISTOGRAM_NUMBER_OF_BINS = 10;
 
 public:
   static vtkSlicerDoseComparisonModuleLogic *New();
@@ -66,6 +68,15 @@ protected:
   /// Loads default gamma color table from the supplied color table file
   void LoadDefaultGammaColorTable();
 
+  /// Compute pass fraction, mean gamma and gamma histogram for every segment of the mask segmentation
+  /// from the computed gamma volume, and write them to the structure metrics table (one row per segment).
+  /// The histogram has \sa DOSECOMPARISON_GAMMA_HISTOGRAM_NUMBER_OF_BINS bins between 0 and the maximum gamma.
+  /// \param passVoxels Voxels that passed the gamma test, in the same voxel order as the gamma volume
+  /// \param failVoxels Voxels that failed the gamma test. Voxels that are neither passed nor failed were not analyzed
+  /// \return Error message, empty string if no error
+  std::string ComputeStructureGammaMetrics(vtkMRMLDoseComparisonNode* parameterNode,
+    const unsigned char* passVoxels, const unsigned char* failVoxels);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
@@ -26,16 +26,30 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+#include <vtkSegment.h>
+#include <vtkSegmentation.h>
+#include <vtkSegmentationConverter.h>
+
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -43,6 +57,10 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <cmath>
+#include <cstring>
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
 {
@@ -182,5 +200,95 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Compute structure metrics on the same data. A segment covering the whole gamma volume
+  // contains all analyzed voxels, so its pass fraction must be the overall pass fraction
+  vtkSmartPointer<vtkOrientedImageData> gammaGeometryImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!SlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(outputGammaVolumeNode, gammaGeometryImage))
+  {
+    errorStream << "ERROR: Failed to get gamma volume geometry!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkMatrix4x4> gammaToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  gammaGeometryImage->GetImageToWorldMatrix(gammaToWorldMatrix);
+
+  vtkSmartPointer<vtkMRMLSegmentationNode> segmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  segmentationNode->SetName("GammaStructures");
+  mrmlScene->AddNode(segmentationNode);
+  segmentationNode->GetSegmentation()->SetMasterRepresentationName(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() );
+
+  // Body covers the whole volume, the other segment its lower half of the slices
+  const char* segmentNames[2] = { "Body", "LowerHalf" };
+  int gammaDimensions[3] = {0, 0, 0};
+  gammaGeometryImage->GetDimensions(gammaDimensions);
+  for (int segmentIndex=0; segmentIndex<2; ++segmentIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    labelmap->SetExtent(gammaGeometryImage->GetExtent());
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    labelmap->SetGeometryFromImageToWorldMatrix(gammaToWorldMatrix);
+    unsigned char* labelmapScalars = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    vtkIdType numberOfSliceVoxels = static_cast<vtkIdType>(gammaDimensions[0]) * gammaDimensions[1];
+    for (int k=0; k<gammaDimensions[2]; ++k)
+    {
+      bool inside = (segmentIndex == 0 || k < gammaDimensions[2] / 2);
+      memset(labelmapScalars + k * numberOfSliceVoxels, (inside ? 1 : 0), numberOfSliceVoxels);
+    }
+
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(segmentNames[segmentIndex]);
+    segment->AddRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmap );
+    segmentationNode->GetSegmentation()->AddSegment(segment);
+  }
+
+  paramNode->SetAndObserveMaskSegmentationNode(segmentationNode);
+  paramNode->ComputeStructureMetricsOn();
+  std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Failed to compute structure metrics: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkMRMLTableNode* metricsTableNode = paramNode->GetStructureMetricsTableNode();
+  vtkTable* metricsTable = (metricsTableNode ? metricsTableNode->GetTable() : NULL);
+  if (!metricsTable || metricsTable->GetNumberOfRows() != 2)
+  {
+    errorStream << "ERROR: Structure metrics table does not have one row for each of the 2 segments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkStringArray* segmentNameColumn = vtkStringArray::SafeDownCast(metricsTable->GetColumnByName("Segment"));
+  vtkIdTypeArray* analyzedVoxelsColumn = vtkIdTypeArray::SafeDownCast(metricsTable->GetColumnByName("Analyzed voxels"));
+  vtkDoubleArray* passFractionColumn = vtkDoubleArray::SafeDownCast(metricsTable->GetColumnByName("Pass fraction (%)"));
+  if (!segmentNameColumn || !analyzedVoxelsColumn || !passFractionColumn)
+  {
+    errorStream << "ERROR: Missing columns in structure metrics table!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int segmentIndex=0; segmentIndex<2; ++segmentIndex)
+  {
+    if (segmentNameColumn->GetValue(segmentIndex).compare(segmentNames[segmentIndex]))
+    {
+      errorStream << "ERROR: Structure metrics row " << segmentIndex << " is '" << segmentNameColumn->GetValue(segmentIndex)
+        << "' instead of '" << segmentNames[segmentIndex] << "'!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  double bodyPassFractionPercent = passFractionColumn->GetValue(0);
+  if ( analyzedVoxelsColumn->GetValue(0) <= 0
+    || fabs(bodyPassFractionPercent - paramNode->GetPassFractionPercent()) > 1e-4 )
+  {
+    errorStream << "ERROR: Body pass fraction " << bodyPassFractionPercent << "% (" << analyzedVoxelsColumn->GetValue(0)
+      << " analyzed voxels) does not match overall pass fraction " << paramNode->GetPassFractionPercent() << "%!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (analyzedVoxelsColumn->GetValue(1) > analyzedVoxelsColumn->GetValue(0))
+  {
+    errorStream << "ERROR: Lower half segment has more analyzed voxels than the body!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
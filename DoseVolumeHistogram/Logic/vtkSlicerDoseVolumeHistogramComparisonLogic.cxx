@@ -26,12 +26,14 @@
 #include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
 #include "vtkMRMLDoseVolumeHistogramNode.h"
 
+// SlicerRT includes
+#include "vtkImageStatisticsCache.h"
+
 // VTK includes
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkDoubleArray.h>
 #include <vtkImageData.h>
-#include <vtkImageAccumulate.h>
 #include <vtkSmartPointer.h>
 #include <vtkVersion.h>
 
@@ -114,10 +116,9 @@ double vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(vtkMRMLDoub
   if (doseVolumeNode)
   {
     vtkDebugWithObjectMacro(dvh1DoubleArrayNode, "vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables: Calculating maximum dose from the given dose volume");
-    vtkNew<vtkImageAccumulate> doseStat;
-    doseStat->SetInputData(doseVolumeNode->GetImageData());
-    doseStat->Update();
-    doseMax = doseStat->GetMax()[0];
+    double doseRange[2] = {0.0, 0.0};
+    vtkImageStatisticsCache::GetInstance()->GetScalarRange(doseVolumeNode->GetImageData(), doseRange);
+    doseMax = doseRange[1];
   }
 
   // Compare the current DVH to the baseline and determine mean and maximum difference
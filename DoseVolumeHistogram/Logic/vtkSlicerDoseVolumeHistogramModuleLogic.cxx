@@ -25,6 +25,8 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 #include "vtkFractionalImageAccumulate.h"
+#include "vtkImageStatisticsCache.h"
+#include "vtkSlicerRtTracer.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -74,6 +76,9 @@
 
 // STD includes
 #include <set>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_DVH_IDENTIFIER_ATTRIBUTE_NAME = vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX + "DVH"; // Identifier
@@ -96,6 +101,195 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_ARRAY_NODE_NAME_P
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE = " Value (% of ";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_END = " cc)";
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Parse number at the beginning of a CSV field.
+  /// \param position Start of the field. Set to the start of the next field (or line end) on return
+  /// \param value Parsed value, zero if the field does not start with a number
+  /// \return True if the field is not empty
+  bool ParseCsvNumber(const char*& position, const char* lineEnd, double& value)
+  {
+    char* numberEnd = NULL;
+    value = strtod(position, &numberEnd);
+    if (numberEnd == position)
+    {
+      value = 0.0;
+    }
+    const char* fieldEnd = static_cast<const char*>(memchr(position, ',', lineEnd - position));
+    bool notEmpty = (fieldEnd != position && position != lineEnd);
+    position = (fieldEnd ? fieldEnd + 1 : lineEnd);
+    return notEmpty;
+  }
+
+  //----------------------------------------------------------------------------
+  // Binary DVH archive
+  //
+  // Header (40 bytes): magic "SRTDVHAR", byte order mark (uint32), version (uint32),
+  //   number of structures (uint32), number of metric columns (uint32), metrics offset (uint64), index offset (uint64)
+  // DVH values: for each structure a contiguous array of doubles (tuples x components), aligned to 8 bytes
+  // Metrics: for each column its name, type (uint8, 0: double, 1: string) and the values of all structures
+  // Index: for each structure its name, dose volume UID, node name, attributes, number of tuples (uint64),
+  //   number of components (uint32) and the offset of the values (uint64)
+  // Strings are stored as length (uint32) followed by the characters. Values are in the byte order of
+  // the writer, which is checked against the byte order mark when reading.
+
+  const char DVH_ARCHIVE_MAGIC[8] = {'S','R','T','D','V','H','A','R'};
+  const vtkTypeUInt32 DVH_ARCHIVE_BYTE_ORDER_MARK = 0x01020304;
+  const vtkTypeUInt32 DVH_ARCHIVE_VERSION = 1;
+  const vtkTypeUInt32 DVH_ARCHIVE_MAX_STRING_LENGTH = 1 << 24;
+  enum
+  {
+    DvhArchiveColumnDouble = 0,
+    DvhArchiveColumnString = 1
+  };
+
+  /// Index entry of one DVH in the archive
+  struct DvhArchiveIndexEntry
+  {
+    std::string StructureName;
+    std::string DoseVolumeUid;
+    std::string NodeName;
+    std::vector<std::pair<std::string, std::string> > Attributes;
+    vtkTypeUInt64 NumberOfTuples;
+    vtkTypeUInt32 NumberOfComponents;
+    vtkTypeUInt64 DataOffset;
+  };
+
+  //----------------------------------------------------------------------------
+  template<class T> void WriteArchiveValue(std::ostream& stream, T value)
+  {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  //----------------------------------------------------------------------------
+  template<class T> bool ReadArchiveValue(std::istream& stream, T& value)
+  {
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return !stream.fail();
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteArchiveString(std::ostream& stream, const std::string& value)
+  {
+    WriteArchiveValue(stream, static_cast<vtkTypeUInt32>(value.size()));
+    stream.write(value.c_str(), value.size());
+  }
+
+  //----------------------------------------------------------------------------
+  bool ReadArchiveString(std::istream& stream, std::string& value)
+  {
+    vtkTypeUInt32 length = 0;
+    if (!ReadArchiveValue(stream, length) || length > DVH_ARCHIVE_MAX_STRING_LENGTH)
+    {
+      return false;
+    }
+    value.resize(length);
+    if (length > 0)
+    {
+      stream.read(&(value[0]), length);
+    }
+    return !stream.fail();
+  }
+
+  //----------------------------------------------------------------------------
+  void AlignArchive(std::ostream& stream)
+  {
+    while (static_cast<vtkTypeUInt64>(stream.tellp()) % 8 != 0)
+    {
+      stream.put(0);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Read archive header and index
+  /// \return Error message, empty string if no error
+  std::string ReadDvhArchiveIndex(std::istream& stream, std::vector<DvhArchiveIndexEntry>& entries,
+    vtkTypeUInt32& numberOfMetricColumns, vtkTypeUInt64& metricsOffset)
+  {
+    char magic[8] = {0,0,0,0,0,0,0,0};
+    stream.read(magic, 8);
+    if (stream.fail() || memcmp(magic, DVH_ARCHIVE_MAGIC, 8) != 0)
+    {
+      return "Not a DVH archive";
+    }
+    vtkTypeUInt32 byteOrderMark = 0;
+    vtkTypeUInt32 version = 0;
+    vtkTypeUInt32 numberOfStructures = 0;
+    vtkTypeUInt64 indexOffset = 0;
+    if ( !ReadArchiveValue(stream, byteOrderMark) || !ReadArchiveValue(stream, version)
+      || !ReadArchiveValue(stream, numberOfStructures) || !ReadArchiveValue(stream, numberOfMetricColumns)
+      || !ReadArchiveValue(stream, metricsOffset) || !ReadArchiveValue(stream, indexOffset) )
+    {
+      return "Truncated DVH archive header";
+    }
+    if (byteOrderMark != DVH_ARCHIVE_BYTE_ORDER_MARK)
+    {
+      return "DVH archive byte order does not match";
+    }
+    if (version != DVH_ARCHIVE_VERSION)
+    {
+      return "Unsupported DVH archive version";
+    }
+
+    stream.seekg(static_cast<std::streamoff>(indexOffset), std::ios::beg);
+    entries.resize(numberOfStructures);
+    for (vtkTypeUInt32 structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+    {
+      DvhArchiveIndexEntry& entry = entries[structureIndex];
+      vtkTypeUInt32 numberOfAttributes = 0;
+      if ( !ReadArchiveString(stream, entry.StructureName) || !ReadArchiveString(stream, entry.DoseVolumeUid)
+        || !ReadArchiveString(stream, entry.NodeName) || !ReadArchiveValue(stream, numberOfAttributes) )
+      {
+        return "Invalid DVH archive index";
+      }
+      entry.Attributes.resize(numberOfAttributes);
+      for (vtkTypeUInt32 attributeIndex=0; attributeIndex<numberOfAttributes; ++attributeIndex)
+      {
+        if (!ReadArchiveString(stream, entry.Attributes[attributeIndex].first) || !ReadArchiveString(stream, entry.Attributes[attributeIndex].second))
+        {
+          return "Invalid DVH archive index";
+        }
+      }
+      if ( !ReadArchiveValue(stream, entry.NumberOfTuples) || !ReadArchiveValue(stream, entry.NumberOfComponents)
+        || !ReadArchiveValue(stream, entry.DataOffset) )
+      {
+        return "Invalid DVH archive index";
+      }
+    }
+    return "";
+  }
+
+  //----------------------------------------------------------------------------
+  /// Read DVH values and set them with the stored name and attributes to the array node
+  bool ReadDvhArchiveEntry(std::istream& stream, const DvhArchiveIndexEntry& entry, vtkMRMLDoubleArrayNode* dvhArrayNode)
+  {
+    vtkSmartPointer<vtkDoubleArray> dvhArray = vtkSmartPointer<vtkDoubleArray>::New();
+    dvhArray->SetNumberOfComponents(entry.NumberOfComponents);
+    dvhArray->SetNumberOfTuples(static_cast<vtkIdType>(entry.NumberOfTuples));
+    std::streamsize numberOfBytes = static_cast<std::streamsize>(entry.NumberOfTuples * entry.NumberOfComponents * sizeof(double));
+    if (numberOfBytes > 0)
+    {
+      stream.seekg(static_cast<std::streamoff>(entry.DataOffset), std::ios::beg);
+      stream.read(reinterpret_cast<char*>(dvhArray->GetPointer(0)), numberOfBytes);
+      if (stream.fail())
+      {
+        return false;
+      }
+    }
+
+    int wasModifying = dvhArrayNode->StartModify();
+    dvhArrayNode->SetName(entry.NodeName.c_str());
+    for (std::vector<std::pair<std::string, std::string> >::const_iterator attributeIt=entry.Attributes.begin(); attributeIt!=entry.Attributes.end(); ++attributeIt)
+    {
+      dvhArrayNode->SetAttribute(attributeIt->first.c_str(), attributeIt->second.c_str());
+    }
+    dvhArrayNode->SetArray(dvhArray);
+    dvhArrayNode->EndModify(wasModifying);
+    return true;
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramModuleLogic);
 
@@ -164,6 +358,8 @@ void vtkSlicerDoseVolumeHistogramModuleLogic::OnMRMLSceneEndClose()
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "ComputeDvh");
+
   if (!this->GetMRMLScene() || !parameterNode)
   {
     std::string errorMessage("Invalid MRML scene or parameter set node");
@@ -186,10 +382,9 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   int disabledNodeModify = parameterNode->StartModify();
 
   // Get maximum dose from dose volume for number of DVH bins
-  vtkNew<vtkImageAccumulate> doseStat;
-  doseStat->SetInputData(doseVolumeNode->GetImageData());
-  doseStat->Update();
-  double maxDose = doseStat->GetMax()[0];
+  double doseRange[2] = {0.0, 0.0};
+  vtkImageStatisticsCache::GetInstance()->GetScalarRange(doseVolumeNode->GetImageData(), doseRange);
+  double maxDose = doseRange[1];
 
   // Get selected segmentation
   vtkSegmentation* selectedSegmentation = segmentationNode->GetSegmentation();
@@ -235,7 +430,12 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 
   // Reconvert segments to specified geometry if possible
   bool resamplingRequired = false;
-  if ( !segmentationCopy->CreateRepresentation(representationName, true) )
+  bool conversionSuccessful = false;
+  {
+    SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "Convert segments");
+    conversionSuccessful = segmentationCopy->CreateRepresentation(representationName, true);
+  }
+  if (!conversionSuccessful)
   {
     // If conversion failed and there is no binary labelmap in the segmentation, then cannot calculate DVH
     if (!segmentationCopy->ContainsRepresentation(representationName) )
@@ -307,6 +507,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseVolume;
   if (!parameterNode->GetAutomaticOversampling())
   {
+    SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "Resample dose");
+
     // Get geometry of oversampled dose volume
     fixedOversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
     fixedOversampledDoseVolume->ShallowCopy(doseImageData);
@@ -329,6 +531,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   {
     std::string segmentID = *segmentIdIt;
     vtkSegment* segment = segmentationCopy->GetSegment(*segmentIdIt);
+    SLICERRT_TRACE_SCOPE_DETAIL("DoseVolumeHistogram", "Segment", segmentID.c_str());
   
     // Get segment labelmap
     vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
@@ -363,6 +566,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     // Resample labelmap if necessary (if it was master, and could not be re-converted using the oversampled geometry, or if there was a parent transform)
     if (resamplingRequired)
     {
+      SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "Resample segment");
 
       // Resample segmentation labelmap volume
       if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
@@ -460,6 +664,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     return errorMessage;
   }
   std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
+  SLICERRT_TRACE_SCOPE_DETAIL("DoseVolumeHistogram", "Segment histogram", segmentName.c_str());
 
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
@@ -535,6 +740,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   }
 
   // Get metrics table for the parameter node; Create one if missing
+  SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "MRML update");
   vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
   vtkTable* metricsTable = metricsTableNode->GetTable();
   // Setup table if empty
@@ -1042,6 +1248,8 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::IsVMetricName(std::string name)
 //---------------------------------------------------------------------------
 bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "ComputeVMetrics");
+
   if (!this->GetMRMLScene() || !parameterNode)
   {
     vtkErrorMacro("ComputeVMetrics: Invalid MRML scene or parameter set node");
@@ -1205,6 +1413,8 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::IsDMetricName(std::string name)
 //---------------------------------------------------------------------------
 bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("DoseVolumeHistogram", "ComputeDMetrics");
+
   if (!this->GetMRMLScene() || !parameterNode)
   {
     vtkErrorMacro("ComputeDMetrics: Invalid MRML scene or parameter set node");
@@ -1588,9 +1798,8 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhMetricsToCsv(vtkMRMLDoseV
 //-----------------------------------------------------------------------------
 vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToDoubleArrayNode(std::string csvFilename)
 {
-  std::string csvSeparatorCharacter = ",";
-
-  std::vector< vtkSmartPointer< vtkDoubleArray > > currentDvh;
+  // Values of each structure (dose, volume, 0 per bin). The bin index is the data line index
+  std::vector< std::vector<double> > structureValues;
 
   // Vectors containing the names and total volumes of structures
   std::vector<std::string> structureNames;
@@ -1598,42 +1807,56 @@ vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToDoubleArrayNode
 
   // Load current DVH from CSV
   std::ifstream dvhStream;
-  dvhStream.open(csvFilename.c_str(), std::ifstream::in);
+  dvhStream.open(csvFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!dvhStream.is_open())
+  {
+    vtkErrorMacro("ReadCsvToDoubleArrayNode: Failed to open file " << csvFilename);
+    return NULL;
+  }
+  dvhStream.seekg(0, std::ios::end);
+  std::streamoff fileSize = dvhStream.tellg();
+  dvhStream.seekg(0, std::ios::beg);
 
+  // The line buffer is reused for all lines, so it is only reallocated when a longer line is read
+  std::string line;
   bool firstLine = true;
-  int fieldCount = 0;
-  int lineNumber = 0;
-  char line[16384];
-
-  while (dvhStream.getline(line, 16384, '\n'))
+  vtkIdType lineNumber = 0;
+  while (std::getline(dvhStream, line))
   {
-    std::string lineStr(line);
-    size_t commaPosition = lineStr.find(csvSeparatorCharacter);
+    if (!line.empty() && line[line.size()-1] == '\r')
+    {
+      line.resize(line.size()-1);
+    }
 
-    // Determine number of fields (twice the number of structures)
+    // Header: every second field contains structure name and total volume
     if (firstLine)
     {
-      while (commaPosition != std::string::npos)
+      size_t fieldStart = 0;
+      for (int fieldIndex=0; fieldStart < line.size(); ++fieldIndex)
       {
-        if (fieldCount%2==1)
+        size_t fieldEnd = line.find(',', fieldStart);
+        if (fieldEnd == std::string::npos)
+        {
+          fieldEnd = line.size();
+        }
+        if (fieldIndex%2 == 1)
         {
           // Get the structure's name
-          std::string field = lineStr.substr(0, commaPosition);
+          std::string field = line.substr(fieldStart, fieldEnd - fieldStart);
           size_t middlePosition = field.find(DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE);
           std::string structureName = field.substr(0, middlePosition);
           if ( structureName.size() > DVH_ARRAY_NODE_NAME_POSTFIX.size()
             && structureName.substr(structureName.size() - DVH_ARRAY_NODE_NAME_POSTFIX.size()) == DVH_ARRAY_NODE_NAME_POSTFIX)
-            {
+          {
             structureName = structureName.substr(0, structureName.size() - DVH_ARRAY_NODE_NAME_POSTFIX.size());
-            }
+          }
           structureNames.push_back(structureName);
 
           // Get the structure's total volume and add it to the vector
           double volumeCCs = 0;
+          if (middlePosition != std::string::npos)
           {
-            std::string structureVolumeString = field.substr( middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size(),
-              field.size() - middlePosition - DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size() - DVH_CSV_HEADER_VOLUME_FIELD_END.size() );
-            volumeCCs = vtkVariant(structureVolumeString).ToDouble();
+            volumeCCs = atof(field.c_str() + middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size());
           }
           structureVolumeCCs.push_back(volumeCCs);
 
@@ -1642,96 +1865,64 @@ vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToDoubleArrayNode
             std::cerr << "Invalid structure volume in CSV header field " << field << std::endl;
           }
         }
-
-        // Move to the next structure's location in the string
-        fieldCount++;
-        lineStr = lineStr.substr(commaPosition+1);
-        commaPosition = lineStr.find(csvSeparatorCharacter);
-      }
-
-      // Handle last field (if there was no comma at the end)
-      if (!lineStr.empty() )
-      {
-        // Get the structure's name
-        size_t middlePosition = lineStr.find(DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE);
-        if (middlePosition != std::string::npos)
-        {
-          structureNames.push_back(lineStr.substr(0, middlePosition - DVH_ARRAY_NODE_NAME_POSTFIX.size()));
-
-          // Get the structure's total volume and add it to the vector
-          double volumeCCs = 0;
-          {
-            std::string structureVolumeString = lineStr.substr( middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size(),
-              lineStr.size() - middlePosition - DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size() - DVH_CSV_HEADER_VOLUME_FIELD_END.size() );
-            volumeCCs = vtkVariant(structureVolumeString).ToDouble();
-          }
-          structureVolumeCCs.push_back(volumeCCs);
-
-          if (volumeCCs == 0)
-          {
-            std::cerr << "Invalid structure volume in CSV header field " << lineStr << std::endl;
-          }
-
-          fieldCount++;
-        }
-      }
-
-      // Add a vtkDoubleArray for each structure into the vector
-      for (int structureIndex=0; structureIndex < fieldCount/2; ++structureIndex)
-      {
-        vtkSmartPointer<vtkDoubleArray> tempArray = vtkSmartPointer<vtkDoubleArray>::New();
-        tempArray->SetNumberOfComponents(3);
-        currentDvh.push_back(tempArray);
+        fieldStart = fieldEnd + 1;
       }
+      structureValues.resize(structureNames.size());
       firstLine = false;
       continue;
     }
 
-    // Read all tuples from the current line
-    int structureNumber = 0;
-    while (commaPosition != std::string::npos)
+    // Preallocate values based on the length of the first data line
+    if (lineNumber == 0 && !line.empty())
     {
-      // Tuple to be inserted into the vtkDoubleArray object
-      double *tupleToInsert = new double[3];
-      for(int j=0; j<3; ++j)
-        tupleToInsert[j] = 0;
-
-      // Get the current bin's dose from the string
-      double doseGy = 0;
+      size_t estimatedNumberOfLines = static_cast<size_t>(fileSize / static_cast<std::streamoff>(line.size() + 1)) + 1;
+      for (size_t structureIndex=0; structureIndex < structureValues.size(); ++structureIndex)
       {
-        doseGy = vtkVariant(lineStr.substr(0, commaPosition)).ToDouble();
+        structureValues[structureIndex].reserve(3 * estimatedNumberOfLines);
       }
-      tupleToInsert[0] = doseGy;
-
-      // Get the current bin's volume from the string
-      double volumePercent = 0;
-      {
-        lineStr = lineStr.substr(commaPosition+1);
-        commaPosition = lineStr.find(csvSeparatorCharacter);
-        volumePercent = vtkVariant(lineStr.substr(0, commaPosition)).ToDouble();
-      }
-      tupleToInsert[1] = volumePercent;
+    }
 
-      if ((doseGy != 0.0 || volumePercent != 0.0) && (commaPosition > 0))
+    // Read (dose, volume) pairs of all structures from the current line
+    const char* position = line.c_str();
+    const char* lineEnd = position + line.size();
+    for (size_t structureIndex=0; structureIndex < structureValues.size() && position < lineEnd; ++structureIndex)
+    {
+      double doseGy = 0.0;
+      double volumePercent = 0.0;
+      ParseCsvNumber(position, lineEnd, doseGy);
+      bool hasVolume = ParseCsvNumber(position, lineEnd, volumePercent);
+      if ((doseGy != 0.0 || volumePercent != 0.0) && hasVolume)
       {
-        // Add the current bin into the vtkDoubleArray for the current structure
-        currentDvh.at(structureNumber)->InsertTuple(lineNumber, tupleToInsert);
+        // Bins missing from a structure in earlier lines are zero
+        std::vector<double>& values = structureValues[structureIndex];
+        values.resize(3 * (lineNumber + 1), 0.0);
+        values[3*lineNumber] = doseGy;
+        values[3*lineNumber + 1] = volumePercent;
       }
-
-      // Destroy the tuple
-      delete tupleToInsert;
-      tupleToInsert = NULL;
-
-      // Move to the next structure's bin in the string
-      lineStr = lineStr.substr(commaPosition+1);
-      commaPosition = lineStr.find(csvSeparatorCharacter);
-      structureNumber++;
     }
     lineNumber++;
   }
 
   dvhStream.close();
 
+  // Move values into DVH arrays
+  std::vector< vtkSmartPointer< vtkDoubleArray > > currentDvh;
+  for (size_t structureIndex=0; structureIndex < structureValues.size(); ++structureIndex)
+  {
+    std::vector<double>& values = structureValues[structureIndex];
+    vtkSmartPointer<vtkDoubleArray> dvhArray = vtkSmartPointer<vtkDoubleArray>::New();
+    dvhArray->SetNumberOfComponents(3);
+    dvhArray->SetNumberOfTuples(static_cast<vtkIdType>(values.size() / 3));
+    if (!values.empty())
+    {
+      memcpy(dvhArray->GetPointer(0), &(values[0]), values.size() * sizeof(double));
+    }
+    currentDvh.push_back(dvhArray);
+
+    // Release memory of the structure as soon as it is copied
+    std::vector<double>().swap(values);
+  }
+
   vtkCollection* doubleArrayNodes = vtkCollection::New();
   for (unsigned int structureIndex=0; structureIndex < currentDvh.size(); structureIndex++)
   {
@@ -1758,6 +1949,311 @@ vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToDoubleArrayNode
   return doubleArrayNodes;
 }
 
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhToArchive(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName)
+{
+  if (!this->GetMRMLScene() || !parameterNode || !fileName)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Invalid MRML scene, parameter set node, or file name");
+    return false;
+  }
+  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
+  if (!metricsTableNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Unable to access DVH metrics table node");
+    return false;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
+  if (!shNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Failed to access subject hierarchy node");
+    return false;
+  }
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+
+  // Get all DVH array nodes from the parameter set node
+  std::vector<vtkMRMLDoubleArrayNode*> dvhArrayNodes;
+  parameterNode->GetDvhArrayNodes(dvhArrayNodes);
+
+  // Assemble index entries and the metrics table rows of the structures
+  std::vector<DvhArchiveIndexEntry> entries;
+  std::vector<vtkIdType> tableRows;
+  std::vector<vtkDoubleArray*> dvhArrays;
+  for (std::vector<vtkMRMLDoubleArrayNode*>::iterator dvhIt=dvhArrayNodes.begin(); dvhIt!=dvhArrayNodes.end(); ++dvhIt)
+  {
+    vtkMRMLDoubleArrayNode* dvhArrayNode = (*dvhIt);
+    vtkDoubleArray* dvhArray = dvhArrayNode->GetArray();
+    if (!dvhArray)
+    {
+      continue;
+    }
+    DvhArchiveIndexEntry entry;
+    vtkIdType tableRow = -1;
+    if (dvhArrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str()))
+    {
+      tableRow = vtkVariant(dvhArrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str())).ToInt();
+    }
+    if (tableRow >= 0 && tableRow < metricsTable->GetNumberOfRows())
+    {
+      entry.StructureName = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString();
+    }
+    else
+    {
+      tableRow = -1;
+      const char* segmentId = dvhArrayNode->GetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
+      entry.StructureName = (segmentId ? segmentId : "");
+    }
+
+    // Dose volume is identified by DICOM series UID if available, otherwise by node ID
+    vtkMRMLNode* doseVolumeNode = dvhArrayNode->GetNodeReference(vtkMRMLDoseVolumeHistogramNode::DOSE_VOLUME_REFERENCE_ROLE);
+    if (doseVolumeNode)
+    {
+      vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+      if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+      {
+        entry.DoseVolumeUid = shNode->GetItemUID(doseShItemID, vtkMRMLSubjectHierarchyConstants::GetDICOMUIDName());
+      }
+      if (entry.DoseVolumeUid.empty())
+      {
+        entry.DoseVolumeUid = doseVolumeNode->GetID();
+      }
+    }
+
+    entry.NodeName = (dvhArrayNode->GetName() ? dvhArrayNode->GetName() : "");
+    std::vector<std::string> attributeNames = dvhArrayNode->GetAttributeNames();
+    for (std::vector<std::string>::iterator nameIt=attributeNames.begin(); nameIt!=attributeNames.end(); ++nameIt)
+    {
+      const char* attributeValue = dvhArrayNode->GetAttribute(nameIt->c_str());
+      entry.Attributes.push_back(std::make_pair(*nameIt, std::string(attributeValue ? attributeValue : "")));
+    }
+    entry.NumberOfTuples = static_cast<vtkTypeUInt64>(dvhArray->GetNumberOfTuples());
+    entry.NumberOfComponents = static_cast<vtkTypeUInt32>(dvhArray->GetNumberOfComponents());
+    entry.DataOffset = 0;
+    entries.push_back(entry);
+    tableRows.push_back(tableRow);
+    dvhArrays.push_back(dvhArray);
+  }
+
+  std::ofstream outfile(fileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+  if (!outfile)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Output file '" << fileName << "' cannot be opened");
+    return false;
+  }
+
+  // Header, offsets are updated when known
+  vtkTypeUInt32 numberOfMetricColumns = static_cast<vtkTypeUInt32>(metricsTable->GetNumberOfColumns());
+  outfile.write(DVH_ARCHIVE_MAGIC, 8);
+  WriteArchiveValue(outfile, DVH_ARCHIVE_BYTE_ORDER_MARK);
+  WriteArchiveValue(outfile, DVH_ARCHIVE_VERSION);
+  WriteArchiveValue(outfile, static_cast<vtkTypeUInt32>(entries.size()));
+  WriteArchiveValue(outfile, numberOfMetricColumns);
+  std::streamoff offsetsPosition = outfile.tellp();
+  WriteArchiveValue(outfile, static_cast<vtkTypeUInt64>(0));
+  WriteArchiveValue(outfile, static_cast<vtkTypeUInt64>(0));
+
+  // DVH values
+  for (size_t structureIndex=0; structureIndex<entries.size(); ++structureIndex)
+  {
+    AlignArchive(outfile);
+    entries[structureIndex].DataOffset = static_cast<vtkTypeUInt64>(outfile.tellp());
+    vtkDoubleArray* dvhArray = dvhArrays[structureIndex];
+    std::streamsize numberOfBytes = static_cast<std::streamsize>(entries[structureIndex].NumberOfTuples * entries[structureIndex].NumberOfComponents * sizeof(double));
+    if (numberOfBytes > 0)
+    {
+      outfile.write(reinterpret_cast<const char*>(dvhArray->GetPointer(0)), numberOfBytes);
+    }
+  }
+
+  // Metrics by column, one value per structure
+  AlignArchive(outfile);
+  vtkTypeUInt64 metricsOffset = static_cast<vtkTypeUInt64>(outfile.tellp());
+  for (vtkTypeUInt32 column=0; column<numberOfMetricColumns; ++column)
+  {
+    vtkAbstractArray* metricColumn = metricsTable->GetColumn(column);
+    bool isNumeric = (vtkDataArray::SafeDownCast(metricColumn) != NULL);
+    WriteArchiveString(outfile, (metricColumn->GetName() ? metricColumn->GetName() : ""));
+    WriteArchiveValue(outfile, static_cast<vtkTypeUInt8>(isNumeric ? DvhArchiveColumnDouble : DvhArchiveColumnString));
+    for (size_t structureIndex=0; structureIndex<entries.size(); ++structureIndex)
+    {
+      vtkIdType tableRow = tableRows[structureIndex];
+      if (isNumeric)
+      {
+        double value = (tableRow >= 0 ? vtkDataArray::SafeDownCast(metricColumn)->GetComponent(tableRow, 0) : vtkMath::Nan());
+        WriteArchiveValue(outfile, value);
+      }
+      else
+      {
+        WriteArchiveString(outfile, (tableRow >= 0 ? metricColumn->GetVariantValue(tableRow).ToString() : std::string()));
+      }
+    }
+  }
+
+  // Index
+  vtkTypeUInt64 indexOffset = static_cast<vtkTypeUInt64>(outfile.tellp());
+  for (std::vector<DvhArchiveIndexEntry>::iterator entryIt=entries.begin(); entryIt!=entries.end(); ++entryIt)
+  {
+    WriteArchiveString(outfile, entryIt->StructureName);
+    WriteArchiveString(outfile, entryIt->DoseVolumeUid);
+    WriteArchiveString(outfile, entryIt->NodeName);
+    WriteArchiveValue(outfile, static_cast<vtkTypeUInt32>(entryIt->Attributes.size()));
+    for (std::vector<std::pair<std::string, std::string> >::iterator attributeIt=entryIt->Attributes.begin(); attributeIt!=entryIt->Attributes.end(); ++attributeIt)
+    {
+      WriteArchiveString(outfile, attributeIt->first);
+      WriteArchiveString(outfile, attributeIt->second);
+    }
+    WriteArchiveValue(outfile, entryIt->NumberOfTuples);
+    WriteArchiveValue(outfile, entryIt->NumberOfComponents);
+    WriteArchiveValue(outfile, entryIt->DataOffset);
+  }
+
+  outfile.seekp(offsetsPosition, std::ios::beg);
+  WriteArchiveValue(outfile, metricsOffset);
+  WriteArchiveValue(outfile, indexOffset);
+
+  if (!outfile)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Failed to write output file '" << fileName << "'");
+    return false;
+  }
+  outfile.close();
+
+  return true;
+}
+
+//---------------------------------------------------------------------------
+vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadDvhArchive(const char* fileName, vtkTable* metricsTable/*=NULL*/)
+{
+  if (!fileName)
+  {
+    vtkErrorMacro("ReadDvhArchive: Invalid file name");
+    return NULL;
+  }
+  std::ifstream infile(fileName, std::ios_base::in | std::ios_base::binary);
+  if (!infile)
+  {
+    vtkErrorMacro("ReadDvhArchive: Input file '" << fileName << "' cannot be opened");
+    return NULL;
+  }
+
+  std::vector<DvhArchiveIndexEntry> entries;
+  vtkTypeUInt32 numberOfMetricColumns = 0;
+  vtkTypeUInt64 metricsOffset = 0;
+  std::string errorMessage = ReadDvhArchiveIndex(infile, entries, numberOfMetricColumns, metricsOffset);
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("ReadDvhArchive: " << errorMessage << " in file '" << fileName << "'");
+    return NULL;
+  }
+
+  vtkCollection* doubleArrayNodes = vtkCollection::New();
+  for (std::vector<DvhArchiveIndexEntry>::iterator entryIt=entries.begin(); entryIt!=entries.end(); ++entryIt)
+  {
+    vtkNew<vtkMRMLDoubleArrayNode> dvhArrayNode;
+    if (!ReadDvhArchiveEntry(infile, *entryIt, dvhArrayNode.GetPointer()))
+    {
+      vtkErrorMacro("ReadDvhArchive: Failed to read DVH of structure " << entryIt->StructureName << " from file '" << fileName << "'");
+      doubleArrayNodes->Delete();
+      return NULL;
+    }
+    doubleArrayNodes->AddItem(dvhArrayNode.GetPointer());
+  }
+
+  // Read metrics into table columns
+  if (metricsTable)
+  {
+    metricsTable->Initialize();
+    infile.seekg(static_cast<std::streamoff>(metricsOffset), std::ios::beg);
+    for (vtkTypeUInt32 column=0; column<numberOfMetricColumns; ++column)
+    {
+      std::string columnName;
+      vtkTypeUInt8 columnType = 0;
+      if (!ReadArchiveString(infile, columnName) || !ReadArchiveValue(infile, columnType))
+      {
+        vtkErrorMacro("ReadDvhArchive: Invalid metrics in file '" << fileName << "'");
+        break;
+      }
+      vtkSmartPointer<vtkAbstractArray> metricColumn;
+      if (columnType == DvhArchiveColumnDouble)
+      {
+        vtkSmartPointer<vtkDoubleArray> doubleColumn = vtkSmartPointer<vtkDoubleArray>::New();
+        doubleColumn->SetNumberOfTuples(static_cast<vtkIdType>(entries.size()));
+        if (!entries.empty())
+        {
+          infile.read(reinterpret_cast<char*>(doubleColumn->GetPointer(0)), entries.size() * sizeof(double));
+        }
+        metricColumn = doubleColumn;
+      }
+      else
+      {
+        vtkSmartPointer<vtkStringArray> stringColumn = vtkSmartPointer<vtkStringArray>::New();
+        stringColumn->SetNumberOfValues(static_cast<vtkIdType>(entries.size()));
+        for (size_t structureIndex=0; structureIndex<entries.size(); ++structureIndex)
+        {
+          std::string value;
+          ReadArchiveString(infile, value);
+          stringColumn->SetValue(static_cast<vtkIdType>(structureIndex), value);
+        }
+        metricColumn = stringColumn;
+      }
+      if (infile.fail())
+      {
+        vtkErrorMacro("ReadDvhArchive: Invalid metrics in file '" << fileName << "'");
+        break;
+      }
+      metricColumn->SetName(columnName.c_str());
+      metricsTable->AddColumn(metricColumn);
+    }
+  }
+
+  return doubleArrayNodes;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ReadDvhFromArchive(const char* fileName, const char* structureName, const char* doseVolumeUid, vtkMRMLDoubleArrayNode* dvhArrayNode)
+{
+  if (!fileName || !structureName || !dvhArrayNode)
+  {
+    vtkErrorMacro("ReadDvhFromArchive: Invalid input arguments");
+    return false;
+  }
+  std::ifstream infile(fileName, std::ios_base::in | std::ios_base::binary);
+  if (!infile)
+  {
+    vtkErrorMacro("ReadDvhFromArchive: Input file '" << fileName << "' cannot be opened");
+    return false;
+  }
+
+  // Only the header and the index are read besides the values of the requested structure
+  std::vector<DvhArchiveIndexEntry> entries;
+  vtkTypeUInt32 numberOfMetricColumns = 0;
+  vtkTypeUInt64 metricsOffset = 0;
+  std::string errorMessage = ReadDvhArchiveIndex(infile, entries, numberOfMetricColumns, metricsOffset);
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("ReadDvhFromArchive: " << errorMessage << " in file '" << fileName << "'");
+    return false;
+  }
+
+  for (std::vector<DvhArchiveIndexEntry>::iterator entryIt=entries.begin(); entryIt!=entries.end(); ++entryIt)
+  {
+    if ( entryIt->StructureName != structureName
+      || (doseVolumeUid && doseVolumeUid[0] != 0 && entryIt->DoseVolumeUid != doseVolumeUid) )
+    {
+      continue;
+    }
+    if (!ReadDvhArchiveEntry(infile, *entryIt, dvhArrayNode))
+    {
+      vtkErrorMacro("ReadDvhFromArchive: Failed to read DVH of structure " << structureName << " from file '" << fileName << "'");
+      return false;
+    }
+    return true;
+  }
+
+  vtkErrorMacro("ReadDvhFromArchive: Structure " << structureName << " is not found in file '" << fileName << "'");
+  return false;
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseVolumeHistogramModuleLogic::AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix)
 {
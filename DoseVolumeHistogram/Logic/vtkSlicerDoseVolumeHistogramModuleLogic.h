@@ -39,6 +39,7 @@ class vtkMRMLScalarVolumeNode;
 class vtkMRMLChartNode;
 class vtkMRMLChartViewNode;
 class vtkMRMLDoseVolumeHistogramNode;
+class vtkTable;
 
 /// \ingroup SlicerRt_QtModules_DoseVolumeHistogram
 /// \brief The DoseVolumeHistogram module computes dose volume histogram (DVH) and metrics from a dose map and segmentation.
@@ -105,8 +106,28 @@ public:
 
   /// Read DVH double arrays from a CSV file
   /// \return a vtkCollection containing vtkMRMLDoubleArrayNodes. Each node represents one structure DVH and contains the vtkDoubleArray as well as the name and total volume attributes for the structure.
+  ///   NULL if the file cannot be opened. The caller takes ownership of the returned collection.
   vtkCollection* ReadCsvToDoubleArrayNode(std::string csvFilename);
 
+  /// Export DVH arrays and metrics table rows to a binary DVH archive.
+  /// The archive starts with a header pointing to an index of the structures (name, dose volume UID,
+  /// node name and attributes, array location), so single DVHs can be read without reading the whole
+  /// file. DVH values are stored as contiguous 8-byte aligned double arrays, metrics are stored by column.
+  /// \return True if file written and saved successfully, false otherwise
+  bool ExportDvhToArchive(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName);
+
+  /// Read all DVHs from a binary DVH archive written by \sa ExportDvhToArchive
+  /// \param metricsTable Table to fill with the stored metrics (one row per DVH) if not NULL
+  /// \return a vtkCollection containing vtkMRMLDoubleArrayNodes with the stored name, attributes and values. NULL on error
+  vtkCollection* ReadDvhArchive(const char* fileName, vtkTable* metricsTable=NULL);
+
+  /// Read a single DVH from a binary DVH archive written by \sa ExportDvhToArchive
+  /// \param structureName Name of the structure to read
+  /// \param doseVolumeUid UID of the dose volume the DVH was computed on. The first DVH of the structure is read if empty
+  /// \param dvhArrayNode Output node getting the stored name, attributes and values
+  /// \return True if the DVH was found and read successfully
+  bool ReadDvhFromArchive(const char* fileName, const char* structureName, const char* doseVolumeUid, vtkMRMLDoubleArrayNode* dvhArrayNode);
+
   /// Assemble dose metric name, e.g. "Mean dose (Gy)". If selected volume is not a dose, it will contain "intensity" instead of "dose"
   /// \param doseMetricAttributeNamePrefix Prefix of the desired dose metric attribute name, e.g. "Mean "
   std::string AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix);
@@ -0,0 +1,200 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// DoseVolumeHistogram includes
+#include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
+#include "vtkMRMLDoseVolumeHistogramNode.h"
+
+// MRML includes
+#include <vtkMRMLDoubleArrayNode.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkDoubleArray.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+  const int NUMBER_OF_STRUCTURES = 1000;
+  const int NUMBER_OF_BINS = 40;
+
+  // Length of the fixed line buffer the CSV reader used to have
+  const size_t OLD_LINE_BUFFER_SIZE = 16384;
+
+  double GetDose(int binIndex)
+  {
+    return 0.5 * (binIndex + 1);
+  }
+
+  double GetVolumePercent(int structureIndex, int binIndex)
+  {
+    return 100.0 - 2.0 * binIndex - 0.1 * (structureIndex % 10);
+  }
+
+  double GetTotalVolumeCc(int structureIndex)
+  {
+    return 10.0 + structureIndex;
+  }
+
+  std::string GetStructureName(int structureIndex)
+  {
+    std::ostringstream nameStream;
+    nameStream << "Structure_" << structureIndex;
+    return nameStream.str();
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDoseVolumeHistogramCsvReadTest1(int argc, char * argv[])
+{
+  // Get temporary directory
+  const char *temporaryDirectoryPath = NULL;
+  if (argc > 2)
+  {
+    if (STRCASECMP(argv[1], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[2];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    }
+    else
+    {
+      std::cerr << "Invalid argument!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Write a DVH table in the exported CSV format with so many structures that
+  // both the header and the data lines are longer than the old line buffer
+  std::string csvFilePath = std::string(temporaryDirectoryPath) + "/TestDvhTable_LongLines.csv";
+  std::ofstream csvStream(csvFilePath.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!csvStream.is_open())
+  {
+    std::cerr << __LINE__ << ": Failed to open file " << csvFilePath << " for writing" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ostringstream headerStream;
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    std::string structureName = GetStructureName(structureIndex);
+    headerStream << structureName << " Dose (Gy),";
+    headerStream << structureName << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE
+      << std::fixed << std::setprecision(3) << GetTotalVolumeCc(structureIndex)
+      << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_END << ",";
+  }
+  csvStream << headerStream.str() << std::endl;
+
+  size_t shortestDataLineLength = std::string::npos;
+  for (int binIndex=0; binIndex<NUMBER_OF_BINS; ++binIndex)
+  {
+    std::ostringstream lineStream;
+    for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+    {
+      lineStream << std::fixed << std::setprecision(6) << GetDose(binIndex) << ","
+        << GetVolumePercent(structureIndex, binIndex) << ",";
+    }
+    std::string line = lineStream.str();
+    if (line.size() < shortestDataLineLength)
+    {
+      shortestDataLineLength = line.size();
+    }
+    csvStream << line << std::endl;
+  }
+  csvStream.close();
+
+  if (headerStream.str().size() <= OLD_LINE_BUFFER_SIZE || shortestDataLineLength <= OLD_LINE_BUFFER_SIZE)
+  {
+    std::cerr << __LINE__ << ": Test CSV lines are not longer than " << OLD_LINE_BUFFER_SIZE << " characters" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Read the table back
+  vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic> dvhLogic = vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic>::New();
+  vtkSmartPointer<vtkCollection> dvhArrayNodes =
+    vtkSmartPointer<vtkCollection>::Take( dvhLogic->ReadCsvToDoubleArrayNode(csvFilePath) );
+  if (!dvhArrayNodes.GetPointer())
+  {
+    std::cerr << __LINE__ << ": Failed to read DVH table from " << csvFilePath << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (dvhArrayNodes->GetNumberOfItems() != NUMBER_OF_STRUCTURES)
+  {
+    std::cerr << __LINE__ << ": Number of read structures is " << dvhArrayNodes->GetNumberOfItems()
+      << " instead of " << NUMBER_OF_STRUCTURES << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ostringstream volumeAttributeNameStream;
+  volumeAttributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    vtkMRMLDoubleArrayNode* dvhArrayNode = vtkMRMLDoubleArrayNode::SafeDownCast(dvhArrayNodes->GetItemAsObject(structureIndex));
+    if (!dvhArrayNode || !dvhArrayNode->GetArray())
+    {
+      std::cerr << __LINE__ << ": Invalid DVH array node for structure " << structureIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    const char* segmentId = dvhArrayNode->GetAttribute(vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
+    if (!segmentId || GetStructureName(structureIndex).compare(segmentId))
+    {
+      std::cerr << __LINE__ << ": Structure " << structureIndex << " is named '" << (segmentId ? segmentId : "")
+        << "' instead of '" << GetStructureName(structureIndex) << "'" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    const char* totalVolume = dvhArrayNode->GetAttribute(volumeAttributeNameStream.str().c_str());
+    if (!totalVolume || fabs(atof(totalVolume) - GetTotalVolumeCc(structureIndex)) > 1e-3)
+    {
+      std::cerr << __LINE__ << ": Total volume of structure " << structureIndex << " is " << (totalVolume ? totalVolume : "missing")
+        << " instead of " << GetTotalVolumeCc(structureIndex) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    vtkDoubleArray* dvhArray = dvhArrayNode->GetArray();
+    if (dvhArray->GetNumberOfTuples() != NUMBER_OF_BINS)
+    {
+      std::cerr << __LINE__ << ": Structure " << structureIndex << " has " << dvhArray->GetNumberOfTuples()
+        << " bins instead of " << NUMBER_OF_BINS << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (int binIndex=0; binIndex<NUMBER_OF_BINS; ++binIndex)
+    {
+      if ( fabs(dvhArray->GetComponent(binIndex, 0) - GetDose(binIndex)) > 1e-6
+        || fabs(dvhArray->GetComponent(binIndex, 1) - GetVolumePercent(structureIndex, binIndex)) > 1e-6 )
+      {
+        std::cerr << __LINE__ << ": Bin " << binIndex << " of structure " << structureIndex << " is ("
+          << dvhArray->GetComponent(binIndex, 0) << ", " << dvhArray->GetComponent(binIndex, 1) << ") instead of ("
+          << GetDose(binIndex) << ", " << GetVolumePercent(structureIndex, binIndex) << ")" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::cout << "DVH CSV long line read test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
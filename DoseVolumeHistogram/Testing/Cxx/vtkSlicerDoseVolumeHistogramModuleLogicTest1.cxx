@@ -52,6 +52,8 @@
 #include <vtkImageAccumulate.h>
 #include <vtkLookupTable.h>
 #include <vtkTimerLog.h>
+#include <vtkTable.h>
+#include <vtkCollection.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -481,6 +483,45 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
 
   bool returnWithSuccess = true;
 
+  // Write DVHs and metrics to binary archive and check that they are read back unchanged
+  std::string temporaryDvhArchiveFileName = std::string(temporaryDvhMetricCsvFileName) + ".dvharchive";
+  vtksys::SystemTools::RemoveFile(temporaryDvhArchiveFileName.c_str());
+  if (!dvhLogic->ExportDvhToArchive(paramNode, temporaryDvhArchiveFileName.c_str()))
+  {
+    std::cerr << "Failed to export DVH archive!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkTable> archiveMetricsTable = vtkSmartPointer<vtkTable>::New();
+  vtkSmartPointer<vtkCollection> archiveDvhNodes = vtkSmartPointer<vtkCollection>::Take(
+    dvhLogic->ReadDvhArchive(temporaryDvhArchiveFileName.c_str(), archiveMetricsTable) );
+  if ( !archiveDvhNodes || archiveDvhNodes->GetNumberOfItems() != static_cast<int>(dvhNodes.size())
+    || archiveMetricsTable->GetNumberOfRows() != static_cast<vtkIdType>(dvhNodes.size()) )
+  {
+    std::cerr << "Failed to read DVHs from archive!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int dvhIndex=0; dvhIndex<archiveDvhNodes->GetNumberOfItems(); ++dvhIndex)
+  {
+    vtkDoubleArray* originalArray = dvhNodes[dvhIndex]->GetArray();
+    vtkDoubleArray* archiveArray = vtkMRMLDoubleArrayNode::SafeDownCast(archiveDvhNodes->GetItemAsObject(dvhIndex))->GetArray();
+    if ( archiveArray->GetNumberOfTuples() != originalArray->GetNumberOfTuples()
+      || archiveArray->GetNumberOfComponents() != originalArray->GetNumberOfComponents()
+      || memcmp(archiveArray->GetPointer(0), originalArray->GetPointer(0),
+                originalArray->GetNumberOfTuples() * originalArray->GetNumberOfComponents() * sizeof(double)) != 0 )
+    {
+      std::cerr << "DVH " << dvhNodes[dvhIndex]->GetName() << " read from archive does not match the original!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::string firstStructureName = archiveMetricsTable->GetValueByName(0, vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_STRUCTURE.c_str()).ToString();
+  vtkNew<vtkMRMLDoubleArrayNode> singleDvhNode;
+  if ( !dvhLogic->ReadDvhFromArchive(temporaryDvhArchiveFileName.c_str(), firstStructureName.c_str(), "", singleDvhNode.GetPointer())
+    || singleDvhNode->GetArray()->GetNumberOfTuples() != dvhNodes[0]->GetArray()->GetNumberOfTuples() )
+  {
+    std::cerr << "Failed to read DVH of structure " << firstStructureName << " from archive!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Compare CSV DVH tables
   double agreementAcceptancePercentage = -1.0;
   if (vtksys::SystemTools::FileExists(baselineDvhTableCsvFileName))
@@ -552,6 +593,11 @@ int CompareCsvDvhTables(std::string dvhCsvFileName, std::string baselineCsvFileN
     vtkSmartPointer<vtkCollection>::Take( csvReadLogic->ReadCsvToDoubleArrayNode(dvhCsvFileName) );
   vtkSmartPointer<vtkCollection> baselineDvh = 
     vtkSmartPointer<vtkCollection>::Take( csvReadLogic->ReadCsvToDoubleArrayNode(baselineCsvFileName) );
+  if (!currentDvh.GetPointer() || !baselineDvh.GetPointer())
+  {
+    std::cerr << "ERROR: Failed to read the current or the baseline CSV DVH table!" << std::endl;
+    return 1;
+  }
  
   // Compare the current DVH to the baseline and determine mean and maximum difference
   agreementAcceptancePercentage = 0.0;
@@ -28,10 +28,17 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
+#include "vtkSlicerRtTracer.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
 
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+
 // MRML includes
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
@@ -40,6 +47,9 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 
 // VTK includes
 #include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
 
 // SlicerQt includes
 #include "qSlicerApplication.h"
@@ -55,6 +65,11 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include <QSlider>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QAtomicInt>
+
+// STD includes
+#include <map>
+#include <vector>
 
 //----------------------------------------------------------------------------
 double qSlicerAbstractDoseEngine::DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM = 16.0;
@@ -63,6 +78,34 @@ double qSlicerAbstractDoseEngine::DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM = 16.
 static const char* INTERMEDIATE_RESULT_REFERENCE_ROLE = "IntermediateResultRef";
 static const char* RESULT_DOSE_REFERENCE_ROLE = "ResultDoseRef";
 
+//----------------------------------------------------------------------------
+/// Rasterized beam aperture with the values determining it (beam model MTime, transforms, reference geometry)
+struct BeamApertureCacheEntry
+{
+  std::vector<double> Key;
+  vtkSmartPointer<vtkOrientedImageData> Labelmap;
+};
+/// Rasterized beam apertures by beam node ID, shared by all dose engines
+static std::map<std::string, BeamApertureCacheEntry> BeamApertureCache;
+
+//----------------------------------------------------------------------------
+/// Append upper 3x4 part of the transform to world of a node to a cache key
+static void AppendTransformToWorldToKey(vtkMRMLTransformNode* transformNode, std::vector<double>& key)
+{
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (transformNode)
+  {
+    transformNode->GetMatrixTransformToWorld(matrix);
+  }
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      key.push_back(matrix->GetElement(row, column));
+    }
+  }
+}
+
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
 class qSlicerAbstractDoseEnginePrivate
@@ -76,6 +119,12 @@ public:
   /// Engine-specific parameters defined in \sa defineBeamParameters.
   /// Key is the parameter name (without engine name prefix), value is the default
   QMap<QString,QVariant> BeamParameters;
+
+  /// Non-zero if cancellation of the ongoing calculation has been requested
+  QAtomicInt CancelRequested;
+
+  /// Spacing of the dose calculation grid (mm). Zero means the resolution of the reference volume
+  double DoseGridSpacing;
 };
 
 //-----------------------------------------------------------------------------
@@ -84,6 +133,8 @@ public:
 //-----------------------------------------------------------------------------
 qSlicerAbstractDoseEnginePrivate::qSlicerAbstractDoseEnginePrivate(qSlicerAbstractDoseEngine& object)
   : q_ptr(&object)
+  , CancelRequested(0)
+  , DoseGridSpacing(0.0)
 {
 }
 
@@ -123,6 +174,151 @@ void qSlicerAbstractDoseEngine::setName(QString name)
 
 //----------------------------------------------------------------------------
 QString qSlicerAbstractDoseEngine::calculateDose(vtkMRMLRTBeamNode* beamNode)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+  d->CancelRequested = 0;
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> resultDoseVolumeNode;
+  QString errorMessage = this->prepareBeamForDoseCalculation(beamNode, resultDoseVolumeNode);
+  if (!errorMessage.isEmpty())
+  {
+    return errorMessage;
+  }
+
+  // Calculate dose
+  {
+    SLICERRT_TRACE_SCOPE_DETAIL("ExternalBeamPlanning", "Dose calculation", this->name().toLatin1().constData());
+    errorMessage = this->calculateDoseUsingEngine(beamNode, resultDoseVolumeNode);
+  }
+  if (errorMessage.isEmpty())
+  {
+    // Add result dose volume to beam
+    this->addResultDose(resultDoseVolumeNode, beamNode);
+  }
+
+  return errorMessage;
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::calculateDoseForBeams(std::vector<vtkMRMLRTBeamNode*>& beamNodes)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+  d->CancelRequested = 0;
+
+  std::vector<vtkSmartPointer<vtkMRMLScalarVolumeNode> > resultDoseVolumeNodes;
+  std::vector<vtkMRMLScalarVolumeNode*> resultDoseVolumeNodePointers;
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beamNodes.begin(); beamIt != beamNodes.end(); ++beamIt)
+  {
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> resultDoseVolumeNode;
+    QString errorMessage = this->prepareBeamForDoseCalculation(*beamIt, resultDoseVolumeNode);
+    if (!errorMessage.isEmpty())
+    {
+      return errorMessage;
+    }
+    resultDoseVolumeNodes.push_back(resultDoseVolumeNode);
+    resultDoseVolumeNodePointers.push_back(resultDoseVolumeNode.GetPointer());
+  }
+
+  // Calculate dose
+  QString errorMessage;
+  {
+    SLICERRT_TRACE_SCOPE_DETAIL("ExternalBeamPlanning", "Dose calculation", this->name().toLatin1().constData());
+    errorMessage = this->calculateDoseForBeamsUsingEngine(beamNodes, resultDoseVolumeNodePointers);
+  }
+  if (errorMessage.isEmpty())
+  {
+    // Add result dose volumes to beams
+    for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
+    {
+      this->addResultDose(resultDoseVolumeNodes[beamIndex], beamNodes[beamIndex]);
+    }
+  }
+  else
+  {
+    // Remove result nodes of the failed or cancelled calculation so that the doses
+    // of the previous calculation remain the results of the beams
+    for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
+    {
+      beamNodes[beamIndex]->GetScene()->RemoveNode(resultDoseVolumeNodes[beamIndex]);
+    }
+  }
+
+  return errorMessage;
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::calculateDoseForBeamsUsingEngine(
+  std::vector<vtkMRMLRTBeamNode*>& beamNodes,
+  std::vector<vtkMRMLScalarVolumeNode*>& resultDoseVolumeNodes )
+{
+  if (beamNodes.size() != resultDoseVolumeNodes.size())
+  {
+    QString errorMessage("Number of beams and result dose volumes differ");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
+  {
+    if (this->isCancelRequested())
+    {
+      return QString("Dose calculation cancelled");
+    }
+
+    SLICERRT_TRACE_SCOPE_DETAIL("ExternalBeamPlanning", "Beam", beamNodes[beamIndex]->GetName());
+    QString errorMessage = this->calculateDoseUsingEngine(beamNodes[beamIndex], resultDoseVolumeNodes[beamIndex]);
+    if (!errorMessage.isEmpty())
+    {
+      return errorMessage;
+    }
+    this->reportBeamDoseCalculated(beamIndex+1, (int)beamNodes.size());
+  }
+
+  return QString();
+}
+
+//----------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::reportBeamDoseCalculated(int numberOfCalculatedBeams, int numberOfBeams)
+{
+  emit beamDoseCalculated(numberOfCalculatedBeams, numberOfBeams);
+}
+
+//----------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::requestCancel()
+{
+  Q_D(qSlicerAbstractDoseEngine);
+  d->CancelRequested = 1;
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerAbstractDoseEngine::isCancelRequested()const
+{
+  Q_D(const qSlicerAbstractDoseEngine);
+  return (d->CancelRequested != 0);
+}
+
+//----------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::setDoseGridSpacing(double spacing)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+  d->DoseGridSpacing = (spacing > 0.0 ? spacing : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double qSlicerAbstractDoseEngine::doseGridSpacing()const
+{
+  Q_D(const qSlicerAbstractDoseEngine);
+  return d->DoseGridSpacing;
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerAbstractDoseEngine::supportsDoseGridSpacing()const
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::prepareBeamForDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkSmartPointer<vtkMRMLScalarVolumeNode>& resultDoseVolumeNode)
 {
   if (!beamNode)
   {
@@ -175,21 +371,13 @@ QString qSlicerAbstractDoseEngine::calculateDose(vtkMRMLRTBeamNode* beamNode)
   this->removeIntermediateResults(beamNode);
 
   // Create output dose volume for beam
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> resultDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  resultDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
   beamNode->GetScene()->AddNode(resultDoseVolumeNode);
   // Give default name for result node (engine can give it a more meaningful name)
   std::string resultDoseNodeName = std::string(beamNode->GetName()) + "_Dose";
   resultDoseVolumeNode->SetName(resultDoseNodeName.c_str());
 
-  // Calculate dose
-  QString errorMessage = this->calculateDoseUsingEngine(beamNode, resultDoseVolumeNode);
-  if (errorMessage.isEmpty())
-  {
-    // Add result dose volume to beam
-    this->addResultDose(resultDoseVolumeNode, beamNode);
-  }
-
-  return errorMessage;
+  return QString();
 }
 
 //---------------------------------------------------------------------------
@@ -328,6 +516,88 @@ void qSlicerAbstractDoseEngine::addResultDose(vtkMRMLScalarVolumeNode* resultDos
   }
 }
 
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkOrientedImageData> qSlicerAbstractDoseEngine::getBeamApertureLabelmap(vtkMRMLRTBeamNode* beamNode)
+{
+  if (!beamNode || !beamNode->GetID() || !beamNode->GetPolyData())
+  {
+    qCritical() << Q_FUNC_INFO << ": Invalid beam node";
+    return NULL;
+  }
+  vtkMRMLRTPlanNode* parentPlanNode = beamNode->GetParentPlanNode();
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = (parentPlanNode ? parentPlanNode->GetReferenceVolumeNode() : NULL);
+  if (!referenceVolumeNode || !referenceVolumeNode->GetImageData())
+  {
+    qCritical() << Q_FUNC_INFO << ": Unable to access reference volume for beam " << beamNode->GetName();
+    return NULL;
+  }
+
+  // Assemble cache key from the beam geometry (the beam model is regenerated on geometry change)
+  // and the reference volume geometry. The contents of the reference volume do not matter
+  std::vector<double> key;
+  key.push_back((double)beamNode->GetPolyData()->GetMTime());
+  AppendTransformToWorldToKey(beamNode->GetParentTransformNode(), key);
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceVolumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      key.push_back(ijkToRasMatrix->GetElement(row, column));
+    }
+  }
+  AppendTransformToWorldToKey(referenceVolumeNode->GetParentTransformNode(), key);
+  int extent[6] = {0,-1,0,-1,0,-1};
+  referenceVolumeNode->GetImageData()->GetExtent(extent);
+  key.insert(key.end(), extent, extent+6);
+
+  std::map<std::string, BeamApertureCacheEntry>::iterator cacheIt = BeamApertureCache.find(beamNode->GetID());
+  if (cacheIt != BeamApertureCache.end() && cacheIt->second.Key == key)
+  {
+    return cacheIt->second.Labelmap;
+  }
+
+  // Rasterize beam model onto the reference volume
+  vtkSmartPointer<vtkSegment> beamSegment = vtkSmartPointer<vtkSegment>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateSegmentFromModelNode(beamNode) );
+  vtkPolyData* beamPolyData = (beamSegment.GetPointer() ? vtkPolyData::SafeDownCast(
+    beamSegment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()) ) : NULL);
+  if (!beamPolyData)
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to get beam model for beam " << beamNode->GetName();
+    return NULL;
+  }
+  vtkSmartPointer<vtkOrientedImageData> beamImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(referenceVolumeNode) );
+  vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule> converter =
+    vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule>::New();
+  converter->SetUseOutputImageDataGeometry(true);
+  if (!beamImageData.GetPointer() || !converter->Convert(beamPolyData, beamImageData))
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to rasterize aperture of beam " << beamNode->GetName();
+    return NULL;
+  }
+
+  BeamApertureCacheEntry& entry = BeamApertureCache[beamNode->GetID()];
+  entry.Key = key;
+  entry.Labelmap = beamImageData;
+
+  return beamImageData;
+}
+
+//---------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::clearBeamApertureCache(vtkMRMLRTBeamNode* beamNode/*=NULL*/)
+{
+  if (!beamNode)
+  {
+    BeamApertureCache.clear();
+  }
+  else if (beamNode->GetID())
+  {
+    BeamApertureCache.erase(beamNode->GetID());
+  }
+}
+
 //---------------------------------------------------------------------------
 vtkMRMLScalarVolumeNode* qSlicerAbstractDoseEngine::getResultDoseForBeam(vtkMRMLRTBeamNode* beamNode)
 {
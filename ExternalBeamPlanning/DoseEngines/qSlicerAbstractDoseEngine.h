@@ -23,11 +23,18 @@
 
 #include "qSlicerExternalBeamPlanningDoseEnginesExport.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+
 // Qt includes
 #include <QObject>
 #include <QStringList>
 
+// STD includes
+#include <vector>
+
 class qSlicerAbstractDoseEnginePrivate;
+class vtkOrientedImageData;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLRTBeamNode;
 class vtkMRMLNode;
@@ -69,12 +76,41 @@ public:
   /// \return Error message. Empty string on success
   QString calculateDose(vtkMRMLRTBeamNode* beamNode);
 
+  /// Perform dose calculation for multiple beams. Engines that can share data between beams
+  /// or compute beams concurrently override \sa calculateDoseForBeamsUsingEngine
+  /// \param beamNodes Beam nodes for which the dose is calculated
+  /// \return Error message. Empty string on success
+  QString calculateDoseForBeams(std::vector<vtkMRMLRTBeamNode*>& beamNodes);
+
   /// Get result per-beam dose volume for given beam
   vtkMRMLScalarVolumeNode* getResultDoseForBeam(vtkMRMLRTBeamNode* beamNode);
 
   /// Remove intermediate nodes created by the dose engine for a certain beam
   Q_INVOKABLE void removeIntermediateResults(vtkMRMLRTBeamNode* beamNode);
 
+  /// Request cancellation of the ongoing dose calculation. Can be called from any thread.
+  /// Engines check the request between computation steps (at least between beams), and
+  /// the calculation returns with an error message if cancelled
+  Q_INVOKABLE void requestCancel();
+  /// Determine whether cancellation of the ongoing dose calculation has been requested
+  Q_INVOKABLE bool isCancelRequested()const;
+
+  /// Set spacing (mm) of the grid on which the dose is calculated. Used for quick coarse dose
+  /// calculation. Zero (default) means the resolution of the reference volume.
+  /// Only has effect if the engine \sa supportsDoseGridSpacing
+  Q_INVOKABLE void setDoseGridSpacing(double spacing);
+  /// Get spacing (mm) of the dose calculation grid. Zero means the resolution of the reference volume
+  Q_INVOKABLE double doseGridSpacing()const;
+  /// Determine whether the engine can calculate dose on a grid coarser than the reference volume
+  /// (see \sa setDoseGridSpacing). False by default
+  Q_INVOKABLE virtual bool supportsDoseGridSpacing()const;
+
+signals:
+  /// Emitted during \sa calculateDoseForBeams each time the dose of a beam has been calculated
+  /// \param numberOfCalculatedBeams Number of beams whose dose has been calculated so far
+  /// \param numberOfBeams Number of beams in the calculation
+  void beamDoseCalculated(int numberOfCalculatedBeams, int numberOfBeams);
+
 // API functions to implement in the subclass
 protected:
   /// Calculate dose for a single beam. Called by \sa CalculateDose that performs actions generic
@@ -88,6 +124,17 @@ protected:
     vtkMRMLRTBeamNode* beamNode,
     vtkMRMLScalarVolumeNode* resultDoseVolumeNode ) = 0;
 
+  /// Calculate dose for multiple beams. Called by \sa calculateDoseForBeams that performs actions
+  /// generic to any dose engine before and after calculation.
+  /// Default implementation calls \sa calculateDoseUsingEngine for each beam. Engines that can share
+  /// data between beams or compute beams concurrently should override it
+  /// \param beamNodes Beams for which the dose is calculated
+  /// \param resultDoseVolumeNodes Output volume nodes for the result doses (one for each beam). Created by
+  ///   \sa calculateDoseForBeams
+  virtual QString calculateDoseForBeamsUsingEngine(
+    std::vector<vtkMRMLRTBeamNode*>& beamNodes,
+    std::vector<vtkMRMLScalarVolumeNode*>& resultDoseVolumeNodes );
+
   /// Define engine-specific beam parameters.
   /// This is the method that needs to be implemented in each engine.
   virtual void defineBeamParameters() = 0;
@@ -106,6 +153,20 @@ public:
   /// \param replace Remove referenced dose volume if already exists. True by default
   Q_INVOKABLE void addResultDose(vtkMRMLScalarVolumeNode* resultDose, vtkMRMLRTBeamNode* beamNode, bool replace=true);
 
+  /// Report progress of \sa calculateDoseForBeamsUsingEngine by emitting \sa beamDoseCalculated.
+  /// Needs to be called from the thread that called \sa calculateDoseForBeams
+  Q_INVOKABLE void reportBeamDoseCalculated(int numberOfCalculatedBeams, int numberOfBeams);
+
+  /// Get beam aperture rasterized onto the reference volume of the parent plan of the beam.
+  /// The labelmap is cached per beam and shared by all dose engines, and it is only recomputed if the
+  /// beam geometry or the reference volume geometry changes. The returned image must not be modified
+  /// \param beamNode Beam node whose aperture is rasterized
+  /// \return Binary labelmap (unsigned char) in the geometry of the reference volume. NULL on failure
+  vtkSmartPointer<vtkOrientedImageData> getBeamApertureLabelmap(vtkMRMLRTBeamNode* beamNode);
+
+  /// Remove cached rasterized aperture of a beam, or all cached apertures if no beam is given
+  static void clearBeamApertureCache(vtkMRMLRTBeamNode* beamNode=NULL);
+
 // Beam parameter definition functions.
 // Need to be called from the implemented \sa defineBeamParameters method.
 // Public so that they can be called from python.
@@ -214,6 +275,12 @@ public:
 
 // Private helper functions
 private:
+  /// Prepare beam for dose calculation: move plan next to reference volume in subject hierarchy,
+  /// remove past intermediate results, and create result dose volume node
+  /// \param resultDoseVolumeNode Output result dose volume node added to the scene
+  /// \return Error message. Empty string on success
+  QString prepareBeamForDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkSmartPointer<vtkMRMLScalarVolumeNode>& resultDoseVolumeNode);
+
   /// Add engine name prefix to the parameter name.
   /// This prefixed parameter name will be the attribute name for the beam parameter in the beam nodes.
   QString assembleEngineParameterName(QString parameterName);
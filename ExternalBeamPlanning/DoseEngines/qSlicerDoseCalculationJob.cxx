@@ -0,0 +1,225 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Dose engines includes
+#include "qSlicerDoseCalculationJob.h"
+
+#include "qSlicerDoseEngineLogic.h"
+#include "qSlicerDoseEnginePluginHandler.h"
+#include "qSlicerAbstractDoseEngine.h"
+
+// Beams includes
+#include "vtkMRMLRTBeamNode.h"
+#include "vtkMRMLRTPlanNode.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+
+// Qt includes
+#include <QDebug>
+#include <QTimer>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+qSlicerDoseCalculationJob::qSlicerDoseCalculationJob(qSlicerDoseEngineLogic* logic, vtkMRMLRTPlanNode* planNode,
+  QList<double> doseGridSpacings, QObject* parent/*=NULL*/)
+  : Superclass(parent)
+  , m_Logic(logic)
+  , m_PlanNode(planNode)
+  , m_ActiveEngine(NULL)
+  , m_DoseGridSpacings(doseGridSpacings)
+  , m_NextLevel(0)
+  , m_CompletedDoseGridSpacing(-1.0)
+  , m_CancelRequested(0)
+  , m_Running(false)
+  , m_Finished(false)
+{
+  // The last level is always the full resolution dose
+  if (m_DoseGridSpacings.isEmpty() || m_DoseGridSpacings.last() > 0.0)
+  {
+    m_DoseGridSpacings.append(0.0);
+  }
+}
+
+//----------------------------------------------------------------------------
+qSlicerDoseCalculationJob::~qSlicerDoseCalculationJob()
+{
+}
+
+//----------------------------------------------------------------------------
+void qSlicerDoseCalculationJob::start()
+{
+  if (m_Running || m_Finished)
+  {
+    qCritical() << Q_FUNC_INFO << ": Job has already been started";
+    return;
+  }
+
+  m_Running = true;
+  QTimer::singleShot(0, this, SLOT(calculateNextLevel()));
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLRTPlanNode* qSlicerDoseCalculationJob::planNode()const
+{
+  return m_PlanNode.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerDoseCalculationJob::isRunning()const
+{
+  return m_Running;
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerDoseCalculationJob::isFinished()const
+{
+  return m_Finished;
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerDoseCalculationJob::isCancelled()const
+{
+  return (m_CancelRequested != 0);
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerDoseCalculationJob::errorMessage()const
+{
+  return m_ErrorMessage;
+}
+
+//----------------------------------------------------------------------------
+double qSlicerDoseCalculationJob::completedDoseGridSpacing()const
+{
+  return m_CompletedDoseGridSpacing;
+}
+
+//----------------------------------------------------------------------------
+void qSlicerDoseCalculationJob::cancel()
+{
+  m_CancelRequested = 1;
+
+  // Interrupt the level being calculated if the engine supports it
+  qSlicerAbstractDoseEngine* activeEngine = m_ActiveEngine;
+  if (activeEngine)
+  {
+    activeEngine->requestCancel();
+  }
+}
+
+//----------------------------------------------------------------------------
+void qSlicerDoseCalculationJob::calculateNextLevel()
+{
+  if (this->isCancelled())
+  {
+    this->finish(QString("Dose calculation cancelled"));
+    return;
+  }
+  vtkMRMLRTPlanNode* planNode = m_PlanNode.GetPointer();
+  if (!planNode || !planNode->GetScene() || !m_Logic)
+  {
+    this->finish(QString("Invalid MRML scene or RT plan node"));
+    return;
+  }
+  qSlicerAbstractDoseEngine* engine =
+    qSlicerDoseEnginePluginHandler::instance()->doseEngineByName(planNode->GetDoseEngineName());
+  if (!engine)
+  {
+    this->finish(QString("Unable to access dose engine with name %1").arg(planNode->GetDoseEngineName() ? planNode->GetDoseEngineName() : "NULL"));
+    return;
+  }
+
+  // Skip coarse levels that the engine does not support, or that would not be coarser than the reference volume
+  double maximumReferenceSpacing = 0.0;
+  if (planNode->GetReferenceVolumeNode())
+  {
+    double* referenceSpacing = planNode->GetReferenceVolumeNode()->GetSpacing();
+    maximumReferenceSpacing = std::max(referenceSpacing[0], std::max(referenceSpacing[1], referenceSpacing[2]));
+  }
+  while ( m_NextLevel < m_DoseGridSpacings.size()-1
+    && (!engine->supportsDoseGridSpacing() || m_DoseGridSpacings[m_NextLevel] < 1.5*maximumReferenceSpacing) )
+  {
+    ++m_NextLevel;
+  }
+  double doseGridSpacing = m_DoseGridSpacings[m_NextLevel];
+
+  std::vector<vtkMRMLRTBeamNode*> beams;
+  planNode->GetBeams(beams);
+
+  m_ActiveEngine = engine;
+  engine->setDoseGridSpacing(doseGridSpacing);
+  QString errorMessage = engine->calculateDoseForBeams(beams);
+  engine->setDoseGridSpacing(0.0);
+  m_ActiveEngine = NULL;
+
+  if (this->isCancelled())
+  {
+    this->finish(QString("Dose calculation cancelled"));
+    return;
+  }
+  if (!errorMessage.isEmpty())
+  {
+    this->finish(errorMessage);
+    return;
+  }
+
+  // Publish the dose of the completed level as the total dose of the plan
+  errorMessage = m_Logic->createAccumulatedDose(planNode);
+  if (!errorMessage.isEmpty())
+  {
+    this->finish(errorMessage);
+    return;
+  }
+
+  m_CompletedDoseGridSpacing = doseGridSpacing;
+  ++m_NextLevel;
+  emit progressUpdated((double)m_NextLevel / m_DoseGridSpacings.size());
+  emit intermediateDoseAvailable(doseGridSpacing);
+
+  if (m_NextLevel >= m_DoseGridSpacings.size())
+  {
+    this->finish(QString());
+    return;
+  }
+
+  // Return to the event loop before calculating the next level so that the
+  // application can display the intermediate dose and process cancel requests
+  QTimer::singleShot(0, this, SLOT(calculateNextLevel()));
+}
+
+//----------------------------------------------------------------------------
+void qSlicerDoseCalculationJob::finish(QString errorMessage)
+{
+  if (!errorMessage.isEmpty() && !this->isCancelled())
+  {
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+  }
+
+  m_Running = false;
+  m_Finished = true;
+  m_ErrorMessage = errorMessage;
+  emit finished(errorMessage);
+
+  this->deleteLater();
+}
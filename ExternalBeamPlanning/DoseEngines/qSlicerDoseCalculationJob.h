@@ -0,0 +1,139 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __qSlicerDoseCalculationJob_h
+#define __qSlicerDoseCalculationJob_h
+
+#include "qSlicerExternalBeamPlanningDoseEnginesExport.h"
+
+// VTK includes
+#include <vtkWeakPointer.h>
+
+// Qt includes
+#include <QObject>
+#include <QList>
+#include <QPointer>
+#include <QAtomicInt>
+
+class qSlicerAbstractDoseEngine;
+class qSlicerDoseEngineLogic;
+class vtkMRMLRTPlanNode;
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// \class qSlicerDoseCalculationJob
+/// \brief Handle of a dose calculation running asynchronously in the application event loop
+///
+/// The dose of the plan is calculated in successive refinement levels, from a coarse dose grid to the
+/// resolution of the reference volume. After each level the per-beam doses and the total dose of the plan
+/// are updated, so that a preview is available long before the full resolution dose. Levels with coarse
+/// dose grid are only calculated if the dose engine \sa qSlicerAbstractDoseEngine::supportsDoseGridSpacing.
+///
+/// MRML nodes are only accessed from the main thread, so the levels are run one by one from the event
+/// loop. Cancellation is honored between refinement levels and within a level wherever the engine checks
+/// \sa qSlicerAbstractDoseEngine::isCancelRequested. The results of the last completed level are kept.
+/// As a level blocks the main thread while it is calculated, cancellation within a level is only possible
+/// when requested from another thread.
+///
+/// Jobs are created by \sa qSlicerDoseEngineLogic::calculateDoseAsync and delete themselves after
+/// \sa finished is emitted.
+class Q_SLICER_EXTERNALBEAMPLANNING_DOSE_ENGINES_EXPORT qSlicerDoseCalculationJob : public QObject
+{
+  Q_OBJECT
+
+public:
+  typedef QObject Superclass;
+  /// Constructor
+  /// \param logic Dose engine logic used for accumulating the per-beam doses to the total dose
+  /// \param planNode Plan whose dose is calculated
+  /// \param doseGridSpacings Dose grid spacing (mm) of each refinement level. Zero means the resolution
+  ///   of the reference volume. Coarse levels not supported by the engine are skipped
+  qSlicerDoseCalculationJob(qSlicerDoseEngineLogic* logic, vtkMRMLRTPlanNode* planNode,
+    QList<double> doseGridSpacings, QObject* parent=NULL);
+  /// Destructor
+  virtual ~qSlicerDoseCalculationJob();
+
+  /// Start calculation. Returns immediately, the first level is calculated when control returns to the event loop
+  Q_INVOKABLE void start();
+
+  /// Get plan whose dose is calculated
+  Q_INVOKABLE vtkMRMLRTPlanNode* planNode()const;
+
+  /// Determine whether the job has been started and has not finished yet
+  Q_INVOKABLE bool isRunning()const;
+  /// Determine whether the job has finished (successfully, with an error, or cancelled)
+  Q_INVOKABLE bool isFinished()const;
+  /// Determine whether the job has been cancelled
+  Q_INVOKABLE bool isCancelled()const;
+  /// Get error message of the finished job. Empty if the job completed successfully
+  Q_INVOKABLE QString errorMessage()const;
+  /// Get dose grid spacing (mm) of the last completed refinement level. Zero means full resolution,
+  /// negative if no level has been completed
+  Q_INVOKABLE double completedDoseGridSpacing()const;
+
+public slots:
+  /// Request cancellation of the job. Can be called from any thread, but only a call from
+  /// another thread than the main thread can interrupt the level being calculated
+  void cancel();
+
+signals:
+  /// Emitted when a refinement level is completed and the doses of the plan are updated
+  /// \param doseGridSpacing Dose grid spacing (mm) of the completed level. Zero for the final level
+  void intermediateDoseAvailable(double doseGridSpacing);
+
+  /// Emitted when a refinement level is completed
+  /// \param progress Value between 0 and 1
+  void progressUpdated(double progress);
+
+  /// Emitted when the job finishes. The job is deleted afterwards
+  /// \param errorMessage Error message. Empty string on success
+  void finished(QString errorMessage);
+
+protected slots:
+  /// Calculate the dose of the next refinement level and schedule the following one
+  void calculateNextLevel();
+
+protected:
+  /// Finish job and schedule its deletion
+  void finish(QString errorMessage);
+
+protected:
+  /// Logic used for accumulating the per-beam doses
+  QPointer<qSlicerDoseEngineLogic> m_Logic;
+  /// Plan whose dose is calculated
+  vtkWeakPointer<vtkMRMLRTPlanNode> m_PlanNode;
+  /// Dose engine calculating the current level. NULL when no level is being calculated
+  qSlicerAbstractDoseEngine* m_ActiveEngine;
+  /// Dose grid spacings of the refinement levels in calculation order
+  QList<double> m_DoseGridSpacings;
+  /// Index of the next level to calculate
+  int m_NextLevel;
+  /// Dose grid spacing of the last completed level (negative if none)
+  double m_CompletedDoseGridSpacing;
+  /// Non-zero if cancellation has been requested
+  QAtomicInt m_CancelRequested;
+  bool m_Running;
+  bool m_Finished;
+  QString m_ErrorMessage;
+
+private:
+  Q_DISABLE_COPY(qSlicerDoseCalculationJob);
+};
+
+#endif
@@ -23,6 +23,7 @@
 
 #include "qSlicerDoseEnginePluginHandler.h"
 #include "qSlicerAbstractDoseEngine.h"
+#include "qSlicerDoseCalculationJob.h"
 
 // Beams includes
 #include "vtkMRMLRTBeamNode.h"
@@ -52,6 +53,8 @@
 
 // Qt includes
 #include <QDebug>
+#include <QMap>
+#include <QPointer>
 
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_SubjectHierarchy
@@ -64,6 +67,9 @@ public:
   qSlicerDoseEngineLogicPrivate(qSlicerDoseEngineLogic& object);
   ~qSlicerDoseEngineLogicPrivate();
   void loadApplicationSettings();
+public:
+  /// Asynchronous dose calculation jobs by plan node ID
+  QMap<QString, QPointer<qSlicerDoseCalculationJob> > DoseCalculationJobs;
 };
 
 //-----------------------------------------------------------------------------
@@ -93,6 +99,7 @@ void qSlicerDoseEngineLogicPrivate::loadApplicationSettings()
 //----------------------------------------------------------------------------
 qSlicerDoseEngineLogic::qSlicerDoseEngineLogic(QObject* parent)
   : QObject(parent)
+  , d_ptr( new qSlicerDoseEngineLogicPrivate(*this) )
 {
 }
 
@@ -110,6 +117,9 @@ void qSlicerDoseEngineLogic::setMRMLScene(vtkMRMLScene* scene)
   qvtkReconnect( scene, vtkMRMLScene::NodeAddedEvent, this, SLOT( onNodeAdded(vtkObject*,vtkObject*) ) );
   // Connect scene import ended event so that subject hierarchy nodes can be created for supported data nodes if missing (backwards compatibility)
   qvtkReconnect( scene, vtkMRMLScene::EndImportEvent, this, SLOT( onSceneImportEnded(vtkObject*) ) );
+  // Connect node removed and scene close events so that cached data of removed beams is released
+  qvtkReconnect( scene, vtkMRMLScene::NodeRemovedEvent, this, SLOT( onNodeRemoved(vtkObject*,vtkObject*) ) );
+  qvtkReconnect( scene, vtkMRMLScene::EndCloseEvent, this, SLOT( onSceneClosed(vtkObject*) ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -130,6 +140,42 @@ void qSlicerDoseEngineLogic::onNodeAdded(vtkObject* sceneObject, vtkObject* node
   }
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onNodeRemoved(vtkObject* sceneObject, vtkObject* nodeObject)
+{
+  Q_UNUSED(sceneObject);
+
+  vtkMRMLRTBeamNode* beamNode = vtkMRMLRTBeamNode::SafeDownCast(nodeObject);
+  if (beamNode)
+  {
+    qSlicerAbstractDoseEngine::clearBeamApertureCache(beamNode);
+  }
+
+  vtkMRMLRTPlanNode* planNode = vtkMRMLRTPlanNode::SafeDownCast(nodeObject);
+  if (planNode)
+  {
+    this->cancelDoseCalculation(planNode);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onSceneClosed(vtkObject* sceneObject)
+{
+  Q_UNUSED(sceneObject);
+  Q_D(qSlicerDoseEngineLogic);
+
+  qSlicerAbstractDoseEngine::clearBeamApertureCache();
+
+  foreach (QPointer<qSlicerDoseCalculationJob> job, d->DoseCalculationJobs)
+  {
+    if (!job.isNull())
+    {
+      job->cancel();
+    }
+  }
+  d->DoseCalculationJobs.clear();
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerDoseEngineLogic::onSceneImportEnded(vtkObject* sceneObject)
 {
@@ -208,30 +254,15 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
     return errorMessage;
   }
 
-  // Calculate dose for each beam under the plan
+  // Calculate dose for the beams under the plan. Beams are passed to the engine together
+  // so that engines can share data between beams and compute them concurrently
   std::vector<vtkMRMLRTBeamNode*> beams;
   planNode->GetBeams(beams);
   int numberOfBeams = beams.size();
-  int currentBeamIndex = 0;
   double progress = 0.0;
-
-  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt, ++currentBeamIndex)
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
   {
-    vtkMRMLRTBeamNode* beamNode = (*beamIt);
-    if (beamNode)
-    {
-      progress = (double)currentBeamIndex / (numberOfBeams+1);
-      emit progressUpdated(progress);
-
-      // Calculate dose for current beam
-      errorMessage = selectedEngine->calculateDose(beamNode);
-      if (!errorMessage.isEmpty())
-      {
-        qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-        return errorMessage;
-      }
-    }
-    else
+    if (!(*beamIt))
     {
       errorMessage = QString("Invalid beam!");
       qCritical() << Q_FUNC_INFO << ": " << errorMessage;
@@ -239,6 +270,17 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
     }
   }
 
+  emit progressUpdated(progress);
+
+  connect(selectedEngine, SIGNAL(beamDoseCalculated(int,int)), this, SLOT(onBeamDoseCalculated(int,int)));
+  errorMessage = selectedEngine->calculateDoseForBeams(beams);
+  disconnect(selectedEngine, SIGNAL(beamDoseCalculated(int,int)), this, SLOT(onBeamDoseCalculated(int,int)));
+  if (!errorMessage.isEmpty())
+  {
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
   progress = (double)numberOfBeams / (numberOfBeams+1);
   emit progressUpdated(progress);
 
@@ -256,6 +298,56 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
   return QString();
 }
 
+//---------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onBeamDoseCalculated(int numberOfCalculatedBeams, int numberOfBeams)
+{
+  // Accumulation of the plan dose is the last step after the beams
+  double progress = (double)numberOfCalculatedBeams / (numberOfBeams+1);
+  emit progressUpdated(progress);
+}
+
+//---------------------------------------------------------------------------
+qSlicerDoseCalculationJob* qSlicerDoseEngineLogic::calculateDoseAsync(vtkMRMLRTPlanNode* planNode, QList<double> doseGridSpacings/*=QList<double>()*/)
+{
+  Q_D(qSlicerDoseEngineLogic);
+  if (!planNode || !planNode->GetScene() || !planNode->GetID())
+  {
+    qCritical() << Q_FUNC_INFO << ": Invalid MRML scene or RT plan node";
+    return NULL;
+  }
+
+  // Results of the previous calculation are outdated
+  this->cancelDoseCalculation(planNode);
+
+  if (doseGridSpacings.isEmpty())
+  {
+    doseGridSpacings << 4.0 << 2.0;
+  }
+  qSlicerDoseCalculationJob* job = new qSlicerDoseCalculationJob(this, planNode, doseGridSpacings, this);
+  connect(job, SIGNAL(progressUpdated(double)), this, SIGNAL(progressUpdated(double)));
+  d->DoseCalculationJobs[QString(planNode->GetID())] = job;
+
+  job->start();
+  return job;
+}
+
+//---------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::cancelDoseCalculation(vtkMRMLRTPlanNode* planNode)
+{
+  Q_D(qSlicerDoseEngineLogic);
+  if (!planNode || !planNode->GetID())
+  {
+    return;
+  }
+
+  QString planID(planNode->GetID());
+  QPointer<qSlicerDoseCalculationJob> job = d->DoseCalculationJobs.take(planID);
+  if (!job.isNull() && !job->isFinished())
+  {
+    job->cancel();
+  }
+}
+
 //---------------------------------------------------------------------------
 QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNode)
 {
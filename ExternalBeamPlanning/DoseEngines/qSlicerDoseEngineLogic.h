@@ -32,10 +32,12 @@
 
 // Qt includes
 #include <QObject>
+#include <QList>
 
 class vtkMRMLScene;
 class vtkMRMLRTPlanNode;
 class vtkMRMLRTBeamNode;
+class qSlicerDoseCalculationJob;
 class qSlicerDoseEngineLogicPrivate; 
 
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
@@ -61,6 +63,21 @@ public:
   /// Calculate dose for a plan
   Q_INVOKABLE QString calculateDose(vtkMRMLRTPlanNode* planNode);
 
+  /// Start dose calculation for a plan that runs asynchronously in the event loop and refines the
+  /// dose progressively, publishing the per-beam and total doses after each refinement level.
+  /// A job of the same plan that is still running is cancelled.
+  /// \param doseGridSpacings Dose grid spacing (mm) of the coarse levels calculated before the full
+  ///   resolution dose. 4 mm then 2 mm if empty. Only used if the dose engine supports it
+  /// \return Job handle that can be used to cancel the calculation and to observe its progress.
+  ///   The job deletes itself after it finished, so it should be stored in a QPointer
+  Q_INVOKABLE qSlicerDoseCalculationJob* calculateDoseAsync(vtkMRMLRTPlanNode* planNode, QList<double> doseGridSpacings=QList<double>());
+
+  /// Cancel asynchronous dose calculation of a plan if it is running.
+  /// Refinement levels are calculated in the main thread, so when called from the main thread
+  /// the cancellation takes effect after the current level. A level in progress is only interrupted
+  /// if cancellation is requested from another thread (see \sa qSlicerDoseCalculationJob::cancel)
+  Q_INVOKABLE void cancelDoseCalculation(vtkMRMLRTPlanNode* planNode);
+
   /// Accumulate per-beam dose volumes for each beam under given plan. The accumulated
   /// total dose is 
   Q_INVOKABLE QString createAccumulatedDose(vtkMRMLRTPlanNode* planNode);
@@ -78,9 +95,18 @@ signals:
   void progressUpdated(double progress);
 
 protected slots:
+  /// Called when the dose of a beam has been calculated by the dose engine. Updates progress
+  void onBeamDoseCalculated(int numberOfCalculatedBeams, int numberOfBeams);
+
   /// Called when a node is added to the scene
   void onNodeAdded(vtkObject* scene, vtkObject* nodeObject);
 
+  /// Called when a node is removed from the scene. Releases cached data of removed beams
+  void onNodeRemoved(vtkObject* scene, vtkObject* nodeObject);
+
+  /// Called when the scene is closed. Releases all cached beam data
+  void onSceneClosed(vtkObject* sceneObject);
+
   /// Called when scene import is finished
   void onSceneImportEnded(vtkObject* sceneObject);
 
@@ -90,7 +116,7 @@ protected slots:
   void onDoseEngineChangedInPlan(vtkObject* nodeObject);
 
 protected:
-  QScopedPointer<qSlicerDoseEngineLogic> d_ptr; 
+  QScopedPointer<qSlicerDoseEngineLogicPrivate> d_ptr;
 
 private:
   Q_DECLARE_PRIVATE(qSlicerDoseEngineLogic);
@@ -27,8 +27,6 @@
 
 // Segmentations includes
 #include "vtkOrientedImageData.h"
-#include "vtkSlicerSegmentationsModuleLogic.h"
-#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
@@ -36,7 +34,6 @@
 // VTK includes
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
-#include <vtkPolyData.h>
 
 // Qt includes
 #include <QDebug>
@@ -80,15 +77,14 @@ QString qSlicerMockDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamN
     return errorMessage;
   }
 
-  vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule> converter = 
-    vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule>::New();
-  converter->SetUseOutputImageDataGeometry(true);
-  vtkSmartPointer<vtkSegment> beamSegment = vtkSmartPointer<vtkSegment>::Take(
-    vtkSlicerSegmentationsModuleLogic::CreateSegmentFromModelNode(beamNode) );
-  vtkPolyData* beamPolyData = vtkPolyData::SafeDownCast(beamSegment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()));
-  vtkSmartPointer<vtkOrientedImageData> beamImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
-    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(referenceVolumeNode) );
-  converter->Convert(beamPolyData, beamImageData);
+  // Rasterized beam aperture (only recomputed if beam or reference geometry changed)
+  vtkSmartPointer<vtkOrientedImageData> beamImageData = this->getBeamApertureLabelmap(beamNode);
+  if (!beamImageData)
+  {
+    QString errorMessage("Failed to rasterize beam aperture");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
 
   // Create dose image
   vtkSmartPointer<vtkImageData> protonDoseImageData = vtkSmartPointer<vtkImageData>::New();
@@ -0,0 +1,613 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Dose engines includes
+#include "qSlicerPencilBeamPhotonDoseEngine.h"
+
+// ExternalBeamPlanning includes
+#include "vtkSlicerExternalBeamPlanningModuleLogic.h"
+
+// Beams includes
+#include "vtkMRMLRTPlanNode.h"
+#include "vtkMRMLRTBeamNode.h"
+
+// SlicerRtCommon includes
+#include "vtkBeamControlPointSequence.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLTransformNode.h>
+#include <vtkMRMLDoubleArrayNode.h>
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkDoubleArray.h>
+#include <vtkSMPTools.h>
+
+// SlicerQt includes
+#include "qSlicerApplication.h"
+#include "qSlicerAbstractCoreModule.h"
+#include "qSlicerModuleManager.h"
+
+// Qt includes
+#include <QDebug>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Width of MLC leaves at isocenter plane (mm) for the MLC position array of beams without control points
+  const double MLC_LEAF_WIDTH = 10.0;
+  /// Voxels closer than this to the source plane get no dose (mm)
+  const double EPSILON_DEPTH = 1e-6;
+
+  //----------------------------------------------------------------------------
+  /// Fluence grid on the isocenter plane in beam frame coordinates
+  struct FluenceGrid
+  {
+    double Origin[2];
+    double Spacing;
+    int Dimensions[2];
+    /// Fluence values in row-major order (first coordinate changes fastest)
+    std::vector<float> Values;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Normalized 1D Gaussian kernel sampled at grid spacing, truncated at 3 sigma
+  void CreateGaussianKernel(double sigma, double spacing, std::vector<float>& kernel)
+  {
+    int radius = std::max(1, (int)ceil(3.0 * sigma / spacing));
+    kernel.resize(2*radius+1);
+    double sum = 0.0;
+    for (int i=-radius; i<=radius; ++i)
+    {
+      double x = i * spacing;
+      double value = (sigma > 0.0 ? exp(-0.5 * x*x / (sigma*sigma)) : (i == 0 ? 1.0 : 0.0));
+      kernel[i+radius] = (float)value;
+      sum += value;
+    }
+    for (std::vector<float>::iterator it=kernel.begin(); it!=kernel.end(); ++it)
+    {
+      (*it) = (float)((*it) / sum);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convolve rows of the fluence grid with a 1D kernel. Inner loops run over contiguous
+  /// memory with no branches so that the compiler can vectorize them
+  class RowConvolutionFunctor
+  {
+  public:
+    RowConvolutionFunctor(const float* input, float* output, int dims[2], const std::vector<float>& kernel)
+      : Input(input), Output(output), Kernel(kernel)
+    {
+      this->Dimensions[0] = dims[0];
+      this->Dimensions[1] = dims[1];
+    }
+
+    void operator()(vtkIdType beginRow, vtkIdType endRow)
+    {
+      int width = this->Dimensions[0];
+      int radius = ((int)this->Kernel.size() - 1) / 2;
+      // Zero-padded copy of the row so that the kernel loop needs no bounds checks
+      std::vector<float> paddedRow(width + 2*radius, 0.0f);
+      for (vtkIdType row=beginRow; row<endRow; ++row)
+      {
+        const float* inputRow = this->Input + row * width;
+        float* outputRow = this->Output + row * width;
+        std::copy(inputRow, inputRow + width, paddedRow.begin() + radius);
+        std::fill(outputRow, outputRow + width, 0.0f);
+        for (int k=0; k<(int)this->Kernel.size(); ++k)
+        {
+          const float weight = this->Kernel[k];
+          const float* shiftedRow = &(paddedRow[k]);
+          for (int i=0; i<width; ++i)
+          {
+            outputRow[i] += weight * shiftedRow[i];
+          }
+        }
+      }
+    }
+
+  private:
+    const float* Input;
+    float* Output;
+    int Dimensions[2];
+    const std::vector<float>& Kernel;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Convolve columns of the fluence grid with a 1D kernel. Whole rows are accumulated
+  /// so that the inner loop is contiguous and vectorizable
+  class ColumnConvolutionFunctor
+  {
+  public:
+    ColumnConvolutionFunctor(const float* input, float* output, int dims[2], const std::vector<float>& kernel)
+      : Input(input), Output(output), Kernel(kernel)
+    {
+      this->Dimensions[0] = dims[0];
+      this->Dimensions[1] = dims[1];
+    }
+
+    void operator()(vtkIdType beginRow, vtkIdType endRow)
+    {
+      int width = this->Dimensions[0];
+      int height = this->Dimensions[1];
+      int radius = ((int)this->Kernel.size() - 1) / 2;
+      for (vtkIdType row=beginRow; row<endRow; ++row)
+      {
+        float* outputRow = this->Output + row * width;
+        std::fill(outputRow, outputRow + width, 0.0f);
+        for (int k=-radius; k<=radius; ++k)
+        {
+          vtkIdType inputRowIndex = row + k;
+          if (inputRowIndex < 0 || inputRowIndex >= height)
+          {
+            continue;
+          }
+          const float weight = this->Kernel[k+radius];
+          const float* inputRow = this->Input + inputRowIndex * width;
+          for (int i=0; i<width; ++i)
+          {
+            outputRow[i] += weight * inputRow[i];
+          }
+        }
+      }
+    }
+
+  private:
+    const float* Input;
+    float* Output;
+    int Dimensions[2];
+    const std::vector<float>& Kernel;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Convolve fluence grid with a 2D Gaussian as two 1D passes
+  void ConvolveSeparable(const std::vector<float>& input, std::vector<float>& output, int dims[2], const std::vector<float>& kernel)
+  {
+    std::vector<float> rowConvolved(input.size(), 0.0f);
+    output.resize(input.size());
+    RowConvolutionFunctor rowFunctor(&(input[0]), &(rowConvolved[0]), dims, kernel);
+    vtkSMPTools::For(0, dims[1], rowFunctor);
+    ColumnConvolutionFunctor columnFunctor(&(rowConvolved[0]), &(output[0]), dims, kernel);
+    vtkSMPTools::For(0, dims[1], columnFunctor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Bilinear interpolation in the fluence grid. Points outside the grid are zero
+  inline float InterpolateFluence(const FluenceGrid& grid, const std::vector<float>& values, double a, double b)
+  {
+    double x = (a - grid.Origin[0]) / grid.Spacing;
+    double y = (b - grid.Origin[1]) / grid.Spacing;
+    if (x < 0.0 || y < 0.0 || x > grid.Dimensions[0]-1 || y > grid.Dimensions[1]-1)
+    {
+      return 0.0f;
+    }
+    int x0 = std::min((int)x, std::max(grid.Dimensions[0]-2, 0));
+    int y0 = std::min((int)y, std::max(grid.Dimensions[1]-2, 0));
+    int x1 = std::min(x0+1, grid.Dimensions[0]-1);
+    int y1 = std::min(y0+1, grid.Dimensions[1]-1);
+    float fx = (float)(x - x0);
+    float fy = (float)(y - y0);
+    const float* row0 = &(values[(size_t)y0 * grid.Dimensions[0]]);
+    const float* row1 = &(values[(size_t)y1 * grid.Dimensions[0]]);
+    float v0 = row0[x0] * (1.0f-fx) + row0[x1] * fx;
+    float v1 = row1[x0] * (1.0f-fx) + row1[x1] * fx;
+    return v0 * (1.0f-fy) + v1 * fy;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute dose for each voxel from the convolved fluence, water-equivalent depth and inverse square law
+  /// The dose grid samples every stride-th voxel of the water-equivalent depth volume along each axis
+  class DoseFunctor
+  {
+  public:
+    DoseFunctor( const FluenceGrid& grid, const std::vector<float>& fluence,
+      const float* depth, float* dose, const int extent[6], const int stride[3], vtkMatrix4x4* imageToWorldMatrix,
+      const double source[3], const double axes[3][3], double sad,
+      double attenuation, double buildup, double normalization )
+      : Grid(grid), Fluence(fluence), Depth(depth), Dose(dose)
+      , SAD(sad), Attenuation(attenuation), Buildup(buildup), Normalization(normalization)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+      }
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Stride[axis] = stride[axis];
+      }
+      for (int row=0; row<3; ++row)
+      {
+        this->Source[row] = source[row];
+        for (int column=0; column<3; ++column)
+        {
+          this->Axes[row][column] = axes[row][column];
+        }
+        for (int column=0; column<4; ++column)
+        {
+          this->ImageToWorld[row][column] = imageToWorldMatrix->GetElement(row, column);
+        }
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      int depthDims[3] = { this->Extent[1]-this->Extent[0]+1, this->Extent[3]-this->Extent[2]+1, this->Extent[5]-this->Extent[4]+1 };
+      int dims[3] = { 0, 0, 0 };
+      for (int axis=0; axis<3; ++axis)
+      {
+        dims[axis] = (depthDims[axis]-1) / this->Stride[axis] + 1;
+      }
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        for (int j=0; j<dims[1]; ++j)
+        {
+          vtkIdType depthOffset = (k*this->Stride[2]*depthDims[1] + j*this->Stride[1]) * (vtkIdType)depthDims[0];
+          const float* depthPtr = this->Depth + depthOffset;
+          float* dosePtr = this->Dose + (k*dims[1] + j) * (vtkIdType)dims[0];
+          for (int i=0; i<dims[0]; ++i)
+          {
+            double index[3] = { (double)(i*this->Stride[0]+this->Extent[0]),
+              (double)(j*this->Stride[1]+this->Extent[2]), (double)(k*this->Stride[2]+this->Extent[4]) };
+            double relative[3] = { 0.0, 0.0, 0.0 };
+            for (int row=0; row<3; ++row)
+            {
+              relative[row] = this->ImageToWorld[row][0]*index[0] + this->ImageToWorld[row][1]*index[1]
+                + this->ImageToWorld[row][2]*index[2] + this->ImageToWorld[row][3] - this->Source[row];
+            }
+            double axialDistance = vtkMath::Dot(relative, this->Axes[2]);
+            float depth = depthPtr[i*this->Stride[0]];
+            if (axialDistance <= EPSILON_DEPTH || depth <= 0.0f)
+            {
+              dosePtr[i] = 0.0f;
+              continue;
+            }
+
+            // Project voxel to the isocenter plane
+            double magnification = this->SAD / axialDistance;
+            double a = vtkMath::Dot(relative, this->Axes[0]) * magnification;
+            double b = vtkMath::Dot(relative, this->Axes[1]) * magnification;
+            float fluence = InterpolateFluence(this->Grid, this->Fluence, a, b);
+            if (fluence <= 0.0f)
+            {
+              dosePtr[i] = 0.0f;
+              continue;
+            }
+
+            double depthDose = (1.0 - exp(-this->Buildup*depth)) * exp(-this->Attenuation*depth);
+            dosePtr[i] = (float)(this->Normalization * depthDose * magnification * magnification * fluence);
+          }
+        }
+      }
+    }
+
+  private:
+    const FluenceGrid& Grid;
+    const std::vector<float>& Fluence;
+    const float* Depth;
+    float* Dose;
+    int Extent[6];
+    int Stride[3];
+    double ImageToWorld[3][4];
+    double Source[3];
+    double Axes[3][3];
+    double SAD;
+    double Attenuation;
+    double Buildup;
+    double Normalization;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Determine whether a point at the isocenter plane given in collimator coordinates is in the aperture
+  /// \param controlPoints Control points of the beam if they define its MLC, NULL otherwise. The leaves of the
+  ///   current control point of the beam are used (\sa vtkBeamControlPointSequence::CreateAperturePolyData)
+  /// \param mlcPositions MLC position array of the beam, used if there are no control points
+  bool IsInAperture(vtkMRMLRTBeamNode* beamNode, vtkBeamControlPointSequence* controlPoints, vtkDoubleArray* mlcPositions, double x, double y)
+  {
+    if ( x < beamNode->GetX1Jaw() || x > beamNode->GetX2Jaw()
+      || y < beamNode->GetY1Jaw() || y > beamNode->GetY2Jaw() )
+    {
+      return false;
+    }
+    if (controlPoints)
+    {
+      // Leaves move along U, leaf pairs are stacked along V
+      bool mlcX = (controlPoints->GetMLCDirection() == vtkBeamControlPointSequence::MLCX);
+      double u = (mlcX ? x : y);
+      double v = (mlcX ? y : x);
+      int numberOfLeafPairs = controlPoints->GetNumberOfLeafPairs();
+      const double* boundaries = controlPoints->GetLeafPairBoundaries();
+      int leafPairIndex = (int)(std::upper_bound(boundaries, boundaries + numberOfLeafPairs + 1, v) - boundaries) - 1;
+      if (leafPairIndex < 0 || leafPairIndex >= numberOfLeafPairs)
+      {
+        return false;
+      }
+      // Bank A then bank B leaf positions
+      const double* leafPositions = controlPoints->GetLeafPositions(beamNode->GetControlPointIndex());
+      return (u >= leafPositions[leafPairIndex] && u <= leafPositions[numberOfLeafPairs + leafPairIndex]);
+    }
+    if (!mlcPositions || mlcPositions->GetNumberOfComponents() < 2 || mlcPositions->GetNumberOfTuples() == 0)
+    {
+      return true;
+    }
+
+    // Leaf pairs are ordered from positive to negative X, centered on the beam axis
+    // (consistent with vtkMRMLRTBeamNode::CreateBeamPolyData)
+    int numberOfLeafPairs = mlcPositions->GetNumberOfTuples();
+    int leafPairIndex = (int)floor(numberOfLeafPairs/2.0 - x/MLC_LEAF_WIDTH);
+    if (leafPairIndex < 0 || leafPairIndex >= numberOfLeafPairs)
+    {
+      return false;
+    }
+    double bank1 = mlcPositions->GetComponent(leafPairIndex, 0);
+    double bank2 = mlcPositions->GetComponent(leafPairIndex, 1);
+    return (y >= std::min(bank1, bank2) && y <= std::max(bank1, bank2));
+  }
+}
+
+//----------------------------------------------------------------------------
+qSlicerPencilBeamPhotonDoseEngine::qSlicerPencilBeamPhotonDoseEngine(QObject* parent)
+  : qSlicerAbstractDoseEngine(parent)
+{
+  this->m_Name = QString("Pencil beam photon");
+}
+
+//----------------------------------------------------------------------------
+qSlicerPencilBeamPhotonDoseEngine::~qSlicerPencilBeamPhotonDoseEngine()
+{
+}
+
+//---------------------------------------------------------------------------
+bool qSlicerPencilBeamPhotonDoseEngine::supportsDoseGridSpacing()const
+{
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void qSlicerPencilBeamPhotonDoseEngine::defineBeamParameters()
+{
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "FluenceResolution", "Fluence resolution (mm):", "Spacing of the fluence grid at the isocenter plane",
+    0.5, 10.0, 2.0, 0.5, 1 );
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "PrimarySigma", "Primary kernel sigma (mm):", "Lateral spread of the primary component of the pencil beam kernel at the isocenter plane",
+    0.1, 20.0, 3.0, 0.1, 1 );
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "ScatterSigma", "Scatter kernel sigma (mm):", "Lateral spread of the scatter component of the pencil beam kernel at the isocenter plane",
+    1.0, 100.0, 30.0, 1.0, 1 );
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "ScatterWeight", "Scatter weight:", "Fraction of the dose deposited by the scatter component of the kernel",
+    0.0, 0.9, 0.08, 0.01, 2 );
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "AttenuationCoefficient", "Attenuation (1/mm):", "Effective linear attenuation coefficient in water. Default corresponds to a 6 MV beam",
+    0.0001, 0.05, 0.0045, 0.0005, 4 );
+  this->addBeamParameterSpinBox(
+    "Pencil beam", "BuildupCoefficient", "Build-up (1/mm):", "Build-up coefficient determining the depth of maximum dose. Default corresponds to a 6 MV beam",
+    0.01, 5.0, 0.3, 0.01, 2 );
+}
+
+//---------------------------------------------------------------------------
+QString qSlicerPencilBeamPhotonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+{
+  if (!beamNode)
+  {
+    QString errorMessage("Invalid beam node");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  vtkMRMLRTPlanNode* parentPlanNode = beamNode->GetParentPlanNode();
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = (parentPlanNode ? parentPlanNode->GetReferenceVolumeNode() : NULL);
+  if (!referenceVolumeNode || !referenceVolumeNode->GetImageData() || !resultDoseVolumeNode)
+  {
+    QString errorMessage("Unable to access reference volume");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (!beamNode->GetParentTransformNode())
+  {
+    QString errorMessage("Unable to access beam transform");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  // Water-equivalent depth (cached in the module logic per beam geometry)
+  qSlicerAbstractCoreModule* module = qSlicerApplication::application()->moduleManager()->module("ExternalBeamPlanning");
+  vtkSlicerExternalBeamPlanningModuleLogic* ebpLogic = (module ? vtkSlicerExternalBeamPlanningModuleLogic::SafeDownCast(module->logic()) : NULL);
+  if (!ebpLogic)
+  {
+    QString errorMessage("Unable to access External Beam Planning logic");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  vtkSmartPointer<vtkOrientedImageData> depthImageData = ebpLogic->ComputeWED(beamNode);
+  if (!depthImageData || depthImageData->GetScalarType() != VTK_FLOAT)
+  {
+    QString errorMessage("Failed to compute water-equivalent depth");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (this->isCancelRequested())
+  {
+    return QString("Dose calculation cancelled");
+  }
+
+  // Beam geometry
+  vtkSmartPointer<vtkMatrix4x4> beamToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  beamNode->GetParentTransformNode()->GetMatrixTransformToWorld(beamToWorldMatrix);
+  double sad = beamNode->GetSAD();
+  double axes[3][3] = { {0.0,0.0,0.0}, {0.0,0.0,0.0}, {0.0,0.0,0.0} };
+  double source[3] = { 0.0, 0.0, 0.0 };
+  for (int row=0; row<3; ++row)
+  {
+    axes[0][row] = beamToWorldMatrix->GetElement(row, 0);
+    axes[1][row] = beamToWorldMatrix->GetElement(row, 1);
+    axes[2][row] = -beamToWorldMatrix->GetElement(row, 2);
+  }
+  for (int axis=0; axis<3; ++axis)
+  {
+    vtkMath::Normalize(axes[axis]);
+  }
+  for (int row=0; row<3; ++row)
+  {
+    source[row] = beamToWorldMatrix->GetElement(row, 3) - sad * axes[2][row];
+  }
+
+  // Sample fluence on the isocenter plane. Beam frame coordinates (a,b) correspond to
+  // collimator coordinates (-Y,-X) (see vtkMRMLRTBeamNode::CreateBeamPolyData)
+  double primarySigma = this->doubleParameter(beamNode, "PrimarySigma");
+  double scatterSigma = this->doubleParameter(beamNode, "ScatterSigma");
+  double scatterWeight = this->doubleParameter(beamNode, "ScatterWeight");
+  FluenceGrid grid;
+  // Fluence finer than half of the dose grid spacing does not improve a coarse dose
+  grid.Spacing = std::max(std::max(0.1, this->doubleParameter(beamNode, "FluenceResolution")), 0.5*this->doseGridSpacing());
+  double margin = 3.0 * std::max(primarySigma, scatterSigma);
+  double bounds[4] = {
+    -beamNode->GetY2Jaw() - margin, -beamNode->GetY1Jaw() + margin,
+    -beamNode->GetX2Jaw() - margin, -beamNode->GetX1Jaw() + margin };
+  grid.Origin[0] = bounds[0];
+  grid.Origin[1] = bounds[2];
+  grid.Dimensions[0] = (int)ceil((bounds[1]-bounds[0]) / grid.Spacing) + 1;
+  grid.Dimensions[1] = (int)ceil((bounds[3]-bounds[2]) / grid.Spacing) + 1;
+  grid.Values.resize((size_t)grid.Dimensions[0] * grid.Dimensions[1], 0.0f);
+
+  // Leaves of the current control point define the MLC opening of imported beams,
+  // the MLC position array that of beams without control points
+  vtkBeamControlPointSequence* controlPoints = beamNode->GetControlPoints();
+  int controlPointIndex = beamNode->GetControlPointIndex();
+  if ( !controlPoints || controlPoints->GetNumberOfLeafPairs() <= 0
+    || controlPointIndex < 0 || controlPointIndex >= controlPoints->GetNumberOfControlPoints()
+    || !controlPoints->GetLeafPositions(controlPointIndex) )
+  {
+    controlPoints = NULL;
+  }
+  vtkMRMLDoubleArrayNode* mlcArrayNode = beamNode->GetMLCPositionDoubleArrayNode();
+  vtkDoubleArray* mlcPositions = (mlcArrayNode ? mlcArrayNode->GetArray() : NULL);
+  for (int y=0; y<grid.Dimensions[1]; ++y)
+  {
+    double b = grid.Origin[1] + y * grid.Spacing;
+    for (int x=0; x<grid.Dimensions[0]; ++x)
+    {
+      double a = grid.Origin[0] + x * grid.Spacing;
+      grid.Values[(size_t)y*grid.Dimensions[0] + x] = (IsInAperture(beamNode, controlPoints, mlcPositions, -b, -a) ? 1.0f : 0.0f);
+    }
+  }
+
+  // Convolve fluence with the double Gaussian kernel
+  std::vector<float> primaryKernel;
+  CreateGaussianKernel(primarySigma, grid.Spacing, primaryKernel);
+  std::vector<float> scatterKernel;
+  CreateGaussianKernel(scatterSigma, grid.Spacing, scatterKernel);
+  std::vector<float> primaryFluence;
+  ConvolveSeparable(grid.Values, primaryFluence, grid.Dimensions, primaryKernel);
+  std::vector<float> scatterFluence;
+  ConvolveSeparable(grid.Values, scatterFluence, grid.Dimensions, scatterKernel);
+  std::vector<float> convolvedFluence(grid.Values.size(), 0.0f);
+  for (size_t i=0; i<convolvedFluence.size(); ++i)
+  {
+    convolvedFluence[i] = (float)((1.0-scatterWeight) * primaryFluence[i] + scatterWeight * scatterFluence[i]);
+  }
+
+  // Normalize depth dose to one at the depth of maximum dose, and scale by prescription.
+  // The beam weight is applied when the per-beam doses are accumulated into the plan dose
+  double attenuation = this->doubleParameter(beamNode, "AttenuationCoefficient");
+  double buildup = this->doubleParameter(beamNode, "BuildupCoefficient");
+  double maximumDepthDose = 1.0;
+  if (buildup > attenuation && attenuation > 0.0)
+  {
+    double depthOfMaximum = log(buildup / attenuation) / (buildup - attenuation);
+    maximumDepthDose = (1.0 - exp(-buildup*depthOfMaximum)) * exp(-attenuation*depthOfMaximum);
+  }
+  double normalization = parentPlanNode->GetRxDose() / maximumDepthDose;
+
+  if (depthImageData->GetNumberOfPoints() != referenceVolumeNode->GetImageData()->GetNumberOfPoints())
+  {
+    QString errorMessage("Geometrical discrepancy between water-equivalent depth and reference volume");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (this->isCancelRequested())
+  {
+    return QString("Dose calculation cancelled");
+  }
+
+  // Dose grid samples every stride-th voxel of the reference volume. The stride is one
+  // (full resolution) unless a coarser dose grid spacing is requested
+  int stride[3] = { 1, 1, 1 };
+  if (this->doseGridSpacing() > 0.0)
+  {
+    double* referenceSpacing = referenceVolumeNode->GetSpacing();
+    for (int axis=0; axis<3; ++axis)
+    {
+      stride[axis] = std::max(1, (int)floor(this->doseGridSpacing() / referenceSpacing[axis] + 0.5));
+    }
+  }
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  depthImageData->GetExtent(extent);
+  int doseDimensions[3] = { 0, 0, 0 };
+  for (int axis=0; axis<3; ++axis)
+  {
+    doseDimensions[axis] = (extent[2*axis+1]-extent[2*axis]) / stride[axis] + 1;
+  }
+
+  // Create dose image. At full resolution it has the geometry of the water-equivalent depth
+  // (same as reference volume), otherwise its voxels coincide with every stride-th reference voxel
+  vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+  doseImageData->SetExtent(0, doseDimensions[0]-1, 0, doseDimensions[1]-1, 0, doseDimensions[2]-1);
+  doseImageData->AllocateScalars(VTK_FLOAT, 1);
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  depthImageData->GetImageToWorldMatrix(imageToWorldMatrix);
+  DoseFunctor doseFunctor( grid, convolvedFluence,
+    (float*)depthImageData->GetScalarPointer(), (float*)doseImageData->GetScalarPointer(), extent, stride, imageToWorldMatrix,
+    source, axes, sad, attenuation, buildup, normalization );
+  vtkSMPTools::For(0, doseDimensions[2], doseFunctor);
+
+  vtkSmartPointer<vtkMatrix4x4> referenceIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceVolumeNode->GetIJKToRASMatrix(referenceIjkToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> doseToReferenceIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int axis=0; axis<3; ++axis)
+  {
+    doseToReferenceIjkMatrix->SetElement(axis, axis, stride[axis]);
+    doseToReferenceIjkMatrix->SetElement(axis, 3, extent[2*axis]);
+  }
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(referenceIjkToRasMatrix, doseToReferenceIjkMatrix, doseIjkToRasMatrix);
+
+  resultDoseVolumeNode->SetAndObserveImageData(doseImageData);
+  resultDoseVolumeNode->SetIJKToRASMatrix(doseIjkToRasMatrix);
+
+  std::string doseNodeName = std::string(beamNode->GetName()) + "_PencilBeamDose";
+  resultDoseVolumeNode->SetName(doseNodeName.c_str());
+
+  return QString();
+}
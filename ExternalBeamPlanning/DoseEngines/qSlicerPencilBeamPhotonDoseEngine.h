@@ -0,0 +1,67 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __qSlicerPencilBeamPhotonDoseEngine_h
+#define __qSlicerPencilBeamPhotonDoseEngine_h
+
+#include "qSlicerExternalBeamPlanningDoseEnginesExport.h"
+
+// ExternalBeamPlanning includes
+#include "qSlicerAbstractDoseEngine.h"
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// \class qSlicerPencilBeamPhotonDoseEngine
+/// \brief Analytic pencil beam photon dose calculation algorithm.
+///
+/// The fluence defined by the jaws and the MLC is sampled on a grid on the isocenter plane, and it is
+/// convolved with a separable double Gaussian (primary and scatter) lateral kernel in the beam's eye view.
+/// Dose in each voxel is the convolved fluence at its projection multiplied by an analytic depth dose
+/// curve evaluated at the water-equivalent depth of the voxel and the inverse square factor.
+/// Intended for fast approximate dose estimation, for example for plan screening.
+class Q_SLICER_EXTERNALBEAMPLANNING_DOSE_ENGINES_EXPORT qSlicerPencilBeamPhotonDoseEngine : public qSlicerAbstractDoseEngine
+{
+  Q_OBJECT
+
+public:
+  typedef qSlicerAbstractDoseEngine Superclass;
+  /// Constructor
+  explicit qSlicerPencilBeamPhotonDoseEngine(QObject* parent=NULL);
+  /// Destructor
+  virtual ~qSlicerPencilBeamPhotonDoseEngine();
+
+  /// The pencil beam engine can calculate dose on a coarse grid for quick previews
+  virtual bool supportsDoseGridSpacing()const;
+
+protected:
+  /// Calculate dose for a single beam. Called by \sa CalculateDose that performs actions generic
+  /// to any dose engine before and after calculation.
+  /// \param beamNode Beam for which the dose is calculated. Each beam has a parent plan from which the
+  ///   plan-specific parameters are got
+  /// \param resultDoseVolumeNode Output volume node for the result dose. It is created by \sa CalculateDose
+  virtual QString calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode);
+
+  /// Define engine-specific beam parameters
+  void defineBeamParameters();
+
+private:
+  Q_DISABLE_COPY(qSlicerPencilBeamPhotonDoseEngine);
+};
+
+#endif
@@ -47,13 +47,458 @@
 #include "SlicerRtCommon.h"
 #include "PlmCommon.h"
 
+// ITK includes
+#include <itkImageDuplicator.h>
+
 // VTK includes
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
+#include <vtkSMPTools.h>
 
 // Qt includes
 #include <QDebug>
 #include <QStringList>
+#include <QAtomicInt>
+#include <QThread>
+
+// STD includes
+#include <map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  typedef itk::Image<short, 3> ShortImageType;
+  typedef itk::Image<unsigned char, 3> UCharImageType;
+
+  //----------------------------------------------------------------------------
+  /// Reference and target images of a plan converted for Plastimatch. Converted once for each plan,
+  /// and each beam gets its own copy (see \sa DuplicateImage)
+  struct PlanImages
+  {
+    ShortImageType::Pointer ReferenceVolumeItk;
+    UCharImageType::Pointer TargetVolumeItk;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Create a deep copy of an ITK image. Plastimatch plans keep and may convert their input images,
+  /// so plans whose dose is computed concurrently must not share them
+  template<class ImageType> typename ImageType::Pointer DuplicateImage(ImageType* image)
+  {
+    typedef itk::ImageDuplicator<ImageType> DuplicatorType;
+    typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+    duplicator->SetInputImage(image);
+    duplicator->Update();
+    return duplicator->GetOutput();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Plastimatch plans and beams of a dose calculation. Plans are deleted on destruction
+  class PlastimatchBeamList
+  {
+  public:
+    ~PlastimatchBeamList()
+    {
+      for (std::vector<Rt_plan*>::iterator planIt=this->Plans.begin(); planIt!=this->Plans.end(); ++planIt)
+      {
+        delete (*planIt);
+      }
+    }
+
+    std::vector<Rt_plan*> Plans;
+    std::vector<Rt_beam*> Beams;
+    /// Plastimatch exception messages for each beam (empty if computation succeeded)
+    std::vector<std::string> Errors;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute dose for a range of beams. Each beam has its own plan, input images and output buffer.
+  /// Progress is reported whenever the thread of the engine finishes a beam, counting the beams
+  /// finished by all threads, as the engine signals cannot be emitted from the other threads
+  class ComputeDoseFunctor
+  {
+  public:
+    ComputeDoseFunctor(qSlicerPlastimatchProtonDoseEngine* engine, PlastimatchBeamList& beams)
+      : Engine(engine)
+      , PlastimatchBeams(beams)
+      , NumberOfComputedBeams(0)
+    {
+    }
+
+    void operator()(vtkIdType beginBeam, vtkIdType endBeam)
+    {
+      for (vtkIdType beamIndex=beginBeam; beamIndex<endBeam; ++beamIndex)
+      {
+        try
+        {
+          this->PlastimatchBeams.Plans[beamIndex]->compute_dose(this->PlastimatchBeams.Beams[beamIndex]);
+        }
+        catch (std::exception& ex)
+        {
+          this->PlastimatchBeams.Errors[beamIndex] = ex.what();
+        }
+
+        int numberOfComputedBeams = this->NumberOfComputedBeams.fetchAndAddOrdered(1) + 1;
+        if (QThread::currentThread() == this->Engine->thread())
+        {
+          this->Engine->reportBeamDoseCalculated(numberOfComputedBeams, (int)this->PlastimatchBeams.Beams.size());
+        }
+      }
+    }
+
+  private:
+    qSlicerPlastimatchProtonDoseEngine* Engine;
+    PlastimatchBeamList& PlastimatchBeams;
+    QAtomicInt NumberOfComputedBeams;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Convert reference volume and target labelmap of a plan to ITK images
+  QString ConvertPlanImages(vtkMRMLRTPlanNode* planNode, PlanImages& images)
+  {
+    vtkMRMLScalarVolumeNode* referenceVolumeNode = planNode->GetReferenceVolumeNode();
+    if (!referenceVolumeNode)
+    {
+      return QString("Unable to access reference volume");
+    }
+
+    // Get target as ITK image
+    vtkSmartPointer<vtkOrientedImageData> targetLabelmap = planNode->GetTargetOrientedImageData();
+    if (targetLabelmap.GetPointer() == NULL)
+    {
+      return QString("Failed to access target labelmap");
+    }
+    Plm_image::Pointer targetPlmVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
+    if (!targetPlmVolume)
+    {
+      return QString("Failed to convert segment labelmap");
+    }
+    targetPlmVolume->print();
+    images.TargetVolumeItk = targetPlmVolume->itk_uchar();
+
+    // Reference code for setting the geometry of the segmentation rasterization
+    // in case the default one (from DICOM) is not desired
+#if defined (commentout)
+    vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    protonDoseVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+    std::string doseGeometryString = vtkSegmentationConverter::SerializeImageGeometry(doseIjkToRasMatrix, protonDoseVolumeNode->GetImageData());
+    segmentationCopy->SetConversionParameter( vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+      doseGeometryString );
+#endif
+
+    // Convert reference volume to Plastimatch image
+    Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+    if (!referenceVolumePlm)
+    {
+      return QString("Failed to convert reference volume");
+    }
+    referenceVolumePlm->print();
+    images.ReferenceVolumeItk = referenceVolumePlm->itk_short();
+
+    return QString();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Set up Plastimatch plan and beam from the parameters of a beam node
+  /// \param engine Dose engine from which the beam parameters are read
+  /// \param images Converted reference and target images of the parent plan of the beam. The plan gets a copy of them
+  /// \param rt_plan Plastimatch plan to set up
+  /// \param rt_beam Output Plastimatch beam appended to the plan
+  QString SetupPlastimatchBeam(qSlicerPlastimatchProtonDoseEngine* engine, vtkMRMLRTBeamNode* beamNode,
+    PlanImages& images, Rt_plan* rt_plan, Rt_beam*& rt_beam)
+  {
+    vtkMRMLRTPlanNode* parentPlanNode = beamNode->GetParentPlanNode();
+
+    // Get isocenter
+    double isocenter[3] = {0.0, 0.0, 0.0};
+    if (!beamNode->GetPlanIsocenterPosition(isocenter))
+    {
+      QString errorMessage("Failed to get isocenter position");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+    // Convert isocenter position to LPS for Plastimatch
+    isocenter[0] = -isocenter[0];
+    isocenter[1] = -isocenter[1];
+
+    // Calculate sourcePosition position
+    double sourcePosition[3] = {0.0, 0.0, 0.0};
+    if (!beamNode->GetSourcePosition(sourcePosition))
+    {
+      QString errorMessage("Failed to calculate source position");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+
+    // Connection of the beam parameters to the rt_beam class used to calculate the dose in Plastimatch
+    try
+    {
+      // Create a beam
+      rt_beam = rt_plan->append_beam();
+
+      // Assign inputs to dose calculation logic
+
+      // Update plan
+      std::cout << "\n ***PLAN PARAMETERS***" << std::endl;
+      std::cout << "Setting reference volume" << std::endl;
+      rt_plan->set_patient (DuplicateImage<ShortImageType>(images.ReferenceVolumeItk));
+      std::cout << "Setting target volume" << std::endl;
+      rt_plan->set_target (DuplicateImage<UCharImageType>(images.TargetVolumeItk));
+      std::cout << "Setting reference dose point -> ";
+      rt_plan->set_ref_dose_point(isocenter); //TODO: MD Fix, for the moment, the reference dose point is the isocenter
+      std::cout << "Reference dose position: " << rt_plan->get_ref_dose_point()[0] << " " << rt_plan->get_ref_dose_point()[1] << " " << rt_plan->get_ref_dose_point()[2] << std::endl;
+      rt_plan->set_have_ref_dose_point(true);
+      rt_plan->set_have_dose_norm(true);
+      std::cout << "Setting dose prescription -> ";
+      rt_plan->set_normalization_dose(parentPlanNode->GetRxDose());
+      std::cout << "Dose prescription = " << rt_plan->get_normalization_dose() << std::endl;
+
+      // Not needed for dose calculation: 
+      // Parameter Set, Plan Contour, Dose Volume, Dose Grid
+
+      // Set beam parameters
+      std::cout << std::endl << " ***BEAM PARAMETERS***" << std::endl;
+
+      std::cout << "Setting source position -> ";
+      rt_beam->set_source_position(sourcePosition);
+      std::cout << "Source position: " << rt_beam->get_source_position()[0] << " " << rt_beam->get_source_position()[1] << " " << rt_beam->get_source_position()[2] << std::endl;
+
+      std::cout << "Setting isocenter position -> ";
+      rt_beam->set_isocenter_position(isocenter);
+      std::cout << "Isocenter position: " << rt_beam->get_isocenter_position()[0] << " " << rt_beam->get_isocenter_position()[1] << " " << rt_beam->get_isocenter_position()[2] << std::endl;
+
+      std::cout << "Setting dose calculation algorithm -> ";
+      int algorithm = engine->integerParameter(beamNode, "Algorithm");
+      switch(algorithm)
+      {
+      case 1: // Pencil beam
+        rt_beam->set_flavor("d");
+        break;
+      default: // Ray tracer
+        rt_beam->set_flavor("b");
+        break;
+      }
+      std::cout << "Algorithm Flavor = " << rt_beam->get_flavor() << std::endl;
+
+      bool kgScattering = engine->booleanParameter(beamNode, "KanematsuGottschalk");
+      if (kgScattering)
+      {
+        rt_beam->set_homo_approx('n');
+        std::cout << "Homo approximation set to false" << std::endl;
+      }
+      else
+      {
+        rt_beam->set_homo_approx('y');
+        std::cout << "Homo approximation set to true" << std::endl;
+      }
+
+      std::cout << "Setting beam weight -> ";
+      rt_beam->set_beam_weight(1.0); // Beam weight is applied centrally by the dose engine logic (qSlicerDoseEngineLogic::createAccumulatedDose)
+      std::cout << "Beam weight = " << rt_beam->get_beam_weight() << std::endl;
+
+      std::cout << "Setting smearing -> ";
+      double rangeCompensatorSmearingRadius = engine->doubleParameter(beamNode, "RangeCompensatorSmearingRadius");
+      rt_beam->set_smearing(rangeCompensatorSmearingRadius);
+      std::cout << "Smearing = " << rt_beam->get_smearing() << std::endl;
+
+      std::cout << "Setting Highland model for range compensator" << std::endl;
+      bool rangeCompensatorHighland = engine->booleanParameter(beamNode, "RangeCompensatorHighland");
+      if (rangeCompensatorHighland)
+      {
+        rt_beam->set_rc_MC_model('n');
+        std::cout << "Highland model for range compensator set to true" << std::endl;
+      }
+      else
+      {
+        rt_beam->set_rc_MC_model('y');
+        std::cout << "Highland model for range compensator set to false" << std::endl;
+      }
+
+      std::cout << "Setting source size -> ";
+      double sourceSize = engine->doubleParameter(beamNode, "SourceSize");
+      rt_beam->set_source_size(sourceSize);
+      std::cout << "Source size = " << rt_beam->get_source_size() << std::endl;
+
+      std::cout << "Setting step length -> ";
+      double stepLength = engine->doubleParameter(beamNode, "StepLength");
+      rt_beam->set_step_length(stepLength);
+      std::cout << "Step length = " << rt_beam->get_step_length() << std::endl;
+
+      //TODO: Add in the future: CouchAngle
+
+      // Aperture parameters
+      std::cout << "\nAPERTURE PARAMETERS:" << std::endl;
+
+      double apertureOffset = engine->doubleParameter(beamNode, "ApertureOffset");
+      if (beamNode->GetSAD() < 0 || beamNode->GetSAD() < apertureOffset)
+      {
+        QString errorMessage = QString("SAD (=%1) must be positive and greater than aperture offset (%2)").arg(beamNode->GetSAD()).arg(apertureOffset);
+        qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+        return errorMessage;
+      }
+      double apertureOrigin[2] = {
+        beamNode->GetX1Jaw() * apertureOffset / beamNode->GetSAD(),
+        beamNode->GetY1Jaw() * apertureOffset / beamNode->GetSAD() };
+
+      double pencilBeamResolution = engine->doubleParameter(beamNode, "PencilBeamResolution");
+      // Convert from spacing at isocenter to spacing at aperture
+      double apertureSpacing[2] = {
+        pencilBeamResolution * apertureOffset / beamNode->GetSAD(),
+        pencilBeamResolution * apertureOffset / beamNode->GetSAD() };
+
+      plm_long apertureDimensions[2] = {
+        (plm_long)((beamNode->GetX2Jaw() - beamNode->GetX1Jaw()) / pencilBeamResolution + 1 ),
+        (plm_long)((beamNode->GetY2Jaw() - beamNode->GetY1Jaw()) / pencilBeamResolution + 1 ) };
+
+      std::cout << "Setting aperture distance -> ";
+      rt_beam->get_aperture()->set_distance(apertureOffset);
+      std::cout << "Aperture distance = " << rt_beam->get_aperture()->get_distance() << std::endl;
+
+      std::cout << "Setting aperture origin -> ";
+      rt_beam->get_aperture()->set_origin(apertureOrigin);
+      std::cout << "Aperture origin = " << apertureOrigin[0] << " " << apertureOrigin[1] << std::endl;
+
+      std::cout << "Setting aperture spacing -> ";
+      rt_beam->get_aperture()->set_spacing(apertureSpacing);
+      std::cout << "Aperture Spacing = " << rt_beam->get_aperture()->get_spacing(0) << " " << rt_beam->get_aperture()->get_spacing(1) << std::endl;
+
+      std::cout << "Setting aperture dim -> ";
+      rt_beam->get_aperture()->set_dim(apertureDimensions);
+      std::cout << "Aperture dim = " << rt_beam->get_aperture()->get_dim(0) << " " << rt_beam->get_aperture()->get_dim(1) << std::endl;
+
+      //TODO: Add in the future: CollimatorAngle
+
+      // Update mebs parameters
+      std::cout << "\nENERGY PARAMETERS:" << std::endl;
+
+      std::cout << "Setting beam line type -> ";
+      int beamLineTypeActive = engine->integerParameter(beamNode, "BeamLineTypeActive");
+      if (beamLineTypeActive == 0)
+      {
+        rt_beam->set_beam_line_type("active");      
+        std::cout << "beam line type set to active" << std::endl;
+      }
+      else
+      {
+        rt_beam->set_beam_line_type("passive");      
+        std::cout << "beam line type set to passive" << std::endl;
+      }
+
+      std::cout << "Setting have prescription -> ";
+      bool manualEnergyLimits = engine->booleanParameter(beamNode, "ManualEnergyLimits");
+      rt_beam->get_mebs()->set_have_prescription(manualEnergyLimits);
+      std::cout << "Manual energy prescription set to " << rt_beam->get_mebs()->get_have_prescription() << std::endl;
+
+      if (rt_beam->get_mebs()->get_have_prescription() == true)
+      {
+        double minimumEnergy = engine->doubleParameter(beamNode, "MinimumEnergy");
+        rt_beam->get_mebs()->set_energy_min(minimumEnergy);
+        double maximumEnergy = engine->doubleParameter(beamNode, "MaximumEnergy");
+        rt_beam->get_mebs()->set_energy_max(maximumEnergy);
+        std::cout << "Energy min: " << rt_beam->get_mebs()->get_energy_min() << ", Energy max: " << rt_beam->get_mebs()->get_energy_max() << std::endl;
+      }
+
+      std::cout << "Setting proximal margin -> ";
+      double proximalMargin = engine->doubleParameter(beamNode, "ProximalMargin");
+      rt_beam->get_mebs()->set_proximal_margin(proximalMargin);
+      std::cout << "Proximal margin = " << rt_beam->get_mebs()->get_proximal_margin() << std::endl;
+
+      std::cout << "Setting distal margin -> ";
+      double distalMargin = engine->doubleParameter(beamNode, "DistalMargin");
+      rt_beam->get_mebs()->set_distal_margin(distalMargin);
+      std::cout << "Distal margin = " << rt_beam->get_mebs()->get_distal_margin() << std::endl;
+
+      std::cout << "Setting energy resolution -> ";
+      double energyResolution = engine->doubleParameter(beamNode, "EnergyResolution");
+      rt_beam->get_mebs()->set_energy_resolution(energyResolution);
+      std::cout << "Energy resolution = " << rt_beam->get_mebs()->get_energy_resolution() << std::endl;
+
+      std::cout << "Setting energy spread -> ";
+      double energySpread = engine->doubleParameter(beamNode, "EnergySpread");
+      rt_beam->get_mebs()->set_spread(energySpread);
+      std::cout << "Energy spread = " << rt_beam->get_mebs()->get_spread() << std::endl;
+
+      // A little warm fuzzy for the developers
+      rt_plan->print_verif ();
+    }
+    catch (std::exception& ex)
+    {
+      QString errorMessage("Plastimatch exception happened! See log for details");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage << ": " << ex.what();
+      return errorMessage;
+    }
+
+    return QString();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Set computed dose to result volume node and add aperture and range compensator as intermediate results
+  void SetResultsFromPlastimatchBeam(qSlicerPlastimatchProtonDoseEngine* engine, vtkMRMLRTBeamNode* beamNode,
+    Rt_beam* rt_beam, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+  {
+    vtkMRMLScene* scene = beamNode->GetScene();
+    vtkMRMLScalarVolumeNode* referenceVolumeNode = beamNode->GetParentPlanNode()->GetReferenceVolumeNode();
+
+    // Get per-beam dose image and set it to result node
+    itk::Image<float, 3>::Pointer doseVolumeItk = rt_beam->get_dose()->itk_float();
+
+    // Create dose image data to set to the volume node
+    vtkSmartPointer<vtkImageData> protonDoseImageData = vtkSmartPointer<vtkImageData>::New();
+    SlicerRtCommon::ConvertItkImageToVtkImageData<float>(doseVolumeItk, protonDoseImageData, VTK_FLOAT);
+
+    // Set image data to result dose volume node
+    resultDoseVolumeNode->SetAndObserveImageData(protonDoseImageData);
+    resultDoseVolumeNode->CopyOrientation(referenceVolumeNode);
+
+    std::string protonDoseNodeName = std::string(beamNode->GetName()) + "_ProtonDose";
+    resultDoseVolumeNode->SetName(protonDoseNodeName.c_str());
+
+    // Get aperture image, create volume node, and add as intermediate result
+    Plm_image::Pointer& ap = rt_beam->get_aperture_image();
+    itk::Image<unsigned char, 3>::Pointer apertureVolumeItk = ap->itk_uchar();
+
+    vtkSmartPointer<vtkImageData> apertureImageData = vtkSmartPointer<vtkImageData>::New();
+    SlicerRtCommon::ConvertItkImageToVtkImageData<unsigned char>(apertureVolumeItk, apertureImageData, VTK_UNSIGNED_CHAR);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> apertureVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    apertureVolumeNode->SetAndObserveImageData(apertureImageData);
+    apertureVolumeNode->SetSpacing(apertureVolumeItk->GetSpacing()[0], apertureVolumeItk->GetSpacing()[1], apertureVolumeItk->GetSpacing()[2]);
+    apertureVolumeNode->SetOrigin(apertureVolumeItk->GetOrigin()[0], apertureVolumeItk->GetOrigin()[1], apertureVolumeItk->GetOrigin()[2]);
+
+    std::string apertureNodeName = std::string(beamNode->GetName()) + "_Aperture";
+    apertureVolumeNode->SetName(apertureNodeName.c_str());
+    scene->AddNode(apertureVolumeNode);
+  
+    engine->addIntermediateResult(apertureVolumeNode, beamNode);
+
+    // Get range compensator image, create volume node, and add as intermediate result
+    Plm_image::Pointer& rc = rt_beam->get_range_compensator_image();
+    itk::Image<float, 3>::Pointer rcVolumeItk = rc->itk_float();
+
+    vtkSmartPointer<vtkImageData> rangeCompensatorImageData = vtkSmartPointer<vtkImageData>::New();
+    SlicerRtCommon::ConvertItkImageToVtkImageData<float>(rcVolumeItk, rangeCompensatorImageData, VTK_FLOAT);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> rangeCompensatorVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    rangeCompensatorVolumeNode->SetAndObserveImageData(rangeCompensatorImageData);
+    rangeCompensatorVolumeNode->SetSpacing(rcVolumeItk->GetSpacing()[0], rcVolumeItk->GetSpacing()[1], rcVolumeItk->GetSpacing()[2]);
+    rangeCompensatorVolumeNode->SetOrigin(rcVolumeItk->GetOrigin()[0], rcVolumeItk->GetOrigin()[1], rcVolumeItk->GetOrigin()[2]);
+
+    std::string rangeCompensatorNodeName = std::string(beamNode->GetName()) + "_RangeCompensator";
+    rangeCompensatorVolumeNode->SetName(rangeCompensatorNodeName.c_str());
+    scene->AddNode(rangeCompensatorVolumeNode);
+  
+    engine->addIntermediateResult(rangeCompensatorVolumeNode, beamNode);
+
+  }
+}
+
+//---------------------------------------------------------------------------
+QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+{
+  std::vector<vtkMRMLRTBeamNode*> beamNodes(1, beamNode);
+  std::vector<vtkMRMLScalarVolumeNode*> resultDoseVolumeNodes(1, resultDoseVolumeNode);
+  return this->calculateDoseForBeamsUsingEngine(beamNodes, resultDoseVolumeNodes);
+}
 
 //----------------------------------------------------------------------------
 qSlicerPlastimatchProtonDoseEngine::qSlicerPlastimatchProtonDoseEngine(QObject* parent)
@@ -140,352 +585,94 @@ void qSlicerPlastimatchProtonDoseEngine::defineBeamParameters()
 }
 
 //---------------------------------------------------------------------------
-QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+QString qSlicerPlastimatchProtonDoseEngine::calculateDoseForBeamsUsingEngine(
+  std::vector<vtkMRMLRTBeamNode*>& beamNodes, std::vector<vtkMRMLScalarVolumeNode*>& resultDoseVolumeNodes )
 {
-  vtkMRMLRTPlanNode* parentPlanNode = beamNode->GetParentPlanNode();
-  if (!parentPlanNode)
-  {
-    QString errorMessage = QString("Unable to access parent node for beam %1").arg(beamNode->GetName());
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-  vtkMRMLScalarVolumeNode* referenceVolumeNode = parentPlanNode->GetReferenceVolumeNode();
-  if (!referenceVolumeNode)
-  {
-    QString errorMessage("Unable to access reference volume");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-  if (!resultDoseVolumeNode)
-  {
-    QString errorMessage("Invalid result dose volume");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-
-  vtkMRMLScene* scene = beamNode->GetScene();
-
-  // Get target as ITK image
-  vtkSmartPointer<vtkOrientedImageData> targetLabelmap = parentPlanNode->GetTargetOrientedImageData();
-  if (targetLabelmap.GetPointer() == NULL)
+  if (beamNodes.size() != resultDoseVolumeNodes.size())
   {
-    QString errorMessage("Failed to access target labelmap");
+    QString errorMessage("Number of beams and result dose volumes differ");
     qCritical() << Q_FUNC_INFO << ": " << errorMessage;
     return errorMessage;
   }
-  Plm_image::Pointer targetPlmVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
-  if (!targetPlmVolume)
-  {
-    QString errorMessage("Failed to convert segment labelmap");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-  targetPlmVolume->print();
-  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = targetPlmVolume->itk_uchar();
 
-  // Reference code for setting the geometry of the segmentation rasterization
-  // in case the default one (from DICOM) is not desired
-#if defined (commentout)
-  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  protonDoseVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
-  std::string doseGeometryString = vtkSegmentationConverter::SerializeImageGeometry(doseIjkToRasMatrix, protonDoseVolumeNode->GetImageData());
-  segmentationCopy->SetConversionParameter( vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
-    doseGeometryString );
-#endif
-
-  // Get isocenter
-  double isocenter[3] = {0.0, 0.0, 0.0};
-  if (!beamNode->GetPlanIsocenterPosition(isocenter))
+  // Convert reference and target volumes only once for each plan
+  std::map<vtkMRMLRTPlanNode*, PlanImages> planImages;
+  for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
   {
-    QString errorMessage("Failed to get isocenter position");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-  // Convert isocenter position to LPS for Plastimatch
-  isocenter[0] = -isocenter[0];
-  isocenter[1] = -isocenter[1];
-
-  // Calculate sourcePosition position
-  double sourcePosition[3] = {0.0, 0.0, 0.0};
-  if (!beamNode->GetSourcePosition(sourcePosition))
-  {
-    QString errorMessage("Failed to calculate source position");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-
-  // Convert reference volume to Plastimatch image
-  //TODO: Cache it so that it does not need to be reconverted every time
-  Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
-  referenceVolumePlm->print();
-  // Create ITK output dose volume based on the reference volume
-  itk::Image<short, 3>::Pointer referenceVolumeItk = referenceVolumePlm->itk_short();
-
-  // Plastimatch RT plan and beam
-  Rt_plan rt_plan;
-  Rt_beam* rt_beam = NULL;
-
-  // Connection of the beam parameters to the rt_beam class used to calculate the dose in Plastimatch
-  try
-  {
-    // Create a beam
-    rt_beam = rt_plan.append_beam();
-
-    // Assign inputs to dose calculation logic
-
-    // Update plan
-    std::cout << "\n ***PLAN PARAMETERS***" << std::endl;
-    std::cout << "Setting reference volume" << std::endl;
-    rt_plan.set_patient (referenceVolumeItk);
-    std::cout << "Setting target volume" << std::endl;
-    rt_plan.set_target (targetVolumeItk);
-    std::cout << "Setting reference dose point -> ";
-    rt_plan.set_ref_dose_point(isocenter); //TODO: MD Fix, for the moment, the reference dose point is the isocenter
-    std::cout << "Reference dose position: " << rt_plan.get_ref_dose_point()[0] << " " << rt_plan.get_ref_dose_point()[1] << " " << rt_plan.get_ref_dose_point()[2] << std::endl;
-    rt_plan.set_have_ref_dose_point(true);
-    rt_plan.set_have_dose_norm(true);
-    std::cout << "Setting dose prescription -> ";
-    rt_plan.set_normalization_dose(parentPlanNode->GetRxDose());
-    std::cout << "Dose prescription = " << rt_plan.get_normalization_dose() << std::endl;
-
-    // Not needed for dose calculation: 
-    // Parameter Set, Plan Contour, Dose Volume, Dose Grid
-
-    // Set beam parameters
-    std::cout << std::endl << " ***BEAM PARAMETERS***" << std::endl;
-
-    std::cout << "Setting source position -> ";
-    rt_beam->set_source_position(sourcePosition);
-    std::cout << "Source position: " << rt_beam->get_source_position()[0] << " " << rt_beam->get_source_position()[1] << " " << rt_beam->get_source_position()[2] << std::endl;
-
-    std::cout << "Setting isocenter position -> ";
-    rt_beam->set_isocenter_position(isocenter);
-    std::cout << "Isocenter position: " << rt_beam->get_isocenter_position()[0] << " " << rt_beam->get_isocenter_position()[1] << " " << rt_beam->get_isocenter_position()[2] << std::endl;
-
-    std::cout << "Setting dose calculation algorithm -> ";
-    int algorithm = this->integerParameter(beamNode, "Algorithm");
-    switch(algorithm)
-    {
-    case 1: // Pencil beam
-      rt_beam->set_flavor("d");
-      break;
-    default: // Ray tracer
-      rt_beam->set_flavor("b");
-      break;
-    }
-    std::cout << "Algorithm Flavor = " << rt_beam->get_flavor() << std::endl;
-
-    bool kgScattering = this->booleanParameter(beamNode, "KanematsuGottschalk");
-    if (kgScattering)
+    vtkMRMLRTBeamNode* beamNode = beamNodes[beamIndex];
+    vtkMRMLRTPlanNode* parentPlanNode = (beamNode ? beamNode->GetParentPlanNode() : NULL);
+    if (!parentPlanNode)
     {
-      rt_beam->set_homo_approx('n');
-      std::cout << "Homo approximation set to false" << std::endl;
-    }
-    else
-    {
-      rt_beam->set_homo_approx('y');
-      std::cout << "Homo approximation set to true" << std::endl;
+      QString errorMessage = QString("Unable to access parent node for beam %1").arg(beamNode ? beamNode->GetName() : "NULL");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
     }
-
-    std::cout << "Setting beam weight -> ";
-    rt_beam->set_beam_weight(1.0); // Beam weight is applied centrally by the dose engine logic (qSlicerDoseEngineLogic::createAccumulatedDose)
-    std::cout << "Beam weight = " << rt_beam->get_beam_weight() << std::endl;
-
-    std::cout << "Setting smearing -> ";
-    double rangeCompensatorSmearingRadius = this->doubleParameter(beamNode, "RangeCompensatorSmearingRadius");
-    rt_beam->set_smearing(rangeCompensatorSmearingRadius);
-    std::cout << "Smearing = " << rt_beam->get_smearing() << std::endl;
-
-    std::cout << "Setting Highland model for range compensator" << std::endl;
-    bool rangeCompensatorHighland = this->booleanParameter(beamNode, "RangeCompensatorHighland");
-    if (rangeCompensatorHighland)
+    if (!resultDoseVolumeNodes[beamIndex])
     {
-      rt_beam->set_rc_MC_model('n');
-      std::cout << "Highland model for range compensator set to true" << std::endl;
+      QString errorMessage("Invalid result dose volume");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
     }
-    else
+    if (planImages.find(parentPlanNode) != planImages.end())
     {
-      rt_beam->set_rc_MC_model('y');
-      std::cout << "Highland model for range compensator set to false" << std::endl;
+      continue;
     }
 
-    std::cout << "Setting source size -> ";
-    double sourceSize = this->doubleParameter(beamNode, "SourceSize");
-    rt_beam->set_source_size(sourceSize);
-    std::cout << "Source size = " << rt_beam->get_source_size() << std::endl;
-
-    std::cout << "Setting step length -> ";
-    double stepLength = this->doubleParameter(beamNode, "StepLength");
-    rt_beam->set_step_length(stepLength);
-    std::cout << "Step length = " << rt_beam->get_step_length() << std::endl;
-
-    //TODO: Add in the future: CouchAngle
-
-    // Aperture parameters
-    std::cout << "\nAPERTURE PARAMETERS:" << std::endl;
-
-    double apertureOffset = this->doubleParameter(beamNode, "ApertureOffset");
-    if (beamNode->GetSAD() < 0 || beamNode->GetSAD() < apertureOffset)
+    PlanImages& images = planImages[parentPlanNode];
+    QString errorMessage = ConvertPlanImages(parentPlanNode, images);
+    if (!errorMessage.isEmpty())
     {
-      QString errorMessage = QString("SAD (=%1) must be positive and greater than aperture offset (%2)").arg(beamNode->GetSAD()).arg(apertureOffset);
       qCritical() << Q_FUNC_INFO << ": " << errorMessage;
       return errorMessage;
     }
-    double apertureOrigin[2] = {
-      beamNode->GetX1Jaw() * apertureOffset / beamNode->GetSAD(),
-      beamNode->GetY1Jaw() * apertureOffset / beamNode->GetSAD() };
-
-    double pencilBeamResolution = this->doubleParameter(beamNode, "PencilBeamResolution");
-    // Convert from spacing at isocenter to spacing at aperture
-    double apertureSpacing[2] = {
-      pencilBeamResolution * apertureOffset / beamNode->GetSAD(),
-      pencilBeamResolution * apertureOffset / beamNode->GetSAD() };
-
-    plm_long apertureDimensions[2] = {
-      (plm_long)((beamNode->GetX2Jaw() - beamNode->GetX1Jaw()) / pencilBeamResolution + 1 ),
-      (plm_long)((beamNode->GetY2Jaw() - beamNode->GetY1Jaw()) / pencilBeamResolution + 1 ) };
-
-    std::cout << "Setting aperture distance -> ";
-    rt_beam->get_aperture()->set_distance(apertureOffset);
-    std::cout << "Aperture distance = " << rt_beam->get_aperture()->get_distance() << std::endl;
-
-    std::cout << "Setting aperture origin -> ";
-    rt_beam->get_aperture()->set_origin(apertureOrigin);
-    std::cout << "Aperture origin = " << apertureOrigin[0] << " " << apertureOrigin[1] << std::endl;
-
-    std::cout << "Setting aperture spacing -> ";
-    rt_beam->get_aperture()->set_spacing(apertureSpacing);
-    std::cout << "Aperture Spacing = " << rt_beam->get_aperture()->get_spacing(0) << " " << rt_beam->get_aperture()->get_spacing(1) << std::endl;
-
-    std::cout << "Setting aperture dim -> ";
-    rt_beam->get_aperture()->set_dim(apertureDimensions);
-    std::cout << "Aperture dim = " << rt_beam->get_aperture()->get_dim(0) << " " << rt_beam->get_aperture()->get_dim(1) << std::endl;
-
-    //TODO: Add in the future: CollimatorAngle
-
-    // Update mebs parameters
-    std::cout << "\nENERGY PARAMETERS:" << std::endl;
-
-    std::cout << "Setting beam line type -> ";
-    int beamLineTypeActive = this->integerParameter(beamNode, "BeamLineTypeActive");
-    if (beamLineTypeActive == 0)
-    {
-      rt_beam->set_beam_line_type("active");      
-      std::cout << "beam line type set to active" << std::endl;
-    }
-    else
-    {
-      rt_beam->set_beam_line_type("passive");      
-      std::cout << "beam line type set to passive" << std::endl;
-    }
-
-    std::cout << "Setting have prescription -> ";
-    bool manualEnergyLimits = this->booleanParameter(beamNode, "ManualEnergyLimits");
-    rt_beam->get_mebs()->set_have_prescription(manualEnergyLimits);
-    std::cout << "Manual energy prescription set to " << rt_beam->get_mebs()->get_have_prescription() << std::endl;
+  }
 
-    if (rt_beam->get_mebs()->get_have_prescription() == true)
+  // Set up a Plastimatch plan for each beam. Each beam has its own plan and copy of the input
+  // images so that the beams can be computed concurrently without sharing any Plastimatch data
+  PlastimatchBeamList plastimatchBeams;
+  for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
+  {
+    vtkMRMLRTBeamNode* beamNode = beamNodes[beamIndex];
+    Rt_plan* rt_plan = new Rt_plan();
+    plastimatchBeams.Plans.push_back(rt_plan);
+    plastimatchBeams.Beams.push_back(NULL);
+    plastimatchBeams.Errors.push_back(std::string());
+
+    QString errorMessage = SetupPlastimatchBeam(this, beamNode, planImages[beamNode->GetParentPlanNode()], rt_plan, plastimatchBeams.Beams[beamIndex]);
+    if (!errorMessage.isEmpty())
     {
-      double minimumEnergy = this->doubleParameter(beamNode, "MinimumEnergy");
-      rt_beam->get_mebs()->set_energy_min(minimumEnergy);
-      double maximumEnergy = this->doubleParameter(beamNode, "MaximumEnergy");
-      rt_beam->get_mebs()->set_energy_max(maximumEnergy);
-      std::cout << "Energy min: " << rt_beam->get_mebs()->get_energy_min() << ", Energy max: " << rt_beam->get_mebs()->get_energy_max() << std::endl;
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
     }
-
-    std::cout << "Setting proximal margin -> ";
-    double proximalMargin = this->doubleParameter(beamNode, "ProximalMargin");
-    rt_beam->get_mebs()->set_proximal_margin(proximalMargin);
-    std::cout << "Proximal margin = " << rt_beam->get_mebs()->get_proximal_margin() << std::endl;
-
-    std::cout << "Setting distal margin -> ";
-    double distalMargin = this->doubleParameter(beamNode, "DistalMargin");
-    rt_beam->get_mebs()->set_distal_margin(distalMargin);
-    std::cout << "Distal margin = " << rt_beam->get_mebs()->get_distal_margin() << std::endl;
-
-    std::cout << "Setting energy resolution -> ";
-    double energyResolution = this->doubleParameter(beamNode, "EnergyResolution");
-    rt_beam->get_mebs()->set_energy_resolution(energyResolution);
-    std::cout << "Energy resolution = " << rt_beam->get_mebs()->get_energy_resolution() << std::endl;
-
-    std::cout << "Setting energy spread -> ";
-    double energySpread = this->doubleParameter(beamNode, "EnergySpread");
-    rt_beam->get_mebs()->set_spread(energySpread);
-    std::cout << "Energy spread = " << rt_beam->get_mebs()->get_spread() << std::endl;
-
-    // A little warm fuzzy for the developers
-    rt_plan.print_verif ();
-    std::cout << "Working..." << std::endl;
-    fflush(stdout);
   }
-  catch (std::exception& ex)
+
+  // Plastimatch cannot be interrupted, so cancellation is only possible before starting the computation
+  if (this->isCancelRequested())
   {
-    QString errorMessage("Plastimatch exception happened! See log for details");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage << ": " << ex.what();
-    return errorMessage;
+    return QString("Dose calculation cancelled");
   }
 
-  // Compute the dose
-  try
+  // Compute the dose for the beams in parallel
+  std::cout << "Computing dose for " << beamNodes.size() << " beam(s)..." << std::endl;
+  fflush(stdout);
+  ComputeDoseFunctor computeDoseFunctor(this, plastimatchBeams);
+  vtkSMPTools::For(0, (vtkIdType)beamNodes.size(), 1, computeDoseFunctor);
+  this->reportBeamDoseCalculated((int)beamNodes.size(), (int)beamNodes.size());
+  for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
   {
-    rt_plan.compute_dose(rt_beam);
+    if (!plastimatchBeams.Errors[beamIndex].empty())
+    {
+      QString errorMessage("Plastimatch exception happened! See log for details");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage << ": " << plastimatchBeams.Errors[beamIndex].c_str();
+      return errorMessage;
+    }
   }
-  catch (std::exception& ex)
+
+  // Set results to the MRML nodes
+  for (unsigned int beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
   {
-    QString errorMessage("Plastimatch exception happened! See log for details");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage << ": " << ex.what();
-    return errorMessage;
+    SetResultsFromPlastimatchBeam(this, beamNodes[beamIndex], plastimatchBeams.Beams[beamIndex], resultDoseVolumeNodes[beamIndex]);
   }
 
-  // Get per-beam dose image and set it to result node
-  itk::Image<float, 3>::Pointer doseVolumeItk = rt_beam->get_dose()->itk_float();
-
-  // Create dose image data to set to the volume node
-  vtkSmartPointer<vtkImageData> protonDoseImageData = vtkSmartPointer<vtkImageData>::New();
-  SlicerRtCommon::ConvertItkImageToVtkImageData<float>(doseVolumeItk, protonDoseImageData, VTK_FLOAT);
-
-  // Set image data to result dose volume node
-  resultDoseVolumeNode->SetAndObserveImageData(protonDoseImageData);
-  resultDoseVolumeNode->CopyOrientation(referenceVolumeNode);
-
-  std::string protonDoseNodeName = std::string(beamNode->GetName()) + "_ProtonDose";
-  resultDoseVolumeNode->SetName(protonDoseNodeName.c_str());
-
-  // Get aperture image, create volume node, and add as intermediate result
-  Plm_image::Pointer& ap = rt_beam->get_aperture_image();
-  itk::Image<unsigned char, 3>::Pointer apertureVolumeItk = ap->itk_uchar();
-
-  vtkSmartPointer<vtkImageData> apertureImageData = vtkSmartPointer<vtkImageData>::New();
-  SlicerRtCommon::ConvertItkImageToVtkImageData<unsigned char>(apertureVolumeItk, apertureImageData, VTK_UNSIGNED_CHAR);
-
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> apertureVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  apertureVolumeNode->SetAndObserveImageData(apertureImageData);
-  apertureVolumeNode->SetSpacing(apertureVolumeItk->GetSpacing()[0], apertureVolumeItk->GetSpacing()[1], apertureVolumeItk->GetSpacing()[2]);
-  apertureVolumeNode->SetOrigin(apertureVolumeItk->GetOrigin()[0], apertureVolumeItk->GetOrigin()[1], apertureVolumeItk->GetOrigin()[2]);
-
-  std::string apertureNodeName = std::string(beamNode->GetName()) + "_Aperture";
-  apertureVolumeNode->SetName(apertureNodeName.c_str());
-  scene->AddNode(apertureVolumeNode);
-  
-  this->addIntermediateResult(apertureVolumeNode, beamNode);
-
-  // Get range compensator image, create volume node, and add as intermediate result
-  Plm_image::Pointer& rc = rt_beam->get_range_compensator_image();
-  itk::Image<float, 3>::Pointer rcVolumeItk = rc->itk_float();
-
-  vtkSmartPointer<vtkImageData> rangeCompensatorImageData = vtkSmartPointer<vtkImageData>::New();
-  SlicerRtCommon::ConvertItkImageToVtkImageData<float>(rcVolumeItk, rangeCompensatorImageData, VTK_FLOAT);
-
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> rangeCompensatorVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  rangeCompensatorVolumeNode->SetAndObserveImageData(rangeCompensatorImageData);
-  rangeCompensatorVolumeNode->SetSpacing(rcVolumeItk->GetSpacing()[0], rcVolumeItk->GetSpacing()[1], rcVolumeItk->GetSpacing()[2]);
-  rangeCompensatorVolumeNode->SetOrigin(rcVolumeItk->GetOrigin()[0], rcVolumeItk->GetOrigin()[1], rcVolumeItk->GetOrigin()[2]);
-
-  std::string rangeCompensatorNodeName = std::string(beamNode->GetName()) + "_RangeCompensator";
-  rangeCompensatorVolumeNode->SetName(rangeCompensatorNodeName.c_str());
-  scene->AddNode(rangeCompensatorVolumeNode);
-  
-  this->addIntermediateResult(rangeCompensatorVolumeNode, beamNode);
-
   return QString();
 }
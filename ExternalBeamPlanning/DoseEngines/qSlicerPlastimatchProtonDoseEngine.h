@@ -48,6 +48,14 @@ protected:
   /// \param resultDoseVolumeNode Output volume node for the result dose. It is created by \sa CalculateDose
   virtual QString calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode);
 
+  /// Calculate dose for multiple beams. The reference and target volumes are converted once per plan and
+  /// shared by the beams, and the beams are computed concurrently, each with its own Plastimatch beam and dose
+  /// \param beamNodes Beams for which the dose is calculated
+  /// \param resultDoseVolumeNodes Output volume nodes for the result doses (one for each beam)
+  virtual QString calculateDoseForBeamsUsingEngine(
+    std::vector<vtkMRMLRTBeamNode*>& beamNodes,
+    std::vector<vtkMRMLScalarVolumeNode*>& resultDoseVolumeNodes );
+
   /// Define engine-specific beam parameters
   void defineBeamParameters();
 
@@ -27,9 +27,15 @@
 #include "vtkSlicerBeamsModuleLogic.h"
 #include "vtkSlicerIECTransformLogic.h"
 
+// ExternalBeamPlanning includes
+#include "vtkWaterEquivalentDepthFilter.h"
+
+// SlicerRT includes
+#include "SlicerRtCommon.h"
+
 // MRML includes
 //#include <vtkMRMLMarkupsFiducialNode.h> //TODO: Includes commented out due to obsolete methods, see below
-//#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 //#include <vtkMRMLScalarVolumeDisplayNode.h>
 //#include <vtkMRMLDoubleArrayNode.h>
@@ -45,6 +51,8 @@
 // VTK includes
 #include <vtkNew.h>
 #include <vtkSmartPointer.h>
+#include <vtkMatrix4x4.h>
+#include <vtkImageData.h>
 //#include <vtkConeSource.h>
 //#include <vtkPoints.h>
 //#include <vtkCellArray.h>
@@ -55,7 +63,6 @@
 //#include <vtkRenderWindow.h>
 //#include <vtkCamera.h>
 //#include <vtkColorTransferFunction.h>
-//#include <vtkImageData.h>
 //#include <vtkImageCast.h>
 //#include <vtkPiecewiseFunction.h>
 //#include <vtkProperty.h>
@@ -73,6 +80,10 @@
 //#include <vtkImageGradientMagnitude.h>
 //#include <vtkImageMathematics.h>
 
+// STD includes
+#include <map>
+#include <vector>
+
 //----------------------------------------------------------------------------
 vtkCxxSetObjectMacro(vtkSlicerExternalBeamPlanningModuleLogic, BeamsLogic, vtkSlicerBeamsModuleLogic);
 
@@ -82,8 +93,22 @@ class vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal
 public:
   vtkInternal();
 
+  /// Assemble the values that determine the water-equivalent depth of a beam
+  /// (beam geometry and reference volume geometry and contents)
+  /// \return Success (false if beam has no transform or plan has no reference volume)
+  bool GetWEDCacheKey(vtkMRMLRTBeamNode* beamNode, std::vector<double>& key);
+
   //TODO: Add Matlab dose engine plugin infrastructure
   vtkSlicerCLIModuleLogic* MatlabDoseCalculationModuleLogic;
+
+  /// Cached water-equivalent depth volume with the values it was computed from
+  struct WEDCacheEntry
+  {
+    std::vector<double> Key;
+    vtkSmartPointer<vtkOrientedImageData> DepthVolume;
+  };
+  /// Cached water-equivalent depth volumes by beam node ID
+  std::map<std::string, WEDCacheEntry> WEDCache;
 };
 
 //----------------------------------------------------------------------------
@@ -92,6 +117,58 @@ vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::vtkInternal()
   this->MatlabDoseCalculationModuleLogic = 0;
 }
 
+//----------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetWEDCacheKey(vtkMRMLRTBeamNode* beamNode, std::vector<double>& key)
+{
+  key.clear();
+  vtkMRMLRTPlanNode* planNode = beamNode->GetParentPlanNode();
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = (planNode ? planNode->GetReferenceVolumeNode() : NULL);
+  vtkMRMLTransformNode* beamTransformNode = beamNode->GetParentTransformNode();
+  if (!referenceVolumeNode || !referenceVolumeNode->GetImageData() || !beamTransformNode)
+  {
+    return false;
+  }
+
+  // Beam geometry
+  vtkSmartPointer<vtkMatrix4x4> beamToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  beamTransformNode->GetMatrixTransformToWorld(beamToWorldMatrix);
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      key.push_back(beamToWorldMatrix->GetElement(row, column));
+    }
+  }
+  key.push_back(beamNode->GetSAD());
+  key.push_back(beamNode->GetX1Jaw());
+  key.push_back(beamNode->GetX2Jaw());
+  key.push_back(beamNode->GetY1Jaw());
+  key.push_back(beamNode->GetY2Jaw());
+
+  // Reference volume geometry and contents
+  key.push_back((double)referenceVolumeNode->GetImageData()->GetMTime());
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceVolumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  if (referenceVolumeNode->GetParentTransformNode())
+  {
+    vtkSmartPointer<vtkMatrix4x4> rasToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    referenceVolumeNode->GetParentTransformNode()->GetMatrixTransformToWorld(rasToWorldMatrix);
+    vtkMatrix4x4::Multiply4x4(rasToWorldMatrix, ijkToRasMatrix, ijkToRasMatrix);
+  }
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      key.push_back(ijkToRasMatrix->GetElement(row, column));
+    }
+  }
+  int extent[6] = {0,-1,0,-1,0,-1};
+  referenceVolumeNode->GetImageData()->GetExtent(extent);
+  key.insert(key.end(), extent, extent+6);
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerExternalBeamPlanningModuleLogic);
 
@@ -239,11 +316,16 @@ void vtkSlicerExternalBeamPlanningModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNod
   {
     this->Modified();
   }
+  if (node->IsA("vtkMRMLRTBeamNode"))
+  {
+    this->ClearWEDCache(vtkMRMLRTBeamNode::SafeDownCast(node));
+  }
 }
 
 //---------------------------------------------------------------------------
 void vtkSlicerExternalBeamPlanningModuleLogic::OnMRMLSceneEndClose()
 {
+  this->ClearWEDCache();
   this->Modified();
 }
 
@@ -276,7 +358,7 @@ void vtkSlicerExternalBeamPlanningModuleLogic::ProcessMRMLNodesEvents(vtkObject*
       {
         // Calculate transform from beam parameters and isocenter from plan
         vtkMRMLRTBeamNode* beamNode = (*beamIt);
-        beamNode->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+        beamNode->InvokeBeamTransformModifiedEvent();
       }
     }
   }
@@ -335,6 +417,80 @@ vtkMRMLRTBeamNode* vtkSlicerExternalBeamPlanningModuleLogic::CloneBeamInPlan(vtk
   return beamCloneNode;
 }
 
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkOrientedImageData> vtkSlicerExternalBeamPlanningModuleLogic::ComputeWED(vtkMRMLRTBeamNode* beamNode)
+{
+  if (!beamNode || !beamNode->GetID())
+  {
+    vtkErrorMacro("ComputeWED: Invalid beam node");
+    return NULL;
+  }
+  vtkMRMLRTPlanNode* planNode = beamNode->GetParentPlanNode();
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = (planNode ? planNode->GetReferenceVolumeNode() : NULL);
+  if (!referenceVolumeNode)
+  {
+    vtkErrorMacro("ComputeWED: Failed to access reference volume for beam " << beamNode->GetName());
+    return NULL;
+  }
+  vtkMRMLTransformNode* beamTransformNode = beamNode->GetParentTransformNode();
+  if (!beamTransformNode)
+  {
+    vtkErrorMacro("ComputeWED: Beam transform is missing for beam " << beamNode->GetName());
+    return NULL;
+  }
+
+  // Return cached depth if neither the beam geometry nor the reference volume changed
+  std::vector<double> key;
+  if (!this->Internal->GetWEDCacheKey(beamNode, key))
+  {
+    vtkErrorMacro("ComputeWED: Failed to get geometry of beam " << beamNode->GetName());
+    return NULL;
+  }
+  std::map<std::string, vtkInternal::WEDCacheEntry>::iterator cacheIt = this->Internal->WEDCache.find(beamNode->GetID());
+  if (cacheIt != this->Internal->WEDCache.end() && cacheIt->second.Key == key)
+  {
+    return cacheIt->second.DepthVolume;
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> referenceImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!SlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(referenceVolumeNode, referenceImageData))
+  {
+    vtkErrorMacro("ComputeWED: Failed to convert reference volume " << referenceVolumeNode->GetName());
+    return NULL;
+  }
+  vtkSmartPointer<vtkMatrix4x4> beamToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  beamTransformNode->GetMatrixTransformToWorld(beamToWorldMatrix);
+
+  vtkSmartPointer<vtkWaterEquivalentDepthFilter> wedFilter = vtkSmartPointer<vtkWaterEquivalentDepthFilter>::New();
+  wedFilter->SetInputVolume(referenceImageData);
+  wedFilter->SetBeamToWorldMatrix(beamToWorldMatrix);
+  wedFilter->SetSAD(beamNode->GetSAD());
+  wedFilter->SetAperture(beamNode->GetX1Jaw(), beamNode->GetX2Jaw(), beamNode->GetY1Jaw(), beamNode->GetY2Jaw());
+  wedFilter->Update();
+
+  vtkSmartPointer<vtkOrientedImageData> depthVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+  depthVolume->DeepCopy(wedFilter->GetOutput());
+
+  vtkInternal::WEDCacheEntry& entry = this->Internal->WEDCache[beamNode->GetID()];
+  entry.Key = key;
+  entry.DepthVolume = depthVolume;
+
+  return depthVolume;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::ClearWEDCache(vtkMRMLRTBeamNode* beamNode/*=NULL*/)
+{
+  if (!beamNode)
+  {
+    this->Internal->WEDCache.clear();
+  }
+  else if (beamNode->GetID())
+  {
+    this->Internal->WEDCache.erase(beamNode->GetID());
+  }
+}
+
 
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
@@ -344,13 +500,6 @@ vtkMRMLRTBeamNode* vtkSlicerExternalBeamPlanningModuleLogic::CloneBeamInPlan(vtk
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 
-//---------------------------------------------------------------------------
-void vtkSlicerExternalBeamPlanningModuleLogic::ComputeWED()
-{
-  //TODO: Needs implementation
-  vtkErrorMacro("ComputeWED: Not implemented");
-}
-
 //----------------------------------------------------------------------------
 void vtkSlicerExternalBeamPlanningModuleLogic::SetMatlabDoseCalculationModuleLogic(vtkSlicerCLIModuleLogic* logic)
 {
@@ -66,15 +66,21 @@ public:
   /// \return The new beam node that has been copied and added to the plan
   vtkMRMLRTBeamNode* CloneBeamInPlan(vtkMRMLRTBeamNode* copiedBeamNode, vtkMRMLRTPlanNode* planNode=NULL);
 
+  /// Compute water-equivalent depth volume for a beam in the geometry of the reference volume of its plan.
+  /// The result is cached per beam, and is recomputed only if the beam geometry or the reference volume changes
+  /// \param beamNode Beam to compute the depth for
+  /// \return Water-equivalent depth volume (float, mm). NULL on failure
+  vtkSmartPointer<vtkOrientedImageData> ComputeWED(vtkMRMLRTBeamNode* beamNode);
+
+  /// Remove cached water-equivalent depth of a beam, or all cached depths if no beam is given
+  void ClearWEDCache(vtkMRMLRTBeamNode* beamNode=NULL);
+
 //TODO: Obsolete functions
 public:
   /// TODO Fix
   /// TODO Move to separate logic
   void UpdateDRR(vtkMRMLRTPlanNode* planNode, char* beamName);
 
-  /// TODO
-  void ComputeWED();
-
   /// TODO
   void SetMatlabDoseCalculationModuleLogic(vtkSlicerCLIModuleLogic* logic);
   vtkSlicerCLIModuleLogic* GetMatlabDoseCalculationModuleLogic();
@@ -0,0 +1,544 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkWaterEquivalentDepthFilter.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkPiecewiseFunction.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Range of CT numbers covered by the stopping power lookup table
+  const int MINIMUM_HU = -1024;
+  const int MAXIMUM_HU = 3071;
+  /// Points closer than this to the source plane are not considered (mm)
+  const double EPSILON_DEPTH = 1e-6;
+
+  //----------------------------------------------------------------------------
+  /// Trilinear interpolation in a float volume. Points outside the volume are zero
+  inline float InterpolateVolume(const float* volume, const int dims[3], const double ijk[3])
+  {
+    if ( ijk[0] < 0.0 || ijk[1] < 0.0 || ijk[2] < 0.0
+      || ijk[0] > dims[0]-1 || ijk[1] > dims[1]-1 || ijk[2] > dims[2]-1 )
+    {
+      return 0.0f;
+    }
+
+    int i0 = std::min((int)ijk[0], std::max(dims[0]-2, 0));
+    int j0 = std::min((int)ijk[1], std::max(dims[1]-2, 0));
+    int k0 = std::min((int)ijk[2], std::max(dims[2]-2, 0));
+    int i1 = std::min(i0+1, dims[0]-1);
+    int j1 = std::min(j0+1, dims[1]-1);
+    int k1 = std::min(k0+1, dims[2]-1);
+    float fi = (float)(ijk[0] - i0);
+    float fj = (float)(ijk[1] - j0);
+    float fk = (float)(ijk[2] - k0);
+
+    vtkIdType sliceSize = (vtkIdType)dims[0] * dims[1];
+    const float* s0 = volume + k0 * sliceSize;
+    const float* s1 = volume + k1 * sliceSize;
+    float c00 = s0[j0*dims[0]+i0] * (1.0f-fi) + s0[j0*dims[0]+i1] * fi;
+    float c10 = s0[j1*dims[0]+i0] * (1.0f-fi) + s0[j1*dims[0]+i1] * fi;
+    float c01 = s1[j0*dims[0]+i0] * (1.0f-fi) + s1[j0*dims[0]+i1] * fi;
+    float c11 = s1[j1*dims[0]+i0] * (1.0f-fi) + s1[j1*dims[0]+i1] * fi;
+    float c0 = c00 * (1.0f-fj) + c10 * fj;
+    float c1 = c01 * (1.0f-fj) + c11 * fj;
+    return c0 * (1.0f-fk) + c1 * fk;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convert CT numbers to relative stopping power using a lookup table
+  template <class T>
+  class StoppingPowerFunctor
+  {
+  public:
+    StoppingPowerFunctor(const T* huPtr, const float* lookupTable, float* stoppingPowerPtr)
+      : HUPtr(huPtr), LookupTable(lookupTable), StoppingPowerPtr(stoppingPowerPtr) { }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType i=begin; i<end; ++i)
+      {
+        double hu = std::max((double)MINIMUM_HU, std::min((double)MAXIMUM_HU, (double)this->HUPtr[i]));
+        this->StoppingPowerPtr[i] = this->LookupTable[(int)hu - MINIMUM_HU];
+      }
+    }
+
+  private:
+    const T* HUPtr;
+    const float* LookupTable;
+    float* StoppingPowerPtr;
+  };
+
+  //----------------------------------------------------------------------------
+  template <class T>
+  void ConvertToStoppingPower(const T* huPtr, vtkIdType numberOfVoxels, const float* lookupTable, float* stoppingPowerPtr)
+  {
+    StoppingPowerFunctor<T> functor(huPtr, lookupTable, stoppingPowerPtr);
+    vtkSMPTools::For(0, numberOfVoxels, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Ray grid and beam geometry shared by the ray tracing and the depth lookup steps
+  struct RayGrid
+  {
+    double Source[3];
+    double U[3];
+    double V[3];
+    double D[3];
+    double SAD;
+    double Bounds[4];
+    double RaySpacing;
+    double StepLength;
+    double StartDistance;
+    int NumberOfRaysA;
+    int NumberOfRaysB;
+    int NumberOfSamples;
+    /// Cumulative water-equivalent depth for each sample of each ray (ray-major order)
+    std::vector<float> Depths;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Integrate relative stopping power along the rays of the grid
+  class RayTraceFunctor
+  {
+  public:
+    RayTraceFunctor(RayGrid& grid, const float* stoppingPower, const int extent[6], vtkMatrix4x4* worldToImageMatrix)
+      : Grid(grid), StoppingPower(stoppingPower)
+    {
+      for (int row=0; row<3; ++row)
+      {
+        this->Dimensions[row] = extent[2*row+1] - extent[2*row] + 1;
+        for (int column=0; column<4; ++column)
+        {
+          this->WorldToImage[row][column] = worldToImageMatrix->GetElement(row, column);
+        }
+        // Index relative to the first voxel so that it can be used to address the buffer directly
+        this->WorldToImage[row][3] -= extent[2*row];
+      }
+    }
+
+    void operator()(vtkIdType beginRay, vtkIdType endRay)
+    {
+      RayGrid& grid = this->Grid;
+      for (vtkIdType rayIndex=beginRay; rayIndex<endRay; ++rayIndex)
+      {
+        double a = grid.Bounds[0] + (rayIndex % grid.NumberOfRaysA) * grid.RaySpacing;
+        double b = grid.Bounds[2] + (rayIndex / grid.NumberOfRaysA) * grid.RaySpacing;
+
+        // Direction of the ray from source through the grid point on the isocenter plane
+        double direction[3] = { 0.0, 0.0, 0.0 };
+        for (int row=0; row<3; ++row)
+        {
+          direction[row] = grid.SAD*grid.D[row] + a*grid.U[row] + b*grid.V[row];
+        }
+        vtkMath::Normalize(direction);
+
+        // Start point and step of the ray in image coordinates
+        double ijk[3] = { 0.0, 0.0, 0.0 };
+        double step[3] = { 0.0, 0.0, 0.0 };
+        for (int row=0; row<3; ++row)
+        {
+          ijk[row] = this->WorldToImage[row][3];
+          for (int column=0; column<3; ++column)
+          {
+            ijk[row] += this->WorldToImage[row][column] * (grid.Source[column] + grid.StartDistance*direction[column]);
+            step[row] += this->WorldToImage[row][column] * direction[column] * grid.StepLength;
+          }
+        }
+
+        float* depthPtr = &(grid.Depths[(size_t)rayIndex * grid.NumberOfSamples]);
+        float cumulativeDepth = 0.0f;
+        float previousStoppingPower = 0.0f;
+        for (int sample=0; sample<grid.NumberOfSamples; ++sample)
+        {
+          float currentStoppingPower = InterpolateVolume(this->StoppingPower, this->Dimensions, ijk);
+          if (sample > 0)
+          {
+            cumulativeDepth += 0.5f * (previousStoppingPower + currentStoppingPower) * (float)grid.StepLength;
+          }
+          depthPtr[sample] = cumulativeDepth;
+          previousStoppingPower = currentStoppingPower;
+          ijk[0] += step[0];
+          ijk[1] += step[1];
+          ijk[2] += step[2];
+        }
+      }
+    }
+
+  private:
+    RayGrid& Grid;
+    const float* StoppingPower;
+    int Dimensions[3];
+    double WorldToImage[3][4];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Look up the depth of each voxel from the ray grid (processing whole slices)
+  class DepthLookupFunctor
+  {
+  public:
+    DepthLookupFunctor(const RayGrid& grid, float* output, const int extent[6], vtkMatrix4x4* imageToWorldMatrix)
+      : Grid(grid), Output(output)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+      }
+      for (int row=0; row<3; ++row)
+      {
+        for (int column=0; column<4; ++column)
+        {
+          this->ImageToWorld[row][column] = imageToWorldMatrix->GetElement(row, column);
+        }
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const RayGrid& grid = this->Grid;
+      int dims[3] = { this->Extent[1]-this->Extent[0]+1, this->Extent[3]-this->Extent[2]+1, this->Extent[5]-this->Extent[4]+1 };
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        for (int j=0; j<dims[1]; ++j)
+        {
+          float* voxelPtr = this->Output + (k*dims[1] + j)*(vtkIdType)dims[0];
+          for (int i=0; i<dims[0]; ++i, ++voxelPtr)
+          {
+            double index[3] = { (double)(i+this->Extent[0]), (double)(j+this->Extent[2]), (double)(k+this->Extent[4]) };
+            double relative[3] = { 0.0, 0.0, 0.0 };
+            for (int row=0; row<3; ++row)
+            {
+              relative[row] = this->ImageToWorld[row][0]*index[0] + this->ImageToWorld[row][1]*index[1]
+                + this->ImageToWorld[row][2]*index[2] + this->ImageToWorld[row][3] - grid.Source[row];
+            }
+            double axialDepth = vtkMath::Dot(relative, grid.D);
+            if (axialDepth <= EPSILON_DEPTH)
+            {
+              continue;
+            }
+
+            // Fractional ray grid and sample indices
+            double rayA = (vtkMath::Dot(relative, grid.U) * grid.SAD / axialDepth - grid.Bounds[0]) / grid.RaySpacing;
+            double rayB = (vtkMath::Dot(relative, grid.V) * grid.SAD / axialDepth - grid.Bounds[2]) / grid.RaySpacing;
+            double sample = (vtkMath::Norm(relative) - grid.StartDistance) / grid.StepLength;
+            if ( rayA < 0.0 || rayB < 0.0 || sample < 0.0
+              || rayA > grid.NumberOfRaysA-1 || rayB > grid.NumberOfRaysB-1 || sample > grid.NumberOfSamples-1 )
+            {
+              continue;
+            }
+            int a0 = std::min((int)rayA, std::max(grid.NumberOfRaysA-2, 0));
+            int b0 = std::min((int)rayB, std::max(grid.NumberOfRaysB-2, 0));
+            int s0 = std::min((int)sample, std::max(grid.NumberOfSamples-2, 0));
+            int a1 = std::min(a0+1, grid.NumberOfRaysA-1);
+            int b1 = std::min(b0+1, grid.NumberOfRaysB-1);
+            int s1 = std::min(s0+1, grid.NumberOfSamples-1);
+            float fa = (float)(rayA - a0);
+            float fb = (float)(rayB - b0);
+            float fs = (float)(sample - s0);
+
+            const float* r00 = &(grid.Depths[((size_t)b0*grid.NumberOfRaysA + a0) * grid.NumberOfSamples]);
+            const float* r01 = &(grid.Depths[((size_t)b0*grid.NumberOfRaysA + a1) * grid.NumberOfSamples]);
+            const float* r10 = &(grid.Depths[((size_t)b1*grid.NumberOfRaysA + a0) * grid.NumberOfSamples]);
+            const float* r11 = &(grid.Depths[((size_t)b1*grid.NumberOfRaysA + a1) * grid.NumberOfSamples]);
+            float d00 = r00[s0] * (1.0f-fs) + r00[s1] * fs;
+            float d01 = r01[s0] * (1.0f-fs) + r01[s1] * fs;
+            float d10 = r10[s0] * (1.0f-fs) + r10[s1] * fs;
+            float d11 = r11[s0] * (1.0f-fs) + r11[s1] * fs;
+            float d0 = d00 * (1.0f-fa) + d01 * fa;
+            float d1 = d10 * (1.0f-fa) + d11 * fa;
+            *voxelPtr = d0 * (1.0f-fb) + d1 * fb;
+          }
+        }
+      }
+    }
+
+  private:
+    const RayGrid& Grid;
+    float* Output;
+    int Extent[6];
+    double ImageToWorld[3][4];
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkWaterEquivalentDepthFilter);
+
+vtkCxxSetObjectMacro(vtkWaterEquivalentDepthFilter, InputVolume, vtkOrientedImageData);
+vtkCxxSetObjectMacro(vtkWaterEquivalentDepthFilter, BeamToWorldMatrix, vtkMatrix4x4);
+vtkCxxSetObjectMacro(vtkWaterEquivalentDepthFilter, StoppingPowerCurve, vtkPiecewiseFunction);
+
+//----------------------------------------------------------------------------
+vtkWaterEquivalentDepthFilter::vtkWaterEquivalentDepthFilter()
+{
+  this->InputVolume = NULL;
+  this->BeamToWorldMatrix = NULL;
+  this->StoppingPowerCurve = NULL;
+
+  this->OutputVolume = vtkOrientedImageData::New();
+
+  this->SAD = 1000.0;
+  this->Aperture[0] = -100.0;
+  this->Aperture[1] = 100.0;
+  this->Aperture[2] = -100.0;
+  this->Aperture[3] = 100.0;
+  this->ApertureMargin = 20.0;
+  this->RestrictToAperture = true;
+  this->RaySpacing = 0.0;
+  this->StepLength = 0.0;
+
+  this->CreateDefaultStoppingPowerCurve();
+}
+
+//----------------------------------------------------------------------------
+vtkWaterEquivalentDepthFilter::~vtkWaterEquivalentDepthFilter()
+{
+  this->SetInputVolume(NULL);
+  this->SetBeamToWorldMatrix(NULL);
+  this->SetStoppingPowerCurve(NULL);
+
+  if (this->OutputVolume)
+  {
+    this->OutputVolume->Delete();
+    this->OutputVolume = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkWaterEquivalentDepthFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "SAD: " << this->SAD << "\n";
+  os << indent << "Aperture: " << this->Aperture[0] << " " << this->Aperture[1] << " " << this->Aperture[2] << " " << this->Aperture[3] << "\n";
+  os << indent << "ApertureMargin: " << this->ApertureMargin << "\n";
+  os << indent << "RestrictToAperture: " << (this->RestrictToAperture ? "true" : "false") << "\n";
+  os << indent << "RaySpacing: " << this->RaySpacing << "\n";
+  os << indent << "StepLength: " << this->StepLength << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkWaterEquivalentDepthFilter::GetOutput()
+{
+  return this->OutputVolume;
+}
+
+//----------------------------------------------------------------------------
+void vtkWaterEquivalentDepthFilter::CreateDefaultStoppingPowerCurve()
+{
+  // Piecewise linear approximation of the stoichiometric calibration curve
+  // (air, lung, adipose, soft tissue, bone)
+  vtkSmartPointer<vtkPiecewiseFunction> curve = vtkSmartPointer<vtkPiecewiseFunction>::New();
+  curve->AddPoint(-1000.0, 0.001);
+  curve->AddPoint(-200.0, 0.80);
+  curve->AddPoint(-98.0, 0.93);
+  curve->AddPoint(15.0, 1.03);
+  curve->AddPoint(100.0, 1.10);
+  curve->AddPoint(1500.0, 1.85);
+  curve->AddPoint(3071.0, 2.60);
+  curve->ClampingOn();
+  this->SetStoppingPowerCurve(curve);
+}
+
+//----------------------------------------------------------------------------
+void vtkWaterEquivalentDepthFilter::ComputeStoppingPowerVolume(std::vector<float>& stoppingPower)
+{
+  // Sample curve once per CT number so that the conversion is a table lookup
+  std::vector<float> lookupTable(MAXIMUM_HU - MINIMUM_HU + 1, 0.0f);
+  for (int hu=MINIMUM_HU; hu<=MAXIMUM_HU; ++hu)
+  {
+    lookupTable[hu - MINIMUM_HU] = (float)std::max(0.0, this->StoppingPowerCurve->GetValue((double)hu));
+  }
+
+  vtkIdType numberOfVoxels = this->InputVolume->GetNumberOfPoints();
+  stoppingPower.resize(numberOfVoxels);
+  switch (this->InputVolume->GetScalarType())
+  {
+    vtkTemplateMacro( ConvertToStoppingPower<VTK_TT>(
+      (VTK_TT*)this->InputVolume->GetScalarPointer(), numberOfVoxels, &(lookupTable[0]), &(stoppingPower[0]) ) );
+  default:
+    vtkErrorMacro("ComputeStoppingPowerVolume: Unsupported scalar type " << this->InputVolume->GetScalarTypeAsString());
+    stoppingPower.clear();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkWaterEquivalentDepthFilter::Update()
+{
+  if (!this->InputVolume || !this->InputVolume->GetPointData() || !this->InputVolume->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Invalid input volume");
+    return;
+  }
+  if (!this->BeamToWorldMatrix)
+  {
+    vtkErrorMacro("Update: Beam to world transform has to be set");
+    return;
+  }
+  if (!this->StoppingPowerCurve)
+  {
+    vtkErrorMacro("Update: Invalid stopping power curve");
+    return;
+  }
+  if (this->SAD <= 0.0)
+  {
+    vtkErrorMacro("Update: Invalid SAD " << this->SAD);
+    return;
+  }
+
+  // Allocate output in the geometry of the input
+  int dims[3] = {0,0,0};
+  this->InputVolume->GetDimensions(dims);
+  int extent[6] = {0,-1,0,-1,0,-1};
+  this->InputVolume->GetExtent(extent);
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->InputVolume->GetImageToWorldMatrix(imageToWorldMatrix);
+  this->OutputVolume->SetExtent(extent);
+  this->OutputVolume->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+  this->OutputVolume->AllocateScalars(VTK_FLOAT, 1);
+  float* outputPtr = (float*)this->OutputVolume->GetScalarPointer();
+  vtkIdType numberOfVoxels = this->OutputVolume->GetNumberOfPoints();
+  std::fill(outputPtr, outputPtr + numberOfVoxels, 0.0f);
+  if (numberOfVoxels == 0)
+  {
+    return;
+  }
+
+  // Relative stopping power volume
+  std::vector<float> stoppingPower;
+  this->ComputeStoppingPowerVolume(stoppingPower);
+  if (stoppingPower.empty())
+  {
+    return;
+  }
+
+  // Beam frame in world coordinates: lateral axes U and V, beam direction D (from source towards isocenter)
+  RayGrid grid;
+  double isocenter[3] = { 0.0, 0.0, 0.0 };
+  for (int row=0; row<3; ++row)
+  {
+    grid.U[row] = this->BeamToWorldMatrix->GetElement(row, 0);
+    grid.V[row] = this->BeamToWorldMatrix->GetElement(row, 1);
+    grid.D[row] = -this->BeamToWorldMatrix->GetElement(row, 2);
+    isocenter[row] = this->BeamToWorldMatrix->GetElement(row, 3);
+  }
+  vtkMath::Normalize(grid.U);
+  vtkMath::Normalize(grid.V);
+  vtkMath::Normalize(grid.D);
+  grid.SAD = this->SAD;
+  for (int row=0; row<3; ++row)
+  {
+    grid.Source[row] = isocenter[row] - grid.SAD * grid.D[row];
+  }
+
+  // Image geometry
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(imageToWorldMatrix, worldToImageMatrix);
+  double spacing[3] = { 1.0, 1.0, 1.0 };
+  this->InputVolume->GetSpacing(spacing);
+  double minimumSpacing = std::min(spacing[0], std::min(spacing[1], spacing[2]));
+  double maximumSpacing = std::max(spacing[0], std::max(spacing[1], spacing[2]));
+  grid.RaySpacing = (this->RaySpacing > 0.0 ? this->RaySpacing : maximumSpacing);
+  grid.StepLength = (this->StepLength > 0.0 ? this->StepLength : minimumSpacing / 2.0);
+
+  // Project volume corners to the isocenter plane to get the ray grid extent and the depth range
+  grid.Bounds[0] = VTK_DOUBLE_MAX;
+  grid.Bounds[1] = VTK_DOUBLE_MIN;
+  grid.Bounds[2] = VTK_DOUBLE_MAX;
+  grid.Bounds[3] = VTK_DOUBLE_MIN;
+  double minimumAxialDepth = VTK_DOUBLE_MAX;
+  double maximumDistance = 0.0;
+  for (int corner=0; corner<8; ++corner)
+  {
+    double cornerImage[4] = {
+      (double)((corner & 1) ? extent[1] : extent[0]),
+      (double)((corner & 2) ? extent[3] : extent[2]),
+      (double)((corner & 4) ? extent[5] : extent[4]),
+      1.0 };
+    double cornerWorld[4] = { 0.0, 0.0, 0.0, 1.0 };
+    imageToWorldMatrix->MultiplyPoint(cornerImage, cornerWorld);
+    double relative[3] = { cornerWorld[0]-grid.Source[0], cornerWorld[1]-grid.Source[1], cornerWorld[2]-grid.Source[2] };
+    double axialDepth = vtkMath::Dot(relative, grid.D);
+    minimumAxialDepth = std::min(minimumAxialDepth, axialDepth);
+    maximumDistance = std::max(maximumDistance, vtkMath::Norm(relative));
+    if (axialDepth > EPSILON_DEPTH)
+    {
+      double a = vtkMath::Dot(relative, grid.U) * grid.SAD / axialDepth;
+      double b = vtkMath::Dot(relative, grid.V) * grid.SAD / axialDepth;
+      grid.Bounds[0] = std::min(grid.Bounds[0], a);
+      grid.Bounds[1] = std::max(grid.Bounds[1], a);
+      grid.Bounds[2] = std::min(grid.Bounds[2], b);
+      grid.Bounds[3] = std::max(grid.Bounds[3], b);
+    }
+  }
+  if (grid.Bounds[0] > grid.Bounds[1] || maximumDistance <= 0.0)
+  {
+    vtkErrorMacro("Update: Volume is entirely behind the beam source");
+    return;
+  }
+  if (this->RestrictToAperture)
+  {
+    // Lateral beam frame coordinates of the jaws at isocenter plane
+    // (consistent with the beam model created in vtkMRMLRTBeamNode::CreateBeamPolyData)
+    grid.Bounds[0] = std::max(grid.Bounds[0], -this->Aperture[3] - this->ApertureMargin);
+    grid.Bounds[1] = std::min(grid.Bounds[1], -this->Aperture[2] + this->ApertureMargin);
+    grid.Bounds[2] = std::max(grid.Bounds[2], -this->Aperture[1] - this->ApertureMargin);
+    grid.Bounds[3] = std::min(grid.Bounds[3], -this->Aperture[0] + this->ApertureMargin);
+    if (grid.Bounds[0] > grid.Bounds[1] || grid.Bounds[2] > grid.Bounds[3])
+    {
+      // Aperture does not intersect the volume, depth is zero everywhere
+      this->OutputVolume->Modified();
+      return;
+    }
+  }
+
+  // Each ray stores the cumulative water-equivalent depth at equidistant samples
+  // starting at the distance of the volume closest to the source
+  grid.NumberOfRaysA = (int)ceil((grid.Bounds[1]-grid.Bounds[0]) / grid.RaySpacing) + 1;
+  grid.NumberOfRaysB = (int)ceil((grid.Bounds[3]-grid.Bounds[2]) / grid.RaySpacing) + 1;
+  grid.StartDistance = std::max(0.0, minimumAxialDepth);
+  grid.NumberOfSamples = (int)ceil((maximumDistance-grid.StartDistance) / grid.StepLength) + 1;
+  grid.Depths.resize((size_t)grid.NumberOfRaysA * grid.NumberOfRaysB * grid.NumberOfSamples, 0.0f);
+
+  // Trace rays in parallel
+  RayTraceFunctor rayTraceFunctor(grid, &(stoppingPower[0]), extent, worldToImageMatrix);
+  vtkSMPTools::For(0, (vtkIdType)grid.NumberOfRaysA * grid.NumberOfRaysB, rayTraceFunctor);
+
+  // Look up depth for each voxel from the ray grid in parallel
+  DepthLookupFunctor depthLookupFunctor(grid, outputPtr, extent, imageToWorldMatrix);
+  vtkSMPTools::For(0, (vtkIdType)dims[2], depthLookupFunctor);
+
+  this->OutputVolume->Modified();
+}
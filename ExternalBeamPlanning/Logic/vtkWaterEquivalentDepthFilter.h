@@ -0,0 +1,126 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkWaterEquivalentDepthFilter - Compute water-equivalent (radiological) depth for a beam
+// .SECTION Description
+// Rays are cast from the beam source through a grid on the isocenter plane, and the
+// relative stopping power (converted from the CT numbers of the input volume) is integrated
+// along each ray. The per-voxel depth is then looked up from the ray grid, so the cost is
+// proportional to the number of ray samples plus the number of voxels.
+
+#ifndef __vtkWaterEquivalentDepthFilter_h
+#define __vtkWaterEquivalentDepthFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerExternalBeamPlanningModuleLogicExport.h"
+
+class vtkOrientedImageData;
+class vtkPiecewiseFunction;
+class vtkMatrix4x4;
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkWaterEquivalentDepthFilter : public vtkObject
+{
+public:
+  static vtkWaterEquivalentDepthFilter *New();
+  vtkTypeMacro(vtkWaterEquivalentDepthFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Compute the water-equivalent depth volume. The output has the geometry of the input volume
+  virtual void Update();
+
+  /// Get output water-equivalent depth volume (float, mm). Voxels not reached by any ray are zero
+  virtual vtkOrientedImageData* GetOutput();
+
+  /// Set input CT volume (Hounsfield units)
+  void SetInputVolume(vtkOrientedImageData* inputVolume);
+  vtkGetObjectMacro(InputVolume, vtkOrientedImageData);
+
+  /// Set beam to world transform. The source is at (0,0,SAD) in the beam frame, and the beam
+  /// travels along the negative Z axis of the beam frame through the isocenter at the origin
+  void SetBeamToWorldMatrix(vtkMatrix4x4* beamToWorldMatrix);
+  vtkGetObjectMacro(BeamToWorldMatrix, vtkMatrix4x4);
+
+  /// Set curve converting CT numbers (HU) to stopping power relative to water.
+  /// A default curve is used if not set
+  void SetStoppingPowerCurve(vtkPiecewiseFunction* curve);
+  vtkGetObjectMacro(StoppingPowerCurve, vtkPiecewiseFunction);
+
+  /// Source-axis distance (mm)
+  vtkGetMacro(SAD, double);
+  vtkSetMacro(SAD, double);
+
+  /// Aperture (jaw positions) at isocenter plane (mm) in X1, X2, Y1, Y2 order.
+  /// Only used if \sa RestrictToAperture is on
+  vtkGetVector4Macro(Aperture, double);
+  vtkSetVector4Macro(Aperture, double);
+
+  /// Lateral margin around the aperture at isocenter plane (mm)
+  vtkGetMacro(ApertureMargin, double);
+  vtkSetMacro(ApertureMargin, double);
+
+  /// Only cast rays through the aperture plus margin instead of the whole volume. On by default
+  vtkGetMacro(RestrictToAperture, bool);
+  vtkSetMacro(RestrictToAperture, bool);
+  vtkBooleanMacro(RestrictToAperture, bool);
+
+  /// Distance between neighboring rays at isocenter plane (mm). Largest voxel spacing if zero (default)
+  vtkGetMacro(RaySpacing, double);
+  vtkSetMacro(RaySpacing, double);
+
+  /// Sampling step along rays (mm). Half of the smallest voxel spacing if zero (default)
+  vtkGetMacro(StepLength, double);
+  vtkSetMacro(StepLength, double);
+
+protected:
+  /// Create default HU to relative stopping power curve
+  void CreateDefaultStoppingPowerCurve();
+
+  /// Convert input CT numbers to relative stopping power using a lookup table sampled from the curve
+  void ComputeStoppingPowerVolume(std::vector<float>& stoppingPower);
+
+protected:
+  vtkOrientedImageData* InputVolume;
+  vtkOrientedImageData* OutputVolume;
+  vtkMatrix4x4* BeamToWorldMatrix;
+  vtkPiecewiseFunction* StoppingPowerCurve;
+
+  double SAD;
+  double Aperture[4];
+  double ApertureMargin;
+  bool RestrictToAperture;
+  double RaySpacing;
+  double StepLength;
+
+protected:
+  vtkWaterEquivalentDepthFilter();
+  virtual ~vtkWaterEquivalentDepthFilter();
+
+private:
+  vtkWaterEquivalentDepthFilter(const vtkWaterEquivalentDepthFilter&); // Not implemented
+  void operator=(const vtkWaterEquivalentDepthFilter&);               // Not implemented
+};
+
+#endif
@@ -37,6 +37,7 @@ class ExternalBeamPlanningTest(unittest.TestCase):
     self.TestSection_01_RetrieveInputData()
     self.TestSection_02_LoadInputData()
     self.TestSection_1_RunPlastimatchProtonDoseEngine()
+    self.TestSection_2_RunPencilBeamPhotonDoseEngineWithBeamWeight()
 
     logging.info('Test finished')
 
@@ -58,6 +59,7 @@ class ExternalBeamPlanningTest(unittest.TestCase):
     self.expectedNumOfFilesInDataDir = 2
     self.expectedNumOfFilesInDataSegDir = 2
     self.plastimatchProtonDoseEngineName = 'Plastimatch proton'
+    self.pencilBeamPhotonDoseEngineName = 'Pencil beam photon'
 
   #------------------------------------------------------------------------------
   def TestSection_01_RetrieveInputData(self):
@@ -188,3 +190,59 @@ class ExternalBeamPlanningTest(unittest.TestCase):
     self.assertAlmostEqual(doseMean, 0.01670, 4)
     self.assertAlmostEqual(doseStdDev, 0.12670, 4)
     self.assertEqual(doseVoxelCount, 1000)
+
+  #------------------------------------------------------------------------------
+  def TestSection_2_RunPencilBeamPhotonDoseEngineWithBeamWeight(self):
+    logging.info('Test section 2: Run pencil beam photon dose engine with beam weight')
+
+    engineLogic = slicer.qSlicerDoseEngineLogic()
+    engineLogic.setMRMLScene(slicer.mrmlScene)
+
+    ctVolumeNode = slicer.util.getNode('TinyPatient_CT')
+    segmentationNode = slicer.util.getNode('TinyPatient_Structures')
+    self.assertIsNotNone(ctVolumeNode)
+    self.assertIsNotNone(segmentationNode)
+
+    totalDoseVolumeNode = slicer.vtkMRMLScalarVolumeNode()
+    totalDoseVolumeNode.SetName('TotalPhotonDose')
+    slicer.mrmlScene.AddNode(totalDoseVolumeNode)
+
+    planNode = slicer.vtkMRMLRTPlanNode()
+    planNode.SetName('TestPhotonPlan')
+    slicer.mrmlScene.AddNode(planNode)
+
+    planNode.SetAndObserveReferenceVolumeNode(ctVolumeNode)
+    planNode.SetAndObserveSegmentationNode(segmentationNode)
+    planNode.SetAndObserveOutputTotalDoseVolumeNode(totalDoseVolumeNode)
+    planNode.SetTargetSegmentID("Tumor_Contour")
+    planNode.SetIsocenterToTargetCenter()
+    planNode.SetDoseEngineName(self.pencilBeamPhotonDoseEngineName)
+
+    beamNode = engineLogic.createBeamInPlan(planNode)
+    beamNode.SetX1Jaw(-50.0)
+    beamNode.SetX2Jaw(50.0)
+    beamNode.SetY1Jaw(-50.0)
+    beamNode.SetY2Jaw(75.0)
+
+    # Reference dose with unit beam weight
+    beamNode.SetBeamWeight(1.0)
+    errorMessage = engineLogic.calculateDose(planNode)
+    self.assertEqual(errorMessage, "")
+    imageAccumulate = vtk.vtkImageAccumulate()
+    imageAccumulate.SetInputConnection(totalDoseVolumeNode.GetImageDataConnection())
+    imageAccumulate.Update()
+    unitWeightDoseMax = imageAccumulate.GetMax()[0]
+    unitWeightDoseMean = imageAccumulate.GetMean()[0]
+    self.assertGreater(unitWeightDoseMax, 0.0)
+
+    # The plan dose scales linearly with the beam weight (it is applied once, at accumulation)
+    beamWeight = 0.5
+    beamNode.SetBeamWeight(beamWeight)
+    errorMessage = engineLogic.calculateDose(planNode)
+    self.assertEqual(errorMessage, "")
+    imageAccumulate.SetInputConnection(totalDoseVolumeNode.GetImageDataConnection())
+    imageAccumulate.Update()
+    logging.info("Photon dose maximum with unit beam weight: " + str(unitWeightDoseMax) + ", with beam weight " + str(beamWeight) + ": " + str(imageAccumulate.GetMax()[0]))
+
+    self.assertAlmostEqual(imageAccumulate.GetMax()[0], beamWeight * unitWeightDoseMax, 4)
+    self.assertAlmostEqual(imageAccumulate.GetMean()[0], beamWeight * unitWeightDoseMean, 4)
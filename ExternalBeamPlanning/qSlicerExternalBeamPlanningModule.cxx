@@ -35,6 +35,7 @@
 #include "qSlicerDoseEnginePluginHandler.h"
 #include "qSlicerPlastimatchProtonDoseEngine.h"
 #include "qSlicerMockDoseEngine.h"
+#include "qSlicerPencilBeamPhotonDoseEngine.h"
 
 // SlicerRT includes
 #include "vtkSlicerBeamsModuleLogic.h"
@@ -144,6 +145,7 @@ void qSlicerExternalBeamPlanningModule::setup()
 
   // Register dose engines
   qSlicerDoseEnginePluginHandler::instance()->registerDoseEngine(new qSlicerPlastimatchProtonDoseEngine());
+  qSlicerDoseEnginePluginHandler::instance()->registerDoseEngine(new qSlicerPencilBeamPhotonDoseEngine());
   qSlicerDoseEnginePluginHandler::instance()->registerDoseEngine(new qSlicerMockDoseEngine());
 
   // Python engines
@@ -519,6 +519,8 @@ void qSlicerExternalBeamPlanningModuleWidget::poisMarkupsNodeChanged(vtkMRMLNode
     return;
   }
 
+  planNode->StartBeamsModify();
+
   planNode->DisableModifiedEventOn();
   planNode->SetAndObservePoisMarkupsFiducialNode(vtkMRMLMarkupsFiducialNode::SafeDownCast(node));
   planNode->DisableModifiedEventOff();
@@ -530,8 +532,10 @@ void qSlicerExternalBeamPlanningModuleWidget::poisMarkupsNodeChanged(vtkMRMLNode
   {
     // Calculate transform from beam parameters and isocenter from plan
     vtkMRMLRTBeamNode* beamNode = (*beamIt);
-    beamNode->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+    beamNode->InvokeBeamTransformModifiedEvent();
   }
+
+  planNode->EndBeamsModify();
 }
 
 //-----------------------------------------------------------------------------
@@ -654,6 +658,9 @@ void qSlicerExternalBeamPlanningModuleWidget::targetSegmentChanged(const QString
     return;
   }
 
+  // Moving the isocenter and the explicit IEC update below result in one transform update per beam
+  planNode->StartBeamsModify();
+
   // Set target segment ID
   planNode->DisableModifiedEventOn();
   planNode->SetTargetSegmentID(segment.toLatin1().constData());
@@ -662,7 +669,6 @@ void qSlicerExternalBeamPlanningModuleWidget::targetSegmentChanged(const QString
   if (planNode->GetIsocenterSpecification() == vtkMRMLRTPlanNode::CenterOfTarget)
   {
     planNode->SetIsocenterToTargetCenter();
-    this->centerViewToIsocenterClicked();
   }
 
   // Trigger update of IEC logic based on the first beam
@@ -671,9 +677,16 @@ void qSlicerExternalBeamPlanningModuleWidget::targetSegmentChanged(const QString
     vtkMRMLRTBeamNode* firstBeamNode = planNode->GetBeamByNumber(1);
     if (firstBeamNode)
     {
-      firstBeamNode->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
+      firstBeamNode->InvokeBeamTransformModifiedEvent();
     }
   }
+
+  planNode->EndBeamsModify();
+
+  if (planNode->GetIsocenterSpecification() == vtkMRMLRTPlanNode::CenterOfTarget)
+  {
+    this->centerViewToIsocenterClicked();
+  }
 }
 
 //-----------------------------------------------------------------------------
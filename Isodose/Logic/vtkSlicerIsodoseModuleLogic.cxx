@@ -30,6 +30,8 @@
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
+#include "vtkImageStatisticsCache.h"
+#include "vtkSlicerRtTracer.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -404,6 +406,8 @@ void vtkSlicerIsodoseModuleLogic::SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* p
 //---------------------------------------------------------------------------
 void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("Isodose", "CreateIsodoseSurfaces");
+
   if (!this->GetMRMLScene() || !parameterNode)
   {
     vtkErrorMacro("CreateIsodoseSurfaces: Invalid scene or parameter set node!");
@@ -519,7 +523,10 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   reslice->SetOutputSpacing(1, 1, 1);
   reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
   reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
+  {
+    SLICERRT_TRACE_SCOPE("Isodose", "Reslice dose");
+    reslice->Update();
+  }
   vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
 
   // Report progress
@@ -527,6 +534,10 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   double progress = (double)(currentStep) / (double)stepCount;
   this->InvokeEvent(SlicerRtCommon::ProgressUpdated, (void*)&progress);
 
+  // Dose range is used to skip the levels above the maximum dose that would produce no surface
+  double doseRange[2] = {0.0, 0.0};
+  bool doseRangeValid = vtkImageStatisticsCache::GetInstance()->GetScalarRange(doseVolumeNode->GetImageData(), doseRange);
+
   // Create isodose surfaces
   for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
@@ -535,6 +546,16 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     double isoLevel = vtkVariant(strIsoLevel).ToDouble();
     colorTableNode->GetColor(i, val);
 
+    if (doseRangeValid && isoLevel > doseRange[1])
+    {
+      ++currentStep;
+      progress = (double)(currentStep) / (double)stepCount;
+      this->InvokeEvent(SlicerRtCommon::ProgressUpdated, (void*)&progress);
+      continue;
+    }
+
+    SLICERRT_TRACE_SCOPE_DETAIL("Isodose", "Isodose level", strIsoLevel);
+
     vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
     marchingCubes->SetInputData(reslicedDoseVolumeImage);
     marchingCubes->SetNumberOfContours(1); 
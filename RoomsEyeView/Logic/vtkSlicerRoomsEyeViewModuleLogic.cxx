@@ -47,6 +47,7 @@
 #include <vtkSmartPointer.h>
 #include <vtkObjectFactory.h>
 #include <vtkTransform.h>
+#include <vtkMatrix4x4.h>
 #include <vtkAppendPolyData.h>
 #include <vtkPolyDataReader.h>
 #include <vtksys/SystemTools.hxx>
@@ -1182,50 +1183,30 @@ std::string vtkSlicerRoomsEyeViewModuleLogic::CheckForCollisions(vtkMRMLRoomsEye
 
   std::string statusString = "";
 
-  // Get transforms used in the collision detection filters
-  vtkMRMLLinearTransformNode* gantryToFixedReferenceTransformNode =
-    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::FixedReference);
-  vtkMRMLLinearTransformNode* patientSupportToPatientSupportRotationTransformNode =
-    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::PatientSupport, vtkSlicerIECTransformLogic::PatientSupportRotation);
-  vtkMRMLLinearTransformNode* collimatorToGantryTransformNode =
-    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry);
-  vtkMRMLLinearTransformNode* tableTopToTableTopEccentricRotationTransformNode =
-    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::TableTopEccentricRotation);
-
-  if ( !gantryToFixedReferenceTransformNode || !patientSupportToPatientSupportRotationTransformNode
-    || !collimatorToGantryTransformNode || !tableTopToTableTopEccentricRotationTransformNode )
+  // Get transforms used in the collision detection filters.
+  // The IEC logic caches the composed matrices, so only the ones affected by the last motion are recomputed
+  vtkSmartPointer<vtkMatrix4x4> gantryToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> patientSupportToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> collimatorToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> tableTopToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if ( !this->IECLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::RAS, gantryToRasMatrix)
+    || !this->IECLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::PatientSupport, vtkSlicerIECTransformLogic::RAS, patientSupportToRasMatrix)
+    || !this->IECLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::RAS, collimatorToRasMatrix)
+    || !this->IECLogic->GetMatrixBetween(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::RAS, tableTopToRasMatrix) )
   {
     statusString = "Failed to access IEC transforms";
     vtkErrorMacro("CheckForCollisions: " + statusString);
     return statusString;
   }
 
-  // Get transforms to world, make sure they are linear
-  vtkSmartPointer<vtkGeneralTransform> gantryToRasGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  gantryToFixedReferenceTransformNode->GetTransformToWorld(gantryToRasGeneralTransform);
   vtkSmartPointer<vtkTransform> gantryToRasTransform = vtkSmartPointer<vtkTransform>::New();
-
-  vtkSmartPointer<vtkGeneralTransform> patientSupportToRasGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  patientSupportToPatientSupportRotationTransformNode->GetTransformToWorld(patientSupportToRasGeneralTransform);
+  gantryToRasTransform->SetMatrix(gantryToRasMatrix);
   vtkSmartPointer<vtkTransform> patientSupportToRasTransform = vtkSmartPointer<vtkTransform>::New();
-
-  vtkSmartPointer<vtkGeneralTransform> collimatorToRasGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  collimatorToGantryTransformNode->GetTransformToWorld(collimatorToRasGeneralTransform);
+  patientSupportToRasTransform->SetMatrix(patientSupportToRasMatrix);
   vtkSmartPointer<vtkTransform> collimatorToRasTransform = vtkSmartPointer<vtkTransform>::New();
-
-  vtkSmartPointer<vtkGeneralTransform> tableTopToRasGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  tableTopToTableTopEccentricRotationTransformNode->GetTransformToWorld(tableTopToRasGeneralTransform);
+  collimatorToRasTransform->SetMatrix(collimatorToRasMatrix);
   vtkSmartPointer<vtkTransform> tableTopToRasTransform = vtkSmartPointer<vtkTransform>::New();
-
-  if ( !vtkMRMLTransformNode::IsGeneralTransformLinear(gantryToRasGeneralTransform, gantryToRasTransform)
-    || !vtkMRMLTransformNode::IsGeneralTransformLinear(patientSupportToRasGeneralTransform, patientSupportToRasTransform)
-    || !vtkMRMLTransformNode::IsGeneralTransformLinear(collimatorToRasGeneralTransform, collimatorToRasTransform)
-    || !vtkMRMLTransformNode::IsGeneralTransformLinear(tableTopToRasGeneralTransform, tableTopToRasTransform) )
-  {
-    statusString = "Non-linear transform detected";
-    vtkErrorMacro("CheckForCollisions: " + statusString);
-    return statusString;
-  }
+  tableTopToRasTransform->SetMatrix(tableTopToRasMatrix);
 
   // If number of contacts between pieces of treatment room is greater than 0, the collision between which pieces
   // will be set to the output string and returned by the function.
@@ -32,6 +32,7 @@
 // SlicerRT includes
 #include "PlmCommon.h"
 #include "SlicerRtCommon.h"
+#include "vtkSlicerRtTracer.h"
 
 // Plastimatch includes
 #include "dice_statistics.h"
@@ -102,6 +103,8 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   Plm_image::Pointer& plmCmpSegmentLabelmap,
   double &checkpointItkConvertStart )
 {
+  SLICERRT_TRACE_SCOPE("SegmentComparison", "Get input labelmaps");
+
   if (!parameterNode || !this->Logic->GetMRMLScene())
   {
     std::string errorMessage("Invalid MRML scene or parameter set node");
@@ -280,6 +283,8 @@ void vtkSlicerSegmentComparisonModuleLogic::OnMRMLSceneEndClose()
 //---------------------------------------------------------------------------
 std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRMLSegmentComparisonNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("SegmentComparison", "ComputeDiceStatistics");
+
   parameterNode->DiceResultsValidOff();
 
   if (!parameterNode || !this->GetMRMLScene())
@@ -318,7 +323,10 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
   dice.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
   dice.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
 
-  dice.run();
+  {
+    SLICERRT_TRACE_SCOPE("SegmentComparison", "Dice");
+    dice.run();
+  }
 
   unsigned long numberOfVoxels = dice.get_true_positives() 
     + dice.get_true_negatives() + dice.get_false_positives()
@@ -424,6 +432,8 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
 //---------------------------------------------------------------------------
 std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtkMRMLSegmentComparisonNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("SegmentComparison", "ComputeHausdorffDistances");
+
   parameterNode->HausdorffResultsValidOff();
 
   if (!parameterNode || !this->GetMRMLScene())
@@ -462,7 +472,10 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
   hausdorff.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
   hausdorff.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
   hausdorff.set_volume_boundary_behavior(ZERO_PADDING);
-  hausdorff.run();
+  {
+    SLICERRT_TRACE_SCOPE("SegmentComparison", "Hausdorff");
+    hausdorff.run();
+  }
 
   double maximumHausdorffDistanceForBoundaryMm = hausdorff.get_boundary_hausdorff();
   double averageHausdorffDistanceForBoundaryMm = hausdorff.get_avg_average_boundary_hausdorff();
@@ -0,0 +1,297 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkLabelmapDistanceTransform.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Set distance to zero for feature voxels and to VTK_FLOAT_MAX for the others, for a range of slices
+  template<typename T> class InitializeDistanceFunctor
+  {
+  public:
+    InitializeDistanceFunctor(const T* labelmap, float* distance, vtkIdType sliceSize, bool featureIsForeground)
+      : Labelmap(labelmap), Distance(distance), SliceSize(sliceSize), FeatureIsForeground(featureIsForeground)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const T* labelmapPtr = this->Labelmap + beginSlice*this->SliceSize;
+      float* distancePtr = this->Distance + beginSlice*this->SliceSize;
+      vtkIdType numberOfVoxels = (endSlice-beginSlice) * this->SliceSize;
+      float foregroundDistance = (this->FeatureIsForeground ? 0.0f : VTK_FLOAT_MAX);
+      float backgroundDistance = (this->FeatureIsForeground ? VTK_FLOAT_MAX : 0.0f);
+      for (vtkIdType i=0; i<numberOfVoxels; ++i)
+      {
+        distancePtr[i] = (labelmapPtr[i] != 0 ? foregroundDistance : backgroundDistance);
+      }
+    }
+
+  private:
+    const T* Labelmap;
+    float* Distance;
+    vtkIdType SliceSize;
+    bool FeatureIsForeground;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T> void InitializeDistance(const T* labelmap, float* distance, const int dims[3], bool featureIsForeground)
+  {
+    InitializeDistanceFunctor<T> functor(labelmap, distance, (vtkIdType)dims[0]*dims[1], featureIsForeground);
+    vtkSMPTools::For(0, dims[2], functor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// One-dimensional squared distance transform along the image lines of one axis.
+  /// Computes d(q) = min_p ( w^2 (q-p)^2 + f(p) ) as the lower envelope of parabolas rooted at the
+  /// finite input values, which is exact and linear in the line length
+  class LineDistanceFunctor
+  {
+  public:
+    LineDistanceFunctor(float* distance, const int dims[3], int axis, double weight, bool borderIsFeature)
+      : Distance(distance), Axis(axis), SquaredWeight(weight*weight), BorderIsFeature(borderIsFeature)
+    {
+      for (int i=0; i<3; ++i)
+      {
+        this->Dimensions[i] = dims[i];
+      }
+      this->Increments[0] = 1;
+      this->Increments[1] = dims[0];
+      this->Increments[2] = (vtkIdType)dims[0] * dims[1];
+      // The two other axes enumerate the lines
+      this->LineAxes[0] = (axis == 0 ? 1 : 0);
+      this->LineAxes[1] = (axis == 2 ? 1 : 2);
+    }
+
+    vtkIdType GetNumberOfLines()
+    {
+      return (vtkIdType)this->Dimensions[this->LineAxes[0]] * this->Dimensions[this->LineAxes[1]];
+    }
+
+    void operator()(vtkIdType beginLine, vtkIdType endLine)
+    {
+      int length = this->Dimensions[this->Axis];
+      vtkIdType increment = this->Increments[this->Axis];
+      std::vector<double> values(length, 0.0);
+      std::vector<double> result(length, 0.0);
+      std::vector<int> sitePositions(length+2, 0);
+      std::vector<double> siteValues(length+2, 0.0);
+      std::vector<double> boundaries(length+3, 0.0);
+
+      for (vtkIdType line=beginLine; line<endLine; ++line)
+      {
+        vtkIdType first = this->Dimensions[this->LineAxes[0]];
+        vtkIdType offset = (line % first) * this->Increments[this->LineAxes[0]]
+          + (line / first) * this->Increments[this->LineAxes[1]];
+        float* linePtr = this->Distance + offset;
+        for (int q=0; q<length; ++q)
+        {
+          values[q] = linePtr[q*increment];
+        }
+
+        this->LowerEnvelope(&values[0], length, &sitePositions[0], &siteValues[0], &boundaries[0], &result[0]);
+
+        for (int q=0; q<length; ++q)
+        {
+          linePtr[q*increment] = (float)std::min(result[q], (double)VTK_FLOAT_MAX);
+        }
+      }
+    }
+
+  private:
+    void LowerEnvelope(const double* f, int n, int* v, double* fv, double* z, double* d)
+    {
+      const double infinity = std::numeric_limits<double>::infinity();
+      const double w2 = this->SquaredWeight;
+
+      // Add parabolas in increasing order of their roots. Virtual feature voxels just outside the line
+      // are added if the border is feature
+      int k = -1;
+      int firstSite = (this->BorderIsFeature ? -1 : 0);
+      int lastSite = (this->BorderIsFeature ? n : n-1);
+      for (int q=firstSite; q<=lastSite; ++q)
+      {
+        double fq = ((q < 0 || q >= n) ? 0.0 : f[q]);
+        if (fq >= VTK_FLOAT_MAX)
+        {
+          continue;
+        }
+        if (k < 0)
+        {
+          k = 0;
+          v[0] = q;
+          fv[0] = fq;
+          z[0] = -infinity;
+          z[1] = infinity;
+          continue;
+        }
+
+        // Remove parabolas hidden by the new one (never the first one, as its boundary is -infinity)
+        double s = 0.0;
+        while (true)
+        {
+          s = ((fq + w2*q*q) - (fv[k] + w2*v[k]*v[k])) / (2.0*w2*(q-v[k]));
+          if (s > z[k])
+          {
+            break;
+          }
+          --k;
+        }
+        ++k;
+        v[k] = q;
+        fv[k] = fq;
+        z[k] = s;
+        z[k+1] = infinity;
+      }
+
+      if (k < 0)
+      {
+        // No feature voxel reachable along the line
+        std::fill(d, d+n, (double)VTK_FLOAT_MAX);
+        return;
+      }
+
+      k = 0;
+      for (int q=0; q<n; ++q)
+      {
+        while (z[k+1] < q)
+        {
+          ++k;
+        }
+        double displacement = q - v[k];
+        d[q] = w2*displacement*displacement + fv[k];
+      }
+    }
+
+  private:
+    float* Distance;
+    int Dimensions[3];
+    vtkIdType Increments[3];
+    int Axis;
+    int LineAxes[2];
+    double SquaredWeight;
+    bool BorderIsFeature;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapDistanceTransform);
+
+//----------------------------------------------------------------------------
+vtkCxxSetObjectMacro(vtkLabelmapDistanceTransform, InputLabelmap, vtkImageData);
+
+//----------------------------------------------------------------------------
+vtkLabelmapDistanceTransform::vtkLabelmapDistanceTransform()
+{
+  this->InputLabelmap = NULL;
+  this->Output = vtkImageData::New();
+
+  this->Radii[0] = 1.0;
+  this->Radii[1] = 1.0;
+  this->Radii[2] = 1.0;
+  this->DistanceToForeground = true;
+  this->BackgroundOutsideExtent = false;
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapDistanceTransform::~vtkLabelmapDistanceTransform()
+{
+  this->SetInputLabelmap(NULL);
+  if (this->Output)
+  {
+    this->Output->Delete();
+    this->Output = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapDistanceTransform::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Radii: " << this->Radii[0] << " " << this->Radii[1] << " " << this->Radii[2] << "\n";
+  os << indent << "DistanceToForeground: " << (this->DistanceToForeground ? "true" : "false") << "\n";
+  os << indent << "BackgroundOutsideExtent: " << (this->BackgroundOutsideExtent ? "true" : "false") << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLabelmapDistanceTransform::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapDistanceTransform::Update()
+{
+  if (!this->InputLabelmap || !this->InputLabelmap->GetPointData() || !this->InputLabelmap->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Invalid input labelmap");
+    return;
+  }
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  this->InputLabelmap->GetExtent(extent);
+  int dims[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+  this->Output->Initialize();
+  this->Output->SetExtent(extent);
+  this->Output->SetSpacing(this->InputLabelmap->GetSpacing());
+  this->Output->SetOrigin(this->InputLabelmap->GetOrigin());
+  if (dims[0] <= 0 || dims[1] <= 0 || dims[2] <= 0)
+  {
+    return;
+  }
+  this->Output->AllocateScalars(VTK_FLOAT, 1);
+  float* distance = static_cast<float*>(this->Output->GetScalarPointer());
+
+  // Feature voxels get zero distance
+  switch (this->InputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(InitializeDistance<VTK_TT>(
+      static_cast<VTK_TT*>(this->InputLabelmap->GetScalarPointer()), distance, dims, this->DistanceToForeground ));
+  default:
+    vtkErrorMacro("Update: Unsupported labelmap scalar type " << this->InputLabelmap->GetScalarTypeAsString());
+    return;
+  }
+
+  // Separable passes along the three axes. Distances are normalized by the radius along each axis
+  bool borderIsFeature = (!this->DistanceToForeground && this->BackgroundOutsideExtent);
+  double spacing[3] = { 1.0, 1.0, 1.0 };
+  this->InputLabelmap->GetSpacing(spacing);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (this->Radii[axis] <= 0.0)
+    {
+      // Infinite weight: only zero displacement is allowed along the axis, which leaves the distances unchanged
+      continue;
+    }
+    LineDistanceFunctor lineFunctor(distance, dims, axis, spacing[axis] / this->Radii[axis], borderIsFeature);
+    vtkSMPTools::For(0, lineFunctor.GetNumberOfLines(), lineFunctor);
+  }
+}
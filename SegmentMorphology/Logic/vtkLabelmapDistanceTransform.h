@@ -0,0 +1,94 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkLabelmapDistanceTransform - Exact Euclidean distance transform of a binary labelmap
+// .SECTION Description
+// Computes for each voxel the squared Euclidean distance to the nearest foreground (or background)
+// voxel using the separable lower envelope of parabolas algorithm (Felzenszwalb and Huttenlocher).
+// The distance is computed in three one-dimensional passes, each processing the image lines along one
+// axis in parallel, so the cost is linear in the number of voxels and independent of the distance range.
+//
+// Distances are normalized per axis by the given radii, so that thresholding the output at one selects
+// the voxels within an ellipsoid of the given radii around the feature voxels. This allows anisotropic
+// margins to be computed with a single transform.
+
+#ifndef __vtkLabelmapDistanceTransform_h
+#define __vtkLabelmapDistanceTransform_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerSegmentMorphologyModuleLogicExport.h"
+
+class vtkImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentMorphology
+class VTK_SLICER_SEGMENTMORPHOLOGY_MODULE_LOGIC_EXPORT vtkLabelmapDistanceTransform : public vtkObject
+{
+public:
+  static vtkLabelmapDistanceTransform *New();
+  vtkTypeMacro(vtkLabelmapDistanceTransform, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Compute the distance transform
+  virtual void Update();
+
+  /// Get output squared normalized distance image (float) with the extent of the input labelmap.
+  /// Voxels with no feature voxel reachable get VTK_FLOAT_MAX
+  virtual vtkImageData* GetOutput();
+
+  /// Set input binary labelmap. Non-zero voxels are foreground.
+  /// Spacing of the image is used to compute physical distances
+  void SetInputLabelmap(vtkImageData* labelmap);
+  vtkGetObjectMacro(InputLabelmap, vtkImageData);
+
+  /// Radii along the image axes (in the units of the image spacing) by which the distances are normalized.
+  /// Along an axis with non-positive radius only voxels in the same position are considered within distance.
+  /// (1,1,1) by default, in which case the output is the squared physical distance
+  vtkGetVector3Macro(Radii, double);
+  vtkSetVector3Macro(Radii, double);
+
+  /// If on (default), distance to the nearest foreground voxel is computed (zero inside the foreground).
+  /// If off, distance to the nearest background voxel is computed (zero outside the foreground)
+  vtkGetMacro(DistanceToForeground, bool);
+  vtkSetMacro(DistanceToForeground, bool);
+  vtkBooleanMacro(DistanceToForeground, bool);
+
+  /// If on, the voxels just outside the extent of the labelmap are considered background. Only has effect
+  /// when computing distance to background. Off by default, so that structures touching the boundary of the
+  /// labelmap extent are not shrunk from the boundary (same as eroding with vtkImageErode3D)
+  vtkGetMacro(BackgroundOutsideExtent, bool);
+  vtkSetMacro(BackgroundOutsideExtent, bool);
+  vtkBooleanMacro(BackgroundOutsideExtent, bool);
+
+protected:
+  vtkImageData* InputLabelmap;
+  vtkImageData* Output;
+
+  double Radii[3];
+  bool DistanceToForeground;
+  bool BackgroundOutsideExtent;
+
+protected:
+  vtkLabelmapDistanceTransform();
+  virtual ~vtkLabelmapDistanceTransform();
+
+private:
+  vtkLabelmapDistanceTransform(const vtkLabelmapDistanceTransform&); // Not implemented
+  void operator=(const vtkLabelmapDistanceTransform&);              // Not implemented
+};
+
+#endif
@@ -33,11 +33,14 @@
 
 // STD includes
 #include <sstream>
+#include <cstdlib>
 
 //------------------------------------------------------------------------------
 static const char* SEGMENTATION_A_REFERENCE_ROLE = "segmentationARef";
 static const char* SEGMENTATION_B_REFERENCE_ROLE = "segmentationBRef";
 static const char* OUTPUT_SEGMENTATION_REFERENCE_ROLE = "outputSegmentationRef";
+static const char* BATCH_OPERATION_ATTRIBUTE_PREFIX = "BatchOperation";
+static const char BATCH_OPERATION_SEPARATOR = '|';
 
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLSegmentMorphologyNode);
@@ -76,6 +79,21 @@ void vtkMRMLSegmentMorphologyNode::WriteXML(ostream& of, int nIndent)
   of << " XSize=\"" << (this->XSize) << "\"";
   of << " YSize=\"" << (this->YSize) << "\"";
   of << " ZSize=\"" << (this->ZSize) << "\"";
+
+  // Batch operations as fields separated by '|'
+  for (unsigned int index=0; index<this->BatchOperations.size(); ++index)
+  {
+    const BatchOperation& batchOperation = this->BatchOperations[index];
+    of << " " << BATCH_OPERATION_ATTRIBUTE_PREFIX << index << "=\""
+      << batchOperation.Operation << BATCH_OPERATION_SEPARATOR
+      << batchOperation.ResultName << BATCH_OPERATION_SEPARATOR
+      << batchOperation.OperandA << BATCH_OPERATION_SEPARATOR
+      << batchOperation.OperandB << BATCH_OPERATION_SEPARATOR
+      << batchOperation.Size[0] << BATCH_OPERATION_SEPARATOR
+      << batchOperation.Size[1] << BATCH_OPERATION_SEPARATOR
+      << batchOperation.Size[2] << BATCH_OPERATION_SEPARATOR
+      << (batchOperation.Output ? 1 : 0) << "\"";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -87,6 +105,7 @@ void vtkMRMLSegmentMorphologyNode::ReadXMLAttributes(const char** atts)
   const char* attName = NULL;
   const char* attValue = NULL;
 
+  this->BatchOperations.clear();
   while (*atts != NULL) 
     {
     attName = *(atts++);
@@ -116,6 +135,36 @@ void vtkMRMLSegmentMorphologyNode::ReadXMLAttributes(const char** atts)
       {
       this->ZSize = vtkVariant(attValue).ToDouble();
       }
+    else if (!strncmp(attName, BATCH_OPERATION_ATTRIBUTE_PREFIX, strlen(BATCH_OPERATION_ATTRIBUTE_PREFIX)))
+      {
+      unsigned int index = (unsigned int)atoi(attName + strlen(BATCH_OPERATION_ATTRIBUTE_PREFIX));
+      std::vector<std::string> fields;
+      std::stringstream ss(attValue);
+      std::string field;
+      while (std::getline(ss, field, BATCH_OPERATION_SEPARATOR))
+        {
+        fields.push_back(field);
+        }
+      if (fields.size() < 8)
+        {
+        vtkErrorMacro("ReadXMLAttributes: Invalid batch operation " << attValue);
+        continue;
+        }
+      BatchOperation batchOperation;
+      batchOperation.Operation = vtkVariant(fields[0]).ToInt();
+      batchOperation.ResultName = fields[1];
+      batchOperation.OperandA = fields[2];
+      batchOperation.OperandB = fields[3];
+      batchOperation.Size[0] = vtkVariant(fields[4]).ToDouble();
+      batchOperation.Size[1] = vtkVariant(fields[5]).ToDouble();
+      batchOperation.Size[2] = vtkVariant(fields[6]).ToDouble();
+      batchOperation.Output = (vtkVariant(fields[7]).ToInt() != 0);
+      if (this->BatchOperations.size() <= index)
+        {
+        this->BatchOperations.resize(index+1);
+        }
+      this->BatchOperations[index] = batchOperation;
+      }
     }
 }
 
@@ -135,6 +184,7 @@ void vtkMRMLSegmentMorphologyNode::Copy(vtkMRMLNode *anode)
   this->XSize = node->XSize;
   this->YSize = node->YSize;
   this->ZSize = node->ZSize;
+  this->BatchOperations = node->BatchOperations;
 
   this->DisableModifiedEventOff();
   this->InvokePendingModifiedEvent();
@@ -152,6 +202,15 @@ void vtkMRMLSegmentMorphologyNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << " XSize:   " << (this->XSize) << "\n";
   os << indent << " YSize:   " << (this->YSize) << "\n";
   os << indent << " ZSize:   " << (this->ZSize) << "\n";
+  os << indent << " BatchOperations:   " << this->BatchOperations.size() << "\n";
+  for (unsigned int index=0; index<this->BatchOperations.size(); ++index)
+  {
+    const BatchOperation& batchOperation = this->BatchOperations[index];
+    os << indent << "  " << batchOperation.ResultName << " = " << batchOperation.Operation
+      << "(" << batchOperation.OperandA << ", " << batchOperation.OperandB << "; "
+      << batchOperation.Size[0] << ", " << batchOperation.Size[1] << ", " << batchOperation.Size[2] << ")"
+      << (batchOperation.Output ? " -> output" : "") << "\n";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -216,3 +275,49 @@ void vtkMRMLSegmentMorphologyNode::SetOperation(int operation)
     this->Operation = operation;
   }
 }
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentMorphologyNode::AddBatchOperation(int operation, const char* resultName, const char* operandA,
+  const char* operandB/*=NULL*/, double xSize/*=0.0*/, double ySize/*=0.0*/, double zSize/*=0.0*/, bool output/*=true*/)
+{
+  BatchOperation batchOperation;
+  batchOperation.Operation = operation;
+  batchOperation.ResultName = (resultName ? resultName : "");
+  batchOperation.OperandA = (operandA ? operandA : "");
+  batchOperation.OperandB = (operandB ? operandB : "");
+  batchOperation.Size[0] = xSize;
+  batchOperation.Size[1] = ySize;
+  batchOperation.Size[2] = zSize;
+  batchOperation.Output = output;
+  this->BatchOperations.push_back(batchOperation);
+
+  this->Modified();
+  return (int)this->BatchOperations.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLSegmentMorphologyNode::RemoveAllBatchOperations()
+{
+  if (this->BatchOperations.empty())
+  {
+    return;
+  }
+  this->BatchOperations.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentMorphologyNode::GetNumberOfBatchOperations()
+{
+  return (int)this->BatchOperations.size();
+}
+
+//----------------------------------------------------------------------------
+const vtkMRMLSegmentMorphologyNode::BatchOperation* vtkMRMLSegmentMorphologyNode::GetBatchOperation(int index)
+{
+  if (index < 0 || index >= (int)this->BatchOperations.size())
+  {
+    return NULL;
+  }
+  return &this->BatchOperations[index];
+}
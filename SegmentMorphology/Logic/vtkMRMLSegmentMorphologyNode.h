@@ -28,6 +28,10 @@
 
 #include "vtkSlicerSegmentMorphologyModuleLogicExport.h"
 
+// STD includes
+#include <string>
+#include <vector>
+
 class vtkMRMLSegmentationNode;
 
 /// \ingroup SlicerRt_QtModules_SegmentMorphology
@@ -44,6 +48,27 @@ public:
     Subtract
   };
 
+  /// Operation in a batch of morphology operations (see \sa AddBatchOperation)
+  struct BatchOperation
+  {
+    BatchOperation() : Operation(None), Output(false)
+    {
+      this->Size[0] = this->Size[1] = this->Size[2] = 0.0;
+    }
+    /// Operation type (\sa SegmentMorphologyOperationType)
+    int Operation;
+    /// Name of the result. Must be unique in the batch
+    std::string ResultName;
+    /// First operand: segment ID in segmentation A or result name of an earlier operation
+    std::string OperandA;
+    /// Second operand for Union, Intersect, and Subtract
+    std::string OperandB;
+    /// Margin sizes along the X, Y, Z axes for Expand and Shrink
+    double Size[3];
+    /// Flag determining whether the result is added to the output segmentation
+    bool Output;
+  };
+
 public:
   static vtkMRMLSegmentMorphologyNode *New();
   vtkTypeMacro(vtkMRMLSegmentMorphologyNode, vtkMRMLNode);
@@ -106,6 +131,24 @@ public:
   vtkGetMacro(ZSize, double);
   vtkSetMacro(ZSize, double);
 
+  /// Add operation to the batch evaluated by \sa vtkSlicerSegmentMorphologyModuleLogic::ApplyBatchOperations.
+  /// Operands are IDs of segments in segmentation A or result names of earlier operations, so the batch
+  /// is an expression graph. For example a ring between 5 and 15 mm around PTV:
+  ///   AddBatchOperation(Expand, "PTV_15", "PTV", NULL, 15.0, 15.0, 15.0, false);
+  ///   AddBatchOperation(Expand, "PTV_5", "PTV", NULL, 5.0, 5.0, 5.0, false);
+  ///   AddBatchOperation(Subtract, "Ring", "PTV_15", "PTV_5");
+  /// Names must not contain the '|' character.
+  /// \param output If true, the result is added to the output segmentation as a segment with the result name
+  /// \return Index of the added operation
+  int AddBatchOperation(int operation, const char* resultName, const char* operandA, const char* operandB=NULL,
+    double xSize=0.0, double ySize=0.0, double zSize=0.0, bool output=true);
+  /// Remove all operations from the batch
+  void RemoveAllBatchOperations();
+  /// Get number of operations in the batch
+  int GetNumberOfBatchOperations();
+  /// Get operation of the batch by index. NULL if the index is out of range
+  const BatchOperation* GetBatchOperation(int index);
+
 protected:
   vtkMRMLSegmentMorphologyNode();
   ~vtkMRMLSegmentMorphologyNode();
@@ -130,6 +173,9 @@ protected:
 
   /// Dimension parameter for the Z axis (for Expand or Shrink)
   double ZSize;
+
+  /// Operations of the batch in evaluation order
+  std::vector<BatchOperation> BatchOperations;
 };
 
 #endif
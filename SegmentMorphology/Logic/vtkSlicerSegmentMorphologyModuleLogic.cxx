@@ -22,6 +22,7 @@
 // SegmentMorphology Logic includes
 #include "vtkSlicerSegmentMorphologyModuleLogic.h"
 #include "vtkMRMLSegmentMorphologyNode.h"
+#include "vtkLabelmapDistanceTransform.h"
 
 // Segmentation includes
 #include "vtkMRMLSegmentationNode.h"
@@ -31,6 +32,7 @@
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
+#include "vtkSlicerRtTracer.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
@@ -38,13 +40,383 @@
 // VTK includes
 #include <vtkGeneralTransform.h>
 #include <vtkImageAccumulate.h>
-#include <vtkImageContinuousDilate3D.h>
-#include <vtkImageContinuousErode3D.h>
-#include <vtkImageLogic.h>
+#include <vtkImageThreshold.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageConstantPad.h>
+#include <vtkImageCast.h>
+#include <vtkSMPTools.h>
+#include <vtkMatrix4x4.h>
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Compute the extent of the non-zero voxels in each slice of a labelmap.
+  /// Slices with no non-zero voxel get an empty (inverted) extent
+  template<typename T> class SliceEffectiveExtentFunctor
+  {
+  public:
+    SliceEffectiveExtentFunctor(const T* labelmap, const int dims[3], std::vector<int>& sliceExtents)
+      : Labelmap(labelmap), SliceExtents(sliceExtents)
+    {
+      for (int i=0; i<3; ++i)
+      {
+        this->Dimensions[i] = dims[i];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        int* sliceExtent = &this->SliceExtents[4*k];
+        sliceExtent[0] = this->Dimensions[0];
+        sliceExtent[1] = -1;
+        sliceExtent[2] = this->Dimensions[1];
+        sliceExtent[3] = -1;
+        const T* slicePtr = this->Labelmap + k*this->Dimensions[0]*(vtkIdType)this->Dimensions[1];
+        for (int j=0; j<this->Dimensions[1]; ++j)
+        {
+          const T* rowPtr = slicePtr + j*(vtkIdType)this->Dimensions[0];
+          int first = 0;
+          while (first < this->Dimensions[0] && rowPtr[first] == 0)
+          {
+            ++first;
+          }
+          if (first == this->Dimensions[0])
+          {
+            continue;
+          }
+          int last = this->Dimensions[0]-1;
+          while (rowPtr[last] == 0)
+          {
+            --last;
+          }
+          sliceExtent[0] = std::min(sliceExtent[0], first);
+          sliceExtent[1] = std::max(sliceExtent[1], last);
+          sliceExtent[2] = std::min(sliceExtent[2], j);
+          sliceExtent[3] = std::max(sliceExtent[3], j);
+        }
+      }
+    }
+
+  private:
+    const T* Labelmap;
+    int Dimensions[3];
+    std::vector<int>& SliceExtents;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Get extent of the non-zero voxels of a labelmap. Returns false if the labelmap is empty
+  template<typename T> bool CalculateEffectiveExtent(vtkImageData* labelmap, int effectiveExtent[6])
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    int dims[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+    if (dims[0] <= 0 || dims[1] <= 0 || dims[2] <= 0)
+    {
+      return false;
+    }
+
+    std::vector<int> sliceExtents(4*dims[2], 0);
+    SliceEffectiveExtentFunctor<T> functor(static_cast<T*>(labelmap->GetScalarPointer()), dims, sliceExtents);
+    vtkSMPTools::For(0, dims[2], functor);
+
+    bool empty = true;
+    for (int k=0; k<dims[2]; ++k)
+    {
+      const int* sliceExtent = &sliceExtents[4*k];
+      if (sliceExtent[1] < sliceExtent[0])
+      {
+        continue;
+      }
+      if (empty)
+      {
+        effectiveExtent[0] = sliceExtent[0];
+        effectiveExtent[1] = sliceExtent[1];
+        effectiveExtent[2] = sliceExtent[2];
+        effectiveExtent[3] = sliceExtent[3];
+        effectiveExtent[4] = effectiveExtent[5] = k;
+        empty = false;
+        continue;
+      }
+      effectiveExtent[0] = std::min(effectiveExtent[0], sliceExtent[0]);
+      effectiveExtent[1] = std::max(effectiveExtent[1], sliceExtent[1]);
+      effectiveExtent[2] = std::min(effectiveExtent[2], sliceExtent[2]);
+      effectiveExtent[3] = std::max(effectiveExtent[3], sliceExtent[3]);
+      effectiveExtent[5] = k;
+    }
+    if (empty)
+    {
+      return false;
+    }
+
+    // Convert from voxel indices to extent
+    for (int axis=0; axis<3; ++axis)
+    {
+      effectiveExtent[2*axis] += extent[2*axis];
+      effectiveExtent[2*axis+1] += extent[2*axis];
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Apply boolean operation on two labelmaps of the same scalar type within a processing extent,
+  /// and count the non-zero output voxels in each slice. Voxels outside the extent of an input are
+  /// considered zero. Output voxels get the value of A (or B in case of union outside A)
+  template<typename T> class BooleanOperationFunctor
+  {
+  public:
+    BooleanOperationFunctor(vtkImageData* imageA, vtkImageData* imageB, vtkImageData* output,
+      const int processingExtent[6], int operation, std::vector<vtkIdType>& sliceVoxelCounts)
+      : Operation(operation), SliceVoxelCounts(sliceVoxelCounts)
+    {
+      this->A = static_cast<T*>(imageA->GetScalarPointer());
+      this->B = static_cast<T*>(imageB->GetScalarPointer());
+      this->Output = static_cast<T*>(output->GetScalarPointer());
+      imageA->GetExtent(this->ExtentA);
+      imageB->GetExtent(this->ExtentB);
+      output->GetExtent(this->OutputExtent);
+      for (int i=0; i<6; ++i)
+      {
+        this->ProcessingExtent[i] = processingExtent[i];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      for (vtkIdType slice=beginSlice; slice<endSlice; ++slice)
+      {
+        int k = this->ProcessingExtent[4] + (int)slice;
+        vtkIdType count = 0;
+        for (int j=this->ProcessingExtent[2]; j<=this->ProcessingExtent[3]; ++j)
+        {
+          int rangeA[2] = { 0, -1 };
+          const T* rowA = this->GetRow(this->A, this->ExtentA, j, k, rangeA);
+          int rangeB[2] = { 0, -1 };
+          const T* rowB = this->GetRow(this->B, this->ExtentB, j, k, rangeB);
+          T* rowOutput = this->Output + this->GetOffset(this->OutputExtent, this->ProcessingExtent[0], j, k);
+          for (int i=this->ProcessingExtent[0]; i<=this->ProcessingExtent[1]; ++i)
+          {
+            T a = ((i >= rangeA[0] && i <= rangeA[1]) ? rowA[i] : 0);
+            T b = ((i >= rangeB[0] && i <= rangeB[1]) ? rowB[i] : 0);
+            T value = 0;
+            switch (this->Operation)
+            {
+            case vtkMRMLSegmentMorphologyNode::Union:
+              value = (a != 0 ? a : b);
+              break;
+            case vtkMRMLSegmentMorphologyNode::Intersect:
+              value = (b != 0 ? a : 0);
+              break;
+            case vtkMRMLSegmentMorphologyNode::Subtract:
+              value = (b != 0 ? 0 : a);
+              break;
+            }
+            *(rowOutput++) = value;
+            count += (value != 0);
+          }
+        }
+        this->SliceVoxelCounts[slice] = count;
+      }
+    }
+
+  private:
+    vtkIdType GetOffset(const int extent[6], int i, int j, int k)
+    {
+      return ( (vtkIdType)(k-extent[4]) * (extent[3]-extent[2]+1) + (j-extent[2]) ) * (extent[1]-extent[0]+1) + (i-extent[0]);
+    }
+
+    /// Get row of an input so that it can be indexed by the i coordinate, and the valid range of i
+    const T* GetRow(const T* image, const int extent[6], int j, int k, int range[2])
+    {
+      if (j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+      {
+        return NULL;
+      }
+      range[0] = extent[0];
+      range[1] = extent[1];
+      return image + this->GetOffset(extent, extent[0], j, k) - extent[0];
+    }
+
+  private:
+    const T* A;
+    const T* B;
+    T* Output;
+    int ExtentA[6];
+    int ExtentB[6];
+    int OutputExtent[6];
+    int ProcessingExtent[6];
+    int Operation;
+    std::vector<vtkIdType>& SliceVoxelCounts;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Apply boolean operation on two labelmaps of the same scalar type in one pass. Only the
+  /// bounding box of the non-zero voxels that can be non-zero in the result is processed,
+  /// the rest of the output (allocated by the caller) is zeroed.
+  /// \return Number of non-zero voxels in the result
+  template<typename T> vtkIdType ApplyBooleanOperation(vtkImageData* imageA, vtkImageData* imageB, int operation, vtkImageData* output)
+  {
+    memset(output->GetScalarPointer(), 0, output->GetNumberOfPoints() * output->GetScalarSize());
+
+    int effectiveExtentA[6] = {0,-1,0,-1,0,-1};
+    bool emptyA = !CalculateEffectiveExtent<T>(imageA, effectiveExtentA);
+    int effectiveExtentB[6] = {0,-1,0,-1,0,-1};
+    bool emptyB = !CalculateEffectiveExtent<T>(imageB, effectiveExtentB);
+
+    // Union needs the union of the bounding boxes, intersect their intersection, and subtract the bounding box of A
+    int processingExtent[6] = {0,-1,0,-1,0,-1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      int* range = processingExtent + 2*axis;
+      if (operation == vtkMRMLSegmentMorphologyNode::Union)
+      {
+        if (emptyA && emptyB)
+        {
+          return 0;
+        }
+        range[0] = (emptyA ? effectiveExtentB[2*axis] : emptyB ? effectiveExtentA[2*axis] : std::min(effectiveExtentA[2*axis], effectiveExtentB[2*axis]));
+        range[1] = (emptyA ? effectiveExtentB[2*axis+1] : emptyB ? effectiveExtentA[2*axis+1] : std::max(effectiveExtentA[2*axis+1], effectiveExtentB[2*axis+1]));
+      }
+      else if (operation == vtkMRMLSegmentMorphologyNode::Intersect)
+      {
+        if (emptyA || emptyB)
+        {
+          return 0;
+        }
+        range[0] = std::max(effectiveExtentA[2*axis], effectiveExtentB[2*axis]);
+        range[1] = std::min(effectiveExtentA[2*axis+1], effectiveExtentB[2*axis+1]);
+      }
+      else
+      {
+        if (emptyA)
+        {
+          return 0;
+        }
+        range[0] = effectiveExtentA[2*axis];
+        range[1] = effectiveExtentA[2*axis+1];
+      }
+      if (range[1] < range[0])
+      {
+        // Disjoint bounding boxes in case of intersection
+        return 0;
+      }
+    }
+
+    int numberOfSlices = processingExtent[5]-processingExtent[4]+1;
+    std::vector<vtkIdType> sliceVoxelCounts(numberOfSlices, 0);
+    BooleanOperationFunctor<T> functor(imageA, imageB, output, processingExtent, operation, sliceVoxelCounts);
+    vtkSMPTools::For(0, numberOfSlices, functor);
+
+    vtkIdType numberOfVoxels = 0;
+    for (int slice=0; slice<numberOfSlices; ++slice)
+    {
+      numberOfVoxels += sliceVoxelCounts[slice];
+    }
+    return numberOfVoxels;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Threshold squared normalized distance: voxels within (or, if inverted, beyond) the
+  /// maximum squared distance get one, the others zero
+  class ThresholdDistanceFunctor
+  {
+  public:
+    ThresholdDistanceFunctor(const float* distance, unsigned char* output, vtkIdType sliceSize, double maximumSquaredDistance, bool invert)
+      : Distance(distance), Output(output), SliceSize(sliceSize), MaximumSquaredDistance((float)maximumSquaredDistance), Invert(invert)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const float* distancePtr = this->Distance + beginSlice*this->SliceSize;
+      unsigned char* outputPtr = this->Output + beginSlice*this->SliceSize;
+      vtkIdType numberOfVoxels = (endSlice-beginSlice) * this->SliceSize;
+      unsigned char inValue = (this->Invert ? 0 : 1);
+      unsigned char outValue = (this->Invert ? 1 : 0);
+      for (vtkIdType i=0; i<numberOfVoxels; ++i)
+      {
+        outputPtr[i] = (distancePtr[i] <= this->MaximumSquaredDistance ? inValue : outValue);
+      }
+    }
+
+  private:
+    const float* Distance;
+    unsigned char* Output;
+    vtkIdType SliceSize;
+    float MaximumSquaredDistance;
+    bool Invert;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Operation of a batch prepared for evaluation. Inputs and output are allocated beforehand
+  /// so that evaluation does not touch shared state
+  struct PreparedBatchOperation
+  {
+    PreparedBatchOperation()
+      : Operation(vtkMRMLSegmentMorphologyNode::None)
+      , MaximumSquaredDistance(0.0)
+    {
+    }
+
+    int Operation;
+    /// Shared distance field of the operand for Expand and Shrink
+    vtkSmartPointer<vtkImageData> DistanceField;
+    double MaximumSquaredDistance;
+    /// Operands for Union, Intersect, and Subtract
+    vtkSmartPointer<vtkImageData> OperandA;
+    vtkSmartPointer<vtkImageData> OperandB;
+    vtkSmartPointer<vtkOrientedImageData> Result;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Evaluate independent operations of a batch in parallel
+  class EvaluateBatchOperationsFunctor
+  {
+  public:
+    EvaluateBatchOperationsFunctor(std::vector<PreparedBatchOperation>& operations)
+      : Operations(operations)
+    {
+    }
+
+    void operator()(vtkIdType beginOperation, vtkIdType endOperation)
+    {
+      for (vtkIdType index=beginOperation; index<endOperation; ++index)
+      {
+        SLICERRT_TRACE_SCOPE("SegmentMorphology", "Batch operation");
+        PreparedBatchOperation& operation = this->Operations[index];
+        if (operation.DistanceField)
+        {
+          int dims[3] = {0,0,0};
+          operation.Result->GetDimensions(dims);
+          ThresholdDistanceFunctor functor(
+            static_cast<float*>(operation.DistanceField->GetScalarPointer()),
+            static_cast<unsigned char*>(operation.Result->GetScalarPointer()),
+            (vtkIdType)dims[0]*dims[1], operation.MaximumSquaredDistance,
+            operation.Operation == vtkMRMLSegmentMorphologyNode::Shrink );
+          vtkSMPTools::For(0, dims[2], functor);
+        }
+        else
+        {
+          ApplyBooleanOperation<unsigned char>(operation.OperandA, operation.OperandB, operation.Operation, operation.Result);
+        }
+      }
+    }
+
+  private:
+    std::vector<PreparedBatchOperation>& Operations;
+  };
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerSegmentMorphologyModuleLogic);
@@ -168,6 +540,8 @@ void vtkSlicerSegmentMorphologyModuleLogic::OnMRMLSceneEndClose()
 //---------------------------------------------------------------------------
 std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkMRMLSegmentMorphologyNode* parameterNode)
 {
+  SLICERRT_TRACE_SCOPE("SegmentMorphology", "ApplyMorphologyOperation");
+
   if (!parameterNode)
   {
     vtkErrorMacro("ApplyMorphologyOperation: Invalid parameter node!");
@@ -231,24 +605,18 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
       vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(imageB, imageA, imageB, true);
     }
 
-    // Make sure the two volumes have the same extent (otherwise logic filter crashes)
-    int aExtent[6] = {0,-1,0,-1,0,-1};
-    imageA->GetExtent(aExtent);
-    int bExtent[6] = {0,-1,0,-1,0,-1};
-    imageB->GetExtent(bExtent);
-    int unionExtent[6] = { std::min(aExtent[0],bExtent[0]), std::max(aExtent[1],bExtent[1]), std::min(aExtent[2],bExtent[2]), std::max(aExtent[3],bExtent[3]), std::min(aExtent[4],bExtent[4]), std::max(aExtent[5],bExtent[5]) };
-
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(imageA);
-    padder->SetOutputWholeExtent(unionExtent);
-    padder->Update();
-    imageA->vtkImageData::DeepCopy(padder->GetOutput());
-    padder->SetInputData(imageB);
-    padder->Update();
-    imageB->vtkImageData::DeepCopy(padder->GetOutput());
+    // The boolean operation is applied on images of the same scalar type
+    if (imageB->GetScalarType() != imageA->GetScalarType())
+    {
+      vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
+      imageCast->SetInputData(imageB);
+      imageCast->SetOutputScalarType(imageA->GetScalarType());
+      imageCast->Update();
+      imageB->vtkImageData::ShallowCopy(imageCast->GetOutput());
+    }
   }
 
-  // Get kernel size
+  // Get margin sizes. Expand and shrink use an ellipsoidal margin with these radii
   double spacingA[3] = {0.0,0.0,0.0};
   imageA->GetSpacing(spacingA);
 
@@ -256,16 +624,18 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
   double ySize = parameterNode->GetYSize();
   double zSize = parameterNode->GetZSize();
 
-  int kernelSize[3] = {1,1,1};
-  kernelSize[0] = (int)( 2.0*(xSize/spacingA[0] + 0.5) );
-  kernelSize[1] = (int)( 2.0*(ySize/spacingA[1] + 0.5) );
-  kernelSize[2] = (int)( 2.0*(zSize/spacingA[2] + 0.5) );
+  // Value of the voxels in the result of expand and shrink
+  double valueMax = 0.0;
+  if (operation == vtkMRMLSegmentMorphologyNode::Expand || operation == vtkMRMLSegmentMorphologyNode::Shrink)
+  {
+    vtkSmartPointer<vtkImageAccumulate> histogram = vtkSmartPointer<vtkImageAccumulate>::New();
+    histogram->SetInputData(imageA);
+    histogram->Update();
+    valueMax = histogram->GetMax()[0];
+  }
 
   // Apply operation on image data
-  vtkSmartPointer<vtkImageAccumulate> histogram = vtkSmartPointer<vtkImageAccumulate>::New();
-  histogram->SetInputData(imageA);
-  histogram->Update();
-  double valueMax = histogram->GetMax()[0];
+  SLICERRT_TRACE_SCOPE("SegmentMorphology", "Operation");
 
   vtkSmartPointer<vtkImageData> tempOutputImageData = NULL;
   switch (operation) 
@@ -284,67 +654,76 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
     padder->SetOutputWholeExtent(extent[0]-expansionExtent[0], extent[1]+expansionExtent[0], extent[2]-expansionExtent[1], extent[3]+expansionExtent[1], extent[4]-expansionExtent[2], extent[5]+expansionExtent[2]);
     padder->Update();
 
-    vtkSmartPointer<vtkImageContinuousDilate3D> dilateFilter = vtkSmartPointer<vtkImageContinuousDilate3D>::New();
-    dilateFilter->SetInputConnection(padder->GetOutputPort());
-    dilateFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    dilateFilter->Update();
-    tempOutputImageData = dilateFilter->GetOutput();
+    // Voxels within the margin from the structure have normalized distance to the foreground at most one
+    vtkSmartPointer<vtkLabelmapDistanceTransform> distanceTransform = vtkSmartPointer<vtkLabelmapDistanceTransform>::New();
+    distanceTransform->SetInputLabelmap(padder->GetOutput());
+    distanceTransform->SetRadii(xSize, ySize, zSize);
+    distanceTransform->DistanceToForegroundOn();
+    distanceTransform->Update();
+
+    vtkSmartPointer<vtkImageThreshold> threshold = vtkSmartPointer<vtkImageThreshold>::New();
+    threshold->SetInputData(distanceTransform->GetOutput());
+    threshold->ThresholdByLower(1.0);
+    threshold->SetInValue(valueMax);
+    threshold->SetOutValue(0);
+    threshold->SetOutputScalarType(imageA->GetScalarType());
+    threshold->Update();
+    tempOutputImageData = threshold->GetOutput();
     break;
     }
 
   // Shrink
   case vtkMRMLSegmentMorphologyNode::Shrink:
     {
-    vtkSmartPointer<vtkImageContinuousErode3D> erodeFilter = vtkSmartPointer<vtkImageContinuousErode3D>::New();
-    erodeFilter->SetInputData(imageA);
-    erodeFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    erodeFilter->Update();
-    tempOutputImageData = erodeFilter->GetOutput();
+    // Voxels are kept if the normalized distance to the nearest background voxel is more than one
+    vtkSmartPointer<vtkLabelmapDistanceTransform> distanceTransform = vtkSmartPointer<vtkLabelmapDistanceTransform>::New();
+    distanceTransform->SetInputLabelmap(imageA);
+    distanceTransform->SetRadii(xSize, ySize, zSize);
+    distanceTransform->DistanceToForegroundOff();
+    distanceTransform->Update();
+
+    vtkSmartPointer<vtkImageThreshold> threshold = vtkSmartPointer<vtkImageThreshold>::New();
+    threshold->SetInputData(distanceTransform->GetOutput());
+    threshold->ThresholdByLower(1.0);
+    threshold->SetInValue(0);
+    threshold->SetOutValue(valueMax);
+    threshold->SetOutputScalarType(imageA->GetScalarType());
+    threshold->Update();
+    tempOutputImageData = threshold->GetOutput();
     break;
     }
 
-  // Union
+  // Union, Intersect, Subtract
   case vtkMRMLSegmentMorphologyNode::Union:
+  case vtkMRMLSegmentMorphologyNode::Intersect:
+  case vtkMRMLSegmentMorphologyNode::Subtract:
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageA);
-    logicFilter->SetInput2Data(imageB);
-    logicFilter->SetOperationToOr();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-    tempOutputImageData = logicFilter->GetOutput();
-    break;
-    }
+    // Output covers both inputs. Only the bounding box of the voxels that can be in the result is processed
+    int aExtent[6] = {0,-1,0,-1,0,-1};
+    imageA->GetExtent(aExtent);
+    int bExtent[6] = {0,-1,0,-1,0,-1};
+    imageB->GetExtent(bExtent);
+    int unionExtent[6] = { std::min(aExtent[0],bExtent[0]), std::max(aExtent[1],bExtent[1]), std::min(aExtent[2],bExtent[2]), std::max(aExtent[3],bExtent[3]), std::min(aExtent[4],bExtent[4]), std::max(aExtent[5],bExtent[5]) };
 
-  // Intersect
-  case vtkMRMLSegmentMorphologyNode::Intersect:
+    tempOutputImageData = vtkSmartPointer<vtkImageData>::New();
+    tempOutputImageData->SetExtent(unionExtent);
+    tempOutputImageData->AllocateScalars(imageA->GetScalarType(), 1);
+
+    vtkIdType numberOfVoxels = 0;
+    switch (imageA->GetScalarType())
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageA);
-    logicFilter->SetInput2Data(imageB);
-    logicFilter->SetOperationToAnd();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-    tempOutputImageData = logicFilter->GetOutput();
-    break;
+      vtkTemplateMacro(numberOfVoxels = ApplyBooleanOperation<VTK_TT>(imageA, imageB, operation, tempOutputImageData));
+    default:
+      {
+      std::string errorMessage("Unsupported labelmap scalar type");
+      vtkErrorMacro("ApplyMorphologyOperation: " << errorMessage);
+      return errorMessage;
+      }
     }
-
-  // Subtract
-  case vtkMRMLSegmentMorphologyNode::Subtract:
+    if (numberOfVoxels == 0)
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageB);
-    logicFilter->SetOperationToNot();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-
-    vtkSmartPointer<vtkImageLogic> logicFilter2 = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter2->SetInput1Data(imageA);
-    logicFilter2->SetInput2Data(logicFilter->GetOutput());
-    logicFilter2->SetOperationToAnd();
-    logicFilter2->SetOutputTrueValue(valueMax);
-    logicFilter2->Update();
-    tempOutputImageData = logicFilter2->GetOutput();
+      vtkDebugMacro("ApplyMorphologyOperation: Result of the operation is empty");
+    }
     break;
     }
   default:
@@ -386,6 +765,289 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyBatchOperations(vtkMRMLSegmentMorphologyNode* parameterNode)
+{
+  SLICERRT_TRACE_SCOPE("SegmentMorphology", "ApplyBatchOperations");
+
+  if (!parameterNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid parameter node");
+    vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLSegmentationNode* inputSegmentationNode = parameterNode->GetSegmentationANode();
+  if (!inputSegmentationNode)
+  {
+    std::string errorMessage("Segmentation A is not selected");
+    vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLSegmentationNode* outputSegmentationNode = parameterNode->GetOutputSegmentationNode();
+  if (!outputSegmentationNode)
+  {
+    std::string errorMessage("Output segmentation is not selected");
+    vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+    return errorMessage;
+  }
+  int numberOfOperations = parameterNode->GetNumberOfBatchOperations();
+  if (numberOfOperations == 0)
+  {
+    return "";
+  }
+
+  // Resolve operands: each is either the result of an earlier operation or a segment of segmentation A.
+  // The level of an operation is one more than the highest level of its operand results, so operations
+  // on the same level are independent of each other
+  std::map<std::string, int> resultIndices;
+  std::vector<int> operandResultIndices(2*numberOfOperations, -1);
+  std::vector<int> levels(numberOfOperations, 0);
+  std::vector<std::string> inputSegmentIDs;
+  int numberOfLevels = 0;
+  for (int index=0; index<numberOfOperations; ++index)
+  {
+    const vtkMRMLSegmentMorphologyNode::BatchOperation* batchOperation = parameterNode->GetBatchOperation(index);
+    int operation = batchOperation->Operation;
+    bool binaryOperation = ( operation == vtkMRMLSegmentMorphologyNode::Union
+      || operation == vtkMRMLSegmentMorphologyNode::Intersect
+      || operation == vtkMRMLSegmentMorphologyNode::Subtract );
+    if (!binaryOperation && operation != vtkMRMLSegmentMorphologyNode::Expand && operation != vtkMRMLSegmentMorphologyNode::Shrink)
+    {
+      std::string errorMessage("Invalid operation for result " + batchOperation->ResultName);
+      vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+      return errorMessage;
+    }
+    if (batchOperation->ResultName.empty() || resultIndices.find(batchOperation->ResultName) != resultIndices.end())
+    {
+      std::string errorMessage("Result names must be unique and non-empty: '" + batchOperation->ResultName + "'");
+      vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+      return errorMessage;
+    }
+
+    for (int operandIndex=0; operandIndex<(binaryOperation ? 2 : 1); ++operandIndex)
+    {
+      const std::string& operand = (operandIndex == 0 ? batchOperation->OperandA : batchOperation->OperandB);
+      std::map<std::string, int>::iterator resultIt = resultIndices.find(operand);
+      if (resultIt != resultIndices.end())
+      {
+        operandResultIndices[2*index+operandIndex] = resultIt->second;
+        levels[index] = std::max(levels[index], levels[resultIt->second]+1);
+      }
+      else if (inputSegmentationNode->GetSegmentation()->GetSegment(operand))
+      {
+        if (std::find(inputSegmentIDs.begin(), inputSegmentIDs.end(), operand) == inputSegmentIDs.end())
+        {
+          inputSegmentIDs.push_back(operand);
+        }
+      }
+      else
+      {
+        std::string errorMessage("Operand '" + operand + "' of " + batchOperation->ResultName
+          + " is neither a segment of segmentation A nor an earlier result");
+        vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+        return errorMessage;
+      }
+    }
+
+    resultIndices[batchOperation->ResultName] = index;
+    numberOfLevels = std::max(numberOfLevels, levels[index]+1);
+  }
+
+  // Extract each input labelmap once. They are brought to the geometry of the first input
+  // and to unsigned char type, so that they can be combined directly
+  std::map<std::string, vtkSmartPointer<vtkOrientedImageData> > inputImages;
+  vtkSmartPointer<vtkOrientedImageData> referenceImage;
+  for (std::vector<std::string>::iterator segmentIt = inputSegmentIDs.begin(); segmentIt != inputSegmentIDs.end(); ++segmentIt)
+  {
+    vtkSmartPointer<vtkOrientedImageData> image = vtkSmartPointer<vtkOrientedImageData>::New();
+    if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
+      inputSegmentationNode, segmentIt->c_str(), image ) )
+    {
+      std::string errorMessage("Failed to get binary labelmap from segment " + (*segmentIt));
+      vtkErrorMacro("ApplyBatchOperations: " << errorMessage);
+      return errorMessage;
+    }
+    if (!referenceImage)
+    {
+      referenceImage = image;
+    }
+    else if (!vtkOrientedImageDataResample::DoGeometriesMatch(referenceImage, image))
+    {
+      vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(image, referenceImage, image, true);
+    }
+    if (image->GetScalarType() != VTK_UNSIGNED_CHAR)
+    {
+      vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
+      imageCast->SetInputData(image);
+      imageCast->SetOutputScalarType(VTK_UNSIGNED_CHAR);
+      imageCast->Update();
+      image->vtkImageData::ShallowCopy(imageCast->GetOutput());
+    }
+    inputImages[*segmentIt] = image;
+  }
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceImage->GetImageToWorldMatrix(imageToWorldMatrix);
+  double spacing[3] = {1.0,1.0,1.0};
+  referenceImage->GetSpacing(spacing);
+
+  // Expand and Shrink operations with the same operand and margin shape share one distance field,
+  // and only threshold it at different distances. Fields for expansion are padded for the largest margin
+  std::vector<std::string> distanceFieldKeys(numberOfOperations);
+  std::vector<double> maximumSquaredDistances(numberOfOperations, 0.0);
+  std::map<std::string, std::vector<double> > distanceFieldRadii;
+  std::map<std::string, std::vector<int> > distanceFieldPaddings;
+  for (int index=0; index<numberOfOperations; ++index)
+  {
+    const vtkMRMLSegmentMorphologyNode::BatchOperation* batchOperation = parameterNode->GetBatchOperation(index);
+    bool expand = (batchOperation->Operation == vtkMRMLSegmentMorphologyNode::Expand);
+    if (!expand && batchOperation->Operation != vtkMRMLSegmentMorphologyNode::Shrink)
+    {
+      continue;
+    }
+    double maximumSize = std::max(batchOperation->Size[0], std::max(batchOperation->Size[1], batchOperation->Size[2]));
+    std::vector<double> radii(3, 0.0);
+    for (int axis=0; axis<3; ++axis)
+    {
+      radii[axis] = (maximumSize > 0.0 ? std::max(batchOperation->Size[axis], 0.0) / maximumSize : 0.0);
+    }
+    std::stringstream keyStream;
+    keyStream << (expand ? "Expand" : "Shrink") << "|" << batchOperation->OperandA << "|" << radii[0] << "|" << radii[1] << "|" << radii[2];
+    std::string key = keyStream.str();
+    distanceFieldKeys[index] = key;
+    maximumSquaredDistances[index] = (maximumSize > 0.0 ? maximumSize*maximumSize : 0.0);
+    distanceFieldRadii[key] = radii;
+
+    std::vector<int>& padding = distanceFieldPaddings[key];
+    padding.resize(3, 0);
+    for (int axis=0; axis<3 && expand; ++axis)
+    {
+      padding[axis] = std::max(padding[axis], int(std::max(batchOperation->Size[axis], 0.0)/spacing[axis] + 1.0)); // Rounding up
+    }
+  }
+
+  // Evaluate the operations level by level. Distance fields are computed (multi-threaded) and the results
+  // allocated before the independent operations of the level are evaluated in parallel
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > results(numberOfOperations);
+  std::map<std::string, vtkSmartPointer<vtkImageData> > distanceFields;
+  for (int level=0; level<numberOfLevels; ++level)
+  {
+    SLICERRT_TRACE_SCOPE("SegmentMorphology", "Batch level");
+    std::vector<PreparedBatchOperation> preparedOperations;
+    std::vector<int> preparedIndices;
+    for (int index=0; index<numberOfOperations; ++index)
+    {
+      if (levels[index] != level)
+      {
+        continue;
+      }
+      const vtkMRMLSegmentMorphologyNode::BatchOperation* batchOperation = parameterNode->GetBatchOperation(index);
+      vtkImageData* operandA = ( operandResultIndices[2*index] >= 0
+        ? results[operandResultIndices[2*index]].GetPointer() : inputImages[batchOperation->OperandA].GetPointer() );
+
+      PreparedBatchOperation preparedOperation;
+      preparedOperation.Operation = batchOperation->Operation;
+      preparedOperation.Result = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!distanceFieldKeys[index].empty())
+      {
+        const std::string& key = distanceFieldKeys[index];
+        std::map<std::string, vtkSmartPointer<vtkImageData> >::iterator fieldIt = distanceFields.find(key);
+        if (fieldIt == distanceFields.end())
+        {
+          SLICERRT_TRACE_SCOPE("SegmentMorphology", "Distance field");
+          bool expand = (batchOperation->Operation == vtkMRMLSegmentMorphologyNode::Expand);
+          vtkSmartPointer<vtkImageData> fieldInput = operandA;
+          if (expand)
+          {
+            const std::vector<int>& padding = distanceFieldPaddings[key];
+            int extent[6] = {0,-1,0,-1,0,-1};
+            operandA->GetExtent(extent);
+            vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+            padder->SetInputData(operandA);
+            padder->SetOutputWholeExtent( extent[0]-padding[0], extent[1]+padding[0],
+              extent[2]-padding[1], extent[3]+padding[1], extent[4]-padding[2], extent[5]+padding[2] );
+            padder->Update();
+            fieldInput = padder->GetOutput();
+          }
+          const std::vector<double>& radii = distanceFieldRadii[key];
+          vtkSmartPointer<vtkLabelmapDistanceTransform> distanceTransform = vtkSmartPointer<vtkLabelmapDistanceTransform>::New();
+          distanceTransform->SetInputLabelmap(fieldInput);
+          distanceTransform->SetRadii(radii[0], radii[1], radii[2]);
+          distanceTransform->SetDistanceToForeground(expand);
+          distanceTransform->Update();
+          fieldIt = distanceFields.insert(std::make_pair(key, vtkSmartPointer<vtkImageData>(distanceTransform->GetOutput()))).first;
+        }
+        preparedOperation.DistanceField = fieldIt->second;
+        preparedOperation.MaximumSquaredDistance = maximumSquaredDistances[index];
+        preparedOperation.Result->SetExtent(fieldIt->second->GetExtent());
+      }
+      else
+      {
+        vtkImageData* operandB = ( operandResultIndices[2*index+1] >= 0
+          ? results[operandResultIndices[2*index+1]].GetPointer() : inputImages[batchOperation->OperandB].GetPointer() );
+        preparedOperation.OperandA = operandA;
+        preparedOperation.OperandB = operandB;
+        int aExtent[6] = {0,-1,0,-1,0,-1};
+        operandA->GetExtent(aExtent);
+        int bExtent[6] = {0,-1,0,-1,0,-1};
+        operandB->GetExtent(bExtent);
+        preparedOperation.Result->SetExtent( std::min(aExtent[0],bExtent[0]), std::max(aExtent[1],bExtent[1]),
+          std::min(aExtent[2],bExtent[2]), std::max(aExtent[3],bExtent[3]), std::min(aExtent[4],bExtent[4]), std::max(aExtent[5],bExtent[5]) );
+      }
+      preparedOperation.Result->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+      preparedOperation.Result->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+
+      preparedOperations.push_back(preparedOperation);
+      preparedIndices.push_back(index);
+    }
+
+    EvaluateBatchOperationsFunctor functor(preparedOperations);
+    vtkSMPTools::For(0, (vtkIdType)preparedOperations.size(), 1, functor);
+
+    for (unsigned int preparedIndex=0; preparedIndex<preparedIndices.size(); ++preparedIndex)
+    {
+      results[preparedIndices[preparedIndex]] = preparedOperations[preparedIndex].Result;
+    }
+  }
+
+  // Add results marked as output to the output segmentation. Segments with the same name are replaced
+  vtkSegmentation* outputSegmentation = outputSegmentationNode->GetSegmentation();
+  if (outputSegmentation->GetNumberOfSegments() == 0)
+  {
+    outputSegmentation->SetMasterRepresentationName(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() );
+  }
+  for (int index=0; index<numberOfOperations; ++index)
+  {
+    const vtkMRMLSegmentMorphologyNode::BatchOperation* batchOperation = parameterNode->GetBatchOperation(index);
+    if (!batchOperation->Output)
+    {
+      continue;
+    }
+
+    std::vector<std::string> segmentIds;
+    outputSegmentation->GetSegmentIDs(segmentIds);
+    for (std::vector<std::string>::iterator segmentIt = segmentIds.begin(); segmentIt != segmentIds.end(); ++segmentIt)
+    {
+      vtkSegment* segment = outputSegmentation->GetSegment(*segmentIt);
+      if (segment && segment->GetName() && batchOperation->ResultName == segment->GetName())
+      {
+        outputSegmentation->RemoveSegment(*segmentIt);
+      }
+    }
+
+    vtkSmartPointer<vtkSegment> newSegment = vtkSmartPointer<vtkSegment>::New();
+    newSegment->SetName(batchOperation->ResultName.c_str());
+    newSegment->AddRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), results[index] );
+    outputSegmentation->AddSegment(newSegment);
+  }
+
+  // Clear output parent transform, the image data is in the world coordinate frame
+  outputSegmentationNode->SetAndObserveTransformNodeID(NULL);
+
+  return "";
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerSegmentMorphologyModuleLogic::GenerateOutputSegmentName(vtkMRMLSegmentMorphologyNode* parameterNode)
 {
@@ -48,6 +48,14 @@ public:
   /// \return Error message, empty string if no error
   std::string ApplyMorphologyOperation(vtkMRMLSegmentMorphologyNode* parameterNode);
 
+  /// Evaluate the batch of morphology operations defined in the parameter node
+  /// (see \sa vtkMRMLSegmentMorphologyNode::AddBatchOperation) on the segments of segmentation A.
+  /// Each input labelmap is extracted once, and Expand and Shrink operations with the same operand
+  /// and margin shape share one distance field. Operations not depending on each other run in parallel.
+  /// Results marked as output are added to the output segmentation, replacing segments with the same name
+  /// \return Error message, empty string if no error
+  std::string ApplyBatchOperations(vtkMRMLSegmentMorphologyNode* parameterNode);
+
 protected:
   /// Generate output segment name from input segment names
   std::string GenerateOutputSegmentName(vtkMRMLSegmentMorphologyNode* parameterNode);
@@ -0,0 +1,181 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+
+// SegmentMorphology includes
+#include "vtkLabelmapDistanceTransform.h"
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const int DIMENSIONS[3] = {9, 7, 5};
+  const double SPACING[3] = {1.0, 2.0, 0.5};
+  const int SEED[3] = {4, 3, 2};
+  const double TOLERANCE = 1e-4;
+
+  //----------------------------------------------------------------------------
+  /// Create labelmap where only the seed voxel is foreground (or background if inverted)
+  void CreateSeedLabelmap(vtkImageData* labelmap, bool inverted)
+  {
+    labelmap->SetDimensions(DIMENSIONS[0], DIMENSIONS[1], DIMENSIONS[2]);
+    labelmap->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    for (int k=0; k<DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<DIMENSIONS[0]; ++i)
+        {
+          bool seed = (i == SEED[0] && j == SEED[1] && k == SEED[2]);
+          unsigned char* voxel = static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k));
+          *voxel = ((seed != inverted) ? 1 : 0);
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Squared physical distance of a voxel from the seed voxel, each axis normalized by the given radius
+  double GetSquaredSeedDistance(int i, int j, int k, const double radii[3])
+  {
+    int index[3] = {i, j, k};
+    double squaredDistance = 0.0;
+    for (int axis=0; axis<3; ++axis)
+    {
+      double displacement = (index[axis] - SEED[axis]) * SPACING[axis] / radii[axis];
+      squaredDistance += displacement * displacement;
+    }
+    return squaredDistance;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Squared physical distance of a voxel from the nearest virtual background voxel just outside the extent
+  double GetSquaredBorderDistance(int i, int j, int k)
+  {
+    int index[3] = {i, j, k};
+    double squaredDistance = VTK_DOUBLE_MAX;
+    for (int axis=0; axis<3; ++axis)
+    {
+      int steps = (index[axis] + 1 < DIMENSIONS[axis] - index[axis] ? index[axis] + 1 : DIMENSIONS[axis] - index[axis]);
+      double distance = steps * SPACING[axis];
+      if (distance * distance < squaredDistance)
+      {
+        squaredDistance = distance * distance;
+      }
+    }
+    return squaredDistance;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compare output of distance transform to the expected distance from the seed voxel (and optionally the border)
+  bool CheckDistances(vtkImageData* output, const double radii[3], bool includeBorder)
+  {
+    int* dims = output->GetDimensions();
+    if (dims[0] != DIMENSIONS[0] || dims[1] != DIMENSIONS[1] || dims[2] != DIMENSIONS[2]
+      || output->GetScalarType() != VTK_FLOAT)
+    {
+      std::cerr << "Output image geometry or scalar type does not match the input labelmap!" << std::endl;
+      return false;
+    }
+    for (int k=0; k<DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<DIMENSIONS[0]; ++i)
+        {
+          double expected = GetSquaredSeedDistance(i, j, k, radii);
+          if (includeBorder)
+          {
+            double borderDistance = GetSquaredBorderDistance(i, j, k);
+            expected = (borderDistance < expected ? borderDistance : expected);
+          }
+          double actual = *static_cast<float*>(output->GetScalarPointer(i,j,k));
+          if (fabs(actual - expected) > TOLERANCE * (1.0 + expected))
+          {
+            std::cerr << "Squared distance at voxel (" << i << ", " << j << ", " << k << ") is " << actual
+              << " instead of " << expected << "!" << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkLabelmapDistanceTransformTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const double unitRadii[3] = {1.0, 1.0, 1.0};
+
+  // Distance to a single foreground seed voxel is the squared physical distance
+  vtkNew<vtkImageData> seedLabelmap;
+  CreateSeedLabelmap(seedLabelmap.GetPointer(), false);
+  vtkNew<vtkLabelmapDistanceTransform> distanceTransform;
+  distanceTransform->SetInputLabelmap(seedLabelmap.GetPointer());
+  distanceTransform->Update();
+  if (!CheckDistances(distanceTransform->GetOutput(), unitRadii, false))
+  {
+    std::cerr << __LINE__ << ": Distance to foreground seed voxel check failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Distances are normalized by the radius along each axis
+  const double radii[3] = {2.0, 4.0, 1.5};
+  distanceTransform->SetRadii(radii[0], radii[1], radii[2]);
+  distanceTransform->Update();
+  if (!CheckDistances(distanceTransform->GetOutput(), radii, false))
+  {
+    std::cerr << __LINE__ << ": Normalized distance to foreground seed voxel check failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Distance to a single background seed voxel. By default the outside of the extent is not considered
+  // background, so that shrinking does not erode structures touching the extent boundary
+  if (distanceTransform->GetBackgroundOutsideExtent())
+  {
+    std::cerr << __LINE__ << ": Outside of the extent is considered background by default!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkImageData> invertedSeedLabelmap;
+  CreateSeedLabelmap(invertedSeedLabelmap.GetPointer(), true);
+  distanceTransform->SetInputLabelmap(invertedSeedLabelmap.GetPointer());
+  distanceTransform->SetRadii(1.0, 1.0, 1.0);
+  distanceTransform->DistanceToForegroundOff();
+  distanceTransform->Update();
+  if (!CheckDistances(distanceTransform->GetOutput(), unitRadii, false))
+  {
+    std::cerr << __LINE__ << ": Distance to background seed voxel check failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Voxels just outside the extent are background as well
+  distanceTransform->BackgroundOutsideExtentOn();
+  distanceTransform->Update();
+  if (!CheckDistances(distanceTransform->GetOutput(), unitRadii, true))
+  {
+    std::cerr << __LINE__ << ": Distance to background seed voxel and extent border check failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Labelmap distance transform test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkMRMLSegmentMorphologyNode.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Compare the batch operations of two parameter nodes
+  bool AreBatchOperationsEqual(vtkMRMLSegmentMorphologyNode* node1, vtkMRMLSegmentMorphologyNode* node2)
+  {
+    if (node1->GetNumberOfBatchOperations() != node2->GetNumberOfBatchOperations())
+    {
+      std::cerr << "Number of batch operations differ: " << node1->GetNumberOfBatchOperations()
+        << " != " << node2->GetNumberOfBatchOperations() << std::endl;
+      return false;
+    }
+    for (int index=0; index<node1->GetNumberOfBatchOperations(); ++index)
+    {
+      const vtkMRMLSegmentMorphologyNode::BatchOperation* operation1 = node1->GetBatchOperation(index);
+      const vtkMRMLSegmentMorphologyNode::BatchOperation* operation2 = node2->GetBatchOperation(index);
+      if ( operation1->Operation != operation2->Operation
+        || operation1->ResultName != operation2->ResultName
+        || operation1->OperandA != operation2->OperandA
+        || operation1->OperandB != operation2->OperandB
+        || operation1->Size[0] != operation2->Size[0]
+        || operation1->Size[1] != operation2->Size[1]
+        || operation1->Size[2] != operation2->Size[2]
+        || operation1->Output != operation2->Output )
+      {
+        std::cerr << "Batch operation " << index << " ('" << operation1->ResultName << "' and '"
+          << operation2->ResultName << "') differ!" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentMorphologyNodeTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Ring between 5 and 15 mm around PTV, with anisotropic and non-integer margins
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLSegmentMorphologyNode> parameterNode;
+  scene->AddNode(parameterNode.GetPointer());
+  parameterNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Expand, "PTV_15", "PTV", NULL, 15.0, 15.0, 7.5, false);
+  parameterNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Expand, "PTV_5", "PTV", NULL, 5.0, 5.0, 2.5, false);
+  int ringIndex = parameterNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Subtract, "Ring", "PTV_15", "PTV_5");
+  if (ringIndex != 2 || parameterNode->GetNumberOfBatchOperations() != 3)
+  {
+    std::cerr << __LINE__ << ": Adding batch operations failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (parameterNode->GetBatchOperation(-1) || parameterNode->GetBatchOperation(3))
+  {
+    std::cerr << __LINE__ << ": Batch operation returned for out of range index!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Write scene to XML string and read it into a new scene
+  scene->SetSaveToXMLString(1);
+  scene->Commit();
+  std::string sceneXml = scene->GetSceneXMLString();
+
+  vtkNew<vtkMRMLScene> readScene;
+  readScene->RegisterNodeClass(vtkSmartPointer<vtkMRMLSegmentMorphologyNode>::New());
+  readScene->SetLoadFromXMLString(1);
+  readScene->SetSceneXMLString(sceneXml);
+  readScene->Import();
+  vtkMRMLSegmentMorphologyNode* readParameterNode = vtkMRMLSegmentMorphologyNode::SafeDownCast(
+    readScene->GetFirstNodeByClass("vtkMRMLSegmentMorphologyNode") );
+  if (!readParameterNode)
+  {
+    std::cerr << __LINE__ << ": Failed to read parameter node from scene XML:\n" << sceneXml << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!AreBatchOperationsEqual(parameterNode.GetPointer(), readParameterNode))
+  {
+    std::cerr << __LINE__ << ": Batch operations changed in XML round-trip!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Copy
+  vtkNew<vtkMRMLSegmentMorphologyNode> copiedParameterNode;
+  copiedParameterNode->Copy(parameterNode.GetPointer());
+  if (!AreBatchOperationsEqual(parameterNode.GetPointer(), copiedParameterNode.GetPointer()))
+  {
+    std::cerr << __LINE__ << ": Batch operations changed by copying the node!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Reading an operation with a gap in the indices leaves the operations before it in default state
+  const char* attributes[] = { "BatchOperation1", "0|PTV_5|PTV||5|5|5|1", NULL };
+  readParameterNode->ReadXMLAttributes(attributes);
+  if (readParameterNode->GetNumberOfBatchOperations() != 2)
+  {
+    std::cerr << __LINE__ << ": Number of batch operations read is " << readParameterNode->GetNumberOfBatchOperations()
+      << " instead of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const vtkMRMLSegmentMorphologyNode::BatchOperation* defaultOperation = readParameterNode->GetBatchOperation(0);
+  if ( defaultOperation->Operation != vtkMRMLSegmentMorphologyNode::None || !defaultOperation->ResultName.empty()
+    || defaultOperation->Size[0] != 0.0 || defaultOperation->Size[1] != 0.0 || defaultOperation->Size[2] != 0.0
+    || defaultOperation->Output )
+  {
+    std::cerr << __LINE__ << ": Missing batch operation is not initialized to the default state!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const vtkMRMLSegmentMorphologyNode::BatchOperation* readOperation = readParameterNode->GetBatchOperation(1);
+  if ( readOperation->Operation != vtkMRMLSegmentMorphologyNode::Expand || readOperation->ResultName != "PTV_5"
+    || readOperation->OperandA != "PTV" || !readOperation->OperandB.empty() || readOperation->Size[2] != 5.0
+    || !readOperation->Output )
+  {
+    std::cerr << __LINE__ << ": Batch operation attribute was not read correctly!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  parameterNode->RemoveAllBatchOperations();
+  if (parameterNode->GetNumberOfBatchOperations() != 0)
+  {
+    std::cerr << __LINE__ << ": Failed to remove batch operations!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Segment morphology node test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkSlicerSegmentMorphologyModuleLogic.h"
+#include "vtkMRMLSegmentMorphologyNode.h"
+
+// SlicerRT includes
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Get binary labelmap of the segment with the given name. NULL if not found
+  vtkOrientedImageData* GetLabelmapBySegmentName(vtkMRMLSegmentationNode* segmentationNode, const std::string& name)
+  {
+    std::vector<std::string> segmentIDs;
+    segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+    {
+      vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIt);
+      if (segment->GetName() && name == segment->GetName())
+      {
+        return vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
+          vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+      }
+    }
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Determine whether a voxel is set in the labelmap. Voxels outside the extent are not set
+  bool IsVoxelSet(vtkImageData* labelmap, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return (labelmap->GetScalarComponentAsDouble(i, j, k, 0) != 0.0);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Extend extent so that it contains the extent of the labelmap
+  void AddToExtent(vtkImageData* labelmap, int extent[6])
+  {
+    int labelmapExtent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(labelmapExtent);
+    for (int axis=0; axis<3; ++axis)
+    {
+      extent[2*axis] = (labelmapExtent[2*axis] < extent[2*axis] ? labelmapExtent[2*axis] : extent[2*axis]);
+      extent[2*axis+1] = (labelmapExtent[2*axis+1] > extent[2*axis+1] ? labelmapExtent[2*axis+1] : extent[2*axis+1]);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerSegmentMorphologyBatchOperationsTest1( int argc, char * argv[] )
+{
+  int argIndex = 1;
+
+  const char *dataDirectoryPath = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+  {
+    dataDirectoryPath = argv[argIndex+1];
+    std::cout << "Data directory path: " << dataDirectoryPath << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationFile = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-InputSegmentationFile") == 0)
+  {
+    inputSegmentationFile = argv[argIndex+1];
+    std::cout << "Input segmentation file name: " << inputSegmentationFile << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *baselineExpandedSegmentationFile = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-BaselineExpandedSegmentationFile") == 0)
+  {
+    baselineExpandedSegmentationFile = argv[argIndex+1];
+    std::cout << "Baseline segmentation expanded by 5mm file name: " << baselineExpandedSegmentationFile << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double volumeDifferenceToleranceVoxel = 0.0;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-VolumeDifferenceToleranceVoxel") == 0)
+  {
+    volumeDifferenceToleranceVoxel = vtkVariant(argv[argIndex+1]).ToDouble();
+    std::cout << "Volume difference tolerance (voxel): " << volumeDifferenceToleranceVoxel << std::endl;
+    argIndex += 2;
+  }
+
+  // Make sure NRRD reading works
+  itk::itkFactoryRegistration();
+
+  // Register planar contour to closed surface conversion rule
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+
+  // Create scene and logic
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic> segmentMorphologyLogic = vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic>::New();
+  segmentMorphologyLogic->SetMRMLScene(mrmlScene);
+
+  // Load input segmentation
+  std::string inputSegmentationFileName = std::string(dataDirectoryPath) + std::string(inputSegmentationFile);
+  if (!vtksys::SystemTools::FileExists(inputSegmentationFileName.c_str()))
+  {
+    std::cerr << __LINE__ << ": Loading segmentation from file '" << inputSegmentationFileName << "' failed - the file does not exist!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkMRMLSegmentationNode* inputSegmentationNode = segmentationsLogic->LoadSegmentationFromFile(inputSegmentationFileName.c_str());
+  if (!inputSegmentationNode || inputSegmentationNode->GetSegmentation()->GetNumberOfSegments() != 1)
+  {
+    std::cerr << __LINE__ << ": Loading segmentation with exactly one segment from file '" << inputSegmentationFileName << "' failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!inputSegmentationNode->GetSegmentation()->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+  {
+    std::cerr << __LINE__ << ": Failed to create binary labelmap representation in input segmentation!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> inputSegmentIDs;
+  inputSegmentationNode->GetSegmentation()->GetSegmentIDs(inputSegmentIDs);
+  std::string inputSegmentID = inputSegmentIDs[0];
+
+  vtkSmartPointer<vtkMRMLSegmentationNode> outputSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  outputSegmentationNode->SetName("Output_Segmentation");
+  mrmlScene->AddNode(outputSegmentationNode);
+
+  // Ring between 5 and 15 mm around the input segment. The two expansions share one distance field
+  vtkSmartPointer<vtkMRMLSegmentMorphologyNode> paramNode = vtkSmartPointer<vtkMRMLSegmentMorphologyNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveSegmentationANode(inputSegmentationNode);
+  paramNode->SetAndObserveOutputSegmentationNode(outputSegmentationNode);
+  paramNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Expand, "Expanded_15", inputSegmentID.c_str(), NULL, 15.0, 15.0, 15.0);
+  paramNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Expand, "Expanded_5", inputSegmentID.c_str(), NULL, 5.0, 5.0, 5.0);
+  paramNode->AddBatchOperation(vtkMRMLSegmentMorphologyNode::Subtract, "Ring", "Expanded_15", "Expanded_5");
+
+  std::string errorMessage = segmentMorphologyLogic->ApplyBatchOperations(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << __LINE__ << ": Applying batch operations failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (outputSegmentationNode->GetSegmentation()->GetNumberOfSegments() != 3)
+  {
+    std::cerr << __LINE__ << ": Output segmentation contains " << outputSegmentationNode->GetSegmentation()->GetNumberOfSegments()
+      << " segments instead of 3!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkOrientedImageData* expanded15Image = GetLabelmapBySegmentName(outputSegmentationNode, "Expanded_15");
+  vtkOrientedImageData* expanded5Image = GetLabelmapBySegmentName(outputSegmentationNode, "Expanded_5");
+  vtkOrientedImageData* ringImage = GetLabelmapBySegmentName(outputSegmentationNode, "Ring");
+  if (!expanded15Image || !expanded5Image || !ringImage)
+  {
+    std::cerr << __LINE__ << ": Failed to get output labelmaps of the batch operations!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Results are in the geometry of the input labelmap
+  vtkSmartPointer<vtkOrientedImageData> inputImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(inputSegmentationNode, inputSegmentID, inputImage)
+    || !vtkOrientedImageDataResample::DoGeometriesMatch(inputImage, expanded15Image)
+    || !vtkOrientedImageDataResample::DoGeometriesMatch(inputImage, expanded5Image)
+    || !vtkOrientedImageDataResample::DoGeometriesMatch(inputImage, ringImage) )
+  {
+    std::cerr << __LINE__ << ": Output labelmap geometries do not match the input labelmap!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Expansion by 5mm matches the result of the single morphology operation
+  std::string baselineFileName = std::string(dataDirectoryPath) + std::string(baselineExpandedSegmentationFile);
+  vtkMRMLSegmentationNode* baselineSegmentationNode = segmentationsLogic->LoadSegmentationFromFile(baselineFileName.c_str());
+  if (!baselineSegmentationNode || baselineSegmentationNode->GetSegmentation()->GetNumberOfSegments() != 1)
+  {
+    std::cerr << __LINE__ << ": Loading baseline segmentation with exactly one segment from file '" << baselineFileName << "' failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> baselineSegmentIDs;
+  baselineSegmentationNode->GetSegmentation()->GetSegmentIDs(baselineSegmentIDs);
+  vtkSmartPointer<vtkOrientedImageData> baselineImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  baselineImage->DeepCopy( vtkOrientedImageData::SafeDownCast(
+    baselineSegmentationNode->GetSegmentation()->GetSegment(baselineSegmentIDs[0])->GetRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) ) );
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(baselineImage, expanded15Image))
+  {
+    vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(baselineImage, expanded15Image, baselineImage);
+  }
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  inputImage->GetExtent(extent);
+  AddToExtent(expanded15Image, extent);
+  AddToExtent(expanded5Image, extent);
+  AddToExtent(ringImage, extent);
+  AddToExtent(baselineImage, extent);
+  int baselineMismatches = 0;
+  int numberOfRingVoxels = 0;
+  for (int k=extent[4]; k<=extent[5]; ++k)
+  {
+    for (int j=extent[2]; j<=extent[3]; ++j)
+    {
+      for (int i=extent[0]; i<=extent[1]; ++i)
+      {
+        bool input = IsVoxelSet(inputImage, i, j, k);
+        bool expanded15 = IsVoxelSet(expanded15Image, i, j, k);
+        bool expanded5 = IsVoxelSet(expanded5Image, i, j, k);
+        bool ring = IsVoxelSet(ringImage, i, j, k);
+        if ((input && !expanded5) || (expanded5 && !expanded15))
+        {
+          std::cerr << __LINE__ << ": Voxel (" << i << ", " << j << ", " << k << ") is not contained by the larger expansion!" << std::endl;
+          return EXIT_FAILURE;
+        }
+        if (ring != (expanded15 && !expanded5))
+        {
+          std::cerr << __LINE__ << ": Ring voxel (" << i << ", " << j << ", " << k << ") does not match the difference of the expansions!" << std::endl;
+          return EXIT_FAILURE;
+        }
+        if (ring)
+        {
+          ++numberOfRingVoxels;
+        }
+        if (expanded5 != IsVoxelSet(baselineImage, i, j, k))
+        {
+          ++baselineMismatches;
+        }
+      }
+    }
+  }
+  if (numberOfRingVoxels == 0)
+  {
+    std::cerr << __LINE__ << ": Ring is empty!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (baselineMismatches > volumeDifferenceToleranceVoxel)
+  {
+    std::cerr << __LINE__ << ": Expansion by 5mm differs from the baseline in " << baselineMismatches << " voxels!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Segment morphology batch operations test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkBeamControlPointSequence.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const double SAD = 1000.0;
+  const double TOLERANCE = 1e-6;
+
+  const int NUMBER_OF_LEAF_PAIRS = 4;
+  const double LEAF_PAIR_BOUNDARIES[NUMBER_OF_LEAF_PAIRS+1] = { -20.0, -10.0, 0.0, 10.0, 20.0 };
+  // Bank A then bank B
+  const double LEAF_POSITIONS[2*NUMBER_OF_LEAF_PAIRS] = { -5.0, -6.0, -7.0, -8.0, 5.0, 6.0, 7.0, 8.0 };
+
+  //----------------------------------------------------------------------------
+  bool IsPointEqual(vtkPolyData* polyData, vtkIdType pointId, double x, double y, double z, int line)
+  {
+    double* point = polyData->GetPoint(pointId);
+    if ( fabs(point[0] - x) > TOLERANCE || fabs(point[1] - y) > TOLERANCE || fabs(point[2] - z) > TOLERANCE )
+    {
+      std::cerr << line << ": Point " << pointId << " is (" << point[0] << ", " << point[1] << ", " << point[2]
+        << ") instead of (" << x << ", " << y << ", " << z << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compare with the jaws-only beam model that the beam node created before MLC support:
+  /// source, four corners of the jaw opening, four side triangles and the cap
+  bool IsJawPyramid(vtkPolyData* polyData, const double jawPositions[4], int line)
+  {
+    const double x1Jaw = jawPositions[0];
+    const double x2Jaw = jawPositions[1];
+    const double y1Jaw = jawPositions[2];
+    const double y2Jaw = jawPositions[3];
+    double expectedPoints[5][3] = {
+      { 0.0, 0.0, SAD },
+      { -2*y2Jaw, -2*x2Jaw, -SAD },
+      { -2*y2Jaw, -2*x1Jaw, -SAD },
+      { -2*y1Jaw, -2*x1Jaw, -SAD },
+      { -2*y1Jaw, -2*x2Jaw, -SAD } };
+    vtkIdType expectedCells[5][4] = {
+      { 0, 1, 2, -1 },
+      { 0, 2, 3, -1 },
+      { 0, 3, 4, -1 },
+      { 0, 4, 1, -1 },
+      { 1, 2, 3, 4 } };
+
+    if (polyData->GetNumberOfPoints() != 5 || polyData->GetNumberOfPolys() != 5)
+    {
+      std::cerr << line << ": Jaw aperture has " << polyData->GetNumberOfPoints() << " points and "
+        << polyData->GetNumberOfPolys() << " polygons instead of 5 and 5" << std::endl;
+      return false;
+    }
+    for (vtkIdType pointId=0; pointId<5; ++pointId)
+    {
+      if (!IsPointEqual(polyData, pointId, expectedPoints[pointId][0], expectedPoints[pointId][1], expectedPoints[pointId][2], line))
+      {
+        return false;
+      }
+    }
+
+    vtkCellArray* polys = polyData->GetPolys();
+    polys->InitTraversal();
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPoints = NULL;
+    for (int cellIndex=0; polys->GetNextCell(numberOfCellPoints, cellPoints); ++cellIndex)
+    {
+      vtkIdType expectedNumberOfCellPoints = (expectedCells[cellIndex][3] < 0 ? 3 : 4);
+      if (numberOfCellPoints != expectedNumberOfCellPoints)
+      {
+        std::cerr << line << ": Cell " << cellIndex << " has " << numberOfCellPoints << " points instead of " << expectedNumberOfCellPoints << std::endl;
+        return false;
+      }
+      for (vtkIdType i=0; i<numberOfCellPoints; ++i)
+      {
+        if (cellPoints[i] != expectedCells[cellIndex][i])
+        {
+          std::cerr << line << ": Point " << i << " of cell " << cellIndex << " is " << cellPoints[i]
+            << " instead of " << expectedCells[cellIndex][i] << std::endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check that the aperture is a pyramid from the source to an outline of the given number of points
+  bool IsApertureOutline(vtkPolyData* polyData, vtkIdType expectedNumberOfOutlinePoints, int line)
+  {
+    if ( polyData->GetNumberOfPoints() != expectedNumberOfOutlinePoints + 1
+      || polyData->GetNumberOfPolys() != expectedNumberOfOutlinePoints + 1 )
+    {
+      std::cerr << line << ": Aperture has " << polyData->GetNumberOfPoints() << " points and " << polyData->GetNumberOfPolys()
+        << " polygons instead of " << expectedNumberOfOutlinePoints + 1 << " and " << expectedNumberOfOutlinePoints + 1 << std::endl;
+      return false;
+    }
+    if (!IsPointEqual(polyData, 0, 0.0, 0.0, SAD, line))
+    {
+      return false;
+    }
+    for (vtkIdType pointId=1; pointId<=expectedNumberOfOutlinePoints; ++pointId)
+    {
+      if (fabs(polyData->GetPoint(pointId)[2] + SAD) > TOLERANCE)
+      {
+        std::cerr << line << ": Outline point " << pointId << " is not in the aperture plane" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkBeamControlPointSequenceTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  //
+  // Jaws only
+
+  const double jawPositions[4] = { -50.0, 60.0, -40.0, 30.0 };
+
+  vtkNew<vtkPolyData> jawAperture;
+  vtkBeamControlPointSequence::CreateAperturePolyData(SAD, jawPositions, 0, NULL, NULL,
+    vtkBeamControlPointSequence::MLCX, jawAperture.GetPointer());
+  if (!IsJawPyramid(jawAperture.GetPointer(), jawPositions, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // MLC without leaf positions also falls back to the jaw opening
+  vtkNew<vtkPolyData> jawApertureWithoutLeaves;
+  vtkBeamControlPointSequence::CreateAperturePolyData(SAD, jawPositions, NUMBER_OF_LEAF_PAIRS, LEAF_PAIR_BOUNDARIES, NULL,
+    vtkBeamControlPointSequence::MLCX, jawApertureWithoutLeaves.GetPointer());
+  if (!IsJawPyramid(jawApertureWithoutLeaves.GetPointer(), jawPositions, __LINE__))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Control point of a beam without MLC
+  vtkNew<vtkBeamControlPointSequence> jawControlPoints;
+  jawControlPoints->AddControlPoint(0.0, 0.0, 0.0, 0.0, jawPositions, NULL);
+  vtkNew<vtkPolyData> jawControlPointAperture;
+  if ( !jawControlPoints->CreateAperturePolyData(0, SAD, jawControlPointAperture.GetPointer())
+    || !IsJawPyramid(jawControlPointAperture.GetPointer(), jawPositions, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  //
+  // MLC
+
+  vtkNew<vtkBeamControlPointSequence> controlPoints;
+  controlPoints->SetMLC(NUMBER_OF_LEAF_PAIRS, LEAF_PAIR_BOUNDARIES, vtkBeamControlPointSequence::MLCX);
+  const double openJawPositions[4] = { -30.0, 30.0, -15.0, 15.0 };
+  const double narrowJawPositions[4] = { -30.0, 30.0, -5.0, 5.0 };
+  const double clippingJawPositions[4] = { -30.0, 6.0, -15.0, 15.0 };
+  controlPoints->AddControlPoint(0.0, 0.0, 0.0, 0.0, openJawPositions, LEAF_POSITIONS);
+  controlPoints->AddControlPoint(10.0, 0.0, 0.0, 0.5, narrowJawPositions, LEAF_POSITIONS);
+  controlPoints->AddControlPoint(20.0, 0.0, 0.0, 1.0, clippingJawPositions, LEAF_POSITIONS);
+  if (controlPoints->GetNumberOfControlPoints() != 3)
+  {
+    std::cerr << __LINE__ << ": Number of control points is " << controlPoints->GetNumberOfControlPoints() << " instead of 3" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // All leaf pairs are within the jaws: two points per leaf on both banks
+  vtkNew<vtkPolyData> openAperture;
+  if ( !controlPoints->CreateAperturePolyData(0, SAD, openAperture.GetPointer())
+    || !IsApertureOutline(openAperture.GetPointer(), 4 * NUMBER_OF_LEAF_PAIRS, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+  // Outline starts at bank B of the first leaf pair, cut by the Y1 jaw, and ends at bank A of the same pair
+  if ( !IsPointEqual(openAperture.GetPointer(), 1, -2.0*(-15.0), -2.0*5.0, -SAD, __LINE__)
+    || !IsPointEqual(openAperture.GetPointer(), 4 * NUMBER_OF_LEAF_PAIRS, -2.0*(-15.0), -2.0*(-5.0), -SAD, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Only the two central leaf pairs are within the Y jaws
+  vtkNew<vtkPolyData> narrowAperture;
+  if ( !controlPoints->CreateAperturePolyData(1, SAD, narrowAperture.GetPointer())
+    || !IsApertureOutline(narrowAperture.GetPointer(), 4 * 2, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Bank B leaf of the last pair is beyond the X2 jaw, so it is clipped
+  vtkNew<vtkPolyData> clippedAperture;
+  if ( !controlPoints->CreateAperturePolyData(2, SAD, clippedAperture.GetPointer())
+    || !IsApertureOutline(clippedAperture.GetPointer(), 4 * NUMBER_OF_LEAF_PAIRS, __LINE__)
+    || !IsPointEqual(clippedAperture.GetPointer(), 7, -2.0*10.0, -2.0*6.0, -SAD, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Leaves moving along Y: leaf pair boundaries are along X
+  vtkNew<vtkPolyData> mlcyAperture;
+  const double squareJawPositions[4] = { -30.0, 30.0, -30.0, 30.0 };
+  vtkBeamControlPointSequence::CreateAperturePolyData(SAD, squareJawPositions, NUMBER_OF_LEAF_PAIRS, LEAF_PAIR_BOUNDARIES, LEAF_POSITIONS,
+    vtkBeamControlPointSequence::MLCY, mlcyAperture.GetPointer());
+  if ( !IsApertureOutline(mlcyAperture.GetPointer(), 4 * NUMBER_OF_LEAF_PAIRS, __LINE__)
+    || !IsPointEqual(mlcyAperture.GetPointer(), 1, -2.0*5.0, -2.0*(-20.0), -SAD, __LINE__) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Beam control point sequence test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
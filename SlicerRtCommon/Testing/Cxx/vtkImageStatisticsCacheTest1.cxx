@@ -0,0 +1,211 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkImageStatisticsCache.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageAccumulate.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const int DIMENSIONS[3] = {10, 8, 6};
+  const int NUMBER_OF_FLOAT_HISTOGRAM_BINS = 7;
+  const double TOLERANCE = 1e-6;
+
+  //----------------------------------------------------------------------------
+  /// Fill image with a repeating pattern of integer steps
+  void CreateImage(vtkImageData* image, int scalarType, double origin, double step)
+  {
+    image->SetDimensions(DIMENSIONS[0], DIMENSIONS[1], DIMENSIONS[2]);
+    image->AllocateScalars(scalarType, 1);
+    for (int k=0; k<DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<DIMENSIONS[0]; ++i)
+        {
+          image->SetScalarComponentFromDouble(i, j, k, 0, origin + step * ((7*i + 3*j + 5*k) % 17));
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool AreEqualWithTolerance(double a, double b, double relativeTolerance=TOLERANCE)
+  {
+    return fabs(a - b) <= relativeTolerance * (1.0 + fabs(a) + fabs(b));
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compare statistics to the result of vtkImageAccumulate using the same histogram bins
+  bool CompareToImageAccumulate(vtkImageData* image, const vtkImageStatisticsCache::Statistics& statistics)
+  {
+    int numberOfBins = (int)statistics.Histogram.size();
+    vtkNew<vtkImageAccumulate> accumulate;
+    accumulate->SetInputData(image);
+    accumulate->SetComponentOrigin(statistics.HistogramOrigin, 0.0, 0.0);
+    accumulate->SetComponentSpacing(statistics.HistogramBinWidth, 1.0, 1.0);
+    // One extra bin, as vtkImageAccumulate excludes the maximum from the last bin of a floating point histogram
+    accumulate->SetComponentExtent(0, numberOfBins, 0, 0, 0, 0);
+    accumulate->Update();
+
+    if ( statistics.NumberOfVoxels != accumulate->GetVoxelCount()
+      || !AreEqualWithTolerance(statistics.Minimum, accumulate->GetMin()[0])
+      || !AreEqualWithTolerance(statistics.Maximum, accumulate->GetMax()[0])
+      || !AreEqualWithTolerance(statistics.Mean, accumulate->GetMean()[0])
+      // Allow for the difference between population and sample standard deviation
+      || !AreEqualWithTolerance(statistics.StandardDeviation, accumulate->GetStandardDeviation()[0], 1e-2) )
+    {
+      std::cerr << "Statistics (count " << statistics.NumberOfVoxels << ", range " << statistics.Minimum << ".." << statistics.Maximum
+        << ", mean " << statistics.Mean << ", stdev " << statistics.StandardDeviation << ") do not match vtkImageAccumulate (count "
+        << accumulate->GetVoxelCount() << ", range " << accumulate->GetMin()[0] << ".." << accumulate->GetMax()[0]
+        << ", mean " << accumulate->GetMean()[0] << ", stdev " << accumulate->GetStandardDeviation()[0] << ")!" << std::endl;
+      return false;
+    }
+
+    vtkImageData* accumulateHistogram = accumulate->GetOutput();
+    for (int bin=0; bin<numberOfBins; ++bin)
+    {
+      double expectedCount = accumulateHistogram->GetScalarComponentAsDouble(bin, 0, 0, 0);
+      if (bin == numberOfBins-1)
+      {
+        expectedCount += accumulateHistogram->GetScalarComponentAsDouble(numberOfBins, 0, 0, 0);
+      }
+      if (statistics.Histogram[bin] != (vtkIdType)expectedCount)
+      {
+        std::cerr << "Histogram bin " << bin << " contains " << statistics.Histogram[bin] << " voxels instead of "
+          << expectedCount << "!" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkImageStatisticsCacheTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkImageStatisticsCache> cache;
+  cache->SetNumberOfHistogramBins(NUMBER_OF_FLOAT_HISTOGRAM_BINS);
+
+  // Integer image gets one bin per value
+  vtkNew<vtkImageData> shortImage;
+  CreateImage(shortImage.GetPointer(), VTK_SHORT, -3.0, 2.0);
+  vtkImageStatisticsCache::Statistics statistics;
+  if (!cache->GetStatistics(shortImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Failed to get statistics of short image!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (statistics.HistogramBinWidth != 1.0 || (int)statistics.Histogram.size() != 33)
+  {
+    std::cerr << __LINE__ << ": Short image histogram has " << statistics.Histogram.size() << " bins of width "
+      << statistics.HistogramBinWidth << " instead of one bin per value!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareToImageAccumulate(shortImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Short image statistics do not match vtkImageAccumulate!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Floating point image gets the set number of bins
+  vtkNew<vtkImageData> floatImage;
+  CreateImage(floatImage.GetPointer(), VTK_FLOAT, 0.37, 1.13);
+  if (!cache->GetStatistics(floatImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Failed to get statistics of float image!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ((int)statistics.Histogram.size() != NUMBER_OF_FLOAT_HISTOGRAM_BINS)
+  {
+    std::cerr << __LINE__ << ": Float image histogram has " << statistics.Histogram.size() << " bins instead of "
+      << NUMBER_OF_FLOAT_HISTOGRAM_BINS << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareToImageAccumulate(floatImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Float image statistics do not match vtkImageAccumulate!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Statistics are cached: changing the voxels without modifying the image returns the previous result
+  double range[2] = {0.0, 0.0};
+  double originalMaximum = statistics.Maximum;
+  float* floatVoxel = static_cast<float*>(floatImage->GetScalarPointer(1, 2, 3));
+  *floatVoxel = 100.0f;
+  if (!cache->GetScalarRange(floatImage.GetPointer(), range) || range[1] != originalMaximum)
+  {
+    std::cerr << __LINE__ << ": Statistics of unmodified image were recomputed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Cached statistics are invalidated when the image is modified
+  floatImage->Modified();
+  if (!cache->GetStatistics(floatImage.GetPointer(), statistics) || statistics.Maximum != 100.0)
+  {
+    std::cerr << __LINE__ << ": Statistics were not updated after modifying the image!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareToImageAccumulate(floatImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Statistics of modified image do not match vtkImageAccumulate!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // ... and when only the scalar array is modified
+  short* shortVoxel = static_cast<short*>(shortImage->GetScalarPointer(0, 0, 0));
+  *shortVoxel = -10;
+  shortImage->GetPointData()->GetScalars()->Modified();
+  if (!cache->GetStatistics(shortImage.GetPointer(), statistics) || statistics.Minimum != -10.0)
+  {
+    std::cerr << __LINE__ << ": Statistics were not updated after modifying the scalars!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareToImageAccumulate(shortImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Statistics of modified scalars do not match vtkImageAccumulate!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Removed image is recomputed
+  *shortVoxel = -20;
+  cache->RemoveImage(shortImage.GetPointer());
+  if (!cache->GetScalarRange(shortImage.GetPointer(), range) || range[0] != -20.0)
+  {
+    std::cerr << __LINE__ << ": Statistics of removed image were not recomputed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Image without scalars has no statistics
+  vtkNew<vtkImageData> emptyImage;
+  if (cache->GetStatistics(emptyImage.GetPointer(), statistics))
+  {
+    std::cerr << __LINE__ << ": Statistics returned for image without scalars!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Image statistics cache test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
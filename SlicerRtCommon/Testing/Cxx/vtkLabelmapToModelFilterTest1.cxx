@@ -0,0 +1,162 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkLabelmapToModelFilter.h"
+
+// VTK includes
+#include <vtkFeatureEdges.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const double ORIGIN[3] = {10.0, -5.0, 0.0};
+  const double SPACING[3] = {1.0, 1.0, 2.0};
+  /// Voxel index extents of the two box shaped labels
+  const int LABEL_1_EXTENT[6] = {3, 7, 3, 7, 3, 7};
+  const int LABEL_2_EXTENT[6] = {11, 16, 4, 9, 10, 15};
+  const double TOLERANCE = 1e-4;
+
+  //----------------------------------------------------------------------------
+  void FillBox(vtkImageData* image, const int boxExtent[6], unsigned char value)
+  {
+    for (int k=boxExtent[4]; k<=boxExtent[5]; ++k)
+    {
+      for (int j=boxExtent[2]; j<=boxExtent[3]; ++j)
+      {
+        for (int i=boxExtent[0]; i<=boxExtent[1]; ++i)
+        {
+          *static_cast<unsigned char*>(image->GetScalarPointer(i,j,k)) = value;
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check that the model is a closed surface around the box of voxels. The surface passes halfway
+  /// between the voxels inside and outside the box
+  bool CheckBoxModel(vtkPolyData* model, const int boxExtent[6])
+  {
+    if (!model || model->GetNumberOfPolys() == 0)
+    {
+      std::cerr << "Model is empty!" << std::endl;
+      return false;
+    }
+    double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
+    model->GetBounds(bounds);
+    for (int axis=0; axis<3; ++axis)
+    {
+      double expectedMinimum = ORIGIN[axis] + (boxExtent[2*axis] - 0.5) * SPACING[axis];
+      double expectedMaximum = ORIGIN[axis] + (boxExtent[2*axis+1] + 0.5) * SPACING[axis];
+      if (fabs(bounds[2*axis] - expectedMinimum) > TOLERANCE || fabs(bounds[2*axis+1] - expectedMaximum) > TOLERANCE)
+      {
+        std::cerr << "Model bounds along axis " << axis << " are " << bounds[2*axis] << ".." << bounds[2*axis+1]
+          << " instead of " << expectedMinimum << ".." << expectedMaximum << "!" << std::endl;
+        return false;
+      }
+    }
+
+    vtkNew<vtkFeatureEdges> boundaryEdges;
+    boundaryEdges->SetInputData(model);
+    boundaryEdges->BoundaryEdgesOn();
+    boundaryEdges->FeatureEdgesOff();
+    boundaryEdges->NonManifoldEdgesOff();
+    boundaryEdges->ManifoldEdgesOff();
+    boundaryEdges->Update();
+    if (boundaryEdges->GetOutput()->GetNumberOfLines() > 0)
+    {
+      std::cerr << "Model is not closed, it has " << boundaryEdges->GetOutput()->GetNumberOfLines() << " boundary edges!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkLabelmapToModelFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkImageData> labelmap;
+  labelmap->SetDimensions(20, 20, 20);
+  labelmap->SetOrigin(ORIGIN[0], ORIGIN[1], ORIGIN[2]);
+  labelmap->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+  labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  FillBox(labelmap.GetPointer(), labelmap->GetExtent(), 0);
+  FillBox(labelmap.GetPointer(), LABEL_1_EXTENT, 1);
+  FillBox(labelmap.GetPointer(), LABEL_2_EXTENT, 2);
+
+  // All labels
+  vtkNew<vtkLabelmapToModelFilter> labelmapToModel;
+  labelmapToModel->SetInputLabelmap(labelmap.GetPointer());
+  labelmapToModel->UpdateAllLabels();
+  if (labelmapToModel->GetNumberOfLabelOutputs() != 2
+    || labelmapToModel->GetLabelOutputValue(0) != 1.0 || labelmapToModel->GetLabelOutputValue(1) != 2.0)
+  {
+    std::cerr << __LINE__ << ": Expected models of labels 1 and 2, got " << labelmapToModel->GetNumberOfLabelOutputs() << " models!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckBoxModel(labelmapToModel->GetLabelOutput(0), LABEL_1_EXTENT))
+  {
+    std::cerr << __LINE__ << ": Model of label 1 is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckBoxModel(labelmapToModel->GetLabelOutput(1), LABEL_2_EXTENT))
+  {
+    std::cerr << __LINE__ << ": Model of label 2 is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Selected label only
+  labelmapToModel->AddLabelValue(2.0);
+  labelmapToModel->UpdateAllLabels();
+  if (labelmapToModel->GetNumberOfLabelOutputs() != 1 || labelmapToModel->GetLabelOutputValue(0) != 2.0)
+  {
+    std::cerr << __LINE__ << ": Expected model of label 2 only, got " << labelmapToModel->GetNumberOfLabelOutputs() << " models!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckBoxModel(labelmapToModel->GetLabelOutput(0), LABEL_2_EXTENT))
+  {
+    std::cerr << __LINE__ << ": Model of selected label 2 is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Single label mode gives the same surface as multi-label mode if there is only one label
+  FillBox(labelmap.GetPointer(), LABEL_2_EXTENT, 0);
+  labelmap->Modified();
+  labelmapToModel->SetLabelValue(1.0);
+  labelmapToModel->Update();
+  if (!CheckBoxModel(labelmapToModel->GetOutput(), LABEL_1_EXTENT))
+  {
+    std::cerr << __LINE__ << ": Model of single label mode is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  labelmapToModel->RemoveAllLabelValues();
+  labelmapToModel->UpdateAllLabels();
+  if ( labelmapToModel->GetNumberOfLabelOutputs() != 1
+    || labelmapToModel->GetLabelOutput(0)->GetNumberOfPoints() != labelmapToModel->GetOutput()->GetNumberOfPoints()
+    || labelmapToModel->GetLabelOutput(0)->GetNumberOfPolys() != labelmapToModel->GetOutput()->GetNumberOfPolys() )
+  {
+    std::cerr << __LINE__ << ": Single and multi-label mode models differ!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Labelmap to model filter test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkPolyDataToLabelmapFilter.h"
+
+// VTK includes
+#include <vtkCubeSource.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const int DIMENSIONS[3] = {30, 30, 20};
+  const double ORIGIN[3] = {-10.0, 5.0, 2.0};
+  const double SPACING[3] = {1.0, 0.5, 2.0};
+
+  /// Box structure. Bounds are not on voxel centers, so that each voxel is clearly inside or outside
+  const unsigned short BOX_LABEL = 3;
+  const double BOX_BOUNDS[6] = {-7.7, -2.2, 6.3, 9.1, 5.1, 17.5};
+
+  /// Sphere structure, overlapping with the box
+  const unsigned short SPHERE_LABEL = 5;
+  const double SPHERE_CENTER[3] = {-3.0, 10.0, 14.0};
+  const double SPHERE_RADIUS = 3.2;
+  /// Voxels closer to the sphere surface than this may be on either side of the tessellated surface
+  const double SPHERE_SURFACE_TOLERANCE = 0.1;
+
+  enum VoxelLocation
+  {
+    Outside,
+    Inside,
+    Uncertain
+  };
+
+  //----------------------------------------------------------------------------
+  void GetVoxelPosition(int i, int j, int k, double position[3])
+  {
+    int index[3] = {i, j, k};
+    for (int axis=0; axis<3; ++axis)
+    {
+      position[axis] = ORIGIN[axis] + index[axis] * SPACING[axis];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  VoxelLocation GetBoxLocation(const double position[3])
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      if (position[axis] < BOX_BOUNDS[2*axis] || position[axis] > BOX_BOUNDS[2*axis+1])
+      {
+        return Outside;
+      }
+    }
+    return Inside;
+  }
+
+  //----------------------------------------------------------------------------
+  VoxelLocation GetSphereLocation(const double position[3])
+  {
+    double distance = sqrt(vtkMath::Distance2BetweenPoints(position, SPHERE_CENTER));
+    if (distance < SPHERE_RADIUS - SPHERE_SURFACE_TOLERANCE)
+    {
+      return Inside;
+    }
+    if (distance > SPHERE_RADIUS + SPHERE_SURFACE_TOLERANCE)
+    {
+      return Outside;
+    }
+    return Uncertain;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check that the output labelmap contains the expected labels. Structures added later overwrite the earlier ones
+  bool CheckLabelmap(vtkImageData* labelmap, bool containsBox, bool containsSphere)
+  {
+    int* dims = labelmap->GetDimensions();
+    if (dims[0] != DIMENSIONS[0] || dims[1] != DIMENSIONS[1] || dims[2] != DIMENSIONS[2]
+      || labelmap->GetScalarType() != VTK_UNSIGNED_SHORT)
+    {
+      std::cerr << "Output labelmap geometry or scalar type does not match the reference image!" << std::endl;
+      return false;
+    }
+
+    vtkIdType numberOfBoxVoxels = 0;
+    vtkIdType numberOfSphereVoxels = 0;
+    for (int k=0; k<DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<DIMENSIONS[0]; ++i)
+        {
+          double position[3] = {0.0, 0.0, 0.0};
+          GetVoxelPosition(i, j, k, position);
+          unsigned short label = *static_cast<unsigned short*>(labelmap->GetScalarPointer(i, j, k));
+          unsigned short labelOutsideSphere = ((containsBox && GetBoxLocation(position) == Inside) ? BOX_LABEL : 0);
+          VoxelLocation sphereLocation = (containsSphere ? GetSphereLocation(position) : Outside);
+          bool valid = true;
+          if (sphereLocation == Inside)
+          {
+            valid = (label == SPHERE_LABEL);
+          }
+          else if (sphereLocation == Outside)
+          {
+            valid = (label == labelOutsideSphere);
+          }
+          else
+          {
+            valid = (label == SPHERE_LABEL || label == labelOutsideSphere);
+          }
+          if (!valid)
+          {
+            std::cerr << "Voxel (" << i << ", " << j << ", " << k << ") at (" << position[0] << ", " << position[1] << ", "
+              << position[2] << ") has unexpected label " << label << "!" << std::endl;
+            return false;
+          }
+          numberOfBoxVoxels += (label == BOX_LABEL ? 1 : 0);
+          numberOfSphereVoxels += (label == SPHERE_LABEL ? 1 : 0);
+        }
+      }
+    }
+    if ((numberOfBoxVoxels > 0) != containsBox || (numberOfSphereVoxels > 0) != containsSphere)
+    {
+      std::cerr << "Output labelmap contains " << numberOfBoxVoxels << " box and " << numberOfSphereVoxels << " sphere voxels!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPolyDataToLabelmapFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkImageData> referenceImage;
+  referenceImage->SetDimensions(DIMENSIONS[0], DIMENSIONS[1], DIMENSIONS[2]);
+  referenceImage->SetOrigin(ORIGIN[0], ORIGIN[1], ORIGIN[2]);
+  referenceImage->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+  referenceImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+
+  vtkNew<vtkCubeSource> boxSource;
+  boxSource->SetBounds(BOX_BOUNDS[0], BOX_BOUNDS[1], BOX_BOUNDS[2], BOX_BOUNDS[3], BOX_BOUNDS[4], BOX_BOUNDS[5]);
+  boxSource->Update();
+  vtkNew<vtkSphereSource> sphereSource;
+  sphereSource->SetCenter(SPHERE_CENTER[0], SPHERE_CENTER[1], SPHERE_CENTER[2]);
+  sphereSource->SetRadius(SPHERE_RADIUS);
+  sphereSource->SetThetaResolution(64);
+  sphereSource->SetPhiResolution(64);
+  sphereSource->Update();
+
+  vtkNew<vtkPolyDataToLabelmapFilter> polyDataToLabelmap;
+  polyDataToLabelmap->SetReferenceImage(referenceImage.GetPointer());
+
+  // Each structure alone
+  polyDataToLabelmap->AddStructure(boxSource->GetOutput(), BOX_LABEL);
+  polyDataToLabelmap->UpdateMultipleStructures();
+  if (!CheckLabelmap(polyDataToLabelmap->GetOutput(), true, false))
+  {
+    std::cerr << __LINE__ << ": Labelmap of box structure is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  polyDataToLabelmap->RemoveAllStructures();
+  polyDataToLabelmap->AddStructure(sphereSource->GetOutput(), SPHERE_LABEL);
+  polyDataToLabelmap->UpdateMultipleStructures();
+  if (!CheckLabelmap(polyDataToLabelmap->GetOutput(), false, true))
+  {
+    std::cerr << __LINE__ << ": Labelmap of sphere structure is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Both structures in one labelmap, the sphere added later overwrites the box where they overlap
+  polyDataToLabelmap->RemoveAllStructures();
+  polyDataToLabelmap->AddStructure(boxSource->GetOutput(), BOX_LABEL);
+  polyDataToLabelmap->AddStructure(sphereSource->GetOutput(), SPHERE_LABEL);
+  if (polyDataToLabelmap->GetNumberOfStructures() != 2)
+  {
+    std::cerr << __LINE__ << ": Number of structures is " << polyDataToLabelmap->GetNumberOfStructures() << " instead of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  polyDataToLabelmap->UpdateMultipleStructures();
+  if (!CheckLabelmap(polyDataToLabelmap->GetOutput(), true, true))
+  {
+    std::cerr << __LINE__ << ": Labelmap of box and sphere structures is invalid!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Poly data to labelmap filter test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
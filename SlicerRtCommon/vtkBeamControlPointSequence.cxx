@@ -0,0 +1,356 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkBeamControlPointSequence.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  double Clamp(double value, double minimum, double maximum)
+  {
+    if (value < minimum)
+    {
+      return minimum;
+    }
+    if (value > maximum)
+    {
+      return maximum;
+    }
+    return value;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Add a point of the aperture outline to the beam model. The outline is projected to the
+  /// plane at SAD distance beyond the isocenter, which is twice the distance from the source
+  void InsertAperturePoint(vtkPoints* points, double x, double y, double sourceAxisDistance)
+  {
+    points->InsertNextPoint(-2.0*y, -2.0*x, -sourceAxisDistance);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkBeamControlPointSequence);
+
+//----------------------------------------------------------------------------
+vtkBeamControlPointSequence::vtkBeamControlPointSequence()
+{
+  this->NumberOfLeafPairs = 0;
+  this->MLCDirection = MLCX;
+  this->FinalCumulativeMetersetWeight = 1.0;
+}
+
+//----------------------------------------------------------------------------
+vtkBeamControlPointSequence::~vtkBeamControlPointSequence()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkBeamControlPointSequence::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfControlPoints: " << this->GetNumberOfControlPoints() << "\n";
+  os << indent << "NumberOfLeafPairs: " << this->NumberOfLeafPairs << "\n";
+  os << indent << "MLCDirection: " << (this->MLCDirection == MLCX ? "MLCX" : "MLCY") << "\n";
+  os << indent << "FinalCumulativeMetersetWeight: " << this->FinalCumulativeMetersetWeight << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkBeamControlPointSequence::Initialize()
+{
+  this->GantryAngles.clear();
+  this->CollimatorAngles.clear();
+  this->CouchAngles.clear();
+  this->CumulativeMetersetWeights.clear();
+  this->JawPositions.clear();
+  this->LeafPositions.clear();
+
+  this->NumberOfLeafPairs = 0;
+  this->LeafPairBoundaries.clear();
+  this->MLCDirection = MLCX;
+
+  this->FinalCumulativeMetersetWeight = 1.0;
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkBeamControlPointSequence::SetMLC(int numberOfLeafPairs, const double* leafPairBoundaries, MLCDirectionType direction)
+{
+  if (this->GetNumberOfControlPoints() > 0)
+  {
+    vtkErrorMacro("SetMLC: MLC cannot be changed after control points have been added");
+    return;
+  }
+  if (numberOfLeafPairs < 0 || (numberOfLeafPairs > 0 && !leafPairBoundaries))
+  {
+    vtkErrorMacro("SetMLC: Invalid leaf pair boundaries");
+    return;
+  }
+
+  this->NumberOfLeafPairs = numberOfLeafPairs;
+  this->LeafPairBoundaries.clear();
+  if (numberOfLeafPairs > 0)
+  {
+    this->LeafPairBoundaries.assign(leafPairBoundaries, leafPairBoundaries + numberOfLeafPairs + 1);
+  }
+  this->MLCDirection = direction;
+
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+const double* vtkBeamControlPointSequence::GetLeafPairBoundaries()
+{
+  return (this->NumberOfLeafPairs > 0 ? &this->LeafPairBoundaries[0] : NULL);
+}
+
+//----------------------------------------------------------------------------
+int vtkBeamControlPointSequence::AddControlPoint(double gantryAngle, double collimatorAngle, double couchAngle,
+  double cumulativeMetersetWeight, const double jawPositions[4], const double* leafPositions)
+{
+  this->GantryAngles.push_back(gantryAngle);
+  this->CollimatorAngles.push_back(collimatorAngle);
+  this->CouchAngles.push_back(couchAngle);
+  this->CumulativeMetersetWeights.push_back(cumulativeMetersetWeight);
+  this->JawPositions.insert(this->JawPositions.end(), jawPositions, jawPositions + 4);
+
+  if (this->NumberOfLeafPairs > 0)
+  {
+    if (leafPositions)
+    {
+      this->LeafPositions.insert(this->LeafPositions.end(), leafPositions, leafPositions + 2*this->NumberOfLeafPairs);
+    }
+    else
+    {
+      // Leaves closed on the central axis if leaf positions are not specified
+      this->LeafPositions.resize(this->LeafPositions.size() + 2*this->NumberOfLeafPairs, 0.0);
+    }
+  }
+
+  this->Modified();
+  return this->GetNumberOfControlPoints() - 1;
+}
+
+//----------------------------------------------------------------------------
+bool vtkBeamControlPointSequence::IsControlPointIndexValid(int index, const char* callerName)
+{
+  if (index < 0 || index >= this->GetNumberOfControlPoints())
+  {
+    vtkErrorMacro(<< callerName << ": Invalid control point index " << index << " (number of control points: " << this->GetNumberOfControlPoints() << ")");
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkBeamControlPointSequence::GetGantryAngle(int index)
+{
+  if (!this->IsControlPointIndexValid(index, "GetGantryAngle"))
+  {
+    return 0.0;
+  }
+  return this->GantryAngles[index];
+}
+
+//----------------------------------------------------------------------------
+double vtkBeamControlPointSequence::GetCollimatorAngle(int index)
+{
+  if (!this->IsControlPointIndexValid(index, "GetCollimatorAngle"))
+  {
+    return 0.0;
+  }
+  return this->CollimatorAngles[index];
+}
+
+//----------------------------------------------------------------------------
+double vtkBeamControlPointSequence::GetCouchAngle(int index)
+{
+  if (!this->IsControlPointIndexValid(index, "GetCouchAngle"))
+  {
+    return 0.0;
+  }
+  return this->CouchAngles[index];
+}
+
+//----------------------------------------------------------------------------
+double vtkBeamControlPointSequence::GetCumulativeMetersetWeight(int index)
+{
+  if (!this->IsControlPointIndexValid(index, "GetCumulativeMetersetWeight"))
+  {
+    return 0.0;
+  }
+  return this->CumulativeMetersetWeights[index];
+}
+
+//----------------------------------------------------------------------------
+bool vtkBeamControlPointSequence::GetJawPositions(int index, double jawPositions[4])
+{
+  if (!this->IsControlPointIndexValid(index, "GetJawPositions"))
+  {
+    return false;
+  }
+  for (int i=0; i<4; ++i)
+  {
+    jawPositions[i] = this->JawPositions[4*index + i];
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+const double* vtkBeamControlPointSequence::GetLeafPositions(int index)
+{
+  if (this->NumberOfLeafPairs == 0 || !this->IsControlPointIndexValid(index, "GetLeafPositions"))
+  {
+    return NULL;
+  }
+  return &this->LeafPositions[2 * this->NumberOfLeafPairs * index];
+}
+
+//----------------------------------------------------------------------------
+bool vtkBeamControlPointSequence::CreateAperturePolyData(int index, double sourceAxisDistance, vtkPolyData* aperturePolyData)
+{
+  if (!aperturePolyData)
+  {
+    vtkErrorMacro("CreateAperturePolyData: Invalid output poly data");
+    return false;
+  }
+  if (!this->IsControlPointIndexValid(index, "CreateAperturePolyData"))
+  {
+    return false;
+  }
+
+  vtkBeamControlPointSequence::CreateAperturePolyData(sourceAxisDistance, &this->JawPositions[4*index],
+    this->NumberOfLeafPairs, this->GetLeafPairBoundaries(), this->GetLeafPositions(index),
+    this->MLCDirection, aperturePolyData);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkBeamControlPointSequence::CreateAperturePolyData(double sourceAxisDistance, const double jawPositions[4],
+  int numberOfLeafPairs, const double* leafPairBoundaries, const double* leafPositions,
+  MLCDirectionType mlcDirection, vtkPolyData* aperturePolyData)
+{
+  if (!aperturePolyData)
+  {
+    return;
+  }
+
+  const double x1Jaw = jawPositions[0];
+  const double x2Jaw = jawPositions[1];
+  const double y1Jaw = jawPositions[2];
+  const double y2Jaw = jawPositions[3];
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkCellArray> cellArray = vtkSmartPointer<vtkCellArray>::New();
+
+  // Source
+  points->InsertNextPoint(0.0, 0.0, sourceAxisDistance);
+
+  if (numberOfLeafPairs <= 0 || !leafPairBoundaries || !leafPositions)
+  {
+    // Opening of the jaws
+    InsertAperturePoint(points, x2Jaw, y2Jaw, sourceAxisDistance);
+    InsertAperturePoint(points, x1Jaw, y2Jaw, sourceAxisDistance);
+    InsertAperturePoint(points, x1Jaw, y1Jaw, sourceAxisDistance);
+    InsertAperturePoint(points, x2Jaw, y1Jaw, sourceAxisDistance);
+  }
+  else
+  {
+    // Coordinates along the leaf motion (u) and along the leaf pair boundaries (v)
+    double u1Jaw = (mlcDirection == MLCX ? x1Jaw : y1Jaw);
+    double u2Jaw = (mlcDirection == MLCX ? x2Jaw : y2Jaw);
+    double v1Jaw = (mlcDirection == MLCX ? y1Jaw : x1Jaw);
+    double v2Jaw = (mlcDirection == MLCX ? y2Jaw : x2Jaw);
+
+    // Outline of the opening: along bank B through the leaf pairs in ascending order,
+    // then back along bank A. Leaf pairs outside the jaws are skipped.
+    std::vector<double> outlineU;
+    std::vector<double> outlineV;
+    for (int leafPair=0; leafPair<numberOfLeafPairs; ++leafPair)
+    {
+      double vLow = leafPairBoundaries[leafPair] > v1Jaw ? leafPairBoundaries[leafPair] : v1Jaw;
+      double vHigh = leafPairBoundaries[leafPair+1] < v2Jaw ? leafPairBoundaries[leafPair+1] : v2Jaw;
+      if (vHigh <= vLow)
+      {
+        continue;
+      }
+      double uA = Clamp(leafPositions[leafPair], u1Jaw, u2Jaw);
+      double uB = Clamp(leafPositions[numberOfLeafPairs + leafPair], u1Jaw, u2Jaw);
+      outlineU.push_back(uB > uA ? uB : uA);
+      outlineV.push_back(vLow);
+      outlineU.push_back(uB > uA ? uB : uA);
+      outlineV.push_back(vHigh);
+    }
+    // Bank A side in descending order closes the outline
+    for (int leafPair=numberOfLeafPairs-1; leafPair>=0; --leafPair)
+    {
+      double vLow = leafPairBoundaries[leafPair] > v1Jaw ? leafPairBoundaries[leafPair] : v1Jaw;
+      double vHigh = leafPairBoundaries[leafPair+1] < v2Jaw ? leafPairBoundaries[leafPair+1] : v2Jaw;
+      if (vHigh <= vLow)
+      {
+        continue;
+      }
+      double uA = Clamp(leafPositions[leafPair], u1Jaw, u2Jaw);
+      outlineU.push_back(uA);
+      outlineV.push_back(vHigh);
+      outlineU.push_back(uA);
+      outlineV.push_back(vLow);
+    }
+
+    for (size_t pointIndex=0; pointIndex<outlineU.size(); ++pointIndex)
+    {
+      if (mlcDirection == MLCX)
+      {
+        InsertAperturePoint(points, outlineU[pointIndex], outlineV[pointIndex], sourceAxisDistance);
+      }
+      else
+      {
+        InsertAperturePoint(points, outlineV[pointIndex], outlineU[pointIndex], sourceAxisDistance);
+      }
+    }
+  }
+
+  // Sides of the pyramid from the source to each edge of the outline, and the cap at the bottom
+  vtkIdType numberOfOutlinePoints = points->GetNumberOfPoints() - 1;
+  if (numberOfOutlinePoints >= 3)
+  {
+    for (vtkIdType pointId=1; pointId<=numberOfOutlinePoints; ++pointId)
+    {
+      cellArray->InsertNextCell(3);
+      cellArray->InsertCellPoint(0);
+      cellArray->InsertCellPoint(pointId);
+      cellArray->InsertCellPoint(pointId < numberOfOutlinePoints ? pointId+1 : 1);
+    }
+
+    cellArray->InsertNextCell(numberOfOutlinePoints);
+    for (vtkIdType pointId=1; pointId<=numberOfOutlinePoints; ++pointId)
+    {
+      cellArray->InsertCellPoint(pointId);
+    }
+  }
+
+  aperturePolyData->SetPoints(points);
+  aperturePolyData->SetPolys(cellArray);
+}
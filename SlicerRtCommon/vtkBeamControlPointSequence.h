@@ -0,0 +1,149 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkBeamControlPointSequence_h
+#define __vtkBeamControlPointSequence_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Control points of a treatment beam (such as a VMAT arc or an IMRT field)
+///
+/// The parameters of all control points are stored in one contiguous array per parameter
+/// (angles, jaw positions, cumulative meterset weight), and the MLC leaf positions of all
+/// control points in a single array, so that arcs with hundreds of control points need
+/// neither a node nor an object per control point. Control points contain all parameters,
+/// the values that are not changed by a DICOM control point are carried over by the reader.
+///
+/// The MLC is described by the leaf pair boundaries along the axis perpendicular to the leaf
+/// motion. Leaf positions of a control point are stored as in DICOM: the positions of bank A
+/// (the leaves on the negative side) for all leaf pairs, followed by the positions of bank B.
+/// The aperture geometry of a control point is only created on request (\sa CreateAperturePolyData).
+class VTK_SLICERRTCOMMON_EXPORT vtkBeamControlPointSequence : public vtkObject
+{
+public:
+  /// Direction in which the MLC leaves move (RT Beam Limiting Device Type MLCX or MLCY)
+  enum MLCDirectionType
+  {
+    MLCX = 0,
+    MLCY
+  };
+
+public:
+  static vtkBeamControlPointSequence* New();
+  vtkTypeMacro(vtkBeamControlPointSequence, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Remove all control points and the MLC definition
+  void Initialize();
+
+  /// Define the MLC of the beam. Must be called before adding control points with leaf positions
+  /// \param numberOfLeafPairs Number of leaf pairs. 0 if the beam has no MLC
+  /// \param leafPairBoundaries Positions of the leaf pair boundaries in ascending order (numberOfLeafPairs+1 values)
+  void SetMLC(int numberOfLeafPairs, const double* leafPairBoundaries, MLCDirectionType direction);
+  /// Get number of MLC leaf pairs. 0 if the beam has no MLC
+  int GetNumberOfLeafPairs() { return this->NumberOfLeafPairs; };
+  /// Get position of the leaf pair boundaries (\sa GetNumberOfLeafPairs + 1 values)
+  const double* GetLeafPairBoundaries();
+  /// Get MLC leaf motion direction
+  vtkGetMacro(MLCDirection, MLCDirectionType);
+
+  /// Append a control point
+  /// \param jawPositions X1, X2, Y1, Y2 jaw positions
+  /// \param leafPositions Bank A then bank B leaf positions (2 * \sa GetNumberOfLeafPairs values). NULL if no MLC
+  /// \return Index of the new control point
+  int AddControlPoint(double gantryAngle, double collimatorAngle, double couchAngle,
+    double cumulativeMetersetWeight, const double jawPositions[4], const double* leafPositions);
+
+  /// Get number of control points
+  int GetNumberOfControlPoints() { return static_cast<int>(this->GantryAngles.size()); };
+
+  /// Get gantry angle of a control point
+  double GetGantryAngle(int index);
+  /// Get beam limiting device (collimator) angle of a control point
+  double GetCollimatorAngle(int index);
+  /// Get patient support (couch) angle of a control point
+  double GetCouchAngle(int index);
+  /// Get cumulative meterset weight of a control point
+  double GetCumulativeMetersetWeight(int index);
+  /// Get X1, X2, Y1, Y2 jaw positions of a control point
+  /// \return Success flag
+  bool GetJawPositions(int index, double jawPositions[4]);
+  /// Get leaf positions of a control point (bank A then bank B). NULL if the beam has no MLC
+  const double* GetLeafPositions(int index);
+
+  /// Final cumulative meterset weight of the beam. Cumulative meterset weights of the
+  /// control points are relative to this value. 1 by default
+  vtkSetMacro(FinalCumulativeMetersetWeight, double);
+  vtkGetMacro(FinalCumulativeMetersetWeight, double);
+
+  /// Create the aperture model of a control point: a pyramid from the source through the opening
+  /// of the jaws and the MLC, in the beam coordinate system used by the beam model
+  /// \return Success flag
+  bool CreateAperturePolyData(int index, double sourceAxisDistance, vtkPolyData* aperturePolyData);
+
+  /// Create aperture model from the given jaw and leaf positions (\sa CreateAperturePolyData)
+  /// \param leafPositions Bank A then bank B leaf positions. If NULL or there are no leaves, then only the jaws define the aperture
+  static void CreateAperturePolyData(double sourceAxisDistance, const double jawPositions[4],
+    int numberOfLeafPairs, const double* leafPairBoundaries, const double* leafPositions,
+    MLCDirectionType mlcDirection, vtkPolyData* aperturePolyData);
+
+protected:
+  /// Check control point index and log error if invalid
+  bool IsControlPointIndexValid(int index, const char* callerName);
+
+protected:
+  /// Gantry angle of each control point
+  std::vector<double> GantryAngles;
+  /// Collimator angle of each control point
+  std::vector<double> CollimatorAngles;
+  /// Couch angle of each control point
+  std::vector<double> CouchAngles;
+  /// Cumulative meterset weight of each control point
+  std::vector<double> CumulativeMetersetWeights;
+  /// X1, X2, Y1, Y2 jaw positions of each control point
+  std::vector<double> JawPositions;
+  /// Leaf positions of each control point (2 * NumberOfLeafPairs values per control point)
+  std::vector<double> LeafPositions;
+
+  /// Number of MLC leaf pairs
+  int NumberOfLeafPairs;
+  /// Leaf pair boundaries (NumberOfLeafPairs + 1 values)
+  std::vector<double> LeafPairBoundaries;
+  /// MLC leaf motion direction
+  MLCDirectionType MLCDirection;
+
+  /// Final cumulative meterset weight of the beam
+  double FinalCumulativeMetersetWeight;
+
+protected:
+  vtkBeamControlPointSequence();
+  ~vtkBeamControlPointSequence();
+
+private:
+  vtkBeamControlPointSequence(const vtkBeamControlPointSequence&); // Not implemented
+  void operator=(const vtkBeamControlPointSequence&);               // Not implemented
+};
+
+#endif
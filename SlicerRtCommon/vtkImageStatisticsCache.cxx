@@ -0,0 +1,415 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkImageStatisticsCache.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkCallbackCommand.h>
+#include <vtkSimpleCriticalSection.h>
+#include <vtkSMPTools.h>
+#include <vtkSMPThreadLocal.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Compute range and moments of the first component of the scalars
+  template<typename T>
+  class RangeAndMomentsFunctor
+  {
+  public:
+    struct Partial
+    {
+      double Minimum;
+      double Maximum;
+      double Sum;
+      double SumOfSquares;
+      vtkIdType Count;
+    };
+
+    RangeAndMomentsFunctor(const T* scalars, int numberOfComponents)
+      : Scalars(scalars)
+      , NumberOfComponents(numberOfComponents)
+    {
+      this->Result.Minimum = VTK_DOUBLE_MAX;
+      this->Result.Maximum = VTK_DOUBLE_MIN;
+      this->Result.Sum = 0.0;
+      this->Result.SumOfSquares = 0.0;
+      this->Result.Count = 0;
+    }
+
+    void Initialize()
+    {
+      Partial& partial = this->Partials.Local();
+      partial = this->Result;
+    }
+
+    void operator()(vtkIdType beginVoxel, vtkIdType endVoxel)
+    {
+      Partial& partial = this->Partials.Local();
+      const T* scalarPtr = this->Scalars + beginVoxel*this->NumberOfComponents;
+      for (vtkIdType voxel=beginVoxel; voxel<endVoxel; ++voxel, scalarPtr+=this->NumberOfComponents)
+      {
+        double value = static_cast<double>(*scalarPtr);
+        if (value != value)
+        {
+          // NaN
+          continue;
+        }
+        partial.Minimum = std::min(partial.Minimum, value);
+        partial.Maximum = std::max(partial.Maximum, value);
+        partial.Sum += value;
+        partial.SumOfSquares += value*value;
+        ++partial.Count;
+      }
+    }
+
+    void Reduce()
+    {
+      for (typename vtkSMPThreadLocal<Partial>::iterator partialIt = this->Partials.begin(); partialIt != this->Partials.end(); ++partialIt)
+      {
+        this->Result.Minimum = std::min(this->Result.Minimum, partialIt->Minimum);
+        this->Result.Maximum = std::max(this->Result.Maximum, partialIt->Maximum);
+        this->Result.Sum += partialIt->Sum;
+        this->Result.SumOfSquares += partialIt->SumOfSquares;
+        this->Result.Count += partialIt->Count;
+      }
+    }
+
+    Partial Result;
+
+  private:
+    const T* Scalars;
+    int NumberOfComponents;
+    vtkSMPThreadLocal<Partial> Partials;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute histogram of the first component of the scalars
+  template<typename T>
+  class HistogramFunctor
+  {
+  public:
+    HistogramFunctor(const T* scalars, int numberOfComponents, double origin, double binWidth, int numberOfBins)
+      : Scalars(scalars)
+      , NumberOfComponents(numberOfComponents)
+      , Origin(origin)
+      , BinWidth(binWidth)
+      , NumberOfBins(numberOfBins)
+    {
+    }
+
+    void Initialize()
+    {
+      this->Histograms.Local().assign(this->NumberOfBins, 0);
+    }
+
+    void operator()(vtkIdType beginVoxel, vtkIdType endVoxel)
+    {
+      std::vector<vtkIdType>& histogram = this->Histograms.Local();
+      const T* scalarPtr = this->Scalars + beginVoxel*this->NumberOfComponents;
+      double inverseBinWidth = 1.0 / this->BinWidth;
+      for (vtkIdType voxel=beginVoxel; voxel<endVoxel; ++voxel, scalarPtr+=this->NumberOfComponents)
+      {
+        double value = static_cast<double>(*scalarPtr);
+        if (value != value)
+        {
+          continue;
+        }
+        int bin = static_cast<int>((value - this->Origin) * inverseBinWidth);
+        bin = std::min(std::max(bin, 0), this->NumberOfBins-1);
+        ++histogram[bin];
+      }
+    }
+
+    void Reduce()
+    {
+      this->Result.assign(this->NumberOfBins, 0);
+      for (typename vtkSMPThreadLocal<std::vector<vtkIdType> >::iterator histogramIt = this->Histograms.begin();
+        histogramIt != this->Histograms.end(); ++histogramIt)
+      {
+        for (int bin=0; bin<this->NumberOfBins; ++bin)
+        {
+          this->Result[bin] += (*histogramIt)[bin];
+        }
+      }
+    }
+
+    std::vector<vtkIdType> Result;
+
+  private:
+    const T* Scalars;
+    int NumberOfComponents;
+    double Origin;
+    double BinWidth;
+    int NumberOfBins;
+    vtkSMPThreadLocal<std::vector<vtkIdType> > Histograms;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  void ComputeImageStatistics(vtkImageStatisticsCache* self, vtkImageData* image, T* scalars, vtkImageStatisticsCache::Statistics& statistics)
+  {
+    vtkIdType numberOfVoxels = image->GetNumberOfPoints();
+    int numberOfComponents = image->GetNumberOfScalarComponents();
+
+    RangeAndMomentsFunctor<T> rangeAndMoments(scalars, numberOfComponents);
+    vtkSMPTools::For(0, numberOfVoxels, rangeAndMoments);
+    statistics.NumberOfVoxels = rangeAndMoments.Result.Count;
+    if (statistics.NumberOfVoxels == 0)
+    {
+      return;
+    }
+    statistics.Minimum = rangeAndMoments.Result.Minimum;
+    statistics.Maximum = rangeAndMoments.Result.Maximum;
+    statistics.Mean = rangeAndMoments.Result.Sum / statistics.NumberOfVoxels;
+    double variance = rangeAndMoments.Result.SumOfSquares / statistics.NumberOfVoxels - statistics.Mean*statistics.Mean;
+    statistics.StandardDeviation = (variance > 0.0 ? sqrt(variance) : 0.0);
+
+    // Integer images get one bin per value if the range allows
+    int numberOfBins = self->GetNumberOfHistogramBins();
+    bool integerScalars = (image->GetScalarType() != VTK_FLOAT && image->GetScalarType() != VTK_DOUBLE);
+    if (integerScalars && statistics.Maximum - statistics.Minimum + 1.0 <= self->GetMaximumNumberOfIntegerBins())
+    {
+      numberOfBins = static_cast<int>(statistics.Maximum - statistics.Minimum) + 1;
+      statistics.HistogramOrigin = statistics.Minimum - 0.5;
+      statistics.HistogramBinWidth = 1.0;
+    }
+    else
+    {
+      numberOfBins = std::max(numberOfBins, 1);
+      statistics.HistogramOrigin = statistics.Minimum;
+      statistics.HistogramBinWidth = (statistics.Maximum > statistics.Minimum ? (statistics.Maximum - statistics.Minimum) / numberOfBins : 1.0);
+    }
+
+    HistogramFunctor<T> histogram(scalars, numberOfComponents, statistics.HistogramOrigin, statistics.HistogramBinWidth, numberOfBins);
+    vtkSMPTools::For(0, numberOfVoxels, histogram);
+    statistics.Histogram.swap(histogram.Result);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCache::Statistics::Statistics()
+  : Minimum(0.0)
+  , Maximum(0.0)
+  , Mean(0.0)
+  , StandardDeviation(0.0)
+  , NumberOfVoxels(0)
+  , HistogramOrigin(0.0)
+  , HistogramBinWidth(1.0)
+{
+}
+
+//----------------------------------------------------------------------------
+// The shared instance, and the Schwarz counter used for its creation and deletion
+vtkImageStatisticsCache* vtkImageStatisticsCache::Instance = NULL;
+static unsigned int vtkImageStatisticsCacheInitializeCount = 0;
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCacheInitialize::vtkImageStatisticsCacheInitialize()
+{
+  if (++vtkImageStatisticsCacheInitializeCount == 1)
+  {
+    vtkImageStatisticsCache::classInitialize();
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCacheInitialize::~vtkImageStatisticsCacheInitialize()
+{
+  if (--vtkImageStatisticsCacheInitializeCount == 0)
+  {
+    vtkImageStatisticsCache::classFinalize();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::classInitialize()
+{
+  vtkImageStatisticsCache::Instance = vtkImageStatisticsCache::New();
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::classFinalize()
+{
+  if (vtkImageStatisticsCache::Instance)
+  {
+    vtkImageStatisticsCache::Instance->Delete();
+    vtkImageStatisticsCache::Instance = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCache* vtkImageStatisticsCache::GetInstance()
+{
+  return vtkImageStatisticsCache::Instance;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkImageStatisticsCache);
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCache::vtkImageStatisticsCache()
+{
+  this->CacheLock = new vtkSimpleCriticalSection();
+  this->NumberOfHistogramBins = 1000;
+  this->MaximumNumberOfIntegerBins = 65536;
+}
+
+//----------------------------------------------------------------------------
+vtkImageStatisticsCache::~vtkImageStatisticsCache()
+{
+  this->RemoveAllImages();
+  delete this->CacheLock;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfHistogramBins: " << this->NumberOfHistogramBins << "\n";
+  os << indent << "MaximumNumberOfIntegerBins: " << this->MaximumNumberOfIntegerBins << "\n";
+  os << indent << "NumberOfCachedImages: " << this->Cache.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageStatisticsCache::GetStatistics(vtkImageData* image, Statistics& statistics)
+{
+  if (!image || !image->GetPointData() || !image->GetPointData()->GetScalars())
+  {
+    return false;
+  }
+  vtkObject* scalars = image->GetPointData()->GetScalars();
+  vtkMTimeType imageMTime = image->GetMTime();
+
+  this->CacheLock->Lock();
+  std::map<vtkImageData*, CacheEntry>::iterator entryIt = this->Cache.find(image);
+  if (entryIt != this->Cache.end() && entryIt->second.Scalars == scalars && entryIt->second.MTime == imageMTime)
+  {
+    statistics = entryIt->second.ImageStatistics;
+    this->CacheLock->Unlock();
+    return true;
+  }
+  this->CacheLock->Unlock();
+
+  // Compute outside the lock so that statistics of other images can be queried meanwhile
+  if (!this->ComputeStatistics(image, statistics))
+  {
+    return false;
+  }
+
+  this->CacheLock->Lock();
+  entryIt = this->Cache.find(image);
+  if (entryIt == this->Cache.end())
+  {
+    vtkSmartPointer<vtkCallbackCommand> deleteCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    deleteCallback->SetClientData(this);
+    deleteCallback->SetCallback(vtkImageStatisticsCache::OnImageDeleted);
+    CacheEntry& entry = this->Cache[image];
+    entry.Image = image;
+    entry.DeleteObserverTag = image->AddObserver(vtkCommand::DeleteEvent, deleteCallback);
+    entryIt = this->Cache.find(image);
+  }
+  entryIt->second.Scalars = scalars;
+  entryIt->second.MTime = imageMTime;
+  entryIt->second.ImageStatistics = statistics;
+  this->CacheLock->Unlock();
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageStatisticsCache::GetScalarRange(vtkImageData* image, double range[2])
+{
+  Statistics statistics;
+  if (!this->GetStatistics(image, statistics) || statistics.NumberOfVoxels == 0)
+  {
+    return false;
+  }
+  range[0] = statistics.Minimum;
+  range[1] = statistics.Maximum;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageStatisticsCache::ComputeStatistics(vtkImageData* image, Statistics& statistics)
+{
+  if (!image || !image->GetPointData() || !image->GetPointData()->GetScalars())
+  {
+    return false;
+  }
+
+  statistics = Statistics();
+  switch (image->GetScalarType())
+  {
+    vtkTemplateMacro(ComputeImageStatistics<VTK_TT>(this, image, static_cast<VTK_TT*>(image->GetScalarPointer()), statistics));
+    default:
+      vtkErrorMacro("ComputeStatistics: Unsupported scalar type " << image->GetScalarType());
+      return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::RemoveImage(vtkImageData* image)
+{
+  this->CacheLock->Lock();
+  std::map<vtkImageData*, CacheEntry>::iterator entryIt = this->Cache.find(image);
+  if (entryIt != this->Cache.end())
+  {
+    image->RemoveObserver(entryIt->second.DeleteObserverTag);
+    this->Cache.erase(entryIt);
+  }
+  this->CacheLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::RemoveAllImages()
+{
+  this->CacheLock->Lock();
+  for (std::map<vtkImageData*, CacheEntry>::iterator entryIt = this->Cache.begin(); entryIt != this->Cache.end(); ++entryIt)
+  {
+    entryIt->second.Image->RemoveObserver(entryIt->second.DeleteObserverTag);
+  }
+  this->Cache.clear();
+  this->CacheLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkImageStatisticsCache::OnImageDeleted(vtkObject* caller, unsigned long vtkNotUsed(eid), void* clientData, void* vtkNotUsed(callData))
+{
+  vtkImageStatisticsCache* self = reinterpret_cast<vtkImageStatisticsCache*>(clientData);
+  vtkImageData* image = static_cast<vtkImageData*>(caller);
+  if (!self)
+  {
+    return;
+  }
+
+  // The image is being destructed, so the observer is not removed explicitly
+  self->CacheLock->Lock();
+  self->Cache.erase(image);
+  self->CacheLock->Unlock();
+}
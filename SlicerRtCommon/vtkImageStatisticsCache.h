@@ -0,0 +1,148 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkImageStatisticsCache_h
+#define __vtkImageStatisticsCache_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <map>
+#include <vector>
+
+class vtkImageData;
+class vtkSimpleCriticalSection;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Shared cache of voxel value statistics of images.
+///
+/// Several modules need the range or the distribution of the values of the same (typically dose)
+/// volume. The statistics of an image are computed with multiple threads on the first request,
+/// and are reused until the image or its scalars are modified or the image is deleted.
+/// Only the first scalar component is considered, NaN values are ignored.
+class VTK_SLICERRTCOMMON_EXPORT vtkImageStatisticsCache : public vtkObject
+{
+public:
+  /// Statistics of the voxel values of an image
+  struct VTK_SLICERRTCOMMON_EXPORT Statistics
+  {
+    Statistics();
+
+    double Minimum;
+    double Maximum;
+    double Mean;
+    double StandardDeviation;
+    vtkIdType NumberOfVoxels;
+
+    /// Lower edge of the first histogram bin
+    double HistogramOrigin;
+    double HistogramBinWidth;
+    /// Number of voxels in each histogram bin. For integer images of narrow enough
+    /// range each bin contains exactly one value (see \sa GetBinCenter)
+    std::vector<vtkIdType> Histogram;
+
+    /// Value at the center of a histogram bin
+    double GetBinCenter(int bin) const { return this->HistogramOrigin + (bin + 0.5) * this->HistogramBinWidth; };
+  };
+
+public:
+  static vtkImageStatisticsCache* New();
+  vtkTypeMacro(vtkImageStatisticsCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Get the instance shared by the modules
+  static vtkImageStatisticsCache* GetInstance();
+
+  /// Get statistics of an image. Computed if the image is not in the cache or has been modified since
+  /// \return False if the image has no scalars
+  bool GetStatistics(vtkImageData* image, Statistics& statistics);
+
+  /// Get minimum and maximum voxel value of an image. Convenience function for \sa GetStatistics
+  /// \return False if the image has no scalars
+  bool GetScalarRange(vtkImageData* image, double range[2]);
+
+  /// Remove statistics of an image from the cache
+  void RemoveImage(vtkImageData* image);
+
+  /// Remove all statistics from the cache
+  void RemoveAllImages();
+
+  /// Number of histogram bins for floating point images, and for integer images with
+  /// more distinct values than \sa MaximumNumberOfIntegerBins. 1000 by default
+  vtkGetMacro(NumberOfHistogramBins, int);
+  vtkSetMacro(NumberOfHistogramBins, int);
+
+  /// Maximum number of histogram bins for integer images that have one bin for each value. 65536 by default
+  vtkGetMacro(MaximumNumberOfIntegerBins, int);
+  vtkSetMacro(MaximumNumberOfIntegerBins, int);
+
+  /// Compute statistics of an image without using the cache
+  /// \return False if the image has no scalars
+  bool ComputeStatistics(vtkImageData* image, Statistics& statistics);
+
+protected:
+  /// Cached statistics of an image
+  struct CacheEntry
+  {
+    vtkImageData* Image;
+    vtkObject* Scalars;
+    vtkMTimeType MTime;
+    unsigned long DeleteObserverTag;
+    Statistics ImageStatistics;
+  };
+
+  /// Remove entry of a deleted image
+  static void OnImageDeleted(vtkObject* caller, unsigned long eid, void* clientData, void* callData);
+
+protected:
+  std::map<vtkImageData*, CacheEntry> Cache;
+  vtkSimpleCriticalSection* CacheLock;
+
+  int NumberOfHistogramBins;
+  int MaximumNumberOfIntegerBins;
+
+protected:
+  vtkImageStatisticsCache();
+  virtual ~vtkImageStatisticsCache();
+
+private:
+  vtkImageStatisticsCache(const vtkImageStatisticsCache&); // Not implemented
+  void operator=(const vtkImageStatisticsCache&);         // Not implemented
+
+  friend class vtkImageStatisticsCacheInitialize;
+  static void classInitialize();
+  static void classFinalize();
+
+  static vtkImageStatisticsCache* Instance;
+};
+
+/// Utility class to make sure the shared instance is created before and deleted after
+/// all other singletons (Schwarz counter idiom)
+class VTK_SLICERRTCOMMON_EXPORT vtkImageStatisticsCacheInitialize
+{
+public:
+  vtkImageStatisticsCacheInitialize();
+  ~vtkImageStatisticsCacheInitialize();
+};
+
+/// This instance will show up in any translation unit that uses vtkImageStatisticsCache.
+/// It will make sure the shared instance is initialized before it is used.
+static vtkImageStatisticsCacheInitialize vtkImageStatisticsCacheInitializer;
+
+#endif
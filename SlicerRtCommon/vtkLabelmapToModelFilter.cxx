@@ -28,6 +28,257 @@
 #include <vtkMarchingCubes.h>
 #include <vtkDecimatePro.h>
 #include <vtkVersion.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <map>
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Bounding extent and voxel count of one label
+  struct LabelExtent
+  {
+    LabelExtent()
+      : NumberOfVoxels(0)
+    {
+      this->Extent[0] = this->Extent[2] = this->Extent[4] = VTK_INT_MAX;
+      this->Extent[1] = this->Extent[3] = this->Extent[5] = VTK_INT_MIN;
+    }
+    void Merge(const LabelExtent& other)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Extent[2*axis] = std::min(this->Extent[2*axis], other.Extent[2*axis]);
+        this->Extent[2*axis+1] = std::max(this->Extent[2*axis+1], other.Extent[2*axis+1]);
+      }
+      this->NumberOfVoxels += other.NumberOfVoxels;
+    }
+    int Extent[6];
+    vtkIdType NumberOfVoxels;
+  };
+  typedef std::map<double, LabelExtent> LabelExtentMap;
+
+  /// Surface extraction errors, reported to the caller in the main thread
+  enum LabelSurfaceError
+  {
+    NoError = 0,
+    MarchingCubesError,
+    NoPolygonsError,
+    DecimationError
+  };
+
+  //----------------------------------------------------------------------------
+  /// Collect the extent of each non-zero label slice by slice. Runs of identical voxels within a row
+  /// are handled at once, so the map is only looked up at label boundaries
+  template<class T> class FindLabelExtentsFunctor
+  {
+  public:
+    FindLabelExtentsFunctor(vtkImageData* image, std::vector<LabelExtentMap>& sliceLabelExtents)
+      : Image(image)
+      , SliceLabelExtents(sliceLabelExtents)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      int extent[6] = {0,0,0,0,0,0};
+      this->Image->GetExtent(extent);
+      vtkIdType increments[3] = {0,0,0};
+      this->Image->GetIncrements(increments);
+      const T* scalars = static_cast<const T*>(this->Image->GetScalarPointer());
+      int dimX = extent[1] - extent[0] + 1;
+
+      for (vtkIdType sliceIndex=beginSlice; sliceIndex<endSlice; ++sliceIndex)
+      {
+        LabelExtentMap& labelExtents = this->SliceLabelExtents[sliceIndex];
+        int k = extent[4] + static_cast<int>(sliceIndex);
+        for (int j=extent[2]; j<=extent[3]; ++j)
+        {
+          const T* row = scalars + sliceIndex*increments[2] + (j-extent[2])*increments[1];
+          int i = 0;
+          while (i < dimX)
+          {
+            T value = row[i*increments[0]];
+            int runStart = i;
+            while (++i < dimX && row[i*increments[0]] == value)
+            {
+            }
+            if (value == 0)
+            {
+              continue;
+            }
+            LabelExtent& labelExtent = labelExtents[static_cast<double>(value)];
+            labelExtent.Extent[0] = std::min(labelExtent.Extent[0], extent[0] + runStart);
+            labelExtent.Extent[1] = std::max(labelExtent.Extent[1], extent[0] + i - 1);
+            labelExtent.Extent[2] = std::min(labelExtent.Extent[2], j);
+            labelExtent.Extent[3] = std::max(labelExtent.Extent[3], j);
+            labelExtent.Extent[4] = std::min(labelExtent.Extent[4], k);
+            labelExtent.Extent[5] = std::max(labelExtent.Extent[5], k);
+            labelExtent.NumberOfVoxels += i - runStart;
+          }
+        }
+      }
+    }
+
+  private:
+    vtkImageData* Image;
+    std::vector<LabelExtentMap>& SliceLabelExtents;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Extract and decimate the surface of each label within its own extent (padded by one voxel
+  /// so that the surface is closed where the label does not touch the labelmap boundary).
+  /// Each label is processed independently, so labels are distributed among the threads
+  template<class T> class ExtractLabelSurfacesFunctor
+  {
+  public:
+    ExtractLabelSurfacesFunctor(vtkImageData* image, const std::vector<double>& labelValues,
+      const std::vector<LabelExtent>& labelExtents, double decimateTargetReduction,
+      std::vector<vtkSmartPointer<vtkPolyData> >& outputs, std::vector<int>& errors)
+      : Image(image)
+      , LabelValues(labelValues)
+      , LabelExtents(labelExtents)
+      , DecimateTargetReduction(decimateTargetReduction)
+      , Outputs(outputs)
+      , Errors(errors)
+    {
+    }
+
+    void operator()(vtkIdType beginLabel, vtkIdType endLabel)
+    {
+      for (vtkIdType labelIndex=beginLabel; labelIndex<endLabel; ++labelIndex)
+      {
+        if (this->LabelExtents[labelIndex].NumberOfVoxels == 0)
+        {
+          continue;
+        }
+        this->Errors[labelIndex] = this->ExtractLabelSurface(labelIndex);
+      }
+    }
+
+  protected:
+    int ExtractLabelSurface(vtkIdType labelIndex)
+    {
+      int wholeExtent[6] = {0,0,0,0,0,0};
+      this->Image->GetExtent(wholeExtent);
+      vtkIdType increments[3] = {0,0,0};
+      this->Image->GetIncrements(increments);
+      const T* scalars = static_cast<const T*>(this->Image->GetScalarPointer());
+
+      const int* labelExtent = this->LabelExtents[labelIndex].Extent;
+      int maskExtent[6] = {0,0,0,0,0,0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        maskExtent[2*axis] = std::max(labelExtent[2*axis] - 1, wholeExtent[2*axis]);
+        maskExtent[2*axis+1] = std::min(labelExtent[2*axis+1] + 1, wholeExtent[2*axis+1]);
+      }
+
+      // Binary mask of the label cropped to its extent
+      vtkSmartPointer<vtkImageData> mask = vtkSmartPointer<vtkImageData>::New();
+      mask->SetExtent(maskExtent);
+      mask->SetOrigin(this->Image->GetOrigin());
+      mask->SetSpacing(this->Image->GetSpacing());
+      mask->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+      unsigned char* maskPtr = static_cast<unsigned char*>(mask->GetScalarPointer());
+      T labelValue = static_cast<T>(this->LabelValues[labelIndex]);
+      for (int k=maskExtent[4]; k<=maskExtent[5]; ++k)
+      {
+        for (int j=maskExtent[2]; j<=maskExtent[3]; ++j)
+        {
+          const T* row = scalars + (k-wholeExtent[4])*increments[2] + (j-wholeExtent[2])*increments[1];
+          for (int i=maskExtent[0]; i<=maskExtent[1]; ++i)
+          {
+            *(maskPtr++) = (row[(i-wholeExtent[0])*increments[0]] == labelValue ? 1 : 0);
+          }
+        }
+      }
+
+      // Run marching cubes
+      vtkSmartPointer<vtkMarchingCubes> marchingCubes = vtkSmartPointer<vtkMarchingCubes>::New();
+      marchingCubes->SetInputData(mask);
+      marchingCubes->SetNumberOfContours(1);
+      marchingCubes->SetValue(0, 0.5);
+      marchingCubes->ComputeScalarsOff();
+      marchingCubes->ComputeGradientsOff();
+      marchingCubes->ComputeNormalsOff();
+      try
+      {
+        marchingCubes->Update();
+      }
+      catch(...)
+      {
+        return MarchingCubesError;
+      }
+      if (marchingCubes->GetOutput()->GetNumberOfPolys() == 0)
+      {
+        return NoPolygonsError;
+      }
+
+      // Decimate
+      vtkSmartPointer<vtkDecimatePro> decimator = vtkSmartPointer<vtkDecimatePro>::New();
+      decimator->SetInputData(marchingCubes->GetOutput());
+      decimator->SetFeatureAngle(60);
+      decimator->SplittingOff();
+      decimator->PreserveTopologyOn();
+      decimator->SetMaximumError(1);
+      decimator->SetTargetReduction(this->DecimateTargetReduction);
+      try
+      {
+        decimator->Update();
+      }
+      catch(...)
+      {
+        return DecimationError;
+      }
+
+      this->Outputs[labelIndex]->ShallowCopy(decimator->GetOutput());
+      return NoError;
+    }
+
+  private:
+    vtkImageData* Image;
+    const std::vector<double>& LabelValues;
+    const std::vector<LabelExtent>& LabelExtents;
+    double DecimateTargetReduction;
+    std::vector<vtkSmartPointer<vtkPolyData> >& Outputs;
+    std::vector<int>& Errors;
+  };
+
+  //----------------------------------------------------------------------------
+  template<class T> void FindLabelExtents(vtkImageData* image, T*, LabelExtentMap& labelExtents)
+  {
+    int extent[6] = {0,0,0,0,0,0};
+    image->GetExtent(extent);
+    vtkIdType numberOfSlices = extent[5] - extent[4] + 1;
+
+    std::vector<LabelExtentMap> sliceLabelExtents(numberOfSlices);
+    FindLabelExtentsFunctor<T> functor(image, sliceLabelExtents);
+    vtkSMPTools::For(0, numberOfSlices, functor);
+
+    labelExtents.clear();
+    for (std::vector<LabelExtentMap>::iterator sliceIt=sliceLabelExtents.begin(); sliceIt!=sliceLabelExtents.end(); ++sliceIt)
+    {
+      for (LabelExtentMap::iterator labelIt=sliceIt->begin(); labelIt!=sliceIt->end(); ++labelIt)
+      {
+        labelExtents[labelIt->first].Merge(labelIt->second);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<class T> void ExtractLabelSurfaces(vtkImageData* image, T*, const std::vector<double>& labelValues,
+    const std::vector<LabelExtent>& labelExtents, double decimateTargetReduction,
+    std::vector<vtkSmartPointer<vtkPolyData> >& outputs, std::vector<int>& errors)
+  {
+    ExtractLabelSurfacesFunctor<T> functor(image, labelValues, labelExtents, decimateTargetReduction, outputs, errors);
+    // One label per work item, as the cost of the labels can be very different
+    vtkSMPTools::For(0, static_cast<vtkIdType>(labelValues.size()), 1, functor);
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkLabelmapToModelFilter);
@@ -117,4 +368,134 @@ void vtkLabelmapToModelFilter::Update()
   }
 
   this->OutputModel->ShallowCopy(decimator->GetOutput());
-} 
\ No newline at end of file
+} 
+
+//----------------------------------------------------------------------------
+void vtkLabelmapToModelFilter::AddLabelValue(double labelValue)
+{
+  this->LabelValues.push_back(labelValue);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapToModelFilter::RemoveAllLabelValues()
+{
+  this->LabelValues.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLabelmapToModelFilter::GetNumberOfLabelOutputs()
+{
+  return static_cast<int>(this->LabelOutputs.size());
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkLabelmapToModelFilter::GetLabelOutput(int index)
+{
+  if (index < 0 || index >= static_cast<int>(this->LabelOutputs.size()))
+  {
+    vtkErrorMacro("GetLabelOutput: Invalid output index " << index);
+    return NULL;
+  }
+  return this->LabelOutputs[index];
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapToModelFilter::GetLabelOutputValue(int index)
+{
+  if (index < 0 || index >= static_cast<int>(this->LabelOutputValues.size()))
+  {
+    vtkErrorMacro("GetLabelOutputValue: Invalid output index " << index);
+    return 0.0;
+  }
+  return this->LabelOutputValues[index];
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapToModelFilter::UpdateAllLabels()
+{
+  this->LabelOutputValues.clear();
+  this->LabelOutputs.clear();
+
+  if (!this->InputLabelmap || !this->InputLabelmap->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("UpdateAllLabels: Input labelmap has to be initialized!");
+    return;
+  }
+  if (this->InputLabelmap->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("UpdateAllLabels: Input labelmap has to have a single scalar component!");
+    return;
+  }
+
+  // Find extent of each label in a single pass
+  LabelExtentMap foundLabelExtents;
+  switch (this->InputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(FindLabelExtents(this->InputLabelmap, static_cast<VTK_TT*>(NULL), foundLabelExtents));
+  default:
+    vtkErrorMacro("UpdateAllLabels: Unsupported scalar type " << this->InputLabelmap->GetScalarTypeAsString());
+    return;
+  }
+
+  // Select labels to extract
+  std::vector<LabelExtent> labelExtents;
+  if (this->LabelValues.empty())
+  {
+    for (LabelExtentMap::iterator labelIt=foundLabelExtents.begin(); labelIt!=foundLabelExtents.end(); ++labelIt)
+    {
+      this->LabelOutputValues.push_back(labelIt->first);
+      labelExtents.push_back(labelIt->second);
+    }
+  }
+  else
+  {
+    for (std::vector<double>::iterator valueIt=this->LabelValues.begin(); valueIt!=this->LabelValues.end(); ++valueIt)
+    {
+      this->LabelOutputValues.push_back(*valueIt);
+      LabelExtentMap::iterator labelIt = foundLabelExtents.find(*valueIt);
+      if (labelIt == foundLabelExtents.end())
+      {
+        vtkWarningMacro("UpdateAllLabels: Label " << (*valueIt) << " is not found in the input labelmap");
+        labelExtents.push_back(LabelExtent());
+      }
+      else
+      {
+        labelExtents.push_back(labelIt->second);
+      }
+    }
+  }
+
+  // Output objects are created in the main thread, the threads only fill them
+  for (size_t labelIndex=0; labelIndex<this->LabelOutputValues.size(); ++labelIndex)
+  {
+    this->LabelOutputs.push_back(vtkSmartPointer<vtkPolyData>::New());
+  }
+
+  // Extract and decimate surfaces in parallel
+  std::vector<int> errors(this->LabelOutputValues.size(), 0);
+  switch (this->InputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(ExtractLabelSurfaces(this->InputLabelmap, static_cast<VTK_TT*>(NULL), this->LabelOutputValues,
+      labelExtents, this->DecimateTargetReduction, this->LabelOutputs, errors));
+  }
+
+  for (size_t labelIndex=0; labelIndex<errors.size(); ++labelIndex)
+  {
+    switch (errors[labelIndex])
+    {
+    case MarchingCubesError:
+      vtkErrorMacro("UpdateAllLabels: Error while running marching cubes for label " << this->LabelOutputValues[labelIndex]);
+      break;
+    case NoPolygonsError:
+      vtkErrorMacro("UpdateAllLabels: No polygons can be created for label " << this->LabelOutputValues[labelIndex]);
+      break;
+    case DecimationError:
+      vtkErrorMacro("UpdateAllLabels: Error decimating model for label " << this->LabelOutputValues[labelIndex]);
+      break;
+    default:
+      break;
+    }
+  }
+}
@@ -18,8 +18,10 @@
 
 ==============================================================================*/
 
-// .NAME vtkLabelmapToModelFilter - Converts PolyData model to Labelmap image data
+// .NAME vtkLabelmapToModelFilter - Converts Labelmap image data to PolyData model
 // .SECTION Description
+// In single label mode (\sa Update) marching cubes is run on the whole input labelmap.
+// In multi-label mode (\sa UpdateAllLabels) one model is created for each label value.
 
 
 #ifndef __vtkLabelmapToModelFilter_h
@@ -28,9 +30,11 @@
 // VTK includes
 #include <vtkPolyData.h>
 #include <vtkImageData.h>
+#include <vtkSmartPointer.h>
 
 // STD includes
 #include <cstdlib>
+#include <vector>
 
 #include "vtkSlicerRtCommonWin32Header.h"
 
@@ -47,6 +51,25 @@ public:
 
   virtual void Update();
 
+  /// Extract the surfaces of multiple labels of the input labelmap at once.
+  /// The volume is scanned only once to find the extent of each label, then the surfaces are
+  /// extracted and decimated in parallel, each label only within its own extent.
+  /// The models are available through \sa GetLabelOutput
+  virtual void UpdateAllLabels();
+
+  /// Add label value to extract in \sa UpdateAllLabels.
+  /// If no value is added then the models of all non-zero labels are created
+  void AddLabelValue(double labelValue);
+  /// Clear label values to extract in \sa UpdateAllLabels
+  void RemoveAllLabelValues();
+
+  /// Get number of models created by \sa UpdateAllLabels
+  int GetNumberOfLabelOutputs();
+  /// Get model created by \sa UpdateAllLabels. Empty if the label was not found in the input
+  vtkPolyData* GetLabelOutput(int index);
+  /// Get label value of the model created by \sa UpdateAllLabels
+  double GetLabelOutputValue(int index);
+
   vtkSetObjectMacro(InputLabelmap, vtkImageData);
 
   vtkGetMacro(DecimateTargetReduction, double);
@@ -65,6 +88,13 @@ protected:
   /// Use this value for the marching cubes
   double LabelValue;
 
+  /// Label values to extract in multi-label mode. All non-zero labels if empty
+  std::vector<double> LabelValues;
+  /// Label values of the models created in multi-label mode
+  std::vector<double> LabelOutputValues;
+  /// Models created in multi-label mode
+  std::vector<vtkSmartPointer<vtkPolyData> > LabelOutputs;
+
 protected:
   vtkLabelmapToModelFilter();
   virtual ~vtkLabelmapToModelFilter();
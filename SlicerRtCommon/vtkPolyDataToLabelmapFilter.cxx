@@ -34,6 +34,9 @@
 #include <vtkSmartPointer.h>
 #include <vtkStripper.h>
 #include <vtkTriangleFilter.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkSMPTools.h>
 
 //----------------------------------------------------------------------------
 
@@ -48,6 +51,129 @@ namespace
       extentsA[4] == extentsB[4] &&
       extentsA[5] == extentsB[5];
   }
+
+  //----------------------------------------------------------------------------
+  /// Triangles of one structure prepared for scanline filling
+  struct RasterizedStructure
+  {
+    unsigned short LabelValue;
+    /// Extent of the structure clipped to the output extent
+    int Extent[6];
+    /// Triangle vertex coordinates in continuous IJK (9 values per triangle)
+    std::vector<double> Triangles;
+    /// Indices of the triangles intersecting each slice within the extent of the structure
+    std::vector<std::vector<vtkIdType> > SliceTriangles;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Fill the structures slice by slice. In each slice the triangles are cut to segments, then the
+  /// segments are intersected with the rows, and the voxels between pairs of crossings are filled
+  /// (even-odd rule). Crossings use half-open intervals so that vertices lying exactly on a slice or
+  /// row are counted once. Structures are processed in the order they were added within each slice,
+  /// so the result does not depend on the number of threads
+  class RasterizeSlicesFunctor
+  {
+  public:
+    RasterizeSlicesFunctor(const std::vector<RasterizedStructure>& structures, vtkImageData* labelmap)
+      : Structures(structures)
+      , Labelmap(labelmap)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      int extent[6] = {0,0,0,0,0,0};
+      this->Labelmap->GetExtent(extent);
+      vtkIdType increments[3] = {0,0,0};
+      this->Labelmap->GetIncrements(increments);
+      unsigned short* labelmapPtr = static_cast<unsigned short*>(this->Labelmap->GetScalarPointer());
+
+      std::vector<std::vector<double> > rowCrossings;
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        for (std::vector<RasterizedStructure>::const_iterator structureIt=this->Structures.begin(); structureIt!=this->Structures.end(); ++structureIt)
+        {
+          const RasterizedStructure& structure = (*structureIt);
+          if (k < structure.Extent[4] || k > structure.Extent[5])
+          {
+            continue;
+          }
+          const std::vector<vtkIdType>& sliceTriangles = structure.SliceTriangles[k - structure.Extent[4]];
+          if (sliceTriangles.empty())
+          {
+            continue;
+          }
+
+          int numberOfRows = structure.Extent[3] - structure.Extent[2] + 1;
+          rowCrossings.resize(numberOfRows);
+          for (int row=0; row<numberOfRows; ++row)
+          {
+            rowCrossings[row].clear();
+          }
+
+          // Cut triangles with the slice plane and intersect the segments with the rows
+          for (std::vector<vtkIdType>::const_iterator triangleIt=sliceTriangles.begin(); triangleIt!=sliceTriangles.end(); ++triangleIt)
+          {
+            const double* triangle = &(structure.Triangles[9*(*triangleIt)]);
+            double segment[2][2] = {{0,0},{0,0}};
+            int numberOfSegmentPoints = 0;
+            for (int edge=0; edge<3; ++edge)
+            {
+              const double* a = triangle + 3*edge;
+              const double* b = triangle + 3*((edge+1)%3);
+              if ((a[2] <= k) != (b[2] <= k) && numberOfSegmentPoints < 2)
+              {
+                double t = (k - a[2]) / (b[2] - a[2]);
+                segment[numberOfSegmentPoints][0] = a[0] + t * (b[0] - a[0]);
+                segment[numberOfSegmentPoints][1] = a[1] + t * (b[1] - a[1]);
+                ++numberOfSegmentPoints;
+              }
+            }
+            if (numberOfSegmentPoints != 2 || segment[0][1] == segment[1][1])
+            {
+              continue;
+            }
+
+            double yMin = std::min(segment[0][1], segment[1][1]);
+            double yMax = std::max(segment[0][1], segment[1][1]);
+            int firstRow = std::max(static_cast<int>(ceil(yMin)), structure.Extent[2]);
+            int lastRow = std::min(static_cast<int>(ceil(yMax)) - 1, structure.Extent[3]);
+            double slope = (segment[1][0] - segment[0][0]) / (segment[1][1] - segment[0][1]);
+            for (int j=firstRow; j<=lastRow; ++j)
+            {
+              rowCrossings[j - structure.Extent[2]].push_back(segment[0][0] + (j - segment[0][1]) * slope);
+            }
+          }
+
+          // Fill voxels between pairs of crossings
+          for (int row=0; row<numberOfRows; ++row)
+          {
+            std::vector<double>& crossings = rowCrossings[row];
+            if (crossings.size() < 2)
+            {
+              continue;
+            }
+            std::sort(crossings.begin(), crossings.end());
+            unsigned short* rowPtr = labelmapPtr
+              + (k - extent[4]) * increments[2] + (structure.Extent[2] + row - extent[2]) * increments[1];
+            for (size_t crossingIndex=0; crossingIndex+1<crossings.size(); crossingIndex+=2)
+            {
+              int firstColumn = std::max(static_cast<int>(ceil(crossings[crossingIndex])), extent[0]);
+              int lastColumn = std::min(static_cast<int>(ceil(crossings[crossingIndex+1])) - 1, extent[1]);
+              for (int i=firstColumn; i<=lastColumn; ++i)
+              {
+                rowPtr[(i - extent[0]) * increments[0]] = structure.LabelValue;
+              }
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    const std::vector<RasterizedStructure>& Structures;
+    vtkImageData* Labelmap;
+  };
 }
 
 //----------------------------------------------------------------------------
@@ -194,6 +320,145 @@ void vtkPolyDataToLabelmapFilter::Update()
   }
 }
 
+//----------------------------------------------------------------------------
+void vtkPolyDataToLabelmapFilter::AddStructure(vtkPolyData* polyData, unsigned short labelValue)
+{
+  if (!polyData)
+  {
+    vtkErrorMacro("AddStructure: Invalid poly data");
+    return;
+  }
+  this->StructurePolyData.push_back(polyData);
+  this->StructureLabelValues.push_back(labelValue);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataToLabelmapFilter::RemoveAllStructures()
+{
+  this->StructurePolyData.clear();
+  this->StructureLabelValues.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkPolyDataToLabelmapFilter::GetNumberOfStructures()
+{
+  return static_cast<int>(this->StructurePolyData.size());
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataToLabelmapFilter::UpdateMultipleStructures()
+{
+  if (!this->ReferenceImageData || !this->OutputLabelmap)
+  {
+    vtkErrorMacro("UpdateMultipleStructures: Reference image and output labelmap have to be initialized!");
+    return;
+  }
+
+  int extent[6] = {0,0,0,0,0,0};
+  this->ReferenceImageData->GetExtent(extent);
+  double origin[3] = {0,0,0};
+  this->ReferenceImageData->GetOrigin(origin);
+  double spacing[3] = {1,1,1};
+  this->ReferenceImageData->GetSpacing(spacing);
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    vtkErrorMacro("UpdateMultipleStructures: Reference image is empty!");
+    return;
+  }
+
+  // Allocate shared output labelmap
+  vtkSmartPointer<vtkImageData> labelmap = vtkSmartPointer<vtkImageData>::New();
+  labelmap->SetExtent(extent);
+  labelmap->SetOrigin(origin);
+  labelmap->SetSpacing(spacing);
+  labelmap->AllocateScalars(VTK_UNSIGNED_SHORT, 1);
+  unsigned short* labelmapPtr = static_cast<unsigned short*>(labelmap->GetScalarPointer());
+  std::fill(labelmapPtr, labelmapPtr + labelmap->GetNumberOfPoints(), static_cast<unsigned short>(this->BackgroundValue));
+
+  // Collect triangles of each structure in continuous IJK and sort them into slices
+  std::vector<RasterizedStructure> structures;
+  for (size_t structureIndex=0; structureIndex<this->StructurePolyData.size(); ++structureIndex)
+  {
+    vtkNew<vtkTriangleFilter> triangleFilter;
+    triangleFilter->SetInputData(this->StructurePolyData[structureIndex]);
+    triangleFilter->PassLinesOff();
+    triangleFilter->PassVertsOff();
+    triangleFilter->Update();
+    vtkPolyData* triangles = triangleFilter->GetOutput();
+    if (!triangles->GetPoints() || triangles->GetNumberOfPolys() == 0)
+    {
+      vtkWarningMacro("UpdateMultipleStructures: Structure " << structureIndex << " has no surface, skipping");
+      continue;
+    }
+
+    structures.push_back(RasterizedStructure());
+    RasterizedStructure& structure = structures.back();
+    structure.LabelValue = this->StructureLabelValues[structureIndex];
+    structure.Triangles.reserve(9 * triangles->GetNumberOfPolys());
+    double bounds[6] = {VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN};
+    vtkPoints* points = triangles->GetPoints();
+    vtkCellArray* polys = triangles->GetPolys();
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      if (numberOfCellPoints != 3)
+      {
+        continue;
+      }
+      for (int vertex=0; vertex<3; ++vertex)
+      {
+        double point[3] = {0,0,0};
+        points->GetPoint(cellPointIds[vertex], point);
+        for (int axis=0; axis<3; ++axis)
+        {
+          double index = (point[axis] - origin[axis]) / spacing[axis];
+          structure.Triangles.push_back(index);
+          bounds[2*axis] = std::min(bounds[2*axis], index);
+          bounds[2*axis+1] = std::max(bounds[2*axis+1], index);
+        }
+      }
+    }
+
+    bool overlapsOutput = true;
+    for (int axis=0; axis<3; ++axis)
+    {
+      structure.Extent[2*axis] = std::max(static_cast<int>(floor(bounds[2*axis])), extent[2*axis]);
+      structure.Extent[2*axis+1] = std::min(static_cast<int>(ceil(bounds[2*axis+1])), extent[2*axis+1]);
+      overlapsOutput = overlapsOutput && (structure.Extent[2*axis] <= structure.Extent[2*axis+1]);
+    }
+    if (!overlapsOutput)
+    {
+      structures.pop_back();
+      continue;
+    }
+
+    // Triangle intersects slice k if k is in [zMin, zMax)
+    structure.SliceTriangles.resize(structure.Extent[5] - structure.Extent[4] + 1);
+    vtkIdType numberOfTriangles = static_cast<vtkIdType>(structure.Triangles.size() / 9);
+    for (vtkIdType triangleIndex=0; triangleIndex<numberOfTriangles; ++triangleIndex)
+    {
+      const double* triangle = &(structure.Triangles[9*triangleIndex]);
+      double zMin = std::min(triangle[2], std::min(triangle[5], triangle[8]));
+      double zMax = std::max(triangle[2], std::max(triangle[5], triangle[8]));
+      int firstSlice = std::max(static_cast<int>(ceil(zMin)), structure.Extent[4]);
+      int lastSlice = std::min(static_cast<int>(ceil(zMax)) - 1, structure.Extent[5]);
+      for (int k=firstSlice; k<=lastSlice; ++k)
+      {
+        structure.SliceTriangles[k - structure.Extent[4]].push_back(triangleIndex);
+      }
+    }
+  }
+
+  // Rasterize slices in parallel. Each slice is written by one thread only
+  RasterizeSlicesFunctor functor(structures, labelmap);
+  vtkSMPTools::For(extent[4], extent[5] + 1, functor);
+
+  this->OutputLabelmap->ShallowCopy(labelmap);
+}
+
 //----------------------------------------------------------------------------
 bool vtkPolyDataToLabelmapFilter::DeterminePolyDataReferenceOverlap(std::vector<int>& referenceExtentsVector, std::vector<double>& originVector)
 {
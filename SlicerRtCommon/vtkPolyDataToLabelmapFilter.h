@@ -20,6 +20,9 @@
 
 // .NAME vtkPolyDataToLabelmapFilter - Converts PolyData model to Labelmap image data
 // .SECTION Description
+// In single structure mode (\sa Update) the input poly data is converted using image stencils.
+// In multi-structure mode (\sa UpdateMultipleStructures) all added structures are rasterized
+// into one shared labelmap using scanline filling.
 
 #ifndef __vtkPolyDataToLabelmapFilter_h
 #define __vtkPolyDataToLabelmapFilter_h
@@ -27,9 +30,11 @@
 // VTK includes
 #include <vtkPolyData.h>
 #include <vtkImageData.h>
+#include <vtkSmartPointer.h>
 
 // STD includes
 #include <cstdlib>
+#include <vector>
 
 #include "vtkSlicerRtCommonWin32Header.h"
 
@@ -49,6 +54,20 @@ public:
 
   virtual void Update();
 
+  /// Rasterize all structures added by \sa AddStructure into one unsigned short labelmap that has the
+  /// geometry of the reference image. Structures are clipped to the reference extent. Where structures
+  /// overlap, the one added later wins. Slices are processed in parallel, and each structure is only
+  /// processed within its own extent. \sa UseReferenceValues is ignored in this mode
+  virtual void UpdateMultipleStructures();
+
+  /// Add structure for \sa UpdateMultipleStructures. The poly data needs to be in the same
+  /// coordinate system as the reference image (see class description) and closed
+  void AddStructure(vtkPolyData* polyData, unsigned short labelValue);
+  /// Remove all structures added by \sa AddStructure
+  void RemoveAllStructures();
+  /// Get number of structures added by \sa AddStructure
+  int GetNumberOfStructures();
+
   vtkSetObjectMacro(InputPolyData, vtkPolyData);
 
   vtkGetMacro(LabelValue, unsigned short);
@@ -81,6 +100,11 @@ protected:
   double BackgroundValue;
   bool UseReferenceValues;
 
+  /// Structures to rasterize in multi-structure mode
+  std::vector<vtkSmartPointer<vtkPolyData> > StructurePolyData;
+  /// Label values of the structures in multi-structure mode
+  std::vector<unsigned short> StructureLabelValues;
+
 protected:
   vtkPolyDataToLabelmapFilter();
   ~vtkPolyDataToLabelmapFilter();
@@ -16,6 +16,7 @@
 
 // AutoWindowLevel Logic includes
 #include "vtkSlicerAutoWindowLevelLogic.h"
+#include "vtkImageStatisticsCache.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeDisplayNode.h>
@@ -24,10 +25,10 @@
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkImageData.h>
-#include <vtkImageAccumulate.h>
 
 // STD includes
 #include <algorithm>
+#include <cmath>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerAutoWindowLevelLogic);
@@ -55,29 +56,17 @@ void vtkSlicerAutoWindowLevelLogic::ComputeWindowLevel(vtkMRMLScalarVolumeNode*
   inputDisplayNode->AutoWindowLevelOff();
   vtkImageData* inputImageData = inputScalarVolumeNode->GetImageData();
 
-  double scalarRange[2] = {0.0,0.0};
-  inputDisplayNode->GetDisplayScalarRange(scalarRange);
-
-  int minScalar = scalarRange[0];
-  int maxScalar = scalarRange[1];
-
-  // Create the histogram vtkImageData
-  vtkSmartPointer<vtkImageData> histogramImageData = vtkSmartPointer<vtkImageData>::New();
-  histogramImageData->Initialize();
-  histogramImageData->SetExtent(minScalar, maxScalar, 0, 0, 0, 0);
-  histogramImageData->SetOrigin(0, 0, 0);
-  histogramImageData->AllocateScalars(VTK_INT, 1);
-
-  // Build the histogram for the scalar image values.
-  vtkSmartPointer<vtkImageAccumulate> imageAccumulator = vtkSmartPointer<vtkImageAccumulate>::New();
-  imageAccumulator->SetInputData(inputImageData);
-  imageAccumulator->SetComponentExtent(histogramImageData->GetExtent());
-  imageAccumulator->SetComponentOrigin(histogramImageData->GetOrigin());
-  imageAccumulator->SetOutput(histogramImageData);
-  imageAccumulator->Update();
+  // Get the histogram of the scalar image values. It is shared with other modules
+  // using statistics of the same image, so the image is only scanned once
+  vtkImageStatisticsCache::Statistics statistics;
+  if (!vtkImageStatisticsCache::GetInstance()->GetStatistics(inputImageData, statistics) || statistics.Histogram.empty())
+  {
+    vtkErrorMacro("ComputeWindowLevel: Failed to get statistics of input volume");
+    return;
+  }
 
-  int meanScalar = (int)imageAccumulator->GetMean()[0];
-  int scalarStandardDeviation = (int)imageAccumulator->GetStandardDeviation()[0];
+  double meanScalar = statistics.Mean;
+  int scalarStandardDeviation = (int)statistics.StandardDeviation;
 
   // The window width is the standard deviation of the scalar values.
   // The minimum window size is capped at 150.
@@ -86,20 +75,21 @@ void vtkSlicerAutoWindowLevelLogic::ComputeWindowLevel(vtkMRMLScalarVolumeNode*
   // Find the highest peak to the right of the mean.
   // This will be the level.
   int level = -1;
-  double largestBinSize = 0.0;
-  double currentBinSize = 0.0;
+  vtkIdType largestBinSize = 0;
 
   // Start looking for the peak in the mean bin.
   // If the mean is too far to the left (because of
   // large negative outliers, move the start bin to
   // the right by one standard deviation
-  for (int currentBin = meanScalar; currentBin < maxScalar; currentBin++)
+  int numberOfBins = (int)statistics.Histogram.size();
+  int meanBin = std::max(0, (int)((meanScalar - statistics.HistogramOrigin) / statistics.HistogramBinWidth));
+  for (int currentBin = meanBin; currentBin < numberOfBins-1; currentBin++)
   {
-    currentBinSize = histogramImageData->GetScalarComponentAsDouble(currentBin, 0, 0, 0);
+    vtkIdType currentBinSize = statistics.Histogram[currentBin];
     if (largestBinSize <= currentBinSize)
     {
       largestBinSize = currentBinSize;
-      level = currentBin;
+      level = (int)floor(statistics.GetBinCenter(currentBin) + 0.5);
     }
   }
 
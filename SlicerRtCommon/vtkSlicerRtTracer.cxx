@@ -0,0 +1,317 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkSlicerRtTracer.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSimpleCriticalSection.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Write string as a JSON string literal
+  void WriteJsonString(std::ostream& outStream, const char* text)
+  {
+    outStream << '"';
+    for (const char* character = text; character && *character; ++character)
+    {
+      switch (*character)
+      {
+      case '"': outStream << "\\\""; break;
+      case '\\': outStream << "\\\\"; break;
+      case '\n': outStream << "\\n"; break;
+      case '\r': outStream << "\\r"; break;
+      case '\t': outStream << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(*character) < 0x20)
+        {
+          char escaped[8];
+          sprintf(escaped, "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(*character)));
+          outStream << escaped;
+        }
+        else
+        {
+          outStream << *character;
+        }
+      }
+    }
+    outStream << '"';
+  }
+}
+
+//----------------------------------------------------------------------------
+// The shared instance, and the Schwarz counter used for its creation and deletion
+vtkSlicerRtTracer* vtkSlicerRtTracer::Instance = NULL;
+bool vtkSlicerRtTracer::Enabled = false;
+static unsigned int vtkSlicerRtTracerInitializeCount = 0;
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTracerInitialize::vtkSlicerRtTracerInitialize()
+{
+  if (++vtkSlicerRtTracerInitializeCount == 1)
+  {
+    vtkSlicerRtTracer::classInitialize();
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTracerInitialize::~vtkSlicerRtTracerInitialize()
+{
+  if (--vtkSlicerRtTracerInitializeCount == 0)
+  {
+    vtkSlicerRtTracer::classFinalize();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::classInitialize()
+{
+  vtkSlicerRtTracer::Instance = vtkSlicerRtTracer::New();
+
+  const char* traceFileName = getenv("SLICERRT_TRACE_FILE");
+  if (traceFileName && traceFileName[0])
+  {
+    vtkSlicerRtTracer::Instance->AutoSaveFileName = traceFileName;
+    vtkSlicerRtTracer::Instance->Enable();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::classFinalize()
+{
+  if (vtkSlicerRtTracer::Instance)
+  {
+    vtkSlicerRtTracer::Enabled = false;
+    if (!vtkSlicerRtTracer::Instance->AutoSaveFileName.empty())
+    {
+      vtkSlicerRtTracer::Instance->WriteChromeTrace(vtkSlicerRtTracer::Instance->AutoSaveFileName.c_str());
+    }
+    vtkSlicerRtTracer::Instance->Delete();
+    vtkSlicerRtTracer::Instance = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTracer* vtkSlicerRtTracer::GetInstance()
+{
+  return vtkSlicerRtTracer::Instance;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerRtTracer);
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTracer::vtkSlicerRtTracer()
+{
+  this->EventsLock = new vtkSimpleCriticalSection();
+  this->TraceStartTime = vtkTimerLog::GetUniversalTime();
+  this->MaximumNumberOfEvents = 1000000;
+  this->NumberOfDroppedEvents = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTracer::~vtkSlicerRtTracer()
+{
+  delete this->EventsLock;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Enabled: " << (vtkSlicerRtTracer::Enabled ? "true" : "false") << "\n";
+  os << indent << "NumberOfEvents: " << this->Events.size() << "\n";
+  os << indent << "NumberOfThreads: " << this->ThreadIds.size() << "\n";
+  os << indent << "MaximumNumberOfEvents: " << this->MaximumNumberOfEvents << "\n";
+  os << indent << "NumberOfDroppedEvents: " << this->NumberOfDroppedEvents << "\n";
+  os << indent << "AutoSaveFileName: " << this->AutoSaveFileName << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::Enable()
+{
+  if (vtkSlicerRtTracer::Enabled)
+  {
+    return;
+  }
+
+  this->EventsLock->Lock();
+  if (this->Events.empty())
+  {
+    this->TraceStartTime = vtkTimerLog::GetUniversalTime();
+  }
+  // Make sure the enabling thread is the first track
+  if (this->ThreadIds.empty())
+  {
+    this->GetCurrentThreadIndex();
+  }
+  this->EventsLock->Unlock();
+
+  vtkSlicerRtTracer::Enabled = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::Disable()
+{
+  vtkSlicerRtTracer::Enabled = false;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::Clear()
+{
+  this->EventsLock->Lock();
+  this->Events.clear();
+  this->NumberOfDroppedEvents = 0;
+  this->TraceStartTime = vtkTimerLog::GetUniversalTime();
+  this->EventsLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtTracer::GetNumberOfEvents()
+{
+  this->EventsLock->Lock();
+  int numberOfEvents = static_cast<int>(this->Events.size());
+  this->EventsLock->Unlock();
+  return numberOfEvents;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtTracer::GetCurrentThreadIndex()
+{
+  vtkMultiThreaderIDType currentThreadId = vtkMultiThreader::GetCurrentThreadID();
+  for (size_t threadIndex=0; threadIndex<this->ThreadIds.size(); ++threadIndex)
+  {
+    if (vtkMultiThreader::ThreadsEqual(this->ThreadIds[threadIndex], currentThreadId))
+    {
+      return static_cast<int>(threadIndex);
+    }
+  }
+  this->ThreadIds.push_back(currentThreadId);
+  return static_cast<int>(this->ThreadIds.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTracer::AddSpan(const char* category, const char* name, const char* detail, double startTime, double endTime)
+{
+  this->EventsLock->Lock();
+  if (static_cast<int>(this->Events.size()) >= this->MaximumNumberOfEvents)
+  {
+    ++this->NumberOfDroppedEvents;
+    this->EventsLock->Unlock();
+    return;
+  }
+
+  this->Events.push_back(TraceEvent());
+  TraceEvent& event = this->Events.back();
+  event.Category = category;
+  event.Name = (name ? name : "");
+  if (detail)
+  {
+    event.Detail = detail;
+  }
+  event.StartTime = startTime;
+  event.Duration = endTime - startTime;
+  event.ThreadIndex = this->GetCurrentThreadIndex();
+  this->EventsLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerRtTracer::WriteChromeTrace(const char* fileName)
+{
+  if (!fileName)
+  {
+    vtkErrorMacro("WriteChromeTrace: Invalid file name");
+    return false;
+  }
+  std::ofstream outStream(fileName);
+  if (!outStream.is_open())
+  {
+    vtkErrorMacro("WriteChromeTrace: Failed to open file " << fileName);
+    return false;
+  }
+  outStream.setf(std::ios::fixed);
+  outStream.precision(3);
+
+  this->EventsLock->Lock();
+
+  // Timestamps and durations are in microseconds
+  outStream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+  outStream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SlicerRT\"}}";
+  for (size_t threadIndex=0; threadIndex<this->ThreadIds.size(); ++threadIndex)
+  {
+    outStream << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadIndex
+      << ",\"args\":{\"name\":\"" << (threadIndex == 0 ? "Main" : "Worker ");
+    if (threadIndex > 0)
+    {
+      outStream << threadIndex;
+    }
+    outStream << "\"}}";
+  }
+  for (std::vector<TraceEvent>::iterator eventIt=this->Events.begin(); eventIt!=this->Events.end(); ++eventIt)
+  {
+    outStream << "," << std::endl << "{\"name\":";
+    WriteJsonString(outStream, eventIt->Name.c_str());
+    outStream << ",\"cat\":";
+    WriteJsonString(outStream, eventIt->Category);
+    outStream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << eventIt->ThreadIndex
+      << ",\"ts\":" << (eventIt->StartTime - this->TraceStartTime) * 1.0e6
+      << ",\"dur\":" << eventIt->Duration * 1.0e6;
+    if (!eventIt->Detail.empty())
+    {
+      outStream << ",\"args\":{\"detail\":";
+      WriteJsonString(outStream, eventIt->Detail.c_str());
+      outStream << "}";
+    }
+    outStream << "}";
+  }
+  outStream << std::endl << "]}" << std::endl;
+
+  this->EventsLock->Unlock();
+
+  if (!outStream.good())
+  {
+    vtkErrorMacro("WriteChromeTrace: Failed to write file " << fileName);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTraceSpan::Start(const char* detail)
+{
+  if (detail)
+  {
+    this->Detail = detail;
+  }
+  this->StartTime = vtkTimerLog::GetUniversalTime();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTraceSpan::Finish()
+{
+  // Spans started before disabling are still recorded so that no stage is cut in half
+  vtkSlicerRtTracer::GetInstance()->AddSpan(this->Category, this->Name,
+    (this->Detail.empty() ? NULL : this->Detail.c_str()), this->StartTime, vtkTimerLog::GetUniversalTime());
+}
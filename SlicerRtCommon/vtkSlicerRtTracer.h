@@ -0,0 +1,201 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerRtTracer_h
+#define __vtkSlicerRtTracer_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkMultiThreader.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+class vtkSimpleCriticalSection;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Records timed spans of the processing steps of the SlicerRT logics.
+///
+/// Spans are recorded by placing \sa SLICERRT_TRACE_SCOPE at the beginning of a scope. The span lasts
+/// until the end of the scope, so nested scopes appear as nested stages. Spans can be recorded from any
+/// thread, each thread gets its own track in the trace. The recorded spans can be written in the Chrome
+/// trace event format, which can be opened in chrome://tracing or https://ui.perfetto.dev.
+///
+/// Tracing is disabled by default, in which case a span costs a single flag check. It can be enabled
+/// from code (e.g. the Python console) or by setting the SLICERRT_TRACE_FILE environment variable to
+/// the path of the trace file, which is then written when the application exits.
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtTracer : public vtkObject
+{
+public:
+  static vtkSlicerRtTracer* New();
+  vtkTypeMacro(vtkSlicerRtTracer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Get the instance shared by the modules
+  static vtkSlicerRtTracer* GetInstance();
+
+  /// Start recording spans. The thread that enables tracing is shown as the main thread in the trace
+  void Enable();
+  /// Stop recording spans. Already recorded spans are kept
+  void Disable();
+  /// Return true if spans are being recorded
+  static bool IsEnabled() { return vtkSlicerRtTracer::Enabled; };
+
+  /// Remove all recorded spans and restart the trace clock
+  void Clear();
+
+  /// Get number of recorded spans
+  int GetNumberOfEvents();
+
+  /// Number of spans that were not recorded because \sa MaximumNumberOfEvents was reached
+  vtkGetMacro(NumberOfDroppedEvents, int);
+
+  /// Maximum number of recorded spans, to limit memory usage of long sessions. 1000000 by default
+  vtkGetMacro(MaximumNumberOfEvents, int);
+  vtkSetMacro(MaximumNumberOfEvents, int);
+
+  /// Write recorded spans to file in Chrome trace event JSON format
+  /// \return Success flag
+  bool WriteChromeTrace(const char* fileName);
+
+  /// Record a finished span. Thread safe. Called by \sa vtkSlicerRtTraceSpan
+  /// \param category Group of the span (typically the module). Must point to a string literal
+  /// \param name Name of the processing step
+  /// \param detail Optional additional information, such as the name of the processed segment
+  /// \param startTime Start time of the span as returned by vtkTimerLog::GetUniversalTime
+  /// \param endTime End time of the span as returned by vtkTimerLog::GetUniversalTime
+  void AddSpan(const char* category, const char* name, const char* detail, double startTime, double endTime);
+
+protected:
+  /// Recorded span
+  struct TraceEvent
+  {
+    const char* Category;
+    std::string Name;
+    std::string Detail;
+    double StartTime;
+    double Duration;
+    int ThreadIndex;
+  };
+
+  /// Get index of the calling thread in \sa ThreadIds. Adds the thread if not yet seen.
+  /// Must be called with \sa EventsLock locked
+  int GetCurrentThreadIndex();
+
+protected:
+  static bool Enabled;
+
+  std::vector<TraceEvent> Events;
+  std::vector<vtkMultiThreaderIDType> ThreadIds;
+  vtkSimpleCriticalSection* EventsLock;
+
+  /// Time of enabling or clearing, spans are written relative to this
+  double TraceStartTime;
+
+  int MaximumNumberOfEvents;
+  int NumberOfDroppedEvents;
+
+  /// File to write the trace to on exit, set from the SLICERRT_TRACE_FILE environment variable
+  std::string AutoSaveFileName;
+
+protected:
+  vtkSlicerRtTracer();
+  virtual ~vtkSlicerRtTracer();
+
+private:
+  vtkSlicerRtTracer(const vtkSlicerRtTracer&); // Not implemented
+  void operator=(const vtkSlicerRtTracer&);   // Not implemented
+
+  friend class vtkSlicerRtTracerInitialize;
+  static void classInitialize();
+  static void classFinalize();
+
+  static vtkSlicerRtTracer* Instance;
+};
+
+/// Utility class to make sure the shared instance is created before and deleted after
+/// all other singletons (Schwarz counter idiom)
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtTracerInitialize
+{
+public:
+  vtkSlicerRtTracerInitialize();
+  ~vtkSlicerRtTracerInitialize();
+};
+
+/// This instance will show up in any translation unit that uses vtkSlicerRtTracer.
+/// It will make sure the shared instance is initialized before it is used.
+static vtkSlicerRtTracerInitialize vtkSlicerRtTracerInitializer;
+
+#ifndef __VTK_WRAP__
+/// \brief Records the lifetime of the object as a span if tracing is enabled. Use through \sa SLICERRT_TRACE_SCOPE
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtTraceSpan
+{
+public:
+  /// \param category Group of the span (typically the module). Must point to a string literal
+  /// \param name Name of the processing step. Must be valid until the end of the span
+  /// \param detail Optional additional information. Copied if tracing is enabled
+  vtkSlicerRtTraceSpan(const char* category, const char* name, const char* detail=NULL)
+    : Category(category)
+    , Name(name)
+    , StartTime(-1.0)
+  {
+    if (vtkSlicerRtTracer::IsEnabled())
+    {
+      this->Start(detail);
+    }
+  };
+  ~vtkSlicerRtTraceSpan()
+  {
+    if (this->StartTime >= 0.0)
+    {
+      this->Finish();
+    }
+  };
+
+private:
+  /// Store detail and start time. Only called when tracing is enabled, so that the disabled case is inlined
+  void Start(const char* detail);
+  /// Record the span
+  void Finish();
+
+private:
+  vtkSlicerRtTraceSpan(const vtkSlicerRtTraceSpan&); // Not implemented
+  void operator=(const vtkSlicerRtTraceSpan&);       // Not implemented
+
+  const char* Category;
+  const char* Name;
+  std::string Detail;
+  /// Negative if tracing was disabled at construction
+  double StartTime;
+};
+
+#define SLICERRT_TRACE_CONCATENATE_IMPL(a, b) a##b
+#define SLICERRT_TRACE_CONCATENATE(a, b) SLICERRT_TRACE_CONCATENATE_IMPL(a, b)
+
+/// Record the rest of the enclosing scope as a span of the given category and name
+#define SLICERRT_TRACE_SCOPE(category, name) \
+  vtkSlicerRtTraceSpan SLICERRT_TRACE_CONCATENATE(slicerRtTraceSpan, __LINE__)(category, name)
+
+/// Record the rest of the enclosing scope as a span with additional information (const char*)
+#define SLICERRT_TRACE_SCOPE_DETAIL(category, name, detail) \
+  vtkSlicerRtTraceSpan SLICERRT_TRACE_CONCATENATE(slicerRtTraceSpan, __LINE__)(category, name, \
+    (vtkSlicerRtTracer::IsEnabled() ? (detail) : NULL))
+#endif
+
+#endif
@@ -0,0 +1,744 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkSyntheticPhantomGenerator.h"
+#include "vtkSlicerRtTracer.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  const short AIR_HU = -1000;
+  const short WATER_HU = 0;
+
+  /// Semi-axes of the body relative to the field of view in the axial plane
+  const double BODY_LATERAL_RATIO = 0.45;
+  const double BODY_ANTERIOR_POSTERIOR_RATIO = 0.35;
+
+  /// Number of placement attempts after which the structure being placed is shrunk
+  const int PLACEMENT_ATTEMPTS_BEFORE_SHRINKING = 100;
+  const int MAXIMUM_PLACEMENT_ATTEMPTS = 2000;
+
+  //----------------------------------------------------------------------------
+  /// Xorshift random number generator. Used instead of rand() so that the phantom
+  /// is the same on every platform
+  class RandomGenerator
+  {
+  public:
+    RandomGenerator(unsigned int seed)
+      : State(static_cast<vtkTypeUInt32>(seed) ^ 0x9E3779B9u)
+    {
+      if (this->State == 0)
+      {
+        this->State = 1;
+      }
+    }
+
+    /// Uniform random number in [minimum, maximum)
+    double Uniform(double minimum, double maximum)
+    {
+      this->State ^= this->State << 13;
+      this->State ^= this->State >> 17;
+      this->State ^= this->State << 5;
+      return minimum + (maximum - minimum) * (this->State / 4294967296.0);
+    }
+
+  private:
+    vtkTypeUInt32 State;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Fraction of the volume of an ellipsoid beyond a plane, where the plane is at normalized
+  /// position u (-1: touching the ellipsoid on the near side, 1: on the far side)
+  double EllipsoidCapVolumeFraction(double u)
+  {
+    if (u <= -1.0)
+    {
+      return 1.0;
+    }
+    if (u >= 1.0)
+    {
+      return 0.0;
+    }
+    return (1.0 - u) * (1.0 - u) * (2.0 + u) / 4.0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Fill the body in the CT image, one slice range per thread
+  class FillBodyFunctor
+  {
+  public:
+    FillBodyFunctor(short* ct, const int dimensions[3], const double origin[3], const double spacing[3], const double bodyRadii[2])
+      : Ct(ct)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Dimensions[axis] = dimensions[axis];
+        this->Origin[axis] = origin[axis];
+        this->Spacing[axis] = spacing[axis];
+      }
+      this->BodyRadii[0] = bodyRadii[0];
+      this->BodyRadii[1] = bodyRadii[1];
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      // The body is a cylinder, so one slice is computed and copied to the others
+      vtkIdType sliceSize = (vtkIdType)this->Dimensions[0] * this->Dimensions[1];
+      short* firstSlicePtr = this->Ct + beginSlice*sliceSize;
+      short* ctPtr = firstSlicePtr;
+      for (int j=0; j<this->Dimensions[1]; ++j)
+      {
+        double dy = (this->Origin[1] + j*this->Spacing[1]) / this->BodyRadii[1];
+        for (int i=0; i<this->Dimensions[0]; ++i, ++ctPtr)
+        {
+          double dx = (this->Origin[0] + i*this->Spacing[0]) / this->BodyRadii[0];
+          *ctPtr = (dx*dx + dy*dy <= 1.0 ? WATER_HU : AIR_HU);
+        }
+      }
+      for (vtkIdType k=beginSlice+1; k<endSlice; ++k)
+      {
+        std::copy(firstSlicePtr, firstSlicePtr + sliceSize, this->Ct + k*sliceSize);
+      }
+    }
+
+  private:
+    short* Ct;
+    int Dimensions[3];
+    double Origin[3];
+    double Spacing[3];
+    double BodyRadii[2];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Fill a dose image with a linear ramp, one slice range per thread
+  class FillDoseFunctor
+  {
+  public:
+    /// \param firstVoxelDose Dose of voxel (0,0,0)
+    /// \param doseIncrement Dose difference between neighboring voxels along each axis
+    FillDoseFunctor(float* dose, const int dimensions[3], double firstVoxelDose, const double doseIncrement[3])
+      : Dose(dose)
+      , FirstVoxelDose(firstVoxelDose)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Dimensions[axis] = dimensions[axis];
+        this->DoseIncrement[axis] = doseIncrement[axis];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      float* dosePtr = this->Dose + beginSlice * this->Dimensions[0] * this->Dimensions[1];
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        for (int j=0; j<this->Dimensions[1]; ++j)
+        {
+          double rowDose = this->FirstVoxelDose + k*this->DoseIncrement[2] + j*this->DoseIncrement[1];
+          for (int i=0; i<this->Dimensions[0]; ++i, ++dosePtr)
+          {
+            *dosePtr = static_cast<float>(rowDose + i*this->DoseIncrement[0]);
+          }
+        }
+      }
+    }
+
+  private:
+    float* Dose;
+    int Dimensions[3];
+    double FirstVoxelDose;
+    double DoseIncrement[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Create the cropped labelmap of each structure and set the structure voxels in the CT.
+  /// Structures do not overlap, so the threads never write the same CT voxel
+  class VoxelizeStructuresFunctor
+  {
+  public:
+    VoxelizeStructuresFunctor(const std::vector<double>& centers, const std::vector<double>& radii,
+      vtkOrientedImageData* ctImage, std::vector<vtkSmartPointer<vtkOrientedImageData> >& labelmaps)
+      : Centers(centers)
+      , Radii(radii)
+      , CtImage(ctImage)
+      , Labelmaps(labelmaps)
+    {
+    }
+
+    void operator()(vtkIdType beginStructure, vtkIdType endStructure)
+    {
+      int dimensions[3] = {0,0,0};
+      this->CtImage->GetDimensions(dimensions);
+      double origin[3] = {0.0,0.0,0.0};
+      this->CtImage->GetOrigin(origin);
+      double spacing[3] = {0.0,0.0,0.0};
+      this->CtImage->GetSpacing(spacing);
+      short* ct = static_cast<short*>(this->CtImage->GetScalarPointer());
+
+      for (vtkIdType structureIndex=beginStructure; structureIndex<endStructure; ++structureIndex)
+      {
+        const double* center = &this->Centers[3*structureIndex];
+        const double* radii = &this->Radii[3*structureIndex];
+        short structureHu = static_cast<short>(30 + 10 * (structureIndex % 5));
+
+        int extent[6] = {0,-1,0,-1,0,-1};
+        for (int axis=0; axis<3; ++axis)
+        {
+          extent[2*axis] = std::max(0, static_cast<int>(floor((center[axis] - radii[axis] - origin[axis]) / spacing[axis])));
+          extent[2*axis+1] = std::min(dimensions[axis]-1, static_cast<int>(ceil((center[axis] + radii[axis] - origin[axis]) / spacing[axis])));
+        }
+
+        vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+        labelmap->SetExtent(extent);
+        labelmap->SetOrigin(origin);
+        labelmap->SetSpacing(spacing);
+        labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+        unsigned char* labelPtr = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+        for (int k=extent[4]; k<=extent[5]; ++k)
+        {
+          double dz = (origin[2] + k*spacing[2] - center[2]) / radii[2];
+          for (int j=extent[2]; j<=extent[3]; ++j)
+          {
+            double dy = (origin[1] + j*spacing[1] - center[1]) / radii[1];
+            short* ctPtr = ct + ((vtkIdType)k*dimensions[1] + j)*dimensions[0] + extent[0];
+            for (int i=extent[0]; i<=extent[1]; ++i, ++labelPtr, ++ctPtr)
+            {
+              double dx = (origin[0] + i*spacing[0] - center[0]) / radii[0];
+              bool inside = (dx*dx + dy*dy + dz*dz <= 1.0);
+              *labelPtr = (inside ? 1 : 0);
+              if (inside)
+              {
+                *ctPtr = structureHu;
+              }
+            }
+          }
+        }
+        this->Labelmaps[structureIndex] = labelmap;
+      }
+    }
+
+  private:
+    const std::vector<double>& Centers;
+    const std::vector<double>& Radii;
+    vtkOrientedImageData* CtImage;
+    std::vector<vtkSmartPointer<vtkOrientedImageData> >& Labelmaps;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSyntheticPhantomGenerator);
+
+//----------------------------------------------------------------------------
+vtkSyntheticPhantomGenerator::vtkSyntheticPhantomGenerator()
+{
+  this->Dimensions[0] = 256;
+  this->Dimensions[1] = 256;
+  this->Dimensions[2] = 200;
+  this->Spacing[0] = 1.5;
+  this->Spacing[1] = 1.5;
+  this->Spacing[2] = 1.5;
+  this->NumberOfStructures = 5;
+  this->MinimumStructureRadius = 10.0;
+  this->MaximumStructureRadius = 40.0;
+  this->Seed = 1;
+  this->MinimumDose = 0.0;
+  this->MaximumDose = 70.0;
+  // Oblique, so that the isodose surfaces are not aligned with the voxel grid
+  this->DoseGradientDirection[0] = 0.3;
+  this->DoseGradientDirection[1] = 0.5;
+  this->DoseGradientDirection[2] = 0.8;
+  this->GenerateCompareDose = false;
+  this->CompareDoseShift = 1.0;
+
+  this->CtImage = NULL;
+  this->DoseImage = NULL;
+  this->CompareDoseImage = NULL;
+  this->Segmentation = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkSyntheticPhantomGenerator::~vtkSyntheticPhantomGenerator()
+{
+  if (this->CtImage)
+  {
+    this->CtImage->Delete();
+  }
+  if (this->DoseImage)
+  {
+    this->DoseImage->Delete();
+  }
+  if (this->CompareDoseImage)
+  {
+    this->CompareDoseImage->Delete();
+  }
+  if (this->Segmentation)
+  {
+    this->Segmentation->Delete();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSyntheticPhantomGenerator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Dimensions: " << this->Dimensions[0] << ", " << this->Dimensions[1] << ", " << this->Dimensions[2] << "\n";
+  os << indent << "Spacing: " << this->Spacing[0] << ", " << this->Spacing[1] << ", " << this->Spacing[2] << "\n";
+  os << indent << "NumberOfStructures: " << this->NumberOfStructures << "\n";
+  os << indent << "MinimumStructureRadius: " << this->MinimumStructureRadius << "\n";
+  os << indent << "MaximumStructureRadius: " << this->MaximumStructureRadius << "\n";
+  os << indent << "Seed: " << this->Seed << "\n";
+  os << indent << "MinimumDose: " << this->MinimumDose << "\n";
+  os << indent << "MaximumDose: " << this->MaximumDose << "\n";
+  os << indent << "DoseGradientDirection: " << this->DoseGradientDirection[0] << ", "
+    << this->DoseGradientDirection[1] << ", " << this->DoseGradientDirection[2] << "\n";
+  os << indent << "GenerateCompareDose: " << (this->GenerateCompareDose ? "true" : "false") << "\n";
+  os << indent << "CompareDoseShift: " << this->CompareDoseShift << "\n";
+  os << indent << "NumberOfGeneratedStructures: " << this->Structures.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkSyntheticPhantomGenerator::Generate()
+{
+  SLICERRT_TRACE_SCOPE("SyntheticPhantom", "Generate");
+
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (this->Dimensions[axis] < 1 || this->Spacing[axis] <= 0.0)
+    {
+      vtkErrorMacro("Generate: Invalid grid dimensions or spacing");
+      return false;
+    }
+  }
+  if (vtkMath::Norm(this->DoseGradientDirection) == 0.0)
+  {
+    vtkErrorMacro("Generate: Invalid dose gradient direction");
+    return false;
+  }
+  if (this->NumberOfStructures < 0 || this->MinimumStructureRadius <= 0.0 || this->MaximumStructureRadius < this->MinimumStructureRadius)
+  {
+    vtkErrorMacro("Generate: Invalid number of structures or structure radius range");
+    return false;
+  }
+
+  if (!this->PlaceStructures())
+  {
+    return false;
+  }
+
+  double origin[3] = {0.0,0.0,0.0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    origin[axis] = -0.5 * (this->Dimensions[axis] - 1) * this->Spacing[axis];
+  }
+
+  // CT: body and structures
+  if (this->CtImage)
+  {
+    this->CtImage->Delete();
+  }
+  this->CtImage = vtkOrientedImageData::New();
+  this->CtImage->SetDimensions(this->Dimensions);
+  this->CtImage->SetOrigin(origin);
+  this->CtImage->SetSpacing(this->Spacing);
+  this->CtImage->AllocateScalars(VTK_SHORT, 1);
+  double bodyRadii[2] = {
+    BODY_LATERAL_RATIO * this->Dimensions[0] * this->Spacing[0],
+    BODY_ANTERIOR_POSTERIOR_RATIO * this->Dimensions[1] * this->Spacing[1] };
+  FillBodyFunctor fillBody(static_cast<short*>(this->CtImage->GetScalarPointer()), this->Dimensions, origin, this->Spacing, bodyRadii);
+  vtkSMPTools::For(0, this->Dimensions[2], fillBody);
+
+  int numberOfStructures = static_cast<int>(this->Structures.size());
+  std::vector<double> centers(3*numberOfStructures);
+  std::vector<double> radii(3*numberOfStructures);
+  for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      centers[3*structureIndex+axis] = this->Structures[structureIndex].Center[axis];
+      radii[3*structureIndex+axis] = this->Structures[structureIndex].Radii[axis];
+    }
+  }
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > labelmaps(numberOfStructures);
+  VoxelizeStructuresFunctor voxelizeStructures(centers, radii, this->CtImage, labelmaps);
+  vtkSMPTools::For(0, numberOfStructures, 1, voxelizeStructures);
+
+  // Structures
+  if (this->Segmentation)
+  {
+    this->Segmentation->Delete();
+  }
+  this->Segmentation = vtkSegmentation::New();
+  this->Segmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+  for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    std::string structureName = this->GetStructureName(structureIndex);
+    double color[3] = {0.0,0.0,0.0};
+    vtkMath::HSVToRGB(fmod(0.618034 * structureIndex, 1.0), 0.7, 0.9, color, color+1, color+2);
+
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(structureName.c_str());
+    segment->SetColor(color);
+    segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmaps[structureIndex]);
+    this->Segmentation->AddSegment(segment, structureName);
+  }
+
+  // Dose: linear ramp along the gradient direction
+  double direction[3] = {0.0,0.0,0.0};
+  double projectionRange[2] = {0.0,0.0};
+  this->GetDoseRamp(direction, projectionRange);
+  double dosePerMm = (projectionRange[1] > projectionRange[0]
+    ? (this->MaximumDose - this->MinimumDose) / (projectionRange[1] - projectionRange[0]) : 0.0);
+  double doseIncrement[3] = {0.0,0.0,0.0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    doseIncrement[axis] = dosePerMm * direction[axis] * this->Spacing[axis];
+  }
+  double firstVoxelDose = this->MinimumDose + dosePerMm * (vtkMath::Dot(direction, origin) - projectionRange[0]);
+
+  if (this->DoseImage)
+  {
+    this->DoseImage->Delete();
+  }
+  this->DoseImage = vtkOrientedImageData::New();
+  this->DoseImage->SetDimensions(this->Dimensions);
+  this->DoseImage->SetOrigin(origin);
+  this->DoseImage->SetSpacing(this->Spacing);
+  this->DoseImage->AllocateScalars(VTK_FLOAT, 1);
+  FillDoseFunctor fillDose(static_cast<float*>(this->DoseImage->GetScalarPointer()), this->Dimensions, firstVoxelDose, doseIncrement);
+  vtkSMPTools::For(0, this->Dimensions[2], fillDose);
+
+  if (this->CompareDoseImage)
+  {
+    this->CompareDoseImage->Delete();
+    this->CompareDoseImage = NULL;
+  }
+  if (this->GenerateCompareDose)
+  {
+    this->CompareDoseImage = vtkOrientedImageData::New();
+    this->CompareDoseImage->SetDimensions(this->Dimensions);
+    this->CompareDoseImage->SetOrigin(origin);
+    this->CompareDoseImage->SetSpacing(this->Spacing);
+    this->CompareDoseImage->AllocateScalars(VTK_FLOAT, 1);
+    FillDoseFunctor fillCompareDose(static_cast<float*>(this->CompareDoseImage->GetScalarPointer()), this->Dimensions,
+      firstVoxelDose + dosePerMm * this->CompareDoseShift, doseIncrement);
+    vtkSMPTools::For(0, this->Dimensions[2], fillCompareDose);
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSyntheticPhantomGenerator::PlaceStructures()
+{
+  this->Structures.clear();
+
+  double bodyRadii[2] = {
+    BODY_LATERAL_RATIO * this->Dimensions[0] * this->Spacing[0],
+    BODY_ANTERIOR_POSTERIOR_RATIO * this->Dimensions[1] * this->Spacing[1] };
+  double halfLength = 0.5 * (this->Dimensions[2] - 1) * this->Spacing[2];
+  // Structures are kept at least one voxel apart, so that their voxelized labelmaps do not touch
+  double gap = std::max(this->Spacing[0], std::max(this->Spacing[1], this->Spacing[2]));
+
+  RandomGenerator random(this->Seed);
+  for (int structureIndex=0; structureIndex<this->NumberOfStructures; ++structureIndex)
+  {
+    double scale = 1.0;
+    bool placed = false;
+    for (int attempt=0; attempt<MAXIMUM_PLACEMENT_ATTEMPTS && !placed; ++attempt)
+    {
+      // Shrink the structure if it does not seem to fit
+      if (attempt > 0 && attempt % PLACEMENT_ATTEMPTS_BEFORE_SHRINKING == 0)
+      {
+        scale *= 0.8;
+      }
+
+      Ellipsoid ellipsoid;
+      for (int axis=0; axis<3; ++axis)
+      {
+        ellipsoid.Radii[axis] = std::max(gap, scale * random.Uniform(this->MinimumStructureRadius, this->MaximumStructureRadius));
+      }
+      ellipsoid.Center[0] = random.Uniform(-bodyRadii[0], bodyRadii[0]);
+      ellipsoid.Center[1] = random.Uniform(-bodyRadii[1], bodyRadii[1]);
+      ellipsoid.Center[2] = random.Uniform(-halfLength, halfLength);
+
+      // Bounding box of the ellipsoid must be in the body
+      double dx = (fabs(ellipsoid.Center[0]) + ellipsoid.Radii[0]) / bodyRadii[0];
+      double dy = (fabs(ellipsoid.Center[1]) + ellipsoid.Radii[1]) / bodyRadii[1];
+      if (dx*dx + dy*dy > 1.0 || fabs(ellipsoid.Center[2]) + ellipsoid.Radii[2] > halfLength - gap)
+      {
+        continue;
+      }
+
+      // Bounding spheres must not intersect the ones of the already placed structures
+      double boundingRadius = std::max(ellipsoid.Radii[0], std::max(ellipsoid.Radii[1], ellipsoid.Radii[2]));
+      placed = true;
+      for (std::vector<Ellipsoid>::iterator otherIt=this->Structures.begin(); otherIt!=this->Structures.end(); ++otherIt)
+      {
+        double otherBoundingRadius = std::max(otherIt->Radii[0], std::max(otherIt->Radii[1], otherIt->Radii[2]));
+        double distance = sqrt(vtkMath::Distance2BetweenPoints(ellipsoid.Center, otherIt->Center));
+        if (distance < boundingRadius + otherBoundingRadius + gap)
+        {
+          placed = false;
+          break;
+        }
+      }
+      if (placed)
+      {
+        this->Structures.push_back(ellipsoid);
+      }
+    }
+
+    if (!placed)
+    {
+      vtkErrorMacro("PlaceStructures: Failed to place structure " << structureIndex
+        << ". Decrease the number of structures or their size, or increase the grid size");
+      this->Structures.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSyntheticPhantomGenerator::GetStructureGeometry(int structureIndex, double center[3], double radii[3])
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Structures.size()))
+  {
+    vtkErrorMacro("GetStructureGeometry: Invalid structure index " << structureIndex);
+    return false;
+  }
+  for (int axis=0; axis<3; ++axis)
+  {
+    center[axis] = this->Structures[structureIndex].Center[axis];
+    radii[axis] = this->Structures[structureIndex].Radii[axis];
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSyntheticPhantomGenerator::GetStructureName(int structureIndex)
+{
+  std::stringstream nameStream;
+  nameStream << "Ellipsoid_" << structureIndex;
+  return nameStream.str();
+}
+
+//----------------------------------------------------------------------------
+void vtkSyntheticPhantomGenerator::GetDoseRamp(double direction[3], double projectionRange[2])
+{
+  for (int axis=0; axis<3; ++axis)
+  {
+    direction[axis] = this->DoseGradientDirection[axis];
+  }
+  vtkMath::Normalize(direction);
+
+  // The grid is centered at the origin, so the projection range is symmetric
+  double halfRange = 0.0;
+  for (int axis=0; axis<3; ++axis)
+  {
+    halfRange += fabs(direction[axis]) * 0.5 * (this->Dimensions[axis] - 1) * this->Spacing[axis];
+  }
+  projectionRange[0] = -halfRange;
+  projectionRange[1] = halfRange;
+}
+
+//----------------------------------------------------------------------------
+void vtkSyntheticPhantomGenerator::GetEllipsoidProjection(int structureIndex, double& centerProjection, double& halfLength)
+{
+  double direction[3] = {0.0,0.0,0.0};
+  double projectionRange[2] = {0.0,0.0};
+  this->GetDoseRamp(direction, projectionRange);
+
+  const Ellipsoid& ellipsoid = this->Structures[structureIndex];
+  centerProjection = vtkMath::Dot(direction, ellipsoid.Center);
+  halfLength = 0.0;
+  for (int axis=0; axis<3; ++axis)
+  {
+    halfLength += ellipsoid.Radii[axis]*ellipsoid.Radii[axis] * direction[axis]*direction[axis];
+  }
+  halfLength = sqrt(halfLength);
+}
+
+//----------------------------------------------------------------------------
+double vtkSyntheticPhantomGenerator::GetDose(const double position[3])
+{
+  double direction[3] = {0.0,0.0,0.0};
+  double projectionRange[2] = {0.0,0.0};
+  this->GetDoseRamp(direction, projectionRange);
+  if (projectionRange[1] <= projectionRange[0])
+  {
+    return this->MinimumDose;
+  }
+  double projection = vtkMath::Dot(direction, position);
+  return this->MinimumDose + (this->MaximumDose - this->MinimumDose)
+    * (projection - projectionRange[0]) / (projectionRange[1] - projectionRange[0]);
+}
+
+//----------------------------------------------------------------------------
+double vtkSyntheticPhantomGenerator::GetAnalyticVolumeCc(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Structures.size()))
+  {
+    vtkErrorMacro("GetAnalyticVolumeCc: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  const Ellipsoid& ellipsoid = this->Structures[structureIndex];
+  return 4.0 / 3.0 * vtkMath::Pi() * ellipsoid.Radii[0] * ellipsoid.Radii[1] * ellipsoid.Radii[2] / 1000.0;
+}
+
+//----------------------------------------------------------------------------
+double vtkSyntheticPhantomGenerator::GetAnalyticVolumeFractionAboveDose(int structureIndex, double dose)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Structures.size()))
+  {
+    vtkErrorMacro("GetAnalyticVolumeFractionAboveDose: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  double direction[3] = {0.0,0.0,0.0};
+  double projectionRange[2] = {0.0,0.0};
+  this->GetDoseRamp(direction, projectionRange);
+  if (projectionRange[1] <= projectionRange[0] || this->MaximumDose <= this->MinimumDose)
+  {
+    return (dose <= this->MinimumDose ? 1.0 : 0.0);
+  }
+
+  // Position of the isodose plane along the gradient
+  double isodoseProjection = projectionRange[0]
+    + (dose - this->MinimumDose) / (this->MaximumDose - this->MinimumDose) * (projectionRange[1] - projectionRange[0]);
+  double centerProjection = 0.0;
+  double halfLength = 0.0;
+  this->GetEllipsoidProjection(structureIndex, centerProjection, halfLength);
+  return EllipsoidCapVolumeFraction((isodoseProjection - centerProjection) / halfLength);
+}
+
+//----------------------------------------------------------------------------
+double vtkSyntheticPhantomGenerator::GetAnalyticDoseAtVolumeFraction(int structureIndex, double volumeFraction)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Structures.size()))
+  {
+    vtkErrorMacro("GetAnalyticDoseAtVolumeFraction: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  double centerProjection = 0.0;
+  double halfLength = 0.0;
+  this->GetEllipsoidProjection(structureIndex, centerProjection, halfLength);
+
+  // Find the normalized isodose plane position by bisection, the cap volume fraction is decreasing
+  double lower = -1.0;
+  double upper = 1.0;
+  for (int iteration=0; iteration<60; ++iteration)
+  {
+    double middle = 0.5 * (lower + upper);
+    if (EllipsoidCapVolumeFraction(middle) > volumeFraction)
+    {
+      lower = middle;
+    }
+    else
+    {
+      upper = middle;
+    }
+  }
+
+  double direction[3] = {0.0,0.0,0.0};
+  double projectionRange[2] = {0.0,0.0};
+  this->GetDoseRamp(direction, projectionRange);
+  double position[3] = {0.0,0.0,0.0};
+  double isodoseProjection = centerProjection + 0.5 * (lower + upper) * halfLength;
+  for (int axis=0; axis<3; ++axis)
+  {
+    position[axis] = isodoseProjection * direction[axis];
+  }
+  return this->GetDose(position);
+}
+
+//----------------------------------------------------------------------------
+double vtkSyntheticPhantomGenerator::GetAnalyticMeanDose(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Structures.size()))
+  {
+    vtkErrorMacro("GetAnalyticMeanDose: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  return this->GetDose(this->Structures[structureIndex].Center);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSyntheticPhantomGenerator::WriteAnalyticDvhToCsv(const char* fileName, double doseStep)
+{
+  if (!fileName || doseStep <= 0.0)
+  {
+    vtkErrorMacro("WriteAnalyticDvhToCsv: Invalid file name or dose step");
+    return false;
+  }
+  if (this->Structures.empty())
+  {
+    vtkErrorMacro("WriteAnalyticDvhToCsv: No structures have been generated");
+    return false;
+  }
+  std::ofstream outfile;
+  outfile.open(fileName, std::ios_base::out | std::ios_base::trunc);
+  if (!outfile)
+  {
+    vtkErrorMacro("WriteAnalyticDvhToCsv: Output file '" << fileName << "' cannot be opened");
+    return false;
+  }
+
+  int numberOfStructures = static_cast<int>(this->Structures.size());
+  for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    std::string structureName = this->GetStructureName(structureIndex);
+    outfile << structureName << " Dose (Gy),";
+    outfile << structureName << " Value (% of " << std::fixed << std::setprecision(3)
+      << this->GetAnalyticVolumeCc(structureIndex) << " cc),";
+  }
+  outfile << std::endl;
+
+  int numberOfRows = static_cast<int>(floor(std::max(this->MaximumDose, 0.0) / doseStep)) + 1;
+  outfile << std::setprecision(6);
+  for (int row=0; row<numberOfRows; ++row)
+  {
+    double dose = row * doseStep;
+    for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+    {
+      outfile << dose << "," << 100.0 * this->GetAnalyticVolumeFractionAboveDose(structureIndex, dose) << ",";
+    }
+    outfile << std::endl;
+  }
+
+  outfile.close();
+  return true;
+}
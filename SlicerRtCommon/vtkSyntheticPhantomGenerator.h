@@ -0,0 +1,170 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSyntheticPhantomGenerator_h
+#define __vtkSyntheticPhantomGenerator_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+class vtkOrientedImageData;
+class vtkSegmentation;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Generates reproducible synthetic CT, dose and structure set phantoms of arbitrary size.
+///
+/// The phantom consists of an elliptic cylinder body of water in air, containing non-overlapping
+/// axis-aligned ellipsoid structures. The dose is a linear ramp along \sa DoseGradientDirection between
+/// \sa MinimumDose and \sa MaximumDose over the grid, so that the cumulative DVH of each ellipsoid is known
+/// analytically (volume fraction of an ellipsoid cap). The compare dose is the dose shifted by
+/// \sa CompareDoseShift millimeters along the gradient, which is a uniform dose difference.
+///
+/// The grid is centered at the RAS origin with identity directions. Structure geometry is determined
+/// by \sa Seed only, so the same parameters always produce the same phantom.
+class VTK_SLICERRTCOMMON_EXPORT vtkSyntheticPhantomGenerator : public vtkObject
+{
+public:
+  static vtkSyntheticPhantomGenerator* New();
+  vtkTypeMacro(vtkSyntheticPhantomGenerator, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Generate the images and the structures using the current parameters
+  /// \return Success flag. Fails if the structures cannot be placed in the body
+  bool Generate();
+
+  /// Number of voxels of the grid along each axis. 256x256x200 by default
+  vtkSetVector3Macro(Dimensions, int);
+  vtkGetVector3Macro(Dimensions, int);
+  /// Voxel size in mm. 1.5mm by default
+  vtkSetVector3Macro(Spacing, double);
+  vtkGetVector3Macro(Spacing, double);
+
+  /// Number of ellipsoid structures. 5 by default
+  vtkSetMacro(NumberOfStructures, int);
+  vtkGetMacro(NumberOfStructures, int);
+  /// Range of the semi-axis lengths of the structures in mm. 10-40mm by default
+  vtkSetMacro(MinimumStructureRadius, double);
+  vtkGetMacro(MinimumStructureRadius, double);
+  vtkSetMacro(MaximumStructureRadius, double);
+  vtkGetMacro(MaximumStructureRadius, double);
+  /// Seed of the structure placement
+  vtkSetMacro(Seed, unsigned int);
+  vtkGetMacro(Seed, unsigned int);
+
+  /// Dose at the grid corner with the lowest and the highest dose (Gy). 0-70Gy by default
+  vtkSetMacro(MinimumDose, double);
+  vtkGetMacro(MinimumDose, double);
+  vtkSetMacro(MaximumDose, double);
+  vtkGetMacro(MaximumDose, double);
+  /// Direction of the dose gradient. Normalized on generation
+  vtkSetVector3Macro(DoseGradientDirection, double);
+  vtkGetVector3Macro(DoseGradientDirection, double);
+
+  /// Generate the compare dose image too. Off by default
+  vtkSetMacro(GenerateCompareDose, bool);
+  vtkGetMacro(GenerateCompareDose, bool);
+  vtkBooleanMacro(GenerateCompareDose, bool);
+  /// Shift of the compare dose along the gradient in mm. 1mm by default
+  vtkSetMacro(CompareDoseShift, double);
+  vtkGetMacro(CompareDoseShift, double);
+
+  /// CT image in HU (short)
+  vtkGetObjectMacro(CtImage, vtkOrientedImageData);
+  /// Dose image in Gy (float)
+  vtkGetObjectMacro(DoseImage, vtkOrientedImageData);
+  /// Compare dose image in Gy (float). NULL if \sa GenerateCompareDose is off
+  vtkGetObjectMacro(CompareDoseImage, vtkOrientedImageData);
+  /// Structures with binary labelmap master representation, cropped to the bounding box of the ellipsoids
+  vtkGetObjectMacro(Segmentation, vtkSegmentation);
+
+  /// Get center and semi-axis lengths of a generated structure (mm)
+  /// \return False if index is out of range
+  bool GetStructureGeometry(int structureIndex, double center[3], double radii[3]);
+  /// Get name of a generated structure, as it appears in the segmentation
+  std::string GetStructureName(int structureIndex);
+
+  /// Dose at a RAS position
+  double GetDose(const double position[3]);
+  /// Volume of a structure in cc
+  double GetAnalyticVolumeCc(int structureIndex);
+  /// Fraction of the volume of a structure that receives at least the given dose
+  double GetAnalyticVolumeFractionAboveDose(int structureIndex, double dose);
+  /// Minimum dose received by the given fraction of the volume of a structure (D metric)
+  double GetAnalyticDoseAtVolumeFraction(int structureIndex, double volumeFraction);
+  /// Mean dose of a structure. The dose is linear, so it is the dose at the center
+  double GetAnalyticMeanDose(int structureIndex);
+
+  /// Write the analytic cumulative DVH of each structure in the DVH CSV format exported by the
+  /// DoseVolumeHistogram module, so that it can be used as baseline of the computed DVHs
+  /// \param doseStep Dose difference between the rows (Gy)
+  /// \return Success flag
+  bool WriteAnalyticDvhToCsv(const char* fileName, double doseStep);
+
+protected:
+  /// Geometry of a generated structure
+  struct Ellipsoid
+  {
+    double Center[3];
+    double Radii[3];
+  };
+
+  /// Place the structures in the body
+  /// \return False if a structure does not fit
+  bool PlaceStructures();
+
+  /// Get normalized dose gradient direction, and the range of its projection on the grid corners
+  void GetDoseRamp(double direction[3], double projectionRange[2]);
+
+  /// Get half-length of the projection of an ellipsoid onto the dose gradient direction, and the projection
+  /// of its center
+  void GetEllipsoidProjection(int structureIndex, double& centerProjection, double& halfLength);
+
+protected:
+  int Dimensions[3];
+  double Spacing[3];
+  int NumberOfStructures;
+  double MinimumStructureRadius;
+  double MaximumStructureRadius;
+  unsigned int Seed;
+  double MinimumDose;
+  double MaximumDose;
+  double DoseGradientDirection[3];
+  bool GenerateCompareDose;
+  double CompareDoseShift;
+
+  vtkOrientedImageData* CtImage;
+  vtkOrientedImageData* DoseImage;
+  vtkOrientedImageData* CompareDoseImage;
+  vtkSegmentation* Segmentation;
+
+  std::vector<Ellipsoid> Structures;
+
+protected:
+  vtkSyntheticPhantomGenerator();
+  virtual ~vtkSyntheticPhantomGenerator();
+
+private:
+  vtkSyntheticPhantomGenerator(const vtkSyntheticPhantomGenerator&); // Not implemented
+  void operator=(const vtkSyntheticPhantomGenerator&);              // Not implemented
+};
+
+#endif
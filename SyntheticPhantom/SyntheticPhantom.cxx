@@ -0,0 +1,172 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SyntheticPhantomCLP.h"
+
+// SlicerRT includes
+#include "SlicerRtCommon.h"
+#include "vtkSyntheticPhantomGenerator.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  bool IsOutputRequested(const std::string& fileName)
+  {
+    return !fileName.empty() && fileName != "None";
+  }
+
+  //----------------------------------------------------------------------------
+  /// Write oriented image to file. The geometry is passed to the volume node instead of the image data
+  void WriteOrientedImage(vtkMRMLScene* scene, vtkOrientedImageData* orientedImage, const std::string& fileName)
+  {
+    double directions[3][3] = {{1.0,0.0,0.0}, {0.0,1.0,0.0}, {0.0,0.0,1.0}};
+    orientedImage->GetDirections(directions);
+    double spacing[3] = {1.0,1.0,1.0};
+    orientedImage->GetSpacing(spacing);
+    double origin[3] = {0.0,0.0,0.0};
+    orientedImage->GetOrigin(origin);
+
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->ShallowCopy(orientedImage);
+    image->SetOrigin(0.0, 0.0, 0.0);
+    image->SetSpacing(1.0, 1.0, 1.0);
+    SlicerRtCommon::WriteImageDataToFile(scene, image, fileName.c_str(), directions, spacing, origin, true);
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  PARSE_ARGS;
+
+  vtkSmartPointer<vtkSyntheticPhantomGenerator> generator = vtkSmartPointer<vtkSyntheticPhantomGenerator>::New();
+  if (dimensions.size() >= 3)
+  {
+    generator->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+  }
+  else if (dimensions.size() >= 1)
+  {
+    generator->SetDimensions(dimensions[0], dimensions[0], dimensions[0]);
+  }
+  if (spacing.size() >= 3)
+  {
+    generator->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  }
+  else if (spacing.size() >= 1)
+  {
+    generator->SetSpacing(spacing[0], spacing[0], spacing[0]);
+  }
+  generator->SetNumberOfStructures(numberOfStructures);
+  generator->SetMinimumStructureRadius(minimumRadius);
+  generator->SetMaximumStructureRadius(maximumRadius);
+  generator->SetSeed(static_cast<unsigned int>(seed));
+  generator->SetMinimumDose(minimumDose);
+  generator->SetMaximumDose(maximumDose);
+  if (doseGradientDirection.size() >= 3)
+  {
+    generator->SetDoseGradientDirection(doseGradientDirection[0], doseGradientDirection[1], doseGradientDirection[2]);
+  }
+  generator->SetGenerateCompareDose(IsOutputRequested(compareDoseVolume));
+  generator->SetCompareDoseShift(compareDoseShift);
+
+  if (!generator->Generate())
+  {
+    std::cerr << "Failed to generate phantom" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Volumes are written through storage nodes, which need a scene
+  vtkSmartPointer<vtkMRMLScene> scene = vtkSmartPointer<vtkMRMLScene>::New();
+  if (IsOutputRequested(ctVolume))
+  {
+    WriteOrientedImage(scene, generator->GetCtImage(), ctVolume);
+  }
+  if (IsOutputRequested(doseVolume))
+  {
+    WriteOrientedImage(scene, generator->GetDoseImage(), doseVolume);
+  }
+  if (IsOutputRequested(compareDoseVolume))
+  {
+    WriteOrientedImage(scene, generator->GetCompareDoseImage(), compareDoseVolume);
+  }
+
+  if (IsOutputRequested(structuresLabelmap))
+  {
+    // Merge the cropped structure labelmaps. Structures do not overlap, so the labels are unambiguous
+    vtkOrientedImageData* ctImage = generator->GetCtImage();
+    vtkSmartPointer<vtkOrientedImageData> mergedLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    mergedLabelmap->SetExtent(ctImage->GetExtent());
+    mergedLabelmap->CopyDirections(ctImage);
+    mergedLabelmap->SetOrigin(ctImage->GetOrigin());
+    mergedLabelmap->SetSpacing(ctImage->GetSpacing());
+    mergedLabelmap->AllocateScalars(VTK_SHORT, 1);
+    mergedLabelmap->GetPointData()->GetScalars()->Fill(0);
+
+    int numberOfStructures = generator->GetSegmentation()->GetNumberOfSegments();
+    for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+    {
+      vtkSegment* segment = generator->GetSegmentation()->GetSegment(generator->GetStructureName(structureIndex));
+      vtkOrientedImageData* structureLabelmap = vtkOrientedImageData::SafeDownCast(
+        segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+      int extent[6] = {0,-1,0,-1,0,-1};
+      structureLabelmap->GetExtent(extent);
+      short label = static_cast<short>(structureIndex + 1);
+      for (int k=extent[4]; k<=extent[5]; ++k)
+      {
+        for (int j=extent[2]; j<=extent[3]; ++j)
+        {
+          unsigned char* structurePtr = static_cast<unsigned char*>(structureLabelmap->GetScalarPointer(extent[0], j, k));
+          short* mergedPtr = static_cast<short*>(mergedLabelmap->GetScalarPointer(extent[0], j, k));
+          for (int i=extent[0]; i<=extent[1]; ++i, ++structurePtr, ++mergedPtr)
+          {
+            if (*structurePtr)
+            {
+              *mergedPtr = label;
+            }
+          }
+        }
+      }
+    }
+    WriteOrientedImage(scene, mergedLabelmap, structuresLabelmap);
+  }
+
+  if (IsOutputRequested(analyticDvhFile))
+  {
+    if (!generator->WriteAnalyticDvhToCsv(analyticDvhFile.c_str(), dvhDoseStep))
+    {
+      std::cerr << "Failed to write analytic DVH to " << analyticDvhFile << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,746 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Module logic includes
+#include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
+#include "vtkMRMLDoseVolumeHistogramNode.h"
+#include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkMRMLIsodoseNode.h"
+#include "vtkSlicerDoseAccumulationModuleLogic.h"
+#include "vtkMRMLDoseAccumulationNode.h"
+#include "vtkSlicerDoseComparisonModuleLogic.h"
+#include "vtkMRMLDoseComparisonNode.h"
+#include "vtkSlicerSegmentMorphologyModuleLogic.h"
+#include "vtkMRMLSegmentMorphologyNode.h"
+#include "vtkSlicerSegmentComparisonModuleLogic.h"
+#include "vtkMRMLSegmentComparisonNode.h"
+
+// SlicerRt includes
+#include "SlicerRtCommon.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkSyntheticPhantomGenerator.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// MRML includes
+#include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkImageData.h>
+#include <vtkImageMathematics.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace
+{
+  /// Stages whose baseline median is below this are dominated by noise and are not checked for regression
+  const double MINIMUM_COMPARED_WALL_TIME_SEC = 0.05;
+
+  //-----------------------------------------------------------------------------
+  /// CPU time (user and system) consumed by all threads of the process so far
+  double GetProcessCpuTimeSec()
+  {
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+      return 0.0;
+    }
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) * 1.0e-7;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+      return 0.0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6;
+#endif
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Reset the peak resident set size of the process so that the next stage gets its own peak.
+  /// Only supported on Linux, elsewhere the peak of the process so far is reported for each stage.
+  /// \return True if the peak could be reset
+  bool ResetPeakResidentSetSize()
+  {
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (!clearRefs.is_open())
+    {
+      return false;
+    }
+    clearRefs << "5";
+    return clearRefs.good();
+#else
+    return false;
+#endif
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Peak resident set size of the process (MB)
+  double GetPeakResidentSetSizeMb()
+  {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+      return 0.0;
+    }
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+#ifdef __linux__
+    // VmHWM follows the reset done through clear_refs, while ru_maxrss does not
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+      if (line.compare(0, 6, "VmHWM:") == 0)
+      {
+        return atof(line.c_str() + 6) / 1024.0;
+      }
+    }
+#endif
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+      return 0.0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+  }
+
+  //-----------------------------------------------------------------------------
+  double GetMedian(std::vector<double> values)
+  {
+    if (values.empty())
+    {
+      return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return (values.size() % 2 ? values[middle] : 0.5 * (values[middle-1] + values[middle]));
+  }
+
+  //-----------------------------------------------------------------------------
+  /// One measured step of the benchmark. Stages are run in the order they are added, so
+  /// a stage can use the results of the previous ones (e.g. metrics need the DVH).
+  class BenchmarkStage
+  {
+  public:
+    BenchmarkStage(const std::string& name) : Name(name), PeakRssMb(0.0) { }
+    virtual ~BenchmarkStage() { }
+    /// Run the measured operation once. Return error message, empty if successful
+    virtual std::string Execute() = 0;
+
+    std::string Name;
+    std::vector<double> WallTimesSec;
+    std::vector<double> CpuTimesSec;
+    double PeakRssMb;
+  };
+
+  //-----------------------------------------------------------------------------
+  class ComputeDvhStage : public BenchmarkStage
+  {
+  public:
+    ComputeDvhStage(vtkSlicerDoseVolumeHistogramModuleLogic* logic, vtkMRMLDoseVolumeHistogramNode* parameterNode)
+      : BenchmarkStage("DoseVolumeHistogram.ComputeDvh"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->ComputeDvh(this->ParameterNode);
+    }
+    vtkSlicerDoseVolumeHistogramModuleLogic* Logic;
+    vtkMRMLDoseVolumeHistogramNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class ComputeDvhMetricsStage : public BenchmarkStage
+  {
+  public:
+    ComputeDvhMetricsStage(vtkSlicerDoseVolumeHistogramModuleLogic* logic, vtkMRMLDoseVolumeHistogramNode* parameterNode)
+      : BenchmarkStage("DoseVolumeHistogram.ComputeMetrics"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      if (!this->Logic->ComputeVMetrics(this->ParameterNode) || !this->Logic->ComputeDMetrics(this->ParameterNode))
+      {
+        return "Failed to compute DVH metrics";
+      }
+      return "";
+    }
+    vtkSlicerDoseVolumeHistogramModuleLogic* Logic;
+    vtkMRMLDoseVolumeHistogramNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class CreateIsodoseSurfacesStage : public BenchmarkStage
+  {
+  public:
+    CreateIsodoseSurfacesStage(vtkSlicerIsodoseModuleLogic* logic, vtkMRMLIsodoseNode* parameterNode)
+      : BenchmarkStage("Isodose.CreateIsodoseSurfaces"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      this->Logic->CreateIsodoseSurfaces(this->ParameterNode);
+      return (this->Logic->GetRootModelHierarchyNode(this->ParameterNode) ? "" : "Failed to create isodose surfaces");
+    }
+    vtkSlicerIsodoseModuleLogic* Logic;
+    vtkMRMLIsodoseNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class AccumulateDoseStage : public BenchmarkStage
+  {
+  public:
+    AccumulateDoseStage(vtkSlicerDoseAccumulationModuleLogic* logic, vtkMRMLDoseAccumulationNode* parameterNode)
+      : BenchmarkStage("DoseAccumulation.AccumulateDoseVolumes"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->AccumulateDoseVolumes(this->ParameterNode);
+    }
+    vtkSlicerDoseAccumulationModuleLogic* Logic;
+    vtkMRMLDoseAccumulationNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class ComputeGammaStage : public BenchmarkStage
+  {
+  public:
+    ComputeGammaStage(vtkSlicerDoseComparisonModuleLogic* logic, vtkMRMLDoseComparisonNode* parameterNode)
+      : BenchmarkStage("DoseComparison.ComputeGammaDoseDifference"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->ComputeGammaDoseDifference(this->ParameterNode);
+    }
+    vtkSlicerDoseComparisonModuleLogic* Logic;
+    vtkMRMLDoseComparisonNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class MorphologyStage : public BenchmarkStage
+  {
+  public:
+    MorphologyStage(vtkSlicerSegmentMorphologyModuleLogic* logic, vtkMRMLSegmentMorphologyNode* parameterNode)
+      : BenchmarkStage("SegmentMorphology.Expand"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->ApplyMorphologyOperation(this->ParameterNode);
+    }
+    vtkSlicerSegmentMorphologyModuleLogic* Logic;
+    vtkMRMLSegmentMorphologyNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class DiceStage : public BenchmarkStage
+  {
+  public:
+    DiceStage(vtkSlicerSegmentComparisonModuleLogic* logic, vtkMRMLSegmentComparisonNode* parameterNode)
+      : BenchmarkStage("SegmentComparison.ComputeDiceStatistics"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->ComputeDiceStatistics(this->ParameterNode);
+    }
+    vtkSlicerSegmentComparisonModuleLogic* Logic;
+    vtkMRMLSegmentComparisonNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  class HausdorffStage : public BenchmarkStage
+  {
+  public:
+    HausdorffStage(vtkSlicerSegmentComparisonModuleLogic* logic, vtkMRMLSegmentComparisonNode* parameterNode)
+      : BenchmarkStage("SegmentComparison.ComputeHausdorffDistances"), Logic(logic), ParameterNode(parameterNode) { }
+    virtual std::string Execute()
+    {
+      return this->Logic->ComputeHausdorffDistances(this->ParameterNode);
+    }
+    vtkSlicerSegmentComparisonModuleLogic* Logic;
+    vtkMRMLSegmentComparisonNode* ParameterNode;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Run stage the given number of times and record timings and peak memory
+  std::string RunStage(BenchmarkStage* stage, int repetitions)
+  {
+    bool peakReset = ResetPeakResidentSetSize();
+    vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+    for (int repetition=0; repetition<repetitions; ++repetition)
+    {
+      double wallStart = timer->GetUniversalTime();
+      double cpuStart = GetProcessCpuTimeSec();
+
+      std::string errorMessage = stage->Execute();
+      if (!errorMessage.empty())
+      {
+        return stage->Name + ": " + errorMessage;
+      }
+
+      stage->WallTimesSec.push_back(timer->GetUniversalTime() - wallStart);
+      stage->CpuTimesSec.push_back(GetProcessCpuTimeSec() - cpuStart);
+    }
+    stage->PeakRssMb = GetPeakResidentSetSizeMb();
+
+    std::cout << "  " << stage->Name << ": median wall time " << GetMedian(stage->WallTimesSec) << " s, median CPU time "
+      << GetMedian(stage->CpuTimesSec) << " s, peak RSS " << stage->PeakRssMb << " MB" << (peakReset ? "" : " (process)") << std::endl;
+    return "";
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write results in JSON. Each stage is written in a single line so that \sa ReadBaselineWallTimes can
+  /// read it back without a full JSON parser
+  bool WriteResultsJson(const std::string& fileName, const std::string& dataset, int scaleFactor, int repetitions,
+    const std::vector<BenchmarkStage*>& stages)
+  {
+    std::ofstream outStream(fileName.c_str());
+    if (!outStream.is_open())
+    {
+      return false;
+    }
+    outStream.precision(6);
+    outStream << "{" << std::endl;
+    outStream << "  \"benchmark\": \"SlicerRtLogicBenchmark\"," << std::endl;
+    outStream << "  \"dataset\": \"" << dataset << "\"," << std::endl;
+    outStream << "  \"scaleFactor\": " << scaleFactor << "," << std::endl;
+    outStream << "  \"repetitions\": " << repetitions << "," << std::endl;
+    outStream << "  \"stages\": [" << std::endl;
+    for (size_t stageIndex=0; stageIndex<stages.size(); ++stageIndex)
+    {
+      BenchmarkStage* stage = stages[stageIndex];
+      outStream << "    { \"name\": \"" << stage->Name << "\""
+        << ", \"wallTimeMedianSec\": " << GetMedian(stage->WallTimesSec)
+        << ", \"wallTimeMinSec\": " << *std::min_element(stage->WallTimesSec.begin(), stage->WallTimesSec.end())
+        << ", \"wallTimeMaxSec\": " << *std::max_element(stage->WallTimesSec.begin(), stage->WallTimesSec.end())
+        << ", \"cpuTimeMedianSec\": " << GetMedian(stage->CpuTimesSec)
+        << ", \"peakRssMb\": " << stage->PeakRssMb
+        << " }" << (stageIndex+1 < stages.size() ? "," : "") << std::endl;
+    }
+    outStream << "  ]" << std::endl;
+    outStream << "}" << std::endl;
+    return outStream.good();
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Read median wall times per stage from a results file written by \sa WriteResultsJson
+  bool ReadBaselineWallTimes(const std::string& fileName, std::map<std::string, double>& baselineWallTimes)
+  {
+    std::ifstream inStream(fileName.c_str());
+    if (!inStream.is_open())
+    {
+      return false;
+    }
+    const std::string nameKey("\"name\": \"");
+    const std::string wallTimeKey("\"wallTimeMedianSec\": ");
+    std::string line;
+    while (std::getline(inStream, line))
+    {
+      size_t namePosition = line.find(nameKey);
+      size_t wallTimePosition = line.find(wallTimeKey);
+      if (namePosition == std::string::npos || wallTimePosition == std::string::npos)
+      {
+        continue;
+      }
+      namePosition += nameKey.size();
+      size_t nameEnd = line.find('"', namePosition);
+      if (nameEnd == std::string::npos)
+      {
+        continue;
+      }
+      baselineWallTimes[line.substr(namePosition, nameEnd - namePosition)] =
+        atof(line.c_str() + wallTimePosition + wallTimeKey.size());
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create scalar volume node from an oriented image generated by the synthetic phantom
+  vtkMRMLScalarVolumeNode* CreateVolumeNodeFromOrientedImage(vtkMRMLScene* scene, vtkOrientedImageData* orientedImage, const char* name)
+  {
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    orientedImage->GetImageToWorldMatrix(imageToWorldMatrix);
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->ShallowCopy(orientedImage);
+    image->SetOrigin(0.0, 0.0, 0.0);
+    image->SetSpacing(1.0, 1.0, 1.0);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    volumeNode->SetName(name);
+    volumeNode->SetIJKToRASMatrix(imageToWorldMatrix);
+    volumeNode->SetAndObserveImageData(image);
+    scene->AddNode(volumeNode);
+    return volumeNode;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create synthetic phantom on a 250x250x200mm grid. Voxel size is 2.5mm divided by the scale factor.
+  /// Structures are created as binary labelmap master, cropped to the bounding box of the ellipsoids
+  bool CreateSyntheticPhantom(vtkMRMLScene* scene, int scaleFactor, int numberOfStructures,
+    vtkMRMLScalarVolumeNode*& doseVolumeNode, vtkMRMLSegmentationNode*& segmentationNode)
+  {
+    const double voxelSize = 2.5 / scaleFactor;
+    vtkSmartPointer<vtkSyntheticPhantomGenerator> phantomGenerator = vtkSmartPointer<vtkSyntheticPhantomGenerator>::New();
+    phantomGenerator->SetDimensions(100 * scaleFactor, 100 * scaleFactor, 80 * scaleFactor);
+    phantomGenerator->SetSpacing(voxelSize, voxelSize, voxelSize);
+    phantomGenerator->SetNumberOfStructures(numberOfStructures);
+    phantomGenerator->SetMinimumStructureRadius(10.0);
+    phantomGenerator->SetMaximumStructureRadius(30.0);
+    if (!phantomGenerator->Generate())
+    {
+      return false;
+    }
+
+    doseVolumeNode = CreateVolumeNodeFromOrientedImage(scene, phantomGenerator->GetDoseImage(), "SyntheticDose");
+    doseVolumeNode->SetAttribute(SlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+
+    vtkSmartPointer<vtkMRMLSegmentationNode> newSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+    newSegmentationNode->SetName("SyntheticStructures");
+    scene->AddNode(newSegmentationNode);
+    newSegmentationNode->GetSegmentation()->DeepCopy(phantomGenerator->GetSegmentation());
+    segmentationNode = newSegmentationNode;
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create a second dose volume by scaling the first one, used as the compared and accumulated dose
+  vtkMRMLScalarVolumeNode* CreateScaledDoseVolume(vtkMRMLScene* scene, vtkMRMLScalarVolumeNode* doseVolumeNode, double scale)
+  {
+    vtkNew<vtkImageMathematics> multiply;
+    multiply->SetInputData(doseVolumeNode->GetImageData());
+    multiply->SetOperationToMultiplyByK();
+    multiply->SetConstantK(scale);
+    multiply->Update();
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> scaledDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    scaledDoseVolumeNode->Copy(doseVolumeNode);
+    scaledDoseVolumeNode->SetName((std::string(doseVolumeNode->GetName()) + "_Scaled").c_str());
+    scene->AddNode(scaledDoseVolumeNode);
+    scaledDoseVolumeNode->SetAndObserveImageData(multiply->GetOutput());
+    return scaledDoseVolumeNode;
+  }
+}
+
+//-----------------------------------------------------------------------------
+/// Runs the main computation of the dose and segment analysis module logics on a dataset and reports timing
+/// and memory usage. Options:
+///   -Dataset: EclipseProstate, EclipseEnt (from the test data directory) or Synthetic
+///   -DataDirectoryPath: Path of Testing/Data, needed for the Eclipse datasets
+///   -ScaleFactor: Voxel count of the synthetic dataset grows with its cube (default 1)
+///   -NumberOfStructures: Number of segments in the synthetic dataset (default 5)
+///   -Repetitions: Number of measured runs of each stage (default 3)
+///   -OutputJsonFile: File to write the results to
+///   -BaselineJsonFile: Results of a reference run. If given, the benchmark fails if a stage
+///      is slower than the baseline times the regression threshold
+///   -RegressionThreshold: Allowed ratio of median wall time to baseline (default 1.25)
+int SlicerRtLogicBenchmark( int argc, char * argv[] )
+{
+  std::string dataset("Synthetic");
+  std::string dataDirectoryPath;
+  int scaleFactor = 1;
+  int numberOfStructures = 5;
+  int repetitions = 3;
+  std::string outputJsonFileName;
+  std::string baselineJsonFileName;
+  double regressionThreshold = 1.25;
+
+  for (int argIndex=1; argIndex+1<argc; argIndex+=2)
+  {
+    if (STRCASECMP(argv[argIndex], "-Dataset") == 0)
+    {
+      dataset = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+    {
+      dataDirectoryPath = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-ScaleFactor") == 0)
+    {
+      scaleFactor = std::max(1, atoi(argv[argIndex+1]));
+    }
+    else if (STRCASECMP(argv[argIndex], "-NumberOfStructures") == 0)
+    {
+      numberOfStructures = std::max(2, atoi(argv[argIndex+1]));
+    }
+    else if (STRCASECMP(argv[argIndex], "-Repetitions") == 0)
+    {
+      repetitions = std::max(1, atoi(argv[argIndex+1]));
+    }
+    else if (STRCASECMP(argv[argIndex], "-OutputJsonFile") == 0)
+    {
+      outputJsonFileName = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-BaselineJsonFile") == 0)
+    {
+      baselineJsonFileName = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-RegressionThreshold") == 0)
+    {
+      regressionThreshold = atof(argv[argIndex+1]);
+    }
+    else
+    {
+      std::cerr << "Invalid argument: " << argv[argIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::cout << "Dataset: " << dataset << ", scale factor: " << scaleFactor << ", repetitions: " << repetitions << std::endl;
+
+  // Make sure NRRD reading works
+  itk::itkFactoryRegistration();
+
+  // Register planar contour to closed surface conversion rule
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+
+  // Create scene
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+
+  // Get input dose volume and segmentation
+  vtkMRMLScalarVolumeNode* doseVolumeNode = NULL;
+  vtkMRMLSegmentationNode* segmentationNode = NULL;
+  if (dataset == "Synthetic")
+  {
+    if (!CreateSyntheticPhantom(mrmlScene, scaleFactor, numberOfStructures, doseVolumeNode, segmentationNode))
+    {
+      std::cerr << "ERROR: Failed to create synthetic phantom!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  else if (dataset == "EclipseProstate" || dataset == "EclipseEnt")
+  {
+    std::string sceneFileName = dataDirectoryPath + "/Scenes/" + dataset + "_Dvh_Scene.mrml";
+    if (!vtksys::SystemTools::FileExists(sceneFileName.c_str()))
+    {
+      std::cerr << "ERROR: Test scene " << sceneFileName << " does not exist!" << std::endl;
+      return EXIT_FAILURE;
+    }
+    mrmlScene->SetURL(sceneFileName.c_str());
+    mrmlScene->Import();
+    // Trigger resolving subject hierarchies after import (merging the imported one with the pseudo-singleton one).
+    vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene);
+
+    std::vector<vtkMRMLNode*> volumeNodes;
+    mrmlScene->GetNodesByClass("vtkMRMLScalarVolumeNode", volumeNodes);
+    for (std::vector<vtkMRMLNode*>::iterator volumeNodeIt=volumeNodes.begin(); volumeNodeIt!=volumeNodes.end(); ++volumeNodeIt)
+    {
+      if (SlicerRtCommon::IsDoseVolumeNode(*volumeNodeIt))
+      {
+        doseVolumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(*volumeNodeIt);
+        break;
+      }
+    }
+    vtkSmartPointer<vtkCollection> segmentationNodes = vtkSmartPointer<vtkCollection>::Take(
+      mrmlScene->GetNodesByClass("vtkMRMLSegmentationNode") );
+    segmentationNode = vtkMRMLSegmentationNode::SafeDownCast(segmentationNodes->GetItemAsObject(0));
+  }
+  else
+  {
+    std::cerr << "ERROR: Unknown dataset " << dataset << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!doseVolumeNode || !segmentationNode)
+  {
+    std::cerr << "ERROR: Failed to get dose volume and segmentation!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> segmentIDs;
+  segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+  if (segmentIDs.size() < 2)
+  {
+    std::cerr << "ERROR: At least two segments are needed for the benchmark!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkMRMLScalarVolumeNode* scaledDoseVolumeNode = CreateScaledDoseVolume(mrmlScene, doseVolumeNode, 1.03);
+
+  // Set up logics and parameter nodes
+  vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic> dvhLogic = vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic>::New();
+  dvhLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode> dvhParameterNode = vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode>::New();
+  mrmlScene->AddNode(dvhParameterNode);
+  dvhParameterNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+  dvhParameterNode->SetAndObserveSegmentationNode(segmentationNode);
+  dvhParameterNode->SetVDoseValues("5, 20");
+  dvhParameterNode->SetShowVMetricsCc(true);
+  dvhParameterNode->SetShowVMetricsPercent(true);
+  dvhParameterNode->SetDVolumeValuesCc("2, 5");
+  dvhParameterNode->SetDVolumeValuesPercent("5, 10");
+  dvhParameterNode->SetShowDMetrics(true);
+
+  vtkSmartPointer<vtkSlicerIsodoseModuleLogic> isodoseLogic = vtkSmartPointer<vtkSlicerIsodoseModuleLogic>::New();
+  isodoseLogic->SetMRMLScene(mrmlScene);
+  vtkMRMLColorTableNode* isodoseColorNode = vtkSlicerIsodoseModuleLogic::CreateDefaultIsodoseColorTable(mrmlScene);
+  vtkSmartPointer<vtkMRMLIsodoseNode> isodoseParameterNode = vtkSmartPointer<vtkMRMLIsodoseNode>::New();
+  mrmlScene->AddNode(isodoseParameterNode);
+  isodoseParameterNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+  isodoseParameterNode->SetAndObserveColorTableNode(isodoseColorNode);
+
+  vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic> doseAccumulationLogic = vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic>::New();
+  doseAccumulationLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> accumulatedDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  accumulatedDoseVolumeNode->SetName("AccumulatedDose");
+  mrmlScene->AddNode(accumulatedDoseVolumeNode);
+  vtkSmartPointer<vtkMRMLDoseAccumulationNode> doseAccumulationParameterNode = vtkSmartPointer<vtkMRMLDoseAccumulationNode>::New();
+  mrmlScene->AddNode(doseAccumulationParameterNode);
+  doseAccumulationParameterNode->AddSelectedInputVolumeNode(doseVolumeNode, 0.5);
+  doseAccumulationParameterNode->AddSelectedInputVolumeNode(scaledDoseVolumeNode, 0.5);
+  doseAccumulationParameterNode->SetAndObserveAccumulatedDoseVolumeNode(accumulatedDoseVolumeNode);
+  doseAccumulationParameterNode->SetAndObserveReferenceDoseVolumeNode(doseVolumeNode);
+
+  vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic> doseComparisonLogic = vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic>::New();
+  doseComparisonLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> gammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  gammaVolumeNode->SetName("Gamma");
+  mrmlScene->AddNode(gammaVolumeNode);
+  vtkSmartPointer<vtkMRMLDoseComparisonNode> doseComparisonParameterNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+  mrmlScene->AddNode(doseComparisonParameterNode);
+  doseComparisonParameterNode->SetAndObserveReferenceDoseVolumeNode(doseVolumeNode);
+  doseComparisonParameterNode->SetAndObserveCompareDoseVolumeNode(scaledDoseVolumeNode);
+  doseComparisonParameterNode->SetAndObserveGammaVolumeNode(gammaVolumeNode);
+
+  vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic> segmentMorphologyLogic = vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic>::New();
+  segmentMorphologyLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkMRMLSegmentationNode> morphologyOutputSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  morphologyOutputSegmentationNode->SetName("MorphologyOutput");
+  mrmlScene->AddNode(morphologyOutputSegmentationNode);
+  vtkSmartPointer<vtkMRMLSegmentMorphologyNode> morphologyParameterNode = vtkSmartPointer<vtkMRMLSegmentMorphologyNode>::New();
+  mrmlScene->AddNode(morphologyParameterNode);
+  morphologyParameterNode->SetAndObserveSegmentationANode(segmentationNode);
+  morphologyParameterNode->SetSegmentAID(segmentIDs[0].c_str());
+  morphologyParameterNode->SetAndObserveSegmentationBNode(segmentationNode);
+  morphologyParameterNode->SetSegmentBID(segmentIDs[1].c_str());
+  morphologyParameterNode->SetAndObserveOutputSegmentationNode(morphologyOutputSegmentationNode);
+  morphologyParameterNode->SetOperation(vtkMRMLSegmentMorphologyNode::Expand);
+  morphologyParameterNode->SetXSize(5.0);
+  morphologyParameterNode->SetYSize(5.0);
+  morphologyParameterNode->SetZSize(5.0);
+
+  vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic> segmentComparisonLogic = vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic>::New();
+  segmentComparisonLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkMRMLSegmentComparisonNode> segmentComparisonParameterNode = vtkSmartPointer<vtkMRMLSegmentComparisonNode>::New();
+  mrmlScene->AddNode(segmentComparisonParameterNode);
+  segmentComparisonParameterNode->SetAndObserveReferenceSegmentationNode(segmentationNode);
+  segmentComparisonParameterNode->SetReferenceSegmentID(segmentIDs[0].c_str());
+  segmentComparisonParameterNode->SetAndObserveCompareSegmentationNode(segmentationNode);
+  segmentComparisonParameterNode->SetCompareSegmentID(segmentIDs[1].c_str());
+
+  // Run stages
+  std::vector<BenchmarkStage*> stages;
+  stages.push_back(new ComputeDvhStage(dvhLogic, dvhParameterNode));
+  stages.push_back(new ComputeDvhMetricsStage(dvhLogic, dvhParameterNode));
+  stages.push_back(new CreateIsodoseSurfacesStage(isodoseLogic, isodoseParameterNode));
+  stages.push_back(new AccumulateDoseStage(doseAccumulationLogic, doseAccumulationParameterNode));
+  stages.push_back(new ComputeGammaStage(doseComparisonLogic, doseComparisonParameterNode));
+  stages.push_back(new MorphologyStage(segmentMorphologyLogic, morphologyParameterNode));
+  stages.push_back(new DiceStage(segmentComparisonLogic, segmentComparisonParameterNode));
+  stages.push_back(new HausdorffStage(segmentComparisonLogic, segmentComparisonParameterNode));
+
+  int returnValue = EXIT_SUCCESS;
+  for (std::vector<BenchmarkStage*>::iterator stageIt=stages.begin(); stageIt!=stages.end(); ++stageIt)
+  {
+    std::string errorMessage = RunStage(*stageIt, repetitions);
+    if (!errorMessage.empty())
+    {
+      std::cerr << "ERROR: " << errorMessage << std::endl;
+      returnValue = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  if (returnValue == EXIT_SUCCESS && !outputJsonFileName.empty())
+  {
+    if (!WriteResultsJson(outputJsonFileName, dataset, scaleFactor, repetitions, stages))
+    {
+      std::cerr << "ERROR: Failed to write benchmark results to " << outputJsonFileName << std::endl;
+      returnValue = EXIT_FAILURE;
+    }
+  }
+
+  // Compare to baseline
+  if (returnValue == EXIT_SUCCESS && !baselineJsonFileName.empty())
+  {
+    std::map<std::string, double> baselineWallTimes;
+    if (!ReadBaselineWallTimes(baselineJsonFileName, baselineWallTimes))
+    {
+      std::cerr << "ERROR: Failed to read benchmark baseline " << baselineJsonFileName << std::endl;
+      returnValue = EXIT_FAILURE;
+    }
+    for (std::vector<BenchmarkStage*>::iterator stageIt=stages.begin(); stageIt!=stages.end(); ++stageIt)
+    {
+      std::map<std::string, double>::iterator baselineIt = baselineWallTimes.find((*stageIt)->Name);
+      if (baselineIt == baselineWallTimes.end() || baselineIt->second < MINIMUM_COMPARED_WALL_TIME_SEC)
+      {
+        continue;
+      }
+      double wallTime = GetMedian((*stageIt)->WallTimesSec);
+      if (wallTime > baselineIt->second * regressionThreshold)
+      {
+        std::cerr << "ERROR: Performance regression in " << (*stageIt)->Name << ": median wall time " << wallTime
+          << " s, baseline " << baselineIt->second << " s (threshold " << regressionThreshold << "x)" << std::endl;
+        returnValue = EXIT_FAILURE;
+      }
+    }
+  }
+
+  for (std::vector<BenchmarkStage*>::iterator stageIt=stages.begin(); stageIt!=stages.end(); ++stageIt)
+  {
+    delete (*stageIt);
+  }
+
+  return returnValue;
+}